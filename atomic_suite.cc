@@ -0,0 +1,331 @@
+#include "bench_util.h"
+#include <atomic>
+#include <future>
+#include <map>
+
+#include <cxxopts.hpp>
+
+#define NUM_TRIALS 3
+#define RUN_TIME_MS 1000
+#define SAMPLE_EVERY 64
+#define MAX_SAMPLES (1UL << 18)
+#define MAX_BACKOFF 1024
+
+enum class Op {
+	FetchAdd, CasSuccess, CasSuccessBackoff, CasFail, CasFailBackoff,
+	Exchange, FetchOr, Store, StoreRelease, LoadAcquire, Cas16
+};
+
+static const std::map<std::string, Op> op_names = {
+	{"fetch_add", Op::FetchAdd},
+	{"cas", Op::CasSuccess},
+	{"cas_backoff", Op::CasSuccessBackoff},
+	{"cas_fail", Op::CasFail},
+	{"cas_fail_backoff", Op::CasFailBackoff},
+	{"exchange", Op::Exchange},
+	{"fetch_or", Op::FetchOr},
+	{"store", Op::Store},
+	{"store_release", Op::StoreRelease},
+	{"load_acquire", Op::LoadAcquire},
+	{"cas16", Op::Cas16},
+};
+
+// Contention levels: every thread on one line, threads spread over k lines, one line per thread
+enum class Contention { Shared, KLines, PerThread };
+
+static const std::map<std::string, Contention> contention_names = {
+	{"shared", Contention::Shared},
+	{"klines", Contention::KLines},
+	{"private", Contention::PerThread},
+};
+
+struct ThreadResult {
+	size_t ops = 0;
+	size_t failures = 0; // CAS retries before an op succeeded
+	std::vector<double> samples; // ns per sampled op
+};
+
+static inline void backoff_pause(unsigned &backoff) {
+	for (unsigned i = 0; i < backoff; i++)
+		_mm_pause();
+	backoff = std::min(backoff * 2, (unsigned)MAX_BACKOFF);
+}
+
+// 16-byte compare-and-swap; returns true on success and updates expected on failure
+static inline bool cmpxchg16b(unsigned __int128 *addr, unsigned __int128 &expected, unsigned __int128 desired) {
+	uint64_t lo = (uint64_t)expected, hi = (uint64_t)(expected >> 64);
+	bool ok;
+	asm volatile("lock cmpxchg16b %1"
+			: "=@ccz"(ok), "+m"(*addr), "+a"(lo), "+d"(hi)
+			: "b"((uint64_t)desired), "c"((uint64_t)(desired >> 64))
+			: "memory");
+	expected = ((unsigned __int128)hi << 64) | lo;
+	return ok;
+}
+
+// One logical operation of type OP on var
+template <typename T, Op OP>
+static inline void op_once(T *addr, T val, size_t &failures, T &sink) {
+	if constexpr (OP == Op::Cas16) {
+		unsigned __int128 expected = *(volatile unsigned __int128 *)addr;
+		while (!cmpxchg16b(addr, expected, expected + 1))
+			failures++;
+	} else {
+		std::atomic<T> *var = (std::atomic<T> *)addr;
+		if constexpr (OP == Op::FetchAdd) {
+			var->fetch_add(1);
+		} else if constexpr (OP == Op::CasSuccess || OP == Op::CasSuccessBackoff) {
+			T old = var->load(std::memory_order_relaxed);
+			unsigned backoff = 1;
+			while (!var->compare_exchange_weak(old, (T)(old + 1))) {
+				failures++;
+				if constexpr (OP == Op::CasSuccessBackoff)
+					backoff_pause(backoff);
+			}
+		} else if constexpr (OP == Op::CasFail || OP == Op::CasFailBackoff) {
+			// Nobody ever stores the all-ones sentinel, so every CAS fails
+			T expected = (T)~(T)0;
+			var->compare_exchange_strong(expected, val);
+			if constexpr (OP == Op::CasFailBackoff) {
+				unsigned backoff = 16;
+				backoff_pause(backoff);
+			}
+		} else if constexpr (OP == Op::Exchange) {
+			sink += var->exchange(val);
+		} else if constexpr (OP == Op::FetchOr) {
+			sink += var->fetch_or(val);
+		} else if constexpr (OP == Op::Store) {
+			var->store(val, std::memory_order_relaxed);
+		} else if constexpr (OP == Op::StoreRelease) {
+			var->store(val, std::memory_order_release);
+		} else if constexpr (OP == Op::LoadAcquire) {
+			sink += var->load(std::memory_order_acquire);
+		}
+	}
+}
+
+template <typename T, Op OP>
+ThreadResult atomic_worker(T *addr, int tid, int core_num, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	ThreadResult r;
+	if (!pin_to_core(core_num))
+		return r;
+	r.samples.reserve(MAX_SAMPLES);
+	T val = (T)(1ULL << (tid % (sizeof(T) * 8 > 64 ? 64 : sizeof(T) * 8)));
+	T sink = 0;
+	double ticks_per_ns = tsc_per_ns();
+	uint64_t overhead = tsc_overhead();
+
+	sync_point.arrive_and_wait();
+	while (!stop.load(std::memory_order_relaxed)) {
+		for (int i = 0; i < SAMPLE_EVERY - 1; i++)
+			op_once<T, OP>(addr, val, r.failures, sink);
+		uint64_t t0 = tsc_begin();
+		op_once<T, OP>(addr, val, r.failures, sink);
+		uint64_t t1 = tsc_end();
+		if (r.samples.size() < MAX_SAMPLES)
+			r.samples.push_back((double)(t1 - t0 > overhead ? t1 - t0 - overhead : 0) / ticks_per_ns);
+		r.ops += SAMPLE_EVERY;
+	}
+	asm volatile("" : : "r"(sink));
+	return r;
+}
+
+using WorkerFn = ThreadResult (*)(void *, int, int, MyBarrier &, std::atomic<bool> &);
+
+template <typename T, Op OP>
+ThreadResult erased_worker(void *addr, int tid, int core_num, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	return atomic_worker<T, OP>((T *)addr, tid, core_num, sync_point, stop);
+}
+
+template <typename T>
+WorkerFn select_worker(Op op) {
+	switch (op) {
+		case Op::FetchAdd: return erased_worker<T, Op::FetchAdd>;
+		case Op::CasSuccess: return erased_worker<T, Op::CasSuccess>;
+		case Op::CasSuccessBackoff: return erased_worker<T, Op::CasSuccessBackoff>;
+		case Op::CasFail: return erased_worker<T, Op::CasFail>;
+		case Op::CasFailBackoff: return erased_worker<T, Op::CasFailBackoff>;
+		case Op::Exchange: return erased_worker<T, Op::Exchange>;
+		case Op::FetchOr: return erased_worker<T, Op::FetchOr>;
+		case Op::Store: return erased_worker<T, Op::Store>;
+		case Op::StoreRelease: return erased_worker<T, Op::StoreRelease>;
+		case Op::LoadAcquire: return erased_worker<T, Op::LoadAcquire>;
+		default: return nullptr;
+	}
+}
+
+static WorkerFn select_worker(Op op, int width) {
+	if (op == Op::Cas16)
+		return erased_worker<unsigned __int128, Op::Cas16>;
+	switch (width) {
+		case 8: return select_worker<uint8_t>(op);
+		case 16: return select_worker<uint16_t>(op);
+		case 32: return select_worker<uint32_t>(op);
+		case 64: return select_worker<uint64_t>(op);
+	}
+	return nullptr;
+}
+
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("Atomic Suite", "Throughput and latency of atomic primitives under contention");
+	options.add_options()
+		("o,ops", "Operations (fetch_add,cas,cas_backoff,cas_fail,cas_fail_backoff,exchange,fetch_or,store,store_release,load_acquire,cas16)",
+		 cxxopts::value<std::string>()->default_value("fetch_add,cas,cas_backoff,cas_fail,cas_fail_backoff,exchange,fetch_or,store,store_release,load_acquire,cas16"))
+		("w,widths", "Operand widths in bits", cxxopts::value<std::string>()->default_value("8,16,32,64"))
+		("c,contention", "Contention levels (shared,klines,private)", cxxopts::value<std::string>()->default_value("shared,klines,private"))
+		("k,lines", "Number of lines for the klines contention level", cxxopts::value<int>()->default_value("4"))
+		("t,threads", "Thread counts, e.g. 1,2,4-8 (default: powers of two up to the node's cores)", cxxopts::value<std::string>()->default_value(""))
+		("n,cpu_node", "NUMA node whose cores run the threads", cxxopts::value<int>()->default_value("0"))
+		("m,memory_nodes", "Memory nodes holding the atomics (default: all)", cxxopts::value<std::string>()->default_value(""))
+		("d,duration", "Run time per trial in ms", cxxopts::value<int>()->default_value(std::to_string(RUN_TIME_MS)))
+		("trials", "Number of trials", cxxopts::value<int>()->default_value(std::to_string(NUM_TRIALS)))
+		("r,result", "Result csv file", cxxopts::value<std::string>()->default_value("results/atomic_suite.csv"))
+		("emulate_cxl", "Serve this node id from an emulated CXL pool: node[:latency_ns[:GB/s[:size]]]", cxxopts::value<std::string>())
+		("page_mode", "Buffer pages (default,4k,thp,2m,1g)", cxxopts::value<std::string>()->default_value("default"))
+		("placement", "Buffer placement (bind,preferred,interleave,first_touch)", cxxopts::value<std::string>()->default_value("bind"))
+		("h,help", "Print usage")
+		;
+	auto arguments = options.parse(argc, argv);
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	// Initialize NUMA library
+	if (numa_available() == -1) {
+		std::cerr << "NUMA is not available on this system." << std::endl;
+		return 1;
+	}
+	if (arguments.count("emulate_cxl") && !enable_cxl_emulation(arguments["emulate_cxl"].as<std::string>()))
+		return 1;
+	warn_unshimmed_cxl();
+	if (!set_alloc_policy(arguments["page_mode"].as<std::string>(), arguments["placement"].as<std::string>()))
+		return 1;
+
+	int cpu_node = arguments["cpu_node"].as<int>();
+	std::vector<int> cores = cores_of_node(cpu_node);
+	if (cores.empty()) {
+		std::cerr << "No CPUs found on NUMA node " << cpu_node << "." << std::endl;
+		return 1;
+	}
+
+	std::vector<size_t> thread_counts;
+	if (arguments["threads"].as<std::string>().empty()) {
+		thread_counts = pow2_sweep(cores.size());
+	} else {
+		for (long t : parse_list(arguments["threads"].as<std::string>()))
+			thread_counts.push_back(t);
+	}
+	std::vector<int> mem_nodes;
+	if (arguments["memory_nodes"].as<std::string>().empty()) {
+		mem_nodes = memory_nodes();
+	} else {
+		for (long m : parse_list(arguments["memory_nodes"].as<std::string>()))
+			mem_nodes.push_back(m);
+	}
+
+	std::vector<std::string> ops, contentions;
+	std::stringstream ss(arguments["ops"].as<std::string>());
+	for (std::string tok; std::getline(ss, tok, ',');) {
+		if (!op_names.count(tok)) {
+			std::cerr << "Unknown op: " << tok << std::endl;
+			return 1;
+		}
+		ops.push_back(tok);
+	}
+	ss = std::stringstream(arguments["contention"].as<std::string>());
+	for (std::string tok; std::getline(ss, tok, ',');) {
+		if (!contention_names.count(tok)) {
+			std::cerr << "Unknown contention level: " << tok << std::endl;
+			return 1;
+		}
+		contentions.push_back(tok);
+	}
+	std::vector<long> widths = parse_list(arguments["widths"].as<std::string>());
+	int k_lines = arguments["lines"].as<int>();
+	int duration_ms = arguments["duration"].as<int>();
+	int num_trials = arguments["trials"].as<int>();
+
+	std::ofstream results_file(arguments["result"].as<std::string>());
+	results_file << "op,width,contention,lines,threads,cpu_node,memory_node,mops,retries_per_op,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,page_size,cxl_shim\n";
+
+	for (int mem_node : mem_nodes) {
+		for (const std::string &op_name : ops) {
+			Op op = op_names.at(op_name);
+			std::vector<long> op_widths = op == Op::Cas16 ? std::vector<long>{128} : widths;
+			for (long width : op_widths) {
+				WorkerFn worker = select_worker(op, width);
+				if (worker == nullptr) {
+					std::cerr << "Unsupported width " << width << " for " << op_name << std::endl;
+					continue;
+				}
+				for (const std::string &contention_name : contentions) {
+					for (size_t num_threads : thread_counts) {
+						if (num_threads > cores.size()) {
+							std::cerr << "Skipping " << num_threads << " threads: node " << cpu_node << " has " << cores.size() << " cores" << std::endl;
+							continue;
+						}
+						size_t lines = 1;
+						switch (contention_names.at(contention_name)) {
+							case Contention::Shared: lines = 1; break;
+							case Contention::KLines: lines = std::min((size_t)k_lines, num_threads); break;
+							case Contention::PerThread: lines = num_threads; break;
+						}
+
+						// One variable at the start of each cache line
+						size_t alloc_size = lines * CACHE_LINE_SIZE;
+						uint8_t *memory = static_cast<uint8_t *>(alloc_on_node(alloc_size, mem_node));
+						if (memory == nullptr) {
+							std::cerr << "Failed to allocate memory on NUMA node " << mem_node << "." << std::endl;
+							return 1;
+						}
+						std::vector<OwnedRange> owners;
+						for (size_t i = 0; i < num_threads; i++)
+							owners.push_back({memory + (i % lines) * CACHE_LINE_SIZE, CACHE_LINE_SIZE, cores[i]});
+						touch_by_owners(memory, alloc_size, owners);
+						size_t page_size = mapping_page_size(memory);
+
+						double total_ops = 0, total_failures = 0, total_seconds = 0;
+						std::vector<double> samples;
+						for (int trial = 0; trial < num_trials; trial++) {
+							alignas(CACHE_LINE_SIZE) std::atomic<bool> stop(false);
+							std::vector<std::future<ThreadResult>> futs;
+							MyBarrier sync_point(num_threads + 1);
+							for (size_t i = 0; i < num_threads; i++) {
+								void *addr = memory + (i % lines) * CACHE_LINE_SIZE;
+								futs.push_back(std::async(std::launch::async, worker, addr, (int)i, cores[i], std::ref(sync_point), std::ref(stop)));
+							}
+							sync_point.arrive_and_wait();
+							auto start_time = std::chrono::steady_clock::now();
+							std::this_thread::sleep_for(std::chrono::milliseconds(duration_ms));
+							stop.store(true);
+							auto end_time = std::chrono::steady_clock::now();
+							for (auto &f : futs) {
+								ThreadResult r = f.get();
+								total_ops += r.ops;
+								total_failures += r.failures;
+								samples.insert(samples.end(), r.samples.begin(), r.samples.end());
+							}
+							total_seconds += std::chrono::duration<double>(end_time - start_time).count();
+						}
+						free_on_node(memory, alloc_size);
+
+						double mops = total_ops / total_seconds / 1e6;
+						double retries_per_op = total_failures / total_ops;
+						LatencyStats lat = latency_stats(samples);
+						results_file << op_name << "," << width << "," << contention_name << "," << lines << ","
+							<< num_threads << "," << cpu_node << "," << mem_node << "," << mops << "," << retries_per_op << ","
+							<< lat.p50 << "," << lat.p90 << "," << lat.p99 << "," << lat.p999 << "," << lat.max << "," << page_size << "," << cxl_shim(mem_node, false) << "\n";
+						std::cout << op_name << "/" << width << " " << contention_name << "(" << lines << ") node " << cpu_node << "->" << mem_node
+							<< " pages " << page_size << " Threads: " << num_threads << ", Mops/s: " << mops << ", p50: " << lat.p50 << " ns, p99: " << lat.p99 << " ns" << std::endl;
+					}
+				}
+			}
+		}
+	}
+
+	// Close the results file
+	results_file.close();
+
+	return 0;
+}
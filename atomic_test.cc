@@ -1,56 +1,33 @@
-#include <numa.h>
-#include <numaif.h>
-#include <iostream>
-#include <thread>
-#include <vector>
-#include <cstring>
-#include <sched.h>
-#include <chrono>
-#include <fstream>
+#include "bench_util.h"
 #include <numeric>
 #include <atomic>
-#include <barrier>
 #include <future>
 #include <emmintrin.h>
 
-#define MEMORY_NODE 0
+#include <cxxopts.hpp>
+
 #define NUM_TRIALS 5
 #define RUN_TIME 3
 
-using MyBarrier = std::barrier<>;
-
-// Function to count the number of CPUs in a CPU set
-int count_cpus_in_numa_node(int node) {
-	struct bitmask *cpumask = numa_allocate_cpumask();
-	if (numa_node_to_cpus(node, cpumask) == -1) {
-		std::cerr << "Failed to get CPUs for NUMA node " << node << std::endl;
-		numa_free_cpumask(cpumask);
-		return -1;
-	}
-	int count = 0;
-	for (unsigned i = 0; i < cpumask->size; ++i) {
-		if (numa_bitmask_isbitset(cpumask, i)) {
-			++count;
-		}
-	}
-	numa_free_cpumask(cpumask);
-	return count/2; //This is to eliminate hyperthreads
-}
 size_t atomic_operation(void *memory, int core_num, MyBarrier& sync_point){
 	size_t count = 0;
-	cpu_set_t cpuset;
-	CPU_ZERO(&cpuset);
-	CPU_SET(core_num, &cpuset);
-	if(sched_setaffinity(0, sizeof(cpuset), &cpuset) != 0){
-		std::cerr << "Error setting thread affinity: " << strerror(errno) << std::endl;
+	if(!pin_to_core(core_num))
 		return 0;
-	}
 	std::atomic<int64_t> *var = (std::atomic<int64_t>*)memory;
+	cxl_pool_t *pool = cxl_pool_of(memory);
 
 	sync_point.arrive_and_wait();
 	auto start_time = std::chrono::steady_clock::now();
 	auto end_time = start_time + std::chrono::seconds(RUN_TIME); 
 
+	if (pool) {
+		// Emulated CXL node: the accessor adds the device latency and bandwidth cap
+		while (std::chrono::steady_clock::now() < end_time) {
+			cxl_fetch_add64(pool, (volatile uint64_t *)memory, 1);
+			count++;
+		}
+		return count;
+	}
 	while (std::chrono::steady_clock::now() < end_time) {
 		var->fetch_add(1);
 		count++;
@@ -58,51 +35,28 @@ size_t atomic_operation(void *memory, int core_num, MyBarrier& sync_point){
 	return count;
 }
 
-int main() {
-	// Initialize NUMA library
-	if (numa_available() == -1) {
-		std::cerr << "NUMA is not available on this system." << std::endl;
-		return 1;
+// Thread-count sweep of fetch_add on memory_node with threads on cpu_node's cores
+static bool run_sweep(int cpu_node, int memory_node, size_t max_threads, std::ofstream &results_file, bool matrix) {
+	std::vector<int> cores = cores_of_node(cpu_node);
+	if (cores.empty()) {
+		std::cerr << "No CPUs found on NUMA node " << cpu_node << "." << std::endl;
+		return false;
 	}
+	size_t num_cpus = max_threads ? std::min(max_threads, cores.size()) : cores.size();
 
-	// Allocate SIZE memory on CXM 
-	int64_t* memory = static_cast<int64_t*>(numa_alloc_onnode(sizeof(int64_t), MEMORY_NODE));
+	// Allocate the counter on the target memory node
+	int64_t* memory = static_cast<int64_t*>(alloc_on_node(sizeof(int64_t), memory_node));
 	if (memory == nullptr) {
-		std::cerr << "Failed to allocate memory on NUMA node 2." << std::endl;
-		return 1;
+		std::cerr << "Failed to allocate memory on NUMA node " << memory_node << "." << std::endl;
+		return false;
 	}
 
-	// Clear allocated memory
-	memset(memory, 0, sizeof(int64_t));
-
-	// Get the number of CPUs on NUMA node 1
-	int num_cpus = count_cpus_in_numa_node(1);
-	if (num_cpus <= 0) {
-		std::cerr << "No CPUs found on NUMA node 1." << std::endl;
-		numa_free(memory, sizeof(int));
-		return 1;
-	}
-
-	// Open a file to store the results
-	std::string filename;
-	switch(MEMORY_NODE){
-		case 1:
-			filename = "results/local_atomic.csv";
-			break;
-		case 0:
-			filename = "results/remote_atomic.csv";
-			break;
-		case 2:
-			//filename = "results/cxl_atomic.csv";
-			filename = "results/cxl_remote_atomic.csv";
-			break;
-	}
-	std::ofstream results_file(filename);
-	results_file << "threads,num_ops\n";
+	// Clear allocated memory; under first_touch the first thread's core places it
+	touch_by_owners(memory, sizeof(int64_t), {{memory, sizeof(int64_t), cores[0]}});
+	size_t page_size = mapping_page_size(memory);
 
 	// Test with an increasing number of threads
-	for (size_t num_threads = 1; num_threads <= static_cast<size_t>(num_cpus); ++num_threads) {
-	//for (size_t num_threads = 128; num_threads <= static_cast<size_t>(num_cpus); ++num_threads) {
+	for (size_t num_threads = 1; num_threads <= num_cpus; ++num_threads) {
 		double avg_ops = 0;
 
 		for (int trial = 0; trial < NUM_TRIALS; ++trial) {
@@ -110,7 +64,7 @@ int main() {
 			std::vector<std::future<size_t>> futs;
 			MyBarrier sync_point(num_threads);
 			for (size_t i = 0; i < num_threads; ++i) {
-				futs.push_back(std::async(std::launch::async, atomic_operation, memory, i + 256, std::ref(sync_point)));
+				futs.push_back(std::async(std::launch::async, atomic_operation, memory, cores[i], std::ref(sync_point)));
 			}
 			for(auto &f:futs){
 				num_ops += f.get();
@@ -121,16 +75,87 @@ int main() {
 		avg_ops = avg_ops/(double)NUM_TRIALS;
 
 		// Store the results
-		results_file << num_threads << "," << avg_ops << "\n";
+		if (matrix)
+			results_file << cpu_node << "," << memory_node << "," << node_distance(cpu_node, memory_node) << ","
+				<< (cores_of_node(memory_node).empty() ? 1 : 0) << ",";
+		results_file << num_threads << "," << avg_ops << "," << page_size << "\n";
+
+		std::cout << "CPU node: " << cpu_node << ", Memory node: " << memory_node << " (" << page_size << " B pages), Threads: " << num_threads << ", Avg Ops: " << avg_ops << std::endl;
+	}
 
-		std::cout << "Threads: " << num_threads << ", Avg Ops: " << avg_ops << std::endl;
+	// Free the allocated memory
+	free_on_node(memory, sizeof(int64_t));
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("Atomic Test", "fetch_add throughput by CPU node and memory node");
+	options.add_options()
+		("c,cpu_node", "NUMA node whose cores run the threads", cxxopts::value<int>()->default_value("1"))
+		("m,memory_node", "Target Memory Node", cxxopts::value<int>()->default_value("0"))
+		("x,matrix", "Sweep every CPU node against every memory node (including CPU-less CXL nodes)")
+		("t,max_threads", "Cap on the thread sweep (0 = all cores of the CPU node)", cxxopts::value<size_t>()->default_value("0"))
+		("r,result", "Result csv file (default: results/<local|remote|cxl>_atomic.csv or results/atomic_matrix.csv)", cxxopts::value<std::string>()->default_value(""))
+		("emulate_cxl", "Serve this node id from an emulated CXL pool: node[:latency_ns[:GB/s[:size]]]", cxxopts::value<std::string>())
+		("page_mode", "Buffer pages (default,4k,thp,2m,1g)", cxxopts::value<std::string>()->default_value("default"))
+		("placement", "Buffer placement (bind,preferred,interleave,first_touch)", cxxopts::value<std::string>()->default_value("bind"))
+		("h,help", "Print usage")
+		;
+	auto arguments = options.parse(argc, argv);
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	// Initialize NUMA library
+	if (numa_available() == -1) {
+		std::cerr << "NUMA is not available on this system." << std::endl;
+		return 1;
+	}
+	if (arguments.count("emulate_cxl") && !enable_cxl_emulation(arguments["emulate_cxl"].as<std::string>()))
+		return 1;
+	if (!set_alloc_policy(arguments["page_mode"].as<std::string>(), arguments["placement"].as<std::string>()))
+		return 1;
+
+	bool matrix = arguments.count("matrix");
+	int cpu_node = arguments["cpu_node"].as<int>();
+	int memory_node = arguments["memory_node"].as<int>();
+	size_t max_threads = arguments["max_threads"].as<size_t>();
+
+	// Open a file to store the results
+	std::string filename = arguments["result"].as<std::string>();
+	if (filename.empty()) {
+		if (matrix)
+			filename = "results/atomic_matrix.csv";
+		else if (cores_of_node(memory_node).empty()) {
+			// A CXL node counts as local to the CPU node it is closest to
+			int nearest = cpu_node;
+			for (int c : cpu_nodes())
+				if (node_distance(c, memory_node) < node_distance(nearest, memory_node))
+					nearest = c;
+			filename = nearest == cpu_node ? "results/cxl_atomic.csv" : "results/cxl_remote_atomic.csv";
+		} else
+			filename = memory_node == cpu_node ? "results/local_atomic.csv" : "results/remote_atomic.csv";
+	}
+	std::ofstream results_file(filename);
+
+	if (matrix) {
+		// One tidy file: a row per (cpu node, memory node, thread count)
+		results_file << "cpu_node,memory_node,distance,cpuless,threads,num_ops,page_size\n";
+		for (int c : cpu_nodes()) {
+			for (int m : memory_nodes()) {
+				if (!run_sweep(c, m, max_threads, results_file, true))
+					return 1;
+			}
+		}
+	} else {
+		results_file << "threads,num_ops,page_size\n";
+		if (!run_sweep(cpu_node, memory_node, max_threads, results_file, false))
+			return 1;
 	}
 
 	// Close the results file
 	results_file.close();
 
-	// Free the allocated memory
-	numa_free(memory, sizeof(int));
-
 	return 0;
 }
@@ -0,0 +1,183 @@
+#ifndef BANDWIDTH_KERNELS_H
+#define BANDWIDTH_KERNELS_H
+
+// Read, write, non-temporal write, copy, triad and read-modify-write kernels at every vector
+// width, with runtime dispatch, shared by the bandwidth benchmarks
+
+#include "bench_util.h"
+#include <immintrin.h>
+
+// Every kernel works on per-thread chunks of doubles: a is the destination, b and c the sources
+using KernelFn = void (*)(double *a, const double *b, const double *c, size_t n, double scalar, double *sink);
+
+enum Kernel { READ, WRITE, NT_WRITE, COPY, TRIAD, RMW, NUM_KERNELS };
+enum Impl { SCALAR, SSE, AVX2, AVX512, NUM_IMPLS };
+
+static const char *kernel_names[NUM_KERNELS] = {"read", "write", "nt_write", "copy", "triad", "rmw"};
+static const char *impl_names[NUM_IMPLS] = {"scalar", "sse", "avx2", "avx512"};
+
+// Streams of memory traffic per element, STREAM convention (RFO traffic is not counted)
+static const int kernel_streams[NUM_KERNELS] = {1, 1, 1, 2, 3, 2};
+
+// Scalar kernels. Auto-vectorization is disabled so they stay one element per instruction.
+#define SCALAR_KERNEL __attribute__((optimize("no-tree-vectorize"))) static void
+
+SCALAR_KERNEL read_scalar(double *a, const double *b, const double *c, size_t n, double scalar, double *sink) {
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	for (size_t i = 0; i < n; i += 4) {
+		s0 += a[i];
+		s1 += a[i + 1];
+		s2 += a[i + 2];
+		s3 += a[i + 3];
+	}
+	*sink += s0 + s1 + s2 + s3;
+}
+
+SCALAR_KERNEL write_scalar(double *a, const double *b, const double *c, size_t n, double scalar, double *sink) {
+	for (size_t i = 0; i < n; i++)
+		a[i] = scalar;
+}
+
+SCALAR_KERNEL nt_write_scalar(double *a, const double *b, const double *c, size_t n, double scalar, double *sink) {
+	long long v;
+	memcpy(&v, &scalar, sizeof(v));
+	for (size_t i = 0; i < n; i++)
+		_mm_stream_si64((long long *)&a[i], v);
+	_mm_sfence();
+}
+
+SCALAR_KERNEL copy_scalar(double *a, const double *b, const double *c, size_t n, double scalar, double *sink) {
+	for (size_t i = 0; i < n; i++)
+		a[i] = b[i];
+}
+
+SCALAR_KERNEL triad_scalar(double *a, const double *b, const double *c, size_t n, double scalar, double *sink) {
+	for (size_t i = 0; i < n; i++)
+		a[i] = b[i] + scalar * c[i];
+}
+
+SCALAR_KERNEL rmw_scalar(double *a, const double *b, const double *c, size_t n, double scalar, double *sink) {
+	for (size_t i = 0; i < n; i++)
+		a[i] += scalar;
+}
+
+// Chunks handed to the kernels are cache-line aligned and a multiple of this many doubles
+// (two 512-bit vectors, the widest read step), so no kernel has a tail to handle
+#define KERNEL_CHUNK_ELEMS 16
+
+// SIMD kernels, generated per vector width
+#define SIMD_KERNELS(SUFFIX, TARGET, VEC, WIDTH, LOAD, STORE, STREAM, SET1, ADD, MUL, ZERO, HSUM) \
+__attribute__((target(TARGET))) static void read_##SUFFIX(double *a, const double *b, const double *c, size_t n, double scalar, double *sink) { \
+	VEC s0 = ZERO(), s1 = ZERO(); \
+	for (size_t i = 0; i < n; i += 2 * WIDTH) { \
+		s0 = ADD(s0, LOAD(&a[i])); \
+		s1 = ADD(s1, LOAD(&a[i + WIDTH])); \
+	} \
+	*sink += HSUM(ADD(s0, s1)); \
+} \
+__attribute__((target(TARGET))) static void write_##SUFFIX(double *a, const double *b, const double *c, size_t n, double scalar, double *sink) { \
+	VEC v = SET1(scalar); \
+	for (size_t i = 0; i < n; i += WIDTH) \
+		STORE(&a[i], v); \
+} \
+__attribute__((target(TARGET))) static void nt_write_##SUFFIX(double *a, const double *b, const double *c, size_t n, double scalar, double *sink) { \
+	VEC v = SET1(scalar); \
+	for (size_t i = 0; i < n; i += WIDTH) \
+		STREAM(&a[i], v); \
+	_mm_sfence(); \
+} \
+__attribute__((target(TARGET))) static void copy_##SUFFIX(double *a, const double *b, const double *c, size_t n, double scalar, double *sink) { \
+	for (size_t i = 0; i < n; i += WIDTH) \
+		STORE(&a[i], LOAD(&b[i])); \
+} \
+__attribute__((target(TARGET))) static void triad_##SUFFIX(double *a, const double *b, const double *c, size_t n, double scalar, double *sink) { \
+	VEC s = SET1(scalar); \
+	for (size_t i = 0; i < n; i += WIDTH) \
+		STORE(&a[i], ADD(LOAD(&b[i]), MUL(s, LOAD(&c[i])))); \
+} \
+__attribute__((target(TARGET))) static void rmw_##SUFFIX(double *a, const double *b, const double *c, size_t n, double scalar, double *sink) { \
+	VEC s = SET1(scalar); \
+	for (size_t i = 0; i < n; i += WIDTH) \
+		STORE(&a[i], ADD(LOAD(&a[i]), s)); \
+}
+
+__attribute__((target("sse2"))) static inline double hsum_sse(__m128d v) {
+	return _mm_cvtsd_f64(v) + _mm_cvtsd_f64(_mm_unpackhi_pd(v, v));
+}
+
+__attribute__((target("avx2"))) static inline double hsum_avx2(__m256d v) {
+	return hsum_sse(_mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1)));
+}
+
+__attribute__((target("avx512f"))) static inline double hsum_avx512(__m512d v) {
+	alignas(64) double lanes[8];
+	_mm512_store_pd(lanes, v);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+}
+
+SIMD_KERNELS(sse, "sse2", __m128d, 2, _mm_load_pd, _mm_store_pd, _mm_stream_pd, _mm_set1_pd, _mm_add_pd, _mm_mul_pd, _mm_setzero_pd, hsum_sse)
+SIMD_KERNELS(avx2, "avx2", __m256d, 4, _mm256_load_pd, _mm256_store_pd, _mm256_stream_pd, _mm256_set1_pd, _mm256_add_pd, _mm256_mul_pd, _mm256_setzero_pd, hsum_avx2)
+SIMD_KERNELS(avx512, "avx512f", __m512d, 8, _mm512_load_pd, _mm512_store_pd, _mm512_stream_pd, _mm512_set1_pd, _mm512_add_pd, _mm512_mul_pd, _mm512_setzero_pd, hsum_avx512)
+
+static const KernelFn kernel_table[NUM_KERNELS][NUM_IMPLS] = {
+	{read_scalar, read_sse, read_avx2, read_avx512},
+	{write_scalar, write_sse, write_avx2, write_avx512},
+	{nt_write_scalar, nt_write_sse, nt_write_avx2, nt_write_avx512},
+	{copy_scalar, copy_sse, copy_avx2, copy_avx512},
+	{triad_scalar, triad_sse, triad_avx2, triad_avx512},
+	{rmw_scalar, rmw_sse, rmw_avx2, rmw_avx512},
+};
+
+// Runtime dispatch: only implementations the CPU supports are run
+static bool impl_supported(int impl) {
+	__builtin_cpu_init();
+	switch (impl) {
+		case SCALAR: return true;
+		case SSE: return __builtin_cpu_supports("sse2");
+		case AVX2: return __builtin_cpu_supports("avx2");
+		case AVX512: return __builtin_cpu_supports("avx512f");
+	}
+	return false;
+}
+
+// Widest implementation the CPU supports
+static int best_impl() {
+	for (int i = NUM_IMPLS - 1; i > 0; i--)
+		if (impl_supported(i))
+			return i;
+	return SCALAR;
+}
+
+// Doubles per link reservation when the buffers are on the emulated CXL node (1 MB, a whole
+// number of kernel steps)
+#define CXL_CHARGE_ELEMS (1UL << 17)
+
+// Function to be executed by each thread; returns the seconds spent in the kernel. streams
+// is the kernel's traffic per element. Buffers in the emulated CXL pool pay its link one
+// block at a time: the block's lines are reserved, streamed, and the thread then waits
+// until the link would have delivered them, so the slower of the two bounds each block.
+inline double bandwidth_worker(KernelFn fn, int streams, double *a, const double *b, const double *c, size_t n, size_t passes, int core_num, MyBarrier &sync_point) {
+	if (!pin_to_core(core_num))
+		return 0;
+	cxl_pool_t *pool = cxl_pool_of(a);
+	double sink = 0;
+	sync_point.arrive_and_wait();
+	auto start_time = std::chrono::steady_clock::now();
+	for (size_t p = 0; p < passes; p++) {
+		if (!pool) {
+			fn(a, b, c, n, 1.0 + p, &sink);
+			continue;
+		}
+		for (size_t off = 0; off < n; off += CXL_CHARGE_ELEMS) {
+			size_t len = std::min(CXL_CHARGE_ELEMS, n - off);
+			uint64_t done = cxl_pool_reserve(pool, a + off, streams * len * sizeof(double));
+			fn(a + off, b + off, c + off, len, 1.0 + p, &sink);
+			cxl_pool_wait(done);
+		}
+	}
+	auto end_time = std::chrono::steady_clock::now();
+	asm volatile("" : : "x"(sink));
+	return std::chrono::duration<double>(end_time - start_time).count();
+}
+
+#endif // BANDWIDTH_KERNELS_H
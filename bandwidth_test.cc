@@ -1,240 +1,204 @@
-#include <numa.h>
-#include <numaif.h>
-#include <iostream>
-#include <thread>
-#include <vector>
-#include <cstring>
-#include <sched.h>
-#include <chrono>
-#include <fstream>
+#include "bandwidth_kernels.h"
+#include <future>
 #include <numeric>
-#include <atomic>
-#include <barrier>
-#include <emmintrin.h>
 
-#define MEMORY_NODE 2
-#define SIZE (1UL<<35)
-#define NUM_TRIALS 5
-
-// Function to count the number of CPUs in a CPU set
-int count_cpus_in_numa_node(int node) {
-	struct bitmask *cpumask = numa_allocate_cpumask();
-	if (numa_node_to_cpus(node, cpumask) == -1) {
-		std::cerr << "Failed to get CPUs for NUMA node " << node << std::endl;
-		numa_free_cpumask(cpumask);
-		return -1;
-	}
-	int count = 0;
-	for (unsigned i = 0; i < cpumask->size; ++i) {
-		if (numa_bitmask_isbitset(cpumask, i)) {
-			++count;
-		}
-	}
-	numa_free_cpumask(cpumask);
-	return count/2; //This is to eliminate hyperthreads
-}
+#include <cxxopts.hpp>
 
-// Function to be executed by each thread
-void write_to_memory(int64_t* memory, size_t start, size_t end, int64_t value) {
-	// Bind thread to NUMA node 0
-	numa_run_on_node(0);
-	int64_t* dst = (int64_t*)((int8_t*)memory + start);
-	int64_t* end_dst = (int64_t*)((int8_t*)memory + end);
-	while(dst<end_dst){
-		*dst = value;
-		dst++;
-	}
-}
-
-void write_to_memory_nt(int64_t* memory, size_t start, size_t end, int64_t value) {
-	// Bind thread to NUMA node 0
-	numa_run_on_node(0);
-
-	size_t size = end - start;
-	void* dst = (uint8_t*)memory + start;
-	void* src = &value;
-	// Cast pointers to the appropriate type for 8-byte access
-	long long* d = static_cast<long long*>(dst);
-	const long long* s = static_cast<const long long*>(src);
-
-	// Align the destination pointer to an 8-byte boundary
-	size_t alignment = reinterpret_cast<uintptr_t>(d) & 0x7;
-	if (alignment) {
-		std::cout << "Memory is not aligned!" << std::endl;
-		alignment = 8 - alignment;
-		size_t copy_size = (alignment > size) ? size : alignment;
-		std::memcpy(d, s, copy_size);
-		d += copy_size / sizeof(uint64_t);
-		s += copy_size / sizeof(uint64_t);
-		size -= copy_size;
-	}
-
-	// Copy the bulk of the data using non-temporal stores (8 bytes at a time)
-	size_t block_size = size / sizeof(value);
-	for (size_t i = 0; i < block_size; ++i) {
-		_mm_stream_si64(d, *s); // Copy 8 bytes (one long long)
-		++d;
-	}
+#define NUM_TRIALS 5
+#define MIN_BYTES_PER_TRIAL (1UL << 30) // repeat small buffers until at least this much is moved
 
-	// Copy any remaining bytes using standard memcpy
-	std::memcpy(d, s, size % 8);
+static int lookup(const char **names, int count, const std::string &name) {
+	for (int i = 0; i < count; i++)
+		if (name == names[i])
+			return i;
+	return -1;
 }
 
-void write_to_memory_nt_batch(int64_t* memory, size_t start, size_t end, int64_t value) {
-	numa_run_on_node(0);
-	size_t size = end - start;
-	void* dst = (uint8_t*)memory + start;
-	void* src = &value;
-	// Cast the input pointers to the appropriate types
-	uint8_t* d = static_cast<uint8_t*>(dst);
-	const uint8_t* s = static_cast<const uint8_t*>(src);
-
-	// Align the destination pointer to 16-byte boundary
-	size_t alignment = reinterpret_cast<uintptr_t>(d) & 0xF;
-	if (alignment) {
-		alignment = 16 - alignment;
-		size_t copy_size = (alignment > size) ? size : alignment;
-		std::memcpy(d, s, copy_size);
-		d += copy_size;
-		//s += copy_size;
-		size -= copy_size;
+static std::vector<int> parse_names(const std::string &spec, const char **names, int count) {
+	std::vector<int> out;
+	if (spec == "all") {
+		for (int i = 0; i < count; i++)
+			out.push_back(i);
+		return out;
 	}
-
-	// Copy the bulk of the data using non-temporal stores
-	size_t block_size = size / 64;
-	for (size_t i = 0; i < block_size; ++i) {
-		_mm_stream_si64(reinterpret_cast<long long*>(d), *reinterpret_cast<const long long*>(s));
-		_mm_stream_si64(reinterpret_cast<long long*>(d + 8), *reinterpret_cast<const long long*>(s));
-		_mm_stream_si64(reinterpret_cast<long long*>(d + 16), *reinterpret_cast<const long long*>(s));
-		_mm_stream_si64(reinterpret_cast<long long*>(d + 24), *reinterpret_cast<const long long*>(s));
-		_mm_stream_si64(reinterpret_cast<long long*>(d + 32), *reinterpret_cast<const long long*>(s));
-		_mm_stream_si64(reinterpret_cast<long long*>(d + 40), *reinterpret_cast<const long long*>(s));
-		_mm_stream_si64(reinterpret_cast<long long*>(d + 48), *reinterpret_cast<const long long*>(s));
-		_mm_stream_si64(reinterpret_cast<long long*>(d + 56), *reinterpret_cast<const long long*>(s));
-		d += 64;
+	std::stringstream ss(spec);
+	for (std::string tok; std::getline(ss, tok, ',');) {
+		int idx = lookup(names, count, tok);
+		if (idx < 0) {
+			std::cerr << "Unknown name: " << tok << std::endl;
+			exit(1);
+		}
+		out.push_back(idx);
 	}
-
-	// Copy the remaining data using standard memcpy
-	std::memcpy(d, s, size % 64);
+	return out;
 }
 
-size_t atomic_operation(void *memory, int core_num, std::barrier *sync_point){
-	size_t count = 0;
-	cpu_set_t cpuset;
-	CPU_ZERO(&cpuset);
-	CPU_SET(core_num, &cpuset);
-	if(sched_setaffinity(0, sizeof(cpuset), &cpuset) != 0){
-		std::cerr << "Error setting thread affinity: " << strerror(errno) << std::endl;
-		return;
-	}
-	std::atomic<int64_t> *var = (std::atomic<int64_t>*)memory;
-
-	sync_point->arrive_and_wait();
-	auto start_time = std::chrono::steady_clock::now();
-	auto end_time = start_time + std::chrono::seconds(3); // Run for 3 seconds
-
-	while (std::chrono::steady_clock::now() < end_time) {
-		var->fetch_add(1);
-		count++;
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("Bandwidth Test", "Memory bandwidth by kernel, ISA, thread count, buffer size and node pair");
+	options.add_options()
+		("k,kernels", "Kernels (read,write,nt_write,copy,triad,rmw or all)", cxxopts::value<std::string>()->default_value("all"))
+		("i,impls", "Implementations (scalar,sse,avx2,avx512, all, or best)", cxxopts::value<std::string>()->default_value("best"))
+		("t,threads", "Thread counts, e.g. 1,2,4-8 (default: powers of two up to the node's cores)", cxxopts::value<std::string>()->default_value(""))
+		("s,sizes", "Buffer sizes per array, e.g. 64M,1G", cxxopts::value<std::string>()->default_value("1G"))
+		("c,cpu_nodes", "CPU nodes running the threads (default: all)", cxxopts::value<std::string>()->default_value(""))
+		("m,memory_nodes", "Memory nodes holding the buffers, including CXL (default: all)", cxxopts::value<std::string>()->default_value(""))
+		("trials", "Number of trials", cxxopts::value<int>()->default_value(std::to_string(NUM_TRIALS)))
+		("r,result", "Result csv file", cxxopts::value<std::string>()->default_value("results/bandwidth.csv"))
+		("emulate_cxl", "Serve this node id from an emulated CXL pool: node[:latency_ns[:GB/s[:size]]]", cxxopts::value<std::string>())
+		("page_mode", "Buffer pages (default,4k,thp,2m,1g)", cxxopts::value<std::string>()->default_value("default"))
+		("placement", "Buffer placement (bind,preferred,interleave,first_touch)", cxxopts::value<std::string>()->default_value("bind"))
+		("h,help", "Print usage")
+		;
+	auto arguments = options.parse(argc, argv);
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
 	}
-	return count;
-}
 
-int main() {
 	// Initialize NUMA library
 	if (numa_available() == -1) {
 		std::cerr << "NUMA is not available on this system." << std::endl;
 		return 1;
 	}
-
-	// Allocate SIZE memory on CXM 
-	size_t size = SIZE / sizeof(int64_t); // Number of integers
-	int64_t* memory = static_cast<int64_t*>(numa_alloc_onnode(size * sizeof(int64_t), MEMORY_NODE));
-	if (memory == nullptr) {
-		std::cerr << "Failed to allocate memory on NUMA node 2." << std::endl;
+	if (arguments.count("emulate_cxl") && !enable_cxl_emulation(arguments["emulate_cxl"].as<std::string>()))
+		return 1;
+	if (!set_alloc_policy(arguments["page_mode"].as<std::string>(), arguments["placement"].as<std::string>()))
 		return 1;
-	}
 
-	// Clear allocated memory
-	memset(memory, 0, size * sizeof(int64_t));
+	std::vector<int> kernels = parse_names(arguments["kernels"].as<std::string>(), kernel_names, NUM_KERNELS);
+	std::vector<int> impls;
+	std::string impl_spec = arguments["impls"].as<std::string>();
+	if (impl_spec == "best") {
+		impls.push_back(best_impl());
+	} else {
+		for (int i : parse_names(impl_spec, impl_names, NUM_IMPLS)) {
+			if (impl_supported(i))
+				impls.push_back(i);
+			else
+				std::cerr << "Skipping " << impl_names[i] << ": not supported by this CPU" << std::endl;
+		}
+	}
 
-	// Get the number of CPUs on NUMA node 1
-	int num_cpus = count_cpus_in_numa_node(1);
-	if (num_cpus <= 0) {
-		std::cerr << "No CPUs found on NUMA node 1." << std::endl;
-		numa_free(memory, size * sizeof(int));
-		return 1;
+	std::vector<size_t> sizes;
+	std::stringstream ss(arguments["sizes"].as<std::string>());
+	for (std::string tok; std::getline(ss, tok, ',');)
+		sizes.push_back(parse_size(tok));
+	std::vector<int> c_nodes = cpu_nodes(), m_nodes = memory_nodes();
+	if (!arguments["cpu_nodes"].as<std::string>().empty()) {
+		c_nodes.clear();
+		for (long n : parse_list(arguments["cpu_nodes"].as<std::string>()))
+			c_nodes.push_back(n);
+	}
+	if (!arguments["memory_nodes"].as<std::string>().empty()) {
+		m_nodes.clear();
+		for (long n : parse_list(arguments["memory_nodes"].as<std::string>()))
+			m_nodes.push_back(n);
 	}
+	int num_trials = arguments["trials"].as<int>();
 
 	// Open a file to store the results
-	std::string filename;
-	switch(MEMORY_NODE){
-		case 0:
-			//filename = "results/local_ntbatchwrite_bandwidth.csv";
-			break;
-		case 1:
-			//filename = "results/remote_ntbatchwrite_bandwidth.csv";
-			break;
-		case 2:
-			//filename = "results/cxl_ntbatchwrite_bandwidth.csv";
-			break;
-	}
-	std::ofstream results_file(filename);
-	results_file << "threads,duration,bandwidth\n";
-
-	// Test with an increasing number of threads
-	for (size_t num_threads = 1; num_threads <= static_cast<size_t>(num_cpus); ++num_threads) {
-		size_t chunk_size = size / num_threads;
-		// To make all accesses within 8butes alignement
-		size_t alignment = chunk_size&15;
-		if(alignment){
-			alignment = 16 - alignment;
-			chunk_size += alignment;
+	std::ofstream results_file(arguments["result"].as<std::string>());
+	results_file << "kernel,impl,cpu_node,memory_node,page_mode,placement,page_size,threads,buffer_bytes,duration,bandwidth,cxl_shim\n";
+
+	for (int cpu_node : c_nodes) {
+		std::vector<int> cores = cores_of_node(cpu_node);
+		if (cores.empty()) {
+			std::cerr << "No CPUs found on NUMA node " << cpu_node << "." << std::endl;
+			continue;
+		}
+		std::vector<size_t> thread_counts;
+		if (arguments["threads"].as<std::string>().empty()) {
+			thread_counts = pow2_sweep(cores.size());
+		} else {
+			for (long t : parse_list(arguments["threads"].as<std::string>()))
+				if ((size_t)t <= cores.size())
+					thread_counts.push_back(t);
 		}
-		std::vector<double> durations;
-		std::vector<double> bandwidths;
-
-		for (int trial = 0; trial < NUM_TRIALS; ++trial) {
-			// Create and run threads
-			std::vector<std::thread> threads;
-			auto start_time = std::chrono::high_resolution_clock::now();
-			std::barrier sync_point(num_threads);
-			for (size_t i = 0; i < num_threads; ++i) {
-				size_t start = i * chunk_size;
-				size_t end = (i == num_threads - 1) ? size : (i + 1) * chunk_size;
-				//threads.emplace_back(atomic_operation, memory, start, end, i + 1);
-				threads.emplace_back(atomic_operation, memory, i+256, &sync_point);
-			}
 
-			// Wait for all threads to finish
-			for (auto& th : threads) {
-				th.join();
+		for (int memory_node : m_nodes) {
+			for (size_t size : sizes) {
+				// Three arrays (destination and two sources), each a whole number of cache lines
+				size = (size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+				size_t elems = size / sizeof(double);
+				double *bufs[3];
+				for (int b = 0; b < 3; b++) {
+					bufs[b] = static_cast<double *>(alloc_on_node(size, memory_node));
+					if (bufs[b] == nullptr) {
+						std::cerr << "Failed to allocate memory on NUMA node " << memory_node << "." << std::endl;
+						return 1;
+					}
+					if (alloc_policy().placement != NodePlacement::FirstTouch)
+						memset(bufs[b], 0, size);
+				}
+				// Under first_touch, each thread of the widest run faults in the chunk it will stream
+				if (alloc_policy().placement == NodePlacement::FirstTouch && !thread_counts.empty() && !is_emulated_cxl(memory_node)) {
+					size_t touch_threads = thread_counts.back(), touch_chunk = (size / touch_threads + 4095) & ~(size_t)4095;
+					std::vector<std::thread> touchers;
+					for (size_t i = 0; i < touch_threads; ++i) {
+						touchers.emplace_back([&, i]() {
+							pin_to_core(cores[i]);
+							size_t off = std::min(size, i * touch_chunk);
+							for (int b = 0; b < 3; b++)
+								first_touch((char *)bufs[b] + off, std::min(touch_chunk, size - off));
+						});
+					}
+					for (auto &t : touchers)
+						t.join();
+				}
+				size_t page_size = mapping_page_size(bufs[0]);
+
+				for (size_t num_threads : thread_counts) {
+					// Per-thread chunks, each a whole number of kernel steps (KERNEL_CHUNK_ELEMS)
+					size_t chunk = (elems / num_threads) / KERNEL_CHUNK_ELEMS * KERNEL_CHUNK_ELEMS;
+					if (chunk == 0)
+						continue;
+					size_t passes = std::max<size_t>(1, MIN_BYTES_PER_TRIAL / (chunk * num_threads * sizeof(double)));
+
+					for (int kernel : kernels) {
+						for (int impl : impls) {
+							std::vector<double> durations;
+							std::vector<double> bandwidths;
+							for (int trial = 0; trial < num_trials; ++trial) {
+								std::vector<std::future<double>> futs;
+								MyBarrier sync_point(num_threads);
+								for (size_t i = 0; i < num_threads; ++i) {
+									size_t off = i * chunk;
+									futs.push_back(std::async(std::launch::async, bandwidth_worker, kernel_table[kernel][impl], kernel_streams[kernel],
+										bufs[0] + off, bufs[1] + off, bufs[2] + off, chunk, passes, cores[i], std::ref(sync_point)));
+								}
+								// The slowest thread bounds the run
+								double duration = 0;
+								for (auto &f : futs)
+									duration = std::max(duration, f.get());
+								double bytes = (double)kernel_streams[kernel] * chunk * num_threads * sizeof(double) * passes;
+								durations.push_back(duration);
+								bandwidths.push_back(bytes / 1e9 / duration); // GB/s
+							}
+
+							// Calculate average duration and bandwidth
+							double avg_duration = std::accumulate(durations.begin(), durations.end(), 0.0) / num_trials;
+							double avg_bandwidth = std::accumulate(bandwidths.begin(), bandwidths.end(), 0.0) / num_trials;
+
+							// Store the results
+							results_file << kernel_names[kernel] << "," << impl_names[impl] << "," << cpu_node << "," << memory_node << ","
+								<< page_mode_names[(int)alloc_policy().pages] << "," << placement_names[(int)alloc_policy().placement] << "," << page_size << ","
+								<< num_threads << "," << size << "," << avg_duration << "," << avg_bandwidth << "," << cxl_shim(memory_node, true) << "\n";
+							std::cout << kernel_names[kernel] << "/" << impl_names[impl] << " node " << cpu_node << "->" << memory_node
+								<< " size " << size << " pages " << page_size << " Threads: " << num_threads << ", Avg Duration: " << avg_duration
+								<< " s, Avg Bandwidth: " << avg_bandwidth << " GB/s" << std::endl;
+						}
+					}
+				}
+
+				// Free the allocated memory
+				for (int b = 0; b < 3; b++)
+					free_on_node(bufs[b], size);
 			}
-			auto end_time = std::chrono::high_resolution_clock::now();
-
-			// Calculate the duration and bandwidth
-			std::chrono::duration<double> duration = end_time - start_time;
-			double bandwidth = (size * sizeof(int)) / (1024.0 * 1024.0 * 1024.0) / duration.count(); // GB/s
-
-			durations.push_back(duration.count());
-			bandwidths.push_back(bandwidth);
 		}
-
-		// Calculate average duration and bandwidth
-		double avg_duration = std::accumulate(durations.begin(), durations.end(), 0.0) / NUM_TRIALS;
-		double avg_bandwidth = std::accumulate(bandwidths.begin(), bandwidths.end(), 0.0) / NUM_TRIALS;
-
-		// Store the results
-		results_file << num_threads << "," << avg_duration << "," << avg_bandwidth << "\n";
-
-		std::cout << "Threads: " << num_threads << ", Avg Duration: " << avg_duration << " s, Avg Bandwidth: " << avg_bandwidth << " GB/s" << std::endl;
 	}
 
 	// Close the results file
 	results_file.close();
 
-	// Free the allocated memory
-	numa_free(memory, size * sizeof(int));
-
 	return 0;
-	}
+}
@@ -0,0 +1,577 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+// Helpers shared by the standalone C++ benchmarks (pinning, topology, timing)
+
+#include <numa.h>
+#include <numaif.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <x86intrin.h>
+#include <algorithm>
+#include <barrier>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "include/cxl_pool.h"
+
+#define CACHE_LINE_SIZE 64
+
+using MyBarrier = std::barrier<>;
+
+// Pin the calling thread to a single core
+inline bool pin_to_core(int core_num) {
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+	CPU_SET(core_num, &cpuset);
+	if (sched_setaffinity(0, sizeof(cpuset), &cpuset) != 0) {
+		std::cerr << "Error setting thread affinity: " << strerror(errno) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// A cpu is a physical core if it is the first entry of its hyperthread sibling list
+inline bool is_first_hyperthread(int cpu) {
+	std::ifstream f("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+	int first = cpu;
+	if (f >> first)
+		return first == cpu;
+	return true;
+}
+
+// Integer read from a per-cpu sysfs topology file, or fallback when it is missing
+inline int read_cpu_sysfs(int cpu, const std::string &file, int fallback) {
+	std::ifstream f("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/" + file);
+	int v = fallback;
+	if (!(f >> v))
+		return fallback;
+	return v;
+}
+
+// Socket (package) of a cpu
+inline int cpu_package(int cpu) {
+	return read_cpu_sysfs(cpu, "topology/physical_package_id", 0);
+}
+
+// Last-level cache domain of a cpu (a core complex on chiplet parts, the socket otherwise)
+inline int cpu_llc(int cpu) {
+	return cpu_package(cpu) * 4096 + read_cpu_sysfs(cpu, "cache/index3/id", 0);
+}
+
+// Emulated CXL node (--emulate_cxl): a CPU-less node id whose memory comes from a
+// cxl_pool on the farthest real node, for machines without a CXL device
+struct EmulatedCxl {
+	int node = -1;
+	cxl_pool_t *pool = nullptr;
+};
+
+inline EmulatedCxl &emulated_cxl() {
+	static EmulatedCxl cxl;
+	return cxl;
+}
+
+inline bool is_emulated_cxl(int node) {
+	return node >= 0 && node == emulated_cxl().node;
+}
+
+// The emulated pool when addr lies in it, otherwise null (use the plain access)
+inline cxl_pool_t *cxl_pool_of(const void *addr) {
+	cxl_pool_t *pool = emulated_cxl().pool;
+	return cxl_pool_contains(pool, addr) ? pool : nullptr;
+}
+
+// cxl_shim result column: "none" for real nodes; on the emulated CXL node, "shimmed" when the
+// benchmark charges its accesses to the pool and "unshimmed" when its raw accesses only see
+// the backing node's latency and bandwidth
+inline const char *cxl_shim(int node, bool charged) {
+	return !is_emulated_cxl(node) ? "none" : charged ? "shimmed" : "unshimmed";
+}
+
+// For benchmarks whose raw coherence operations cannot go through the pool's accessors
+inline void warn_unshimmed_cxl() {
+	if (emulated_cxl().pool)
+		std::cerr << "Note: accesses here bypass the CXL shim; rows on emulated node " << emulated_cxl().node
+			<< " see only the backing node " << emulated_cxl().pool->node << " (cxl_shim=unshimmed)" << std::endl;
+}
+
+// Physical cores (one hyperthread per core) that belong to a NUMA node
+inline std::vector<int> cores_of_node(int node) {
+	std::vector<int> cores;
+	if (is_emulated_cxl(node))
+		return cores;
+	struct bitmask *cpumask = numa_allocate_cpumask();
+	if (numa_node_to_cpus(node, cpumask) == -1) {
+		std::cerr << "Failed to get CPUs for NUMA node " << node << std::endl;
+		numa_free_cpumask(cpumask);
+		return cores;
+	}
+	for (unsigned i = 0; i < cpumask->size; ++i) {
+		if (numa_bitmask_isbitset(cpumask, i) && is_first_hyperthread(i))
+			cores.push_back(i);
+	}
+	numa_free_cpumask(cpumask);
+	return cores;
+}
+
+// NUMA nodes that own at least one CPU
+inline std::vector<int> cpu_nodes() {
+	std::vector<int> nodes;
+	for (int node = 0; node <= numa_max_node(); ++node) {
+		if (numa_bitmask_isbitset(numa_nodes_ptr, node) && !cores_of_node(node).empty())
+			nodes.push_back(node);
+	}
+	return nodes;
+}
+
+// NUMA nodes that own memory, including CPU-less (CXL) nodes
+inline std::vector<int> memory_nodes() {
+	std::vector<int> nodes;
+	for (int node = 0; node <= numa_max_node(); ++node) {
+		long long free_size = 0;
+		if (numa_bitmask_isbitset(numa_nodes_ptr, node) && numa_node_size64(node, &free_size) > 0)
+			nodes.push_back(node);
+	}
+	if (emulated_cxl().pool && std::find(nodes.begin(), nodes.end(), emulated_cxl().node) == nodes.end())
+		nodes.push_back(emulated_cxl().node);
+	return nodes;
+}
+
+// Hop distance as reported by the firmware SLIT table (10 = local); an emulated CXL node
+// is as far as the node backing its pool
+inline int node_distance(int from, int to) {
+	if (is_emulated_cxl(to))
+		to = emulated_cxl().pool->node;
+	return numa_distance(from, to);
+}
+
+// Parse "1,2,8-16" into a list of integers
+inline std::vector<long> parse_list(const std::string &spec) {
+	std::vector<long> out;
+	std::stringstream ss(spec);
+	std::string tok;
+	while (std::getline(ss, tok, ',')) {
+		if (tok.empty())
+			continue;
+		size_t dash = tok.find('-', 1);
+		if (dash == std::string::npos) {
+			out.push_back(std::stol(tok));
+		} else {
+			long lo = std::stol(tok.substr(0, dash));
+			long hi = std::stol(tok.substr(dash + 1));
+			for (long v = lo; v <= hi; ++v)
+				out.push_back(v);
+		}
+	}
+	return out;
+}
+
+// Parse "4K", "2M", "1G" style sizes
+inline size_t parse_size(const std::string &spec) {
+	size_t pos = 0;
+	double v = std::stod(spec, &pos);
+	switch (pos < spec.size() ? toupper(spec[pos]) : 0) {
+		case 'K': v *= 1UL << 10; break;
+		case 'M': v *= 1UL << 20; break;
+		case 'G': v *= 1UL << 30; break;
+	}
+	return (size_t)v;
+}
+
+// 1, 2, 4, ... up to (and including) max
+inline std::vector<size_t> pow2_sweep(size_t max) {
+	std::vector<size_t> out;
+	for (size_t n = 1; n < max; n *= 2)
+		out.push_back(n);
+	out.push_back(max);
+	return out;
+}
+
+// Serve node from an emulated CXL pool. spec is "node[:latency_ns[:GB/s[:size]]]"; the
+// defaults model a x8 CXL 2.0 memory expander.
+inline bool enable_cxl_emulation(const std::string &spec) {
+	std::vector<std::string> fields;
+	std::stringstream ss(spec);
+	std::string tok;
+	while (std::getline(ss, tok, ':'))
+		fields.push_back(tok);
+	cxl_pool_config_t config = {};
+	config.node = -1;
+	config.latency_ns = fields.size() > 1 ? std::stod(fields[1]) : 250;
+	config.bandwidth_gbps = fields.size() > 2 ? std::stod(fields[2]) : 24;
+	config.size = fields.size() > 3 ? parse_size(fields[3]) : 16UL << 30;
+	cxl_pool_t *pool = cxl_pool_create(&config);
+	if (!pool)
+		return false;
+	emulated_cxl().node = std::stoi(fields[0]);
+	emulated_cxl().pool = pool;
+	std::cout << "Emulated CXL node " << emulated_cxl().node << ": pool on node " << pool->node << ", native "
+		<< pool->native_ns << " ns + " << cxl_pool_injected_ns(pool) << " ns injected, "
+		<< config.bandwidth_gbps << " GB/s cap" << std::endl;
+	return true;
+}
+
+// Serialized timestamp reads for timing short code sequences
+inline uint64_t tsc_begin() {
+	_mm_lfence();
+	uint64_t t = __rdtsc();
+	_mm_lfence();
+	return t;
+}
+
+inline uint64_t tsc_end() {
+	unsigned aux;
+	uint64_t t = __rdtscp(&aux);
+	_mm_lfence();
+	return t;
+}
+
+// TSC ticks per nanosecond, calibrated once against steady_clock
+inline double tsc_per_ns() {
+	static double ratio = [] {
+		auto t0 = std::chrono::steady_clock::now();
+		uint64_t c0 = tsc_begin();
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		uint64_t c1 = tsc_end();
+		auto t1 = std::chrono::steady_clock::now();
+		return (double)(c1 - c0) / std::chrono::duration<double, std::nano>(t1 - t0).count();
+	}();
+	return ratio;
+}
+
+// Cost of an empty tsc_begin/tsc_end pair, subtracted from sampled latencies
+inline uint64_t tsc_overhead() {
+	static uint64_t overhead = [] {
+		uint64_t best = UINT64_MAX;
+		for (int i = 0; i < 1000; i++) {
+			uint64_t t0 = tsc_begin();
+			uint64_t t1 = tsc_end();
+			best = std::min(best, t1 - t0);
+		}
+		return best;
+	}();
+	return overhead;
+}
+
+// Page size and placement of benchmark buffers (--page_mode, --placement). The defaults
+// keep numa_alloc_onnode's behaviour: bound to the node, with whatever page size THP gives.
+enum class PageMode { Default, Base, THP, Huge2M, Huge1G };
+enum class NodePlacement { Bind, Preferred, Interleave, FirstTouch };
+
+struct AllocPolicy {
+	PageMode pages = PageMode::Default;
+	NodePlacement placement = NodePlacement::Bind;
+};
+
+static const char *page_mode_names[] = {"default", "4k", "thp", "2m", "1g"};
+static const char *placement_names[] = {"bind", "preferred", "interleave", "first_touch"};
+
+inline AllocPolicy &alloc_policy() {
+	static AllocPolicy policy;
+	return policy;
+}
+
+// Set the policy every allocation helper below follows
+inline bool set_alloc_policy(const std::string &pages, const std::string &placement) {
+	auto find = [](const char **names, int count, const std::string &name) {
+		for (int i = 0; i < count; i++)
+			if (name == names[i])
+				return i;
+		return -1;
+	};
+	int p = find(page_mode_names, 5, pages), m = find(placement_names, 4, placement);
+	if (p < 0 || m < 0) {
+		std::cerr << "Unknown " << (p < 0 ? "page mode: " + pages : "placement: " + placement) << std::endl;
+		return false;
+	}
+	alloc_policy() = {(PageMode)p, (NodePlacement)m};
+	return true;
+}
+
+// Bytes a mapping under the policy is rounded up to
+inline size_t policy_alignment(const AllocPolicy &policy) {
+	switch (policy.pages) {
+		case PageMode::Huge2M: return 2UL << 20;
+		case PageMode::Huge1G: return 1UL << 30;
+		default: return 4UL << 10;
+	}
+}
+
+// Apply the placement to a fresh mapping: bind or prefer node, or interleave over every
+// memory node; first_touch leaves the default policy so the first writer's node wins
+inline bool apply_placement(void *addr, size_t size, int node, NodePlacement placement) {
+	unsigned long nodemask[16] = {0};
+	int mode = MPOL_BIND;
+	switch (placement) {
+		case NodePlacement::FirstTouch:
+			return true;
+		case NodePlacement::Interleave:
+			mode = MPOL_INTERLEAVE;
+			for (int n = 0; n <= numa_max_node(); ++n) {
+				long long free_size = 0;
+				if (numa_bitmask_isbitset(numa_nodes_ptr, n) && numa_node_size64(n, &free_size) > 0)
+					nodemask[n / 64] |= 1UL << (n % 64);
+			}
+			break;
+		case NodePlacement::Preferred:
+			mode = MPOL_PREFERRED;
+			nodemask[node / 64] |= 1UL << (node % 64);
+			break;
+		case NodePlacement::Bind:
+			nodemask[node / 64] |= 1UL << (node % 64);
+			break;
+	}
+	if (mbind(addr, size, mode, nodemask, sizeof(nodemask) * 8, 0) != 0) {
+		std::cerr << placement_names[(int)placement] << " mbind to node " << node << " failed: " << strerror(errno) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Write one byte per base page from the calling thread (the owner, under first_touch)
+inline void first_touch(void *addr, size_t size) {
+	for (size_t off = 0; off < size; off += 4096)
+		((volatile char *)addr)[off] = 0;
+}
+
+// Part of a buffer that one worker core uses
+struct OwnedRange {
+	void *addr;
+	size_t bytes;
+	int core;
+};
+
+// Prepare a fresh buffer from alloc_on_node. Normally it is zeroed from the calling thread;
+// under first_touch each owner instead faults in the pages of its range from its own core,
+// owners in order so a page shared by two goes to the first, and the caller takes the rest.
+inline void touch_by_owners(void *addr, size_t size, const std::vector<OwnedRange> &owners) {
+	if (alloc_policy().placement != NodePlacement::FirstTouch || cxl_pool_of(addr)) {
+		memset(addr, 0, size);
+		return;
+	}
+	for (const OwnedRange &o : owners) {
+		uintptr_t start = (uintptr_t)o.addr & ~(uintptr_t)4095;
+		uintptr_t end = ((uintptr_t)o.addr + o.bytes + 4095) & ~(uintptr_t)4095;
+		std::thread([&]() {
+			pin_to_core(o.core);
+			first_touch((void *)start, end - start);
+		}).join();
+	}
+	first_touch(addr, size);
+}
+
+// Anonymous mapping under policy. Explicit hugetlb pages fail rather than fall back, so a
+// result is never silently measured on the wrong page size; check mapping_page_size().
+inline void *map_with_policy(size_t size, int node, const AllocPolicy &policy) {
+	size_t align = policy_alignment(policy);
+	size = (size + align - 1) & ~(align - 1);
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	if (policy.pages == PageMode::Huge2M)
+		flags |= MAP_HUGETLB | (21 << MAP_HUGE_SHIFT);
+	if (policy.pages == PageMode::Huge1G)
+		flags |= MAP_HUGETLB | (30 << MAP_HUGE_SHIFT);
+	void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (addr == MAP_FAILED) {
+		std::cerr << "mmap of " << size << " bytes with " << page_mode_names[(int)policy.pages] << " pages failed: " << strerror(errno)
+			<< (flags & MAP_HUGETLB ? " (reserve pages in /sys/kernel/mm/hugepages)" : "") << std::endl;
+		return nullptr;
+	}
+	if (policy.pages == PageMode::Base)
+		madvise(addr, size, MADV_NOHUGEPAGE);
+	if (policy.pages == PageMode::THP)
+		madvise(addr, size, MADV_HUGEPAGE);
+	if (!apply_placement(addr, size, node, policy.placement)) {
+		munmap(addr, size);
+		return nullptr;
+	}
+	// Fault everything in now so page placement is not part of the measurement
+	if (policy.placement != NodePlacement::FirstTouch)
+		memset(addr, 0, size);
+	return addr;
+}
+
+// numa_alloc_onnode under the allocation policy, also serving the emulated CXL node (whose
+// pool ignores the policy). The memory is zeroed unless the placement is first_touch.
+inline void *alloc_on_node(size_t size, int node) {
+	if (is_emulated_cxl(node)) {
+		void *addr = cxl_alloc(emulated_cxl().pool, size);
+		if (addr)
+			memset(addr, 0, size);
+		return addr;
+	}
+	const AllocPolicy &policy = alloc_policy();
+	if (policy.pages == PageMode::Default && policy.placement == NodePlacement::Bind)
+		return numa_alloc_onnode(size, node);
+	return map_with_policy(size, node, policy);
+}
+
+inline void free_on_node(void *addr, size_t size) {
+	size_t align = policy_alignment(alloc_policy());
+	if (cxl_pool_t *pool = cxl_pool_of(addr))
+		cxl_free(pool, addr, size);
+	else
+		numa_free(addr, (size + align - 1) & ~(align - 1));
+}
+
+// Anonymous mapping placed on a node by the allocation policy's placement. With huge set,
+// explicit 2M hugetlb pages are tried first and transparent huge pages are requested as the
+// fallback; otherwise THP is disabled. The emulated CXL node always uses base pages of its pool.
+inline void *alloc_pages_on_node(size_t size, int node, bool huge) {
+	if (is_emulated_cxl(node))
+		return alloc_on_node(size, node);
+	void *addr = MAP_FAILED;
+	if (huge)
+		addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (addr == MAP_FAILED) {
+		addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (addr == MAP_FAILED)
+			return nullptr;
+		madvise(addr, size, huge ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+	}
+	NodePlacement placement = alloc_policy().placement;
+	if (!apply_placement(addr, size, node, placement)) {
+		munmap(addr, size);
+		return nullptr;
+	}
+	// Fault everything in now so page placement is not part of the measurement
+	if (placement != NodePlacement::FirstTouch)
+		memset(addr, 0, size);
+	return addr;
+}
+
+inline void free_pages(void *addr, size_t size) {
+	if (cxl_pool_t *pool = cxl_pool_of(addr))
+		cxl_free(pool, addr, size);
+	else
+		munmap(addr, size);
+}
+
+// Anonymous 4K-page mapping whose pages cycle over nodes by weight: weights {3, 1} puts three
+// pages on nodes[0], then one on nodes[1], and so on. Pages are faulted in under a thread
+// bind policy, one node at a time; an mbind per run of pages would split the mapping into a
+// VMA per run and hit vm.max_map_count at page granularity.
+inline void *alloc_weighted(size_t size, const std::vector<int> &nodes, const std::vector<int> &weights) {
+	const size_t page = 4096;
+	size = (size + page - 1) & ~(page - 1);
+	void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED)
+		return nullptr;
+	madvise(addr, size, MADV_NOHUGEPAGE);
+	int period = 0;
+	for (int w : weights)
+		period += w;
+	if (period == 0) {
+		munmap(addr, size);
+		return nullptr;
+	}
+	int first = 0;
+	for (size_t i = 0; i < nodes.size(); first += weights[i], i++) {
+		if (weights[i] == 0)
+			continue;
+		unsigned long nodemask[16] = {0};
+		nodemask[nodes[i] / 64] |= 1UL << (nodes[i] % 64);
+		if (set_mempolicy(MPOL_BIND, nodemask, sizeof(nodemask) * 8) != 0) {
+			std::cerr << "set_mempolicy to node " << nodes[i] << " failed: " << strerror(errno) << std::endl;
+			set_mempolicy(MPOL_DEFAULT, nullptr, 0);
+			munmap(addr, size);
+			return nullptr;
+		}
+		for (size_t p = 0; p < size / page; p++)
+			if ((int)(p % period) >= first && (int)(p % period) < first + weights[i])
+				((volatile char *)addr)[p * page] = 0;
+	}
+	set_mempolicy(MPOL_DEFAULT, nullptr, 0);
+	return addr;
+}
+
+// Fraction of the 4K pages of [addr, addr + size) that currently sit on node
+inline double fraction_on_node(const void *addr, size_t size, int node) {
+	const size_t page = 4096;
+	size_t n = size / page;
+	if (n == 0)
+		return 0;
+	std::vector<void *> pages(n);
+	std::vector<int> status(n, -1);
+	for (size_t p = 0; p < n; p++)
+		pages[p] = (char *)addr + p * page;
+	numa_move_pages(0, n, pages.data(), nullptr, status.data(), 0);
+	return (double)std::count(status.begin(), status.end(), node) / n;
+}
+
+// Page size actually backing the mapping that contains addr (hugetlb, THP or base pages)
+inline size_t mapping_page_size(const void *addr) {
+	std::ifstream smaps("/proc/self/smaps");
+	uintptr_t target = (uintptr_t)addr;
+	std::string line;
+	bool in_vma = false;
+	size_t kernel_page_kb = 4, rss_kb = 0, thp_kb = 0;
+	while (std::getline(smaps, line)) {
+		uintptr_t start, end;
+		if (sscanf(line.c_str(), "%lx-%lx ", &start, &end) == 2 && line.find(':') > line.find(' ')) {
+			if (in_vma)
+				break;
+			in_vma = target >= start && target < end;
+			continue;
+		}
+		if (!in_vma)
+			continue;
+		sscanf(line.c_str(), "KernelPageSize: %zu kB", &kernel_page_kb);
+		sscanf(line.c_str(), "Rss: %zu kB", &rss_kb);
+		sscanf(line.c_str(), "AnonHugePages: %zu kB", &thp_kb);
+	}
+	if (kernel_page_kb > 4)
+		return kernel_page_kb << 10;
+	if (rss_kb && thp_kb * 2 >= rss_kb)
+		return 2UL << 20;
+	return 4UL << 10;
+}
+
+// Every chased element sits alone in a cache line so each load is a distinct line
+struct alignas(CACHE_LINE_SIZE) ChaseNode {
+	ChaseNode *next;
+};
+
+// Link the lines of buf into one random cycle (Sattolo's algorithm), defeating the prefetchers
+inline ChaseNode *build_chase(ChaseNode *buf, size_t lines, std::mt19937_64 &rng) {
+	std::vector<uint32_t> order(lines);
+	for (size_t i = 0; i < lines; i++)
+		order[i] = i;
+	for (size_t i = lines - 1; i > 0; i--) {
+		std::uniform_int_distribution<size_t> dist(0, i - 1);
+		std::swap(order[i], order[dist(rng)]);
+	}
+	for (size_t i = 0; i < lines; i++)
+		buf[order[i]].next = &buf[order[(i + 1) % lines]];
+	return &buf[order[0]];
+}
+
+struct LatencyStats {
+	double p50 = 0, p90 = 0, p99 = 0, p999 = 0, max = 0;
+};
+
+// Percentiles of a set of samples (sorts the input)
+inline LatencyStats latency_stats(std::vector<double> &samples) {
+	LatencyStats s;
+	if (samples.empty())
+		return s;
+	std::sort(samples.begin(), samples.end());
+	auto pct = [&](double p) { return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))]; };
+	s.p50 = pct(0.50);
+	s.p90 = pct(0.90);
+	s.p99 = pct(0.99);
+	s.p999 = pct(0.999);
+	s.max = samples.back();
+	return s;
+}
+
+#endif // BENCH_UTIL_H
@@ -0,0 +1,244 @@
+#include "bench_util.h"
+#include <random>
+#include <emmintrin.h>
+
+#include <cxxopts.hpp>
+
+#define NUM_LINES 64       // independent lines timed per round
+#define LINE_SPACING 4160  // one page plus one line, so lines land on different pages and sets
+#define NUM_ROUNDS 200
+
+// Coherence state the line is left in on the source cores before the target touches it
+enum class LineState { Modified, Exclusive, Shared, Flushed };
+
+static const char *state_name(LineState s) {
+	switch (s) {
+		case LineState::Modified: return "modified";
+		case LineState::Exclusive: return "exclusive";
+		case LineState::Shared: return "shared";
+		case LineState::Flushed: return "flushed";
+	}
+	return "unknown";
+}
+
+struct Placement {
+	std::string name;
+	int source;
+	int target;
+	std::vector<int> sharers; // candidate extra sharers, same socket as the source, excluding the target
+};
+
+// Time one access of the target to every line, in random order, once the sources prepared them.
+// sharers[0] is the source core; sharers[1..k-1] only read the line in the Shared state.
+static std::vector<double> measure(LineState state, bool write, const std::vector<uint8_t *> &lines,
+		const std::vector<int> &sharers, int target, int rounds) {
+	std::vector<double> samples;
+	size_t participants = sharers.size() + 1;
+	MyBarrier sync_point(participants);
+
+	auto source_thread = [&](size_t rank) {
+		pin_to_core(sharers[rank]);
+		for (int r = 0; r < rounds; r++) {
+			sync_point.arrive_and_wait();
+			if (rank == 0) {
+				// Step 1: the source owns every line
+				for (uint8_t *l : lines) {
+					switch (state) {
+						case LineState::Modified:
+							*(volatile uint64_t *)l = r;
+							break;
+						case LineState::Exclusive:
+						case LineState::Shared:
+						case LineState::Flushed:
+							*(volatile uint64_t *)l = r;
+							_mm_clflush(l);
+							break;
+					}
+				}
+				_mm_mfence();
+			}
+			sync_point.arrive_and_wait();
+			// Step 2: readers pull clean copies (E with one reader, S/F with several)
+			if ((state == LineState::Exclusive && rank == 0) || state == LineState::Shared) {
+				uint64_t sink = 0;
+				for (uint8_t *l : lines)
+					sink += *(volatile uint64_t *)l;
+				asm volatile("" : : "r"(sink));
+			}
+			sync_point.arrive_and_wait();
+			// Step 3: target measures
+			sync_point.arrive_and_wait();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < sharers.size(); i++)
+		threads.emplace_back(source_thread, i);
+
+	pin_to_core(target);
+	double ticks_per_ns = tsc_per_ns();
+	uint64_t overhead = tsc_overhead();
+	std::mt19937 rng(target);
+	std::vector<size_t> order(lines.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	for (int r = 0; r < rounds; r++) {
+		sync_point.arrive_and_wait();
+		sync_point.arrive_and_wait();
+		sync_point.arrive_and_wait();
+		std::shuffle(order.begin(), order.end(), rng);
+		for (size_t idx : order) {
+			volatile uint64_t *p = (volatile uint64_t *)lines[idx];
+			uint64_t t0, t1;
+			if (write) {
+				t0 = tsc_begin();
+				*p = r + 1;
+				_mm_mfence();
+				t1 = tsc_end();
+			} else {
+				t0 = tsc_begin();
+				uint64_t v = *p;
+				t1 = tsc_end();
+				asm volatile("" : : "r"(v));
+			}
+			samples.push_back((double)(t1 - t0 > overhead ? t1 - t0 - overhead : 0) / ticks_per_ns);
+		}
+		sync_point.arrive_and_wait();
+	}
+	for (auto &t : threads)
+		t.join();
+	return samples;
+}
+
+// Source is the first core of cpu node 0; targets cover the same LLC, the same socket and a remote socket
+static std::vector<Placement> find_placements() {
+	std::vector<Placement> out;
+	std::vector<int> all;
+	for (int n : cpu_nodes())
+		for (int c : cores_of_node(n))
+			all.push_back(c);
+	if (all.size() < 2)
+		return out;
+	int source = all[0];
+	int same_llc = -1, same_socket = -1, remote = -1;
+	for (int c : all) {
+		if (c == source)
+			continue;
+		if (cpu_package(c) != cpu_package(source)) {
+			if (remote < 0)
+				remote = c;
+		} else if (cpu_llc(c) == cpu_llc(source)) {
+			if (same_llc < 0)
+				same_llc = c;
+		} else if (same_socket < 0) {
+			same_socket = c;
+		}
+	}
+	auto add = [&](const std::string &name, int target) {
+		if (target < 0)
+			return;
+		Placement p{name, source, target, {}};
+		for (int c : all)
+			if (c != source && c != target && cpu_package(c) == cpu_package(source))
+				p.sharers.push_back(c);
+		out.push_back(p);
+	};
+	add("same_llc", same_llc);
+	add("same_socket", same_socket);
+	add("remote_socket", remote);
+	return out;
+}
+
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("Cache Line State", "Transfer latency of lines held in M/E/S/invalid state by other cores");
+	options.add_options()
+		("m,memory_nodes", "Home nodes of the lines (default: all, CXL included)", cxxopts::value<std::string>()->default_value(""))
+		("k,sharers", "Sharer counts for the shared state", cxxopts::value<std::string>()->default_value("2,4,8,16"))
+		("rounds", "Rounds of NUM_LINES timed accesses", cxxopts::value<int>()->default_value(std::to_string(NUM_ROUNDS)))
+		("r,result", "Result csv file", cxxopts::value<std::string>()->default_value("results/cacheline_state.csv"))
+		("emulate_cxl", "Serve this node id from an emulated CXL pool: node[:latency_ns[:GB/s[:size]]]", cxxopts::value<std::string>())
+		("page_mode", "Buffer pages (default,4k,thp,2m,1g)", cxxopts::value<std::string>()->default_value("default"))
+		("placement", "Buffer placement (bind,preferred,interleave,first_touch)", cxxopts::value<std::string>()->default_value("bind"))
+		("h,help", "Print usage")
+		;
+	auto arguments = options.parse(argc, argv);
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	// Initialize NUMA library
+	if (numa_available() == -1) {
+		std::cerr << "NUMA is not available on this system." << std::endl;
+		return 1;
+	}
+	if (arguments.count("emulate_cxl") && !enable_cxl_emulation(arguments["emulate_cxl"].as<std::string>()))
+		return 1;
+	warn_unshimmed_cxl();
+	if (!set_alloc_policy(arguments["page_mode"].as<std::string>(), arguments["placement"].as<std::string>()))
+		return 1;
+
+	std::vector<int> m_nodes = memory_nodes();
+	if (!arguments["memory_nodes"].as<std::string>().empty()) {
+		m_nodes.clear();
+		for (long n : parse_list(arguments["memory_nodes"].as<std::string>()))
+			m_nodes.push_back(n);
+	}
+	std::vector<long> sharer_counts = parse_list(arguments["sharers"].as<std::string>());
+	int rounds = arguments["rounds"].as<int>();
+
+	std::vector<Placement> placements = find_placements();
+	if (placements.empty()) {
+		std::cerr << "Need at least two cores." << std::endl;
+		return 1;
+	}
+
+	std::ofstream results_file(arguments["result"].as<std::string>());
+	results_file << "state,access,placement,source,target,memory_node,sharers,p50_ns,p90_ns,p99_ns,max_ns,page_size,cxl_shim\n";
+
+	size_t alloc_size = NUM_LINES * LINE_SPACING;
+	for (int memory_node : m_nodes) {
+		uint8_t *memory = static_cast<uint8_t *>(alloc_on_node(alloc_size, memory_node));
+		if (memory == nullptr) {
+			std::cerr << "Failed to allocate memory on NUMA node " << memory_node << std::endl;
+			return 1;
+		}
+		// Every placement's source core writes the lines first
+		touch_by_owners(memory, alloc_size, {{memory, alloc_size, placements[0].source}});
+		size_t page_size = mapping_page_size(memory);
+		std::vector<uint8_t *> lines;
+		for (int i = 0; i < NUM_LINES; i++)
+			lines.push_back(memory + i * LINE_SPACING);
+
+		for (const Placement &p : placements) {
+			for (LineState state : {LineState::Modified, LineState::Exclusive, LineState::Shared, LineState::Flushed}) {
+				std::vector<long> ks = {1};
+				if (state == LineState::Shared)
+					ks = sharer_counts;
+				for (long k : ks) {
+					// A single reader of a clean line gets it Exclusive, so Shared needs two or more
+					if (k < 1 || (size_t)k > p.sharers.size() + 1 || (state == LineState::Shared && k < 2))
+						continue;
+					std::vector<int> sharers = {p.source};
+					sharers.insert(sharers.end(), p.sharers.begin(), p.sharers.begin() + (k - 1));
+					for (bool write : {false, true}) {
+						std::vector<double> samples = measure(state, write, lines, sharers, p.target, rounds);
+						LatencyStats lat = latency_stats(samples);
+						results_file << state_name(state) << "," << (write ? "write" : "read") << "," << p.name << ","
+							<< p.source << "," << p.target << "," << memory_node << "," << k << ","
+							<< lat.p50 << "," << lat.p90 << "," << lat.p99 << "," << lat.max << "," << page_size << "," << cxl_shim(memory_node, false) << "\n";
+						std::cout << state_name(state) << " " << (write ? "write" : "read") << " " << p.name << " ("
+							<< p.source << "->" << p.target << ") home " << memory_node << " pages " << page_size << " sharers " << k
+							<< ": p50 " << lat.p50 << " ns, p99 " << lat.p99 << " ns" << std::endl;
+					}
+				}
+			}
+		}
+		free_on_node(memory, alloc_size);
+	}
+
+	// Close the results file
+	results_file.close();
+
+	return 0;
+}
@@ -0,0 +1,429 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+// Leader/follower runner for benchmarks that stand in for several hosts joined by a fabric.
+// Each host is a process; the leader connects to every follower over TCP ("host:port") or
+// a Unix socket ("unix:/path"), starts each measurement on all hosts together and collects
+// their results. Everything a host sends goes through a link model: a token bucket for
+// bandwidth followed by a delay queue for latency, so one machine can emulate rack-scale
+// links.
+//
+// Besides control messages, followers can reach memory homed on the leader with
+// remote_fetch_add(), a round trip over the modeled link answered by the leader's handler.
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CLUSTER_MAX_SLOTS 1024 // follower threads that may have an RPC outstanding
+#define CLUSTER_CONNECT_TIMEOUT_S 30
+#define LINK_SPIN_US 50
+
+struct LinkModel {
+	double latency_us = 0;      // one-way propagation delay
+	double bandwidth_gbps = 0;  // 0: unlimited
+	size_t burst_bytes = 65536; // token bucket depth
+};
+
+enum class MsgType : uint32_t { Prepare, Ready, Go, Result, Done, Rpc, Reply };
+
+struct Msg {
+	MsgType type;
+	uint32_t slot = 0;  // Rpc/Reply: the follower thread waiting for it
+	int64_t value = 0;  // Prepare: phase parameter; Rpc: argument; Reply: result
+	double result = 0;  // Result
+	char phase[32] = {};
+};
+
+// A connected socket whose sends are shaped by a LinkModel. A sender thread drains the
+// delay queue; receives are plain blocking reads.
+class ModeledLink {
+public:
+	ModeledLink(int fd, const LinkModel &model) : fd_(fd), model_(model), last_refill_(now()) {
+		tokens_ = model_.burst_bytes;
+		sender_ = std::thread([this] { drain(); });
+	}
+	~ModeledLink() {
+		{
+			std::lock_guard<std::mutex> g(mu_);
+			closing_ = true;
+		}
+		cv_.notify_all();
+		sender_.join();
+		close(fd_);
+	}
+
+	void send(const Msg &m) {
+		std::lock_guard<std::mutex> g(mu_);
+		auto t = now();
+		std::chrono::nanoseconds ready = t;
+		if (model_.bandwidth_gbps > 0) {
+			// Bytes per ns == Gbit/s / 8. The bucket may go negative: the message then
+			// leaves once the deficit has refilled.
+			double rate = model_.bandwidth_gbps / 8;
+			tokens_ = std::min<double>(model_.burst_bytes, tokens_ + (t - last_refill_).count() * rate);
+			last_refill_ = t;
+			tokens_ -= sizeof(Msg);
+			if (tokens_ < 0)
+				ready = t + std::chrono::nanoseconds((long)(-tokens_ / rate));
+		}
+		auto deliver = ready + std::chrono::nanoseconds((long)(model_.latency_us * 1000));
+		if (!queue_.empty() && deliver < queue_.back().first)
+			deliver = queue_.back().first; // a link does not reorder
+		queue_.emplace_back(deliver, m);
+		cv_.notify_one();
+	}
+
+	bool recv(Msg &m) {
+		char *p = reinterpret_cast<char *>(&m);
+		for (size_t got = 0; got < sizeof(m);) {
+			ssize_t n = read(fd_, p + got, sizeof(m) - got);
+			if (n <= 0)
+				return false;
+			got += n;
+		}
+		return true;
+	}
+
+	// Stop further reads, e.g. to unblock a receiver thread
+	void shutdown_reads() {
+		::shutdown(fd_, SHUT_RD);
+	}
+
+	const LinkModel &model() const {
+		return model_;
+	}
+
+private:
+	static std::chrono::nanoseconds now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch());
+	}
+
+	void drain() {
+		std::unique_lock<std::mutex> lk(mu_);
+		while (true) {
+			cv_.wait(lk, [this] { return closing_ || !queue_.empty(); });
+			if (queue_.empty())
+				return;
+			auto deliver = queue_.front().first;
+			auto wait = deliver - now();
+			if (wait > std::chrono::nanoseconds(0)) {
+				// Condition variable wakeups are tens of us late: sleep for long delays and
+				// spin out the rest, so microsecond links stay accurate
+				if (wait > std::chrono::microseconds(LINK_SPIN_US)) {
+					cv_.wait_for(lk, wait - std::chrono::microseconds(LINK_SPIN_US));
+				} else {
+					lk.unlock();
+					while (now() < deliver)
+						;
+					lk.lock();
+				}
+				continue;
+			}
+			Msg m = queue_.front().second;
+			queue_.pop_front();
+			lk.unlock();
+			const char *p = reinterpret_cast<const char *>(&m);
+			for (size_t sent = 0; sent < sizeof(m);) {
+				ssize_t n = write(fd_, p + sent, sizeof(m) - sent);
+				if (n <= 0)
+					break;
+				sent += n;
+			}
+			lk.lock();
+		}
+	}
+
+	int fd_;
+	LinkModel model_;
+	std::mutex mu_;
+	std::condition_variable cv_;
+	std::deque<std::pair<std::chrono::nanoseconds, Msg>> queue_;
+	double tokens_;
+	std::chrono::nanoseconds last_refill_;
+	bool closing_ = false;
+	std::thread sender_;
+};
+
+// "unix:/path" or "host:port"
+inline int cluster_socket(const std::string &addr, bool listening) {
+	if (addr.rfind("unix:", 0) == 0) {
+		sockaddr_un sa = {};
+		sa.sun_family = AF_UNIX;
+		strncpy(sa.sun_path, addr.c_str() + 5, sizeof(sa.sun_path) - 1);
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listening) {
+			unlink(sa.sun_path);
+			if (bind(fd, (sockaddr *)&sa, sizeof(sa)) != 0 || listen(fd, 1) != 0) {
+				close(fd);
+				return -1;
+			}
+		} else if (connect(fd, (sockaddr *)&sa, sizeof(sa)) != 0) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+	size_t colon = addr.rfind(':');
+	if (colon == std::string::npos)
+		return -1;
+	std::string host = addr.substr(0, colon), port = addr.substr(colon + 1);
+	addrinfo hints = {}, *res = nullptr;
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = listening ? AI_PASSIVE : 0;
+	if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res) != 0)
+		return -1;
+	int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	bool ok;
+	if (listening) {
+		int one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		ok = bind(fd, res->ai_addr, res->ai_addrlen) == 0 && listen(fd, 1) == 0;
+	} else {
+		ok = connect(fd, res->ai_addr, res->ai_addrlen) == 0;
+	}
+	freeaddrinfo(res);
+	if (!ok) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Blocking queue of control messages, filled by a link's receiver thread
+class MsgQueue {
+public:
+	void push(const Msg &m) {
+		{
+			std::lock_guard<std::mutex> g(mu_);
+			q_.push_back(m);
+		}
+		cv_.notify_one();
+	}
+	// Returns false if the link closed before a message arrived
+	bool pop(Msg &m) {
+		std::unique_lock<std::mutex> lk(mu_);
+		cv_.wait(lk, [this] { return closed_ || !q_.empty(); });
+		if (q_.empty())
+			return false;
+		m = q_.front();
+		q_.pop_front();
+		return true;
+	}
+	void close() {
+		{
+			std::lock_guard<std::mutex> g(mu_);
+			closed_ = true;
+		}
+		cv_.notify_all();
+	}
+
+private:
+	std::mutex mu_;
+	std::condition_variable cv_;
+	std::deque<Msg> q_;
+	bool closed_ = false;
+};
+
+// The function a host runs for one measurement: param is the phase parameter (e.g. a
+// thread count), and start() must be called once the host is ready, just before timing;
+// it returns when every host may begin. Returns the host's result.
+using PhaseFn = std::function<double(const std::string &phase, long param, const std::function<void()> &start)>;
+
+class Cluster {
+public:
+	// Leader of the given followers
+	static std::unique_ptr<Cluster> lead(const std::vector<std::string> &followers, const LinkModel &model) {
+		std::unique_ptr<Cluster> c(new Cluster(true));
+		for (const std::string &addr : followers) {
+			int fd = -1;
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(CLUSTER_CONNECT_TIMEOUT_S);
+			while ((fd = cluster_socket(addr, false)) < 0 && std::chrono::steady_clock::now() < deadline)
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			if (fd < 0) {
+				std::cerr << "Cannot reach follower " << addr << std::endl;
+				return nullptr;
+			}
+			c->add_peer(fd, model);
+		}
+		return c;
+	}
+
+	// Follower waiting for its leader on addr
+	static std::unique_ptr<Cluster> follow(const std::string &addr, const LinkModel &model) {
+		int lfd = cluster_socket(addr, true);
+		if (lfd < 0) {
+			std::cerr << "Cannot listen on " << addr << ": " << strerror(errno) << std::endl;
+			return nullptr;
+		}
+		int fd = accept(lfd, nullptr, nullptr);
+		close(lfd);
+		if (fd < 0)
+			return nullptr;
+		std::unique_ptr<Cluster> c(new Cluster(false));
+		c->add_peer(fd, model);
+		return c;
+	}
+
+	~Cluster() {
+		if (leader_) {
+			Msg done{MsgType::Done};
+			for (auto &p : peers_)
+				p->link->send(done);
+		}
+		for (auto &p : peers_) {
+			// The leader waits for followers to hang up; a follower only gets here after Done
+			if (!leader_)
+				p->link->shutdown_reads();
+			p->receiver.join();
+		}
+	}
+
+	bool is_leader() const {
+		return leader_;
+	}
+	size_t hosts() const {
+		return leader_ ? peers_.size() + 1 : 0;
+	}
+
+	// Leader: called on every Rpc from a follower, with its argument; the return value is
+	// sent back. Set before the first run().
+	void set_rpc_handler(std::function<int64_t(int64_t)> handler) {
+		rpc_handler_ = std::move(handler);
+	}
+
+	// Leader: run one phase on all hosts at once. Returns each host's result, leader first.
+	std::vector<double> run(const std::string &phase, long param, const PhaseFn &fn) {
+		Msg prepare{MsgType::Prepare};
+		prepare.value = param;
+		strncpy(prepare.phase, phase.c_str(), sizeof(prepare.phase) - 1);
+		for (auto &p : peers_)
+			p->link->send(prepare);
+		auto start = [this] {
+			Msg m;
+			for (auto &p : peers_)
+				if (!p->control.pop(m) || m.type != MsgType::Ready)
+					std::cerr << "Follower lost before starting" << std::endl;
+			Msg go{MsgType::Go};
+			for (auto &p : peers_)
+				p->link->send(go);
+			// Begin when Go reaches the followers
+			if (!peers_.empty())
+				std::this_thread::sleep_for(std::chrono::nanoseconds((long)(peers_[0]->link->model().latency_us * 1000)));
+		};
+		std::vector<double> results{fn(phase, param, start)};
+		for (auto &p : peers_) {
+			Msg m;
+			results.push_back(p->control.pop(m) && m.type == MsgType::Result ? m.result : 0);
+		}
+		return results;
+	}
+
+	// Follower: run phases as the leader asks until it is done
+	void serve(const PhaseFn &fn) {
+		Peer &leader = *peers_[0];
+		Msg m;
+		while (leader.control.pop(m) && m.type == MsgType::Prepare) {
+			auto start = [&leader] {
+				leader.link->send(Msg{MsgType::Ready});
+				Msg go;
+				leader.control.pop(go);
+			};
+			Msg result{MsgType::Result};
+			result.result = fn(m.phase, m.value, start);
+			leader.link->send(result);
+		}
+	}
+
+	// Follower: apply the leader's handler to arg, remotely. Each slot (one per calling
+	// thread) may have one call outstanding.
+	int64_t remote_fetch_add(uint32_t slot, int64_t arg) {
+		Reply &r = replies_[slot % CLUSTER_MAX_SLOTS];
+		uint64_t seq = r.seq.load(std::memory_order_acquire);
+		Msg m{MsgType::Rpc};
+		m.slot = slot % CLUSTER_MAX_SLOTS;
+		m.value = arg;
+		peers_[0]->link->send(m);
+		r.seq.wait(seq, std::memory_order_acquire);
+		return r.value;
+	}
+
+private:
+	struct Peer {
+		std::unique_ptr<ModeledLink> link;
+		MsgQueue control;
+		std::thread receiver;
+	};
+	struct Reply {
+		std::atomic<uint64_t> seq{0};
+		int64_t value = 0;
+	};
+
+	explicit Cluster(bool leader) : leader_(leader), replies_(leader ? 0 : CLUSTER_MAX_SLOTS) {}
+
+	void add_peer(int fd, const LinkModel &model) {
+		// Small messages must not wait for Nagle; the link model does the delaying (fails
+		// harmlessly on Unix sockets)
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		peers_.emplace_back(new Peer);
+		Peer *p = peers_.back().get();
+		p->link.reset(new ModeledLink(fd, model));
+		p->receiver = std::thread([this, p] { receive(*p); });
+	}
+
+	void receive(Peer &p) {
+		Msg m;
+		while (p.link->recv(m)) {
+			if (m.type == MsgType::Rpc) {
+				Msg reply{MsgType::Reply};
+				reply.slot = m.slot;
+				reply.value = rpc_handler_ ? rpc_handler_(m.value) : 0;
+				p.link->send(reply);
+			} else if (m.type == MsgType::Reply) {
+				Reply &r = replies_[m.slot];
+				r.value = m.value;
+				r.seq.fetch_add(1, std::memory_order_release);
+				r.seq.notify_one();
+			} else {
+				p.control.push(m);
+			}
+		}
+		p.control.close();
+	}
+
+	bool leader_;
+	std::vector<std::unique_ptr<Peer>> peers_;
+	std::vector<Reply> replies_;
+	std::function<int64_t(int64_t)> rpc_handler_;
+};
+
+// Comma-separated follower addresses
+inline std::vector<std::string> cluster_addresses(const std::string &spec) {
+	std::vector<std::string> out;
+	std::stringstream ss(spec);
+	for (std::string tok; std::getline(ss, tok, ',');)
+		if (!tok.empty())
+			out.push_back(tok);
+	return out;
+}
+
+#endif // CLUSTER_H
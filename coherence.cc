@@ -14,12 +14,15 @@
 
 #include <cxxopts.hpp> 
 
+#include "cluster.h"
+
 #define NUM_TRIALS 10
 #define RUN_TIME 1
 
 using MyBarrier = std::barrier<>;
 int global_var_;
 std::atomic<int> atomic_var_(0);
+Cluster* cluster_ = nullptr; // set when running as one of several hosts
 
 size_t local_increment(int core_num, MyBarrier& sync_point){
 	cpu_set_t cpuset;
@@ -95,6 +98,15 @@ size_t global_atomic(int core_num, MyBarrier& sync_point){
 	auto end_time = start_time + std::chrono::seconds(RUN_TIME); 
 
 	size_t count = 0;
+	// On a follower the shared variable lives on the leader's host: every update is a
+	// round trip over the modeled link
+	if (cluster_ && !cluster_->is_leader()) {
+		while (std::chrono::steady_clock::now() < end_time) {
+			cluster_->remote_fetch_add(core_num, 1);
+			count++;
+		}
+		return count;
+	}
 	while (std::chrono::steady_clock::now() < end_time) {
 		atomic_var_.fetch_add(1);
 		count++;
@@ -125,17 +137,70 @@ size_t local_atomic(int core_num, MyBarrier& sync_point){
 	return count;
 }
 
+// One trial of one phase on this host: num_threads threads from core_offset on
+double run_trial(const std::string& phase, long num_threads, const std::function<void()>& start, int core_offset){
+	std::vector<std::future<size_t>> futs;
+	MyBarrier sync_point(num_threads + 1);
+	for(int i = 0; i < num_threads; i++){
+		futs.push_back(std::async(std::launch::async, phase == "local" ? local_atomic : global_atomic, i + core_offset, std::ref(sync_point)));
+	}
+	start();
+	sync_point.arrive_and_wait();
+	double num_ops = 0;
+	for(auto &f:futs){
+		num_ops += f.get();
+	}
+	return num_ops;
+}
+
 int main(int argc, char* argv[]) {
 	cxxopts::Options options("Coherence Test", "Tests to see the effects of cache coherence");
 	options.add_options()
 		("f,false", "False Sharing")
 		("i,interleave", "Distribute threads")
 		("follower", "Follower Address and Port", cxxopts::value<std::string>())
+		("followers", "Lead these followers (comma-separated host:port or unix:/path)", cxxopts::value<std::string>())
+		("link_latency_us", "One-way latency of the modeled inter-host link", cxxopts::value<double>()->default_value("2"))
+		("link_gbps", "Bandwidth of the modeled inter-host link, 0 for unlimited", cxxopts::value<double>()->default_value("100"))
+		("core_offset", "First core used by this host's threads", cxxopts::value<int>()->default_value("0"))
 		("m,memory_node", "Target Memory Node", cxxopts::value<int>()->default_value("0"))
 		("r,record_result", "Store Results as csv", cxxopts::value<int>()->default_value("0"))
 		;
 	auto arguments = options.parse(argc, argv);
 
+	LinkModel link;
+	link.latency_us = arguments["link_latency_us"].as<double>();
+	link.bandwidth_gbps = arguments["link_gbps"].as<double>();
+	int core_offset = arguments["core_offset"].as<int>();
+	auto trial_fn = [core_offset](const std::string& phase, long num_threads, const std::function<void()>& start) {
+		return run_trial(phase, num_threads, start, core_offset);
+	};
+
+	// A follower runs whatever the leader asks for and reports back; the leader records
+	std::unique_ptr<Cluster> cluster;
+	if(arguments.count("follower")){
+		cluster = Cluster::follow(arguments["follower"].as<std::string>(), link);
+		if(!cluster)
+			return 1;
+		cluster_ = cluster.get();
+		cluster->serve(trial_fn);
+		return 0;
+	}
+	if(arguments.count("followers")){
+		cluster = Cluster::lead(cluster_addresses(arguments["followers"].as<std::string>()), link);
+		if(!cluster)
+			return 1;
+		cluster_ = cluster.get();
+		cluster->set_rpc_handler([](int64_t v) { return (int64_t)atomic_var_.fetch_add(v); });
+	}
+	// Ops summed over every host
+	auto run_all = [&](const std::string& phase, long num_threads) {
+		if(!cluster)
+			return trial_fn(phase, num_threads, []{});
+		std::vector<double> per_host = cluster->run(phase, num_threads, trial_fn);
+		return std::accumulate(per_host.begin(), per_host.end(), 0.0);
+	};
+
 	// Open a file to store the results
 	std::string filename = "results/coherence_atomic.csv";
 	std::ofstream results_file(filename);
@@ -144,49 +209,21 @@ int main(int argc, char* argv[]) {
 
 	size_t num_cores = std::thread::hardware_concurrency()/4;
 	num_cores = 256;
-	int coreNumAdd = 128;
 	for(int num_threads = 1; num_threads <= num_cores; num_threads++){
 		double local_avg_ops = 0;
 		for(int trial = 0; trial < NUM_TRIALS; trial++){
-			double num_ops = 0;
-			std::vector<std::future<size_t>> futs;
-			MyBarrier sync_point(num_threads);
-			for(int i = 0; i < num_threads; i++){
-			/*
-			  if(i%2)
-				  futs.push_back(std::async(std::launch::async, local_increment, i + coreNumAdd, std::ref(sync_point)));
-				else
-				  futs.push_back(std::async(std::launch::async, local_increment, i, std::ref(sync_point)));
-					*/
-				futs.push_back(std::async(std::launch::async, local_atomic, i, std::ref(sync_point)));
-			}
-			for(auto &f:futs){
-				num_ops += f.get();
-			}
-			local_avg_ops += num_ops;
+			local_avg_ops += run_all("local", num_threads);
 		}
 		local_avg_ops = local_avg_ops/(double)NUM_TRIALS;
 		double global_avg_ops = 0;
 		for(int trial = 0; trial < NUM_TRIALS; trial++){
-			double num_ops = 0;
-			std::vector<std::future<size_t>> futs;
-			MyBarrier sync_point(num_threads);
-			for(int i = 0; i < num_threads; i++){
-			/*
-				if(i%2)
-				  futs.push_back(std::async(std::launch::async, global_increment, i + coreNumAdd, std::ref(sync_point)));
-				else
-				  futs.push_back(std::async(std::launch::async, global_increment, i, std::ref(sync_point)));
-					*/
-				futs.push_back(std::async(std::launch::async, global_atomic, i, std::ref(sync_point)));
-			}
-			for(auto &f:futs){
-				num_ops += f.get();
-			}
-			global_avg_ops += num_ops;
+			global_avg_ops += run_all("global", num_threads);
 		}
 		global_avg_ops = global_avg_ops/(double)NUM_TRIALS;
-		std::cout << "Threads: " << num_threads << ", Global Ops: " << global_avg_ops << " local:" << local_avg_ops << " = " << local_avg_ops / global_avg_ops <<std::endl;
+		std::cout << "Threads: " << num_threads << ", Global Ops: " << global_avg_ops << " local:" << local_avg_ops << " = " << local_avg_ops / global_avg_ops;
+		if(cluster)
+			std::cout << " (" << cluster->hosts() << " hosts)";
+		std::cout << std::endl;
 		if(arguments["record_result"].as<int>())
 			results_file << num_threads << "," << global_avg_ops << "," << local_avg_ops << "," << local_avg_ops / global_avg_ops << "\n";
 	}
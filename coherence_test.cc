@@ -13,11 +13,14 @@
 
 #include <cxxopts.hpp> 
 
+#include "cluster.h"
+
 #define NUM_TRIALS 10
 #define RUN_TIME 3
 
 using MyBarrier = std::barrier<>;
 int global_var_;
+Cluster* cluster_ = nullptr; // set when running as one of several hosts
 
 double calculateVariance(const std::vector<size_t>& values) {
     if (values.empty()) {
@@ -105,6 +108,15 @@ size_t global_increment(int core_num, MyBarrier& sync_point){
 	auto end_time = start_time + std::chrono::seconds(RUN_TIME); 
 
 	size_t count = 0;
+	// On a follower the shared variable lives on the leader's host: every update is a
+	// round trip over the modeled link
+	if (cluster_ && !cluster_->is_leader()) {
+		while (std::chrono::steady_clock::now() < end_time) {
+			cluster_->remote_fetch_add(core_num, 1);
+			count++;
+		}
+		return count;
+	}
 	while (std::chrono::steady_clock::now() < end_time) {
 		asm volatile(
 					"movl %0, %%eax\n"    
@@ -120,110 +132,126 @@ size_t global_increment(int core_num, MyBarrier& sync_point){
 	return count;
 }
 
+int num_rows = 11;
+int c[11][8] = {
+ {8,9,10,11,120,121,122,123}, //next soft numa ailgned
+ {8,9,10,11,124,125,126,127}, //next soft numa ailgned
+ {8,9,10,11,12,13,14,15}, //Same soft numa
+ {8,9,10,11,16,17,18,19}, //Next soft numa unaligned
+ {8,9,10,11,20,21,22,23}, //next soft numa ailgned
+ {8,9,10,11,128,129,130,131}, // Hard NUMA
+ {8,9,10,11,132,133,134,135}, // Hard NUMA
+ {8,16,24,32,40,48,56,64}, //All differente soft numa
+ {8,17,26,35,44,53,62,71},
+ {8,16,24,32,128,136,144,152},
+ {8,17,26,35,132,141,150,159}};
+ /*
+int num_rows = 8;
+int c[8][8] = {
+ {8,9,10,11,12,13,14,15}, //1 soft numa
+ {8,9,10,11,16,17,18,19}, //2
+ {8,9,10,16,17,18,24,25}, //3
+ {8,9,16,17,24,25,32,33}, //4
+ {8,16,17,24,25,32,33,40}, //5
+ {8,16,24,25,32,33,40,48}, //6
+ {8,16,24,32,33,40,48,56}, //7
+ {8,16,24,32,40,48,56,64} //8
+ };
+ */
+int coreNumAdd = 0;
+
+// One trial of one phase on this host, on row i of the core table shifted by core_offset
+double run_trial(const std::string& phase, long i, const std::function<void()>& start, int core_offset){
+	std::vector<std::future<size_t>> futs;
+	MyBarrier sync_point(8 + 1);
+	if(phase == "local"){
+		for(int k = 0; k < 4; k++)
+			futs.push_back(std::async(std::launch::async, local_increment, c[i][k] + core_offset, std::ref(sync_point)));
+		for(int k = 4; k < 8; k++)
+			futs.push_back(std::async(std::launch::async, local_increment, c[i][k] + coreNumAdd + core_offset, std::ref(sync_point)));
+	} else {
+		for(int k = 0; k < 8; k++)
+			futs.push_back(std::async(std::launch::async, global_increment, c[i][k] + coreNumAdd + core_offset, std::ref(sync_point)));
+	}
+	start();
+	sync_point.arrive_and_wait();
+	double num_ops = 0;
+	for(auto &f:futs){
+		num_ops += f.get();
+	}
+	return num_ops;
+}
+
 int main(int argc, char* argv[]) {
 	cxxopts::Options options("Coherence Test", "Tests to see the effects of cache coherence");
 	options.add_options()
 		("f,false", "False Sharing")
 		("i,interleave", "Distribute threads")
 		("follower", "Follower Address and Port", cxxopts::value<std::string>())
+		("followers", "Lead these followers (comma-separated host:port or unix:/path)", cxxopts::value<std::string>())
+		("link_latency_us", "One-way latency of the modeled inter-host link", cxxopts::value<double>()->default_value("2"))
+		("link_gbps", "Bandwidth of the modeled inter-host link, 0 for unlimited", cxxopts::value<double>()->default_value("100"))
+		("core_offset", "Added to every core of this host's threads", cxxopts::value<int>()->default_value("0"))
 		("m,memory_node", "Target Memory Node", cxxopts::value<int>()->default_value("0"))
 		("r,record_result", "Store Results as csv", cxxopts::value<int>()->default_value("0"))
 		;
 	auto arguments = options.parse(argc, argv);
 
+	LinkModel link;
+	link.latency_us = arguments["link_latency_us"].as<double>();
+	link.bandwidth_gbps = arguments["link_gbps"].as<double>();
+	int core_offset = arguments["core_offset"].as<int>();
+	auto trial_fn = [core_offset](const std::string& phase, long row, const std::function<void()>& start) {
+		return run_trial(phase, row, start, core_offset);
+	};
+
+	// A follower runs whatever the leader asks for and reports back; the leader records
+	std::unique_ptr<Cluster> cluster;
+	if(arguments.count("follower")){
+		cluster = Cluster::follow(arguments["follower"].as<std::string>(), link);
+		if(!cluster)
+			return 1;
+		cluster_ = cluster.get();
+		cluster->serve(trial_fn);
+		return 0;
+	}
+	if(arguments.count("followers")){
+		cluster = Cluster::lead(cluster_addresses(arguments["followers"].as<std::string>()), link);
+		if(!cluster)
+			return 1;
+		cluster_ = cluster.get();
+		cluster->set_rpc_handler([](int64_t v) { return (int64_t)__atomic_fetch_add(&global_var_, v, __ATOMIC_RELAXED); });
+	}
+	// Ops summed over every host
+	auto run_all = [&](const std::string& phase, long row) {
+		if(!cluster)
+			return trial_fn(phase, row, []{});
+		std::vector<double> per_host = cluster->run(phase, row, trial_fn);
+		return std::accumulate(per_host.begin(), per_host.end(), 0.0);
+	};
+
 	// Open a file to store the results
 	std::string filename = "results/softnuma.csv";
 	std::ofstream results_file(filename);
 	if(arguments["record_result"].as<int>())
 		results_file << "coreNumAdd,local,local_var,global,global_var,diff\n";
 
-	int num_rows = 11;
-	int c[11][8] = {
-	 {8,9,10,11,120,121,122,123}, //next soft numa ailgned
-	 {8,9,10,11,124,125,126,127}, //next soft numa ailgned
-	 {8,9,10,11,12,13,14,15}, //Same soft numa
-	 {8,9,10,11,16,17,18,19}, //Next soft numa unaligned
-	 {8,9,10,11,20,21,22,23}, //next soft numa ailgned
-	 {8,9,10,11,128,129,130,131}, // Hard NUMA
-	 {8,9,10,11,132,133,134,135}, // Hard NUMA
-	 {8,16,24,32,40,48,56,64}, //All differente soft numa
-	 {8,17,26,35,44,53,62,71},
-	 {8,16,24,32,128,136,144,152},
-	 {8,17,26,35,132,141,150,159}};
-	 /*
-	int num_rows = 8;
-	int c[8][8] = {
-	 {8,9,10,11,12,13,14,15}, //1 soft numa
-	 {8,9,10,11,16,17,18,19}, //2
-	 {8,9,10,16,17,18,24,25}, //3
-	 {8,9,16,17,24,25,32,33}, //4
-	 {8,16,17,24,25,32,33,40}, //5
-	 {8,16,24,25,32,33,40,48}, //6
-	 {8,16,24,32,33,40,48,56}, //7
-	 {8,16,24,32,40,48,56,64} //8
-	 };
-	 */
 	size_t num_cores = std::thread::hardware_concurrency()/4;
 	num_cores = 1;
-	int coreNumAdd = 0;
 	std::vector<size_t> local_v;
 	std::vector<size_t> global_v;
 	for(int i=0; i<num_rows; i++){
 	for(int num_threads = 1; num_threads <= num_cores; num_threads++){
 		double local_avg_ops = 0;
 		for(int trial = 0; trial < NUM_TRIALS; trial++){
-			double num_ops = 0;
-			std::vector<std::future<size_t>> futs;
-			MyBarrier sync_point(num_threads);
-			/*
-			for(int i = 0; i < num_threads; i++){
-			  if(i%2)
-				  futs.push_back(std::async(std::launch::async, local_increment, i*2 + coreNumAdd, std::ref(sync_point)));
-				else
-				  futs.push_back(std::async(std::launch::async, local_increment, i*2, std::ref(sync_point)));
-				futs.push_back(std::async(std::launch::async, local_increment, i*2, std::ref(sync_point)));
-			}
-					*/
-			futs.push_back(std::async(std::launch::async, local_increment, c[i][0], std::ref(sync_point)));
-			futs.push_back(std::async(std::launch::async, local_increment, c[i][1], std::ref(sync_point)));
-			futs.push_back(std::async(std::launch::async, local_increment, c[i][2], std::ref(sync_point)));
-			futs.push_back(std::async(std::launch::async, local_increment, c[i][3], std::ref(sync_point)));
-			futs.push_back(std::async(std::launch::async, local_increment, c[i][4] + coreNumAdd, std::ref(sync_point)));
-			futs.push_back(std::async(std::launch::async, local_increment, c[i][5] + coreNumAdd, std::ref(sync_point)));
-			futs.push_back(std::async(std::launch::async, local_increment, c[i][6] + coreNumAdd, std::ref(sync_point)));
-			futs.push_back(std::async(std::launch::async, local_increment, c[i][7] + coreNumAdd, std::ref(sync_point)));
-			for(auto &f:futs){
-				num_ops += f.get();
-			}
+			double num_ops = run_all("local", i);
 			local_v.push_back(num_ops);
 			local_avg_ops += num_ops;
 		}
 		local_avg_ops = local_avg_ops/(double)NUM_TRIALS;
 		double global_avg_ops = 0;
 		for(int trial = 0; trial < NUM_TRIALS; trial++){
-			double num_ops = 0;
-			std::vector<std::future<size_t>> futs;
-			MyBarrier sync_point(num_threads);
-			/*
-			for(int i = 0; i < num_threads; i++){
-				if(i%2)
-				  futs.push_back(std::async(std::launch::async, global_increment, i*2 + coreNumAdd, std::ref(sync_point)));
-				else
-				  futs.push_back(std::async(std::launch::async, global_increment, i*2, std::ref(sync_point)));
-				futs.push_back(std::async(std::launch::async, global_increment, i*2, std::ref(sync_point)));
-			}
-					*/
-			futs.push_back(std::async(std::launch::async, global_increment, c[i][0] + coreNumAdd, std::ref(sync_point)));
-			futs.push_back(std::async(std::launch::async, global_increment, c[i][1] + coreNumAdd, std::ref(sync_point)));
-			futs.push_back(std::async(std::launch::async, global_increment, c[i][2] + coreNumAdd, std::ref(sync_point)));
-			futs.push_back(std::async(std::launch::async, global_increment, c[i][3] + coreNumAdd, std::ref(sync_point)));
-			futs.push_back(std::async(std::launch::async, global_increment, c[i][4] + coreNumAdd, std::ref(sync_point)));
-			futs.push_back(std::async(std::launch::async, global_increment, c[i][5] + coreNumAdd, std::ref(sync_point)));
-			futs.push_back(std::async(std::launch::async, global_increment, c[i][6] + coreNumAdd, std::ref(sync_point)));
-			futs.push_back(std::async(std::launch::async, global_increment, c[i][7] + coreNumAdd, std::ref(sync_point)));
-			for(auto &f:futs){
-				num_ops += f.get();
-			}
+			double num_ops = run_all("global", i);
 			global_v.push_back(num_ops);
 			global_avg_ops += num_ops;
 		}
@@ -1,186 +1,176 @@
-#include <numa.h>
-#include <numaif.h>
-#include <iostream>
-#include <thread>
-#include <vector>
-#include <cstring>
-#include <sched.h>
-#include <chrono>
-#include <fstream>
-#include <numeric>
+#include "bench_util.h"
 #include <atomic>
-#include <barrier>
 #include <future>
 #include <emmintrin.h>
-#include <unistd.h>
 
-#include <cxxopts.hpp> 
+#include <cxxopts.hpp>
 
 #define NUM_TRIALS 5
-#define NUM_ITERATIONS 10000000
-#define RUN_TIME 3
-
-using MyBarrier = std::barrier<>;
-
-size_t writer(int64_t *memory, size_t idx, int core_num, MyBarrier& sync_point){
-	cpu_set_t cpuset;
-	CPU_ZERO(&cpuset);
-	CPU_SET(core_num, &cpuset);
-	if(sched_setaffinity(0, sizeof(cpuset), &cpuset) != 0){
-		std::cerr << "Error setting thread affinity: " << strerror(errno) << std::endl;
+#define RUN_TIME_MS 1000
+#define PADDED_STRIDE 4096 // baseline layout: every writer on its own page
+#define GROUP_STRIDE 256   // distance between writer groups in the writers-per-line sweep
+
+// Each writer increments its own slot in shared memory; the op count is kept in a
+// thread-private register, never read back from the (possibly falsely shared) slot.
+size_t writer(int64_t *slot, int core_num, MyBarrier& sync_point, std::atomic<bool>& stop){
+	if(!pin_to_core(core_num))
 		return 0;
-	}
+	volatile int64_t *var = slot;
+	size_t count = 0;
 
 	sync_point.arrive_and_wait();
-	auto start_time = std::chrono::steady_clock::now();
-	auto end_time = start_time + std::chrono::seconds(RUN_TIME); 
-
-	while (std::chrono::steady_clock::now() < end_time) {
-		memory[idx]++;
+	while (!stop.load(std::memory_order_relaxed)) {
+		for (int i = 0; i < 64; i++)
+			*var = *var + 1;
+		count += 64;
 	}
-	return (size_t)memory[idx];
-	/*
-	for(int i=0; i<NUM_ITERATIONS; i++){
-		memory[idx]++;
+	return count;
+}
+
+// Total ops per second of num_threads writers, writer i at byte offset offsets[i]
+static double run_layout(uint8_t *memory, const std::vector<size_t> &offsets, const std::vector<int> &cores, int duration_ms, int num_trials) {
+	size_t num_threads = offsets.size();
+	double total_ops = 0;
+	for (int trial = 0; trial < num_trials; trial++) {
+		alignas(CACHE_LINE_SIZE) std::atomic<bool> stop(false);
+		std::vector<std::future<size_t>> futs;
+		MyBarrier sync_point(num_threads + 1);
+		for (size_t i = 0; i < num_threads; i++)
+			futs.push_back(std::async(std::launch::async, writer, (int64_t *)(memory + offsets[i]), cores[i], std::ref(sync_point), std::ref(stop)));
+		sync_point.arrive_and_wait();
+		std::this_thread::sleep_for(std::chrono::milliseconds(duration_ms));
+		stop.store(true);
+		for (auto &f : futs)
+			total_ops += f.get();
 	}
-	*/
+	return total_ops / num_trials / (duration_ms / 1000.0);
 }
 
 int main(int argc, char* argv[]) {
-	cxxopts::Options options("Coherence Test", "Tests to see the effects of cache coherence");
+	cxxopts::Options options("False Sharing", "False-sharing stride and writers-per-line sweep");
 	options.add_options()
-		("f,false", "False Sharing")
-		("i,interleave", "Distribute threads")
-		("follower", "Follower Address and Port", cxxopts::value<std::string>())
-		("m,memory_node", "Target Memory Node", cxxopts::value<int>()->default_value("0"))
+		("t,threads", "Number of writer threads", cxxopts::value<int>()->default_value("8"))
+		("c,cpu_nodes", "CPU nodes the writers are spread over round-robin (default: all)", cxxopts::value<std::string>()->default_value(""))
+		("m,memory_nodes", "Target memory nodes, local, remote and CXL (default: all)", cxxopts::value<std::string>()->default_value(""))
+		("s,strides", "Byte strides between consecutive writers", cxxopts::value<std::string>()->default_value("8,16,32,64,128,256,512,1024,2048,4096"))
+		("w,writers_per_line", "Writers sharing one line in the writers-per-line sweep", cxxopts::value<std::string>()->default_value("1,2,4,8"))
+		("d,duration", "Run time per trial in ms", cxxopts::value<int>()->default_value(std::to_string(RUN_TIME_MS)))
+		("trials", "Number of trials", cxxopts::value<int>()->default_value(std::to_string(NUM_TRIALS)))
+		("r,result", "Result csv file", cxxopts::value<std::string>()->default_value("results/false_sharing_sweep.csv"))
+		("emulate_cxl", "Serve this node id from an emulated CXL pool: node[:latency_ns[:GB/s[:size]]]", cxxopts::value<std::string>())
+		("page_mode", "Buffer pages (default,4k,thp,2m,1g)", cxxopts::value<std::string>()->default_value("default"))
+		("placement", "Buffer placement (bind,preferred,interleave,first_touch)", cxxopts::value<std::string>()->default_value("bind"))
+		("h,help", "Print usage")
 		;
 	auto arguments = options.parse(argc, argv);
-
-	int MEMORY_NODE = arguments["memory_node"].as<int>();
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
 
 	// Initialize NUMA library
 	if (numa_available() == -1) {
 		std::cerr << "NUMA is not available on this system." << std::endl;
 		return 1;
 	}
-
-	// Allocate SIZE memory
-	unsigned int num_cores = std::thread::hardware_concurrency();
-	long cacheLineSize = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
-	int64_t* false_sharing_memory = static_cast<int64_t*>(numa_alloc_onnode(num_cores * sizeof(int64_t), MEMORY_NODE));
-	int64_t* memory = static_cast<int64_t*>(numa_alloc_onnode(num_cores * cacheLineSize * sizeof(int64_t), MEMORY_NODE));
-	if (memory == nullptr || false_sharing_memory == nullptr) {
-		std::cerr << "Failed to allocate memory on NUMA node " << MEMORY_NODE << std::endl;
+	if (arguments.count("emulate_cxl") && !enable_cxl_emulation(arguments["emulate_cxl"].as<std::string>()))
+		return 1;
+	warn_unshimmed_cxl();
+	if (!set_alloc_policy(arguments["page_mode"].as<std::string>(), arguments["placement"].as<std::string>()))
 		return 1;
+
+	size_t num_threads = arguments["threads"].as<int>();
+	int duration_ms = arguments["duration"].as<int>();
+	int num_trials = arguments["trials"].as<int>();
+	std::vector<int> c_nodes = cpu_nodes(), m_nodes = memory_nodes();
+	if (!arguments["cpu_nodes"].as<std::string>().empty()) {
+		c_nodes.clear();
+		for (long n : parse_list(arguments["cpu_nodes"].as<std::string>()))
+			c_nodes.push_back(n);
+	}
+	if (!arguments["memory_nodes"].as<std::string>().empty()) {
+		m_nodes.clear();
+		for (long n : parse_list(arguments["memory_nodes"].as<std::string>()))
+			m_nodes.push_back(n);
 	}
 
-	// Clear allocated memory
-	memset(false_sharing_memory, 0, num_cores * sizeof(int64_t));
-	memset(memory, 0, num_cores * cacheLineSize * sizeof(int64_t));
-
-/*
-	// Open a file to store the results
-	std::string filename;
-	switch(MEMORY_NODE){
-	case 1:
-		filename = "results/local_falseshare_distribute.csv";
-		break;
-	case 0:
-		filename = "results/remote_falseshare.csv";
-		break;
-	case 2:
-		filename = "results/cxl_falseshare.csv";
-		break;
+	// Spread writers over the CPU nodes round-robin, like alternating sockets
+	std::vector<std::vector<int>> node_cores;
+	for (int n : c_nodes)
+		node_cores.push_back(cores_of_node(n));
+	std::vector<int> cores;
+	for (size_t i = 0; cores.size() < num_threads && i < num_threads * c_nodes.size(); i++) {
+		const std::vector<int> &nc = node_cores[i % c_nodes.size()];
+		if (i / c_nodes.size() < nc.size())
+			cores.push_back(nc[i / c_nodes.size()]);
 	}
-	std::ofstream results_file(filename);
-	results_file << "threads,false_share,non_share,diff\n";
-
-	num_cores = 128;
-	for(int num_threads = 1; num_threads <= num_cores; num_threads++){
-		double non_avg_ops = 0;
-		for(int trial = 0; trial < NUM_TRIALS; trial++){
-			double num_ops = 0;
-			std::vector<std::future<size_t>> futs;
-			MyBarrier sync_point(num_threads);
-			for(int i = 0; i < num_threads; i++){
-			  if(i%2)
-					futs.push_back(std::async(std::launch::async, writer, memory, i*(cacheLineSize/sizeof(int64_t)), i + 128, std::ref(sync_point)));
-				else
-					futs.push_back(std::async(std::launch::async, writer, memory, i*(cacheLineSize/sizeof(int64_t)), i, std::ref(sync_point)));
-			}
-			for(auto &f:futs){
-				num_ops += f.get();
-			}
-			non_avg_ops += num_ops;
-		}
-		non_avg_ops = non_avg_ops/(double)NUM_TRIALS;
-		double false_avg_ops = 0;
-		for(int trial = 0; trial < NUM_TRIALS; trial++){
-			double num_ops = 0;
-			std::vector<std::future<size_t>> futs;
-			MyBarrier sync_point(num_threads);
-			for(int i = 0; i < num_threads; i++){
-				if(i%2)
-					futs.push_back(std::async(std::launch::async, writer, false_sharing_memory, i, i + 128, std::ref(sync_point)));
-				else
-					futs.push_back(std::async(std::launch::async, writer, false_sharing_memory, i, i, std::ref(sync_point)));
-			}
-			for(auto &f:futs){
-				num_ops += f.get();
-			}
-			false_avg_ops += num_ops;
-		}
-		false_avg_ops = false_avg_ops/(double)NUM_TRIALS;
-		std::cout << "Threads: " << num_threads << ", false sharing Ops: " << false_avg_ops << " non shared:" << non_avg_ops <<std::endl;
-		results_file << num_threads << "," << false_avg_ops << "," << non_avg_ops << "," << false_avg_ops / non_avg_ops << "\n";
+	if (cores.size() < num_threads) {
+		std::cerr << "Only " << cores.size() << " cores available for " << num_threads << " writers." << std::endl;
+		return 1;
 	}
 
-	// Close the results file
-	results_file.close();
-	*/
-	double false_avg_ops = 0;
-	double non_avg_ops = 0;
-	for (int trial = 0; trial < NUM_TRIALS; trial++){
-		double num_ops = 0;
-		std::vector<std::future<size_t>> futs;
-		MyBarrier sync_point(8);
-		/*
-		for(int i=0; i<8; i++)
-			futs.push_back(std::async(std::launch::async, writer, memory, i*(cacheLineSize/sizeof(int64_t)), i + 128, std::ref(sync_point)));
-			*/
-		for(int i=0; i<4; i++)
-			futs.push_back(std::async(std::launch::async, writer, memory, i*(cacheLineSize/sizeof(int64_t)), i + 128, std::ref(sync_point)));
-		for(int i=0; i<4; i++)
-			futs.push_back(std::async(std::launch::async, writer, memory, i*(cacheLineSize/sizeof(int64_t)), i , std::ref(sync_point)));
-		for(auto &f : futs){
-			non_avg_ops += f.get();
+	std::vector<long> strides = parse_list(arguments["strides"].as<std::string>());
+	std::vector<long> writers_per_line = parse_list(arguments["writers_per_line"].as<std::string>());
+
+	// Big enough for the widest layout, plus one page so nothing runs past the end
+	size_t alloc_size = num_threads * PADDED_STRIDE + 4096;
+	for (long s : strides)
+		alloc_size = std::max(alloc_size, num_threads * s + 4096);
+
+	std::ofstream results_file(arguments["result"].as<std::string>());
+	results_file << "sweep,stride,writers_per_line,pairing,threads,memory_node,ops,relative,page_size,cxl_shim\n";
+
+	for (int memory_node : m_nodes) {
+		uint8_t *memory = static_cast<uint8_t *>(alloc_on_node(alloc_size, memory_node));
+		if (memory == nullptr) {
+			std::cerr << "Failed to allocate memory on NUMA node " << memory_node << std::endl;
+			return 1;
+		}
+		// Owners are the writers of the padded baseline layout, one page each
+		std::vector<OwnedRange> owners;
+		for (size_t i = 0; i < num_threads; i++)
+			owners.push_back({memory + i * PADDED_STRIDE, PADDED_STRIDE, cores[i]});
+		touch_by_owners(memory, alloc_size, owners);
+		size_t page_size = mapping_page_size(memory);
+		std::cout << "Node " << memory_node << ": " << page_size << " B pages" << std::endl;
+
+		// Baseline: no two writers within a page
+		std::vector<size_t> offsets(num_threads);
+		for (size_t i = 0; i < num_threads; i++)
+			offsets[i] = i * PADDED_STRIDE;
+		double padded_ops = run_layout(memory, offsets, cores, duration_ms, num_trials);
+
+		// Stride sweep: writer i at i * stride. Below 64 B several writers share a line;
+		// at exactly 64 B neighbours sit in the two lines of one 128 B adjacent-line prefetch pair.
+		for (long stride : strides) {
+			for (size_t i = 0; i < num_threads; i++)
+				offsets[i] = i * stride;
+			double ops = run_layout(memory, offsets, cores, duration_ms, num_trials);
+			long wpl = std::min((long)num_threads, std::max(1L, (long)CACHE_LINE_SIZE / stride));
+			int pairing = stride >= CACHE_LINE_SIZE && stride < 2 * CACHE_LINE_SIZE;
+			results_file << "stride," << stride << "," << wpl << "," << pairing << "," << num_threads << "," << memory_node << ","
+				<< ops << "," << ops / padded_ops << "," << page_size << "," << cxl_shim(memory_node, false) << "\n";
+			std::cout << "Node " << memory_node << " stride " << stride << ": " << ops << " ops/s (" << ops / padded_ops << "x padded)" << std::endl;
 		}
-	}
-	non_avg_ops = non_avg_ops/(double)NUM_TRIALS;
 
-	for (int trial = 0; trial < NUM_TRIALS; trial++){
-		double num_ops = 0;
-		std::vector<std::future<size_t>> futs;
-		MyBarrier sync_point(8);
-		for(int i=0; i<4; i++)
-			futs.push_back(std::async(std::launch::async, writer, false_sharing_memory, i*(cacheLineSize/sizeof(int64_t)), i + 128, std::ref(sync_point)));
-		for(int i=0; i<4; i++)
-			futs.push_back(std::async(std::launch::async, writer, false_sharing_memory, i*(cacheLineSize/sizeof(int64_t)), i , std::ref(sync_point)));
-		/*
-		for(int i=0; i<8; i++)
-			futs.push_back(std::async(std::launch::async, writer, false_sharing_memory, i*(cacheLineSize/sizeof(int64_t)), i + 128, std::ref(sync_point)));
-			*/
-		for(auto &f : futs){
-			false_avg_ops += f.get();
+		// Writers-per-line sweep: groups of w writers on 8 B slots of one line, groups GROUP_STRIDE apart
+		for (long wpl : writers_per_line) {
+			if (wpl < 1 || wpl > (long)(CACHE_LINE_SIZE / sizeof(int64_t)))
+				continue;
+			for (size_t i = 0; i < num_threads; i++)
+				offsets[i] = (i / wpl) * GROUP_STRIDE + (i % wpl) * sizeof(int64_t);
+			double ops = run_layout(memory, offsets, cores, duration_ms, num_trials);
+			results_file << "writers," << sizeof(int64_t) << "," << wpl << ",0," << num_threads << "," << memory_node << ","
+				<< ops << "," << ops / padded_ops << "," << page_size << "," << cxl_shim(memory_node, false) << "\n";
+			std::cout << "Node " << memory_node << " " << wpl << " writers/line: " << ops << " ops/s (" << ops / padded_ops << "x padded)" << std::endl;
 		}
-	}
-	false_avg_ops = false_avg_ops/(double)NUM_TRIALS;
 
-	std::cout << 8 << "," << false_avg_ops << "," << non_avg_ops << "," << non_avg_ops/false_avg_ops << "\n";
+		// Free the allocated memory
+		free_on_node(memory, alloc_size);
+	}
 
-	// Free the allocated memory
-	numa_free(memory, num_cores * cacheLineSize *  sizeof(int64_t));
-	numa_free(false_sharing_memory, num_cores * sizeof(int64_t));
+	// Close the results file
+	results_file.close();
 
 	return 0;
 }
@@ -0,0 +1,292 @@
+#include "bench_util.h"
+#include <atomic>
+#include <map>
+#include <immintrin.h>
+
+#include <cxxopts.hpp>
+
+#define NUM_TRIALS 5
+#define NUM_ITERS (1UL << 20)
+#define MAX_PENDING 64 // store-buffer drain sweep: most distinct lines stored before the fence
+
+// Ordering primitive issued after each store. Lock add to the stack is the usual cheaper
+// stand-in for mfence; the flush variants write the line back before the next store.
+enum class Fence {
+	None, MFence, SFence, LFence, LockAdd,
+	Relaxed, Acquire, Release, AcqRel, SeqCst,
+	ClflushMFence, ClflushoptSFence, ClwbSFence
+};
+
+static const std::map<std::string, Fence> fence_names = {
+	{"none", Fence::None},
+	{"mfence", Fence::MFence},
+	{"sfence", Fence::SFence},
+	{"lfence", Fence::LFence},
+	{"lock_add", Fence::LockAdd},
+	{"fence_relaxed", Fence::Relaxed},
+	{"fence_acquire", Fence::Acquire},
+	{"fence_release", Fence::Release},
+	{"fence_acq_rel", Fence::AcqRel},
+	{"fence_seq_cst", Fence::SeqCst},
+	{"clflush_mfence", Fence::ClflushMFence},
+	{"clflushopt_sfence", Fence::ClflushoptSFence},
+	{"clwb_sfence", Fence::ClwbSFence},
+};
+
+static bool fence_supported(Fence f) {
+	__builtin_cpu_init();
+	switch (f) {
+		case Fence::ClflushoptSFence: return __builtin_cpu_supports("clflushopt");
+		case Fence::ClwbSFence: return __builtin_cpu_supports("clwb");
+		default: return true;
+	}
+}
+
+static inline void lock_add_stack() {
+	asm volatile("lock addl $0, (%%rsp)" : : : "memory", "cc");
+}
+
+__attribute__((target("clflushopt"))) static void flush_opt(void *p) {
+	_mm_clflushopt(p);
+}
+
+__attribute__((target("clwb"))) static void write_back(void *p) {
+	_mm_clwb(p);
+}
+
+// Issue one fence of the given kind after the stores to line
+static inline __attribute__((always_inline)) void fence(Fence f, volatile uint64_t *line) {
+	switch (f) {
+		case Fence::None: asm volatile("" : : : "memory"); break;
+		case Fence::MFence: _mm_mfence(); break;
+		case Fence::SFence: _mm_sfence(); break;
+		case Fence::LFence: _mm_lfence(); break;
+		case Fence::LockAdd: lock_add_stack(); break;
+		case Fence::Relaxed: std::atomic_thread_fence(std::memory_order_relaxed); break;
+		case Fence::Acquire: std::atomic_thread_fence(std::memory_order_acquire); break;
+		case Fence::Release: std::atomic_thread_fence(std::memory_order_release); break;
+		case Fence::AcqRel: std::atomic_thread_fence(std::memory_order_acq_rel); break;
+		case Fence::SeqCst: std::atomic_thread_fence(std::memory_order_seq_cst); break;
+		case Fence::ClflushMFence: _mm_clflush((const void *)line); _mm_mfence(); break;
+		case Fence::ClflushoptSFence: flush_opt((void *)line); _mm_sfence(); break;
+		case Fence::ClwbSFence: write_back((void *)line); _mm_sfence(); break;
+	}
+}
+
+// ns per (pending stores to distinct lines + one fence). pending 1 is the publication path:
+// store a value, then order it. The loop is stamped out per fence so the switch folds away.
+template <Fence F>
+static double store_fence_loop(uint8_t *lines, size_t pending, size_t iters) {
+	uint64_t t0 = tsc_begin();
+	for (size_t i = 0; i < iters; i++) {
+		for (size_t p = 0; p < pending; p++)
+			*(volatile uint64_t *)(lines + p * CACHE_LINE_SIZE) = i;
+		fence(F, (volatile uint64_t *)lines);
+	}
+	uint64_t t1 = tsc_end();
+	return (t1 - t0) / tsc_per_ns() / iters;
+}
+
+static double store_fence(Fence f, uint8_t *lines, size_t pending, size_t iters) {
+	switch (f) {
+		case Fence::None: return store_fence_loop<Fence::None>(lines, pending, iters);
+		case Fence::MFence: return store_fence_loop<Fence::MFence>(lines, pending, iters);
+		case Fence::SFence: return store_fence_loop<Fence::SFence>(lines, pending, iters);
+		case Fence::LFence: return store_fence_loop<Fence::LFence>(lines, pending, iters);
+		case Fence::LockAdd: return store_fence_loop<Fence::LockAdd>(lines, pending, iters);
+		case Fence::Relaxed: return store_fence_loop<Fence::Relaxed>(lines, pending, iters);
+		case Fence::Acquire: return store_fence_loop<Fence::Acquire>(lines, pending, iters);
+		case Fence::Release: return store_fence_loop<Fence::Release>(lines, pending, iters);
+		case Fence::AcqRel: return store_fence_loop<Fence::AcqRel>(lines, pending, iters);
+		case Fence::SeqCst: return store_fence_loop<Fence::SeqCst>(lines, pending, iters);
+		case Fence::ClflushMFence: return store_fence_loop<Fence::ClflushMFence>(lines, pending, iters);
+		case Fence::ClflushoptSFence: return store_fence_loop<Fence::ClflushoptSFence>(lines, pending, iters);
+		case Fence::ClwbSFence: return store_fence_loop<Fence::ClwbSFence>(lines, pending, iters);
+	}
+	return 0;
+}
+
+// Holder: keeps re-reading the first line so every store has to take ownership back from it
+void holder(uint8_t *line, int core_num, std::atomic<bool> &ready, std::atomic<bool> &stop) {
+	if (!pin_to_core(core_num)) {
+		ready.store(true);
+		return;
+	}
+	uint64_t sink = 0;
+	ready.store(true);
+	while (!stop.load(std::memory_order_relaxed)) {
+		sink += *(volatile uint64_t *)line;
+		_mm_pause();
+	}
+	asm volatile("" : : "r"(sink));
+}
+
+// Local memory, remote memory, or a CPU-less (CXL) node, seen from cpu_node
+static std::string placement_name(int cpu_node, int memory_node) {
+	if (memory_node == cpu_node)
+		return "local";
+	if (cores_of_node(memory_node).empty())
+		return "cxl";
+	return "remote";
+}
+
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("Fence Cost", "Cost of fences and cache-line flushes after a store, by placement");
+	options.add_options()
+		("c,cpu_node", "NUMA node whose first core runs the measurement", cxxopts::value<int>()->default_value("0"))
+		("m,memory_nodes", "Home nodes of the stored lines, CXL included (default: all)", cxxopts::value<std::string>()->default_value(""))
+		("f,fences", "Fences to measure (default: all supported)", cxxopts::value<std::string>()->default_value(""))
+		("p,pending", "Stores to distinct lines before each fence in the drain sweep", cxxopts::value<std::string>()->default_value("1,2,4,8,16,32,64"))
+		("holders", "Where a reader keeps the stored line shared (none,same_socket,remote_socket)", cxxopts::value<std::string>()->default_value("none,same_socket,remote_socket"))
+		("n,iterations", "Store+fence iterations per trial", cxxopts::value<size_t>()->default_value(std::to_string(NUM_ITERS)))
+		("trials", "Number of trials (the fastest is kept)", cxxopts::value<int>()->default_value(std::to_string(NUM_TRIALS)))
+		("r,result", "Result csv file", cxxopts::value<std::string>()->default_value("results/fence_cost.csv"))
+		("emulate_cxl", "Serve this node id from an emulated CXL pool: node[:latency_ns[:GB/s[:size]]]", cxxopts::value<std::string>())
+		("page_mode", "Buffer pages (default,4k,thp,2m,1g)", cxxopts::value<std::string>()->default_value("default"))
+		("placement", "Buffer placement (bind,preferred,interleave,first_touch)", cxxopts::value<std::string>()->default_value("bind"))
+		("h,help", "Print usage")
+		;
+	auto arguments = options.parse(argc, argv);
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	// Initialize NUMA library
+	if (numa_available() == -1) {
+		std::cerr << "NUMA is not available on this system." << std::endl;
+		return 1;
+	}
+	if (arguments.count("emulate_cxl") && !enable_cxl_emulation(arguments["emulate_cxl"].as<std::string>()))
+		return 1;
+	warn_unshimmed_cxl();
+	if (!set_alloc_policy(arguments["page_mode"].as<std::string>(), arguments["placement"].as<std::string>()))
+		return 1;
+
+	int cpu_node = arguments["cpu_node"].as<int>();
+	std::vector<int> cores = cores_of_node(cpu_node);
+	if (cores.empty()) {
+		std::cerr << "No CPUs found on NUMA node " << cpu_node << "." << std::endl;
+		return 1;
+	}
+	int self = cores[0];
+	std::vector<int> m_nodes = memory_nodes();
+	if (!arguments["memory_nodes"].as<std::string>().empty()) {
+		m_nodes.clear();
+		for (long n : parse_list(arguments["memory_nodes"].as<std::string>()))
+			m_nodes.push_back(n);
+	}
+	std::vector<std::pair<std::string, Fence>> fences;
+	if (arguments["fences"].as<std::string>().empty()) {
+		for (auto &[name, f] : fence_names)
+			if (fence_supported(f))
+				fences.push_back({name, f});
+	} else {
+		std::stringstream ss(arguments["fences"].as<std::string>());
+		for (std::string tok; std::getline(ss, tok, ',');) {
+			if (!fence_names.count(tok)) {
+				std::cerr << "Unknown fence: " << tok << std::endl;
+				return 1;
+			}
+			if (!fence_supported(fence_names.at(tok))) {
+				std::cerr << "Fence not supported on this CPU: " << tok << std::endl;
+				return 1;
+			}
+			fences.push_back({tok, fence_names.at(tok)});
+		}
+	}
+	std::vector<long> pendings = parse_list(arguments["pending"].as<std::string>());
+	size_t iters = arguments["iterations"].as<size_t>();
+	int num_trials = arguments["trials"].as<int>();
+
+	// Holder cores: another core of our socket, and a core on another socket
+	std::map<std::string, int> holder_core = {{"none", -1}};
+	for (int n : cpu_nodes()) {
+		for (int c : cores_of_node(n)) {
+			if (c == self)
+				continue;
+			std::string where = cpu_package(c) == cpu_package(self) ? "same_socket" : "remote_socket";
+			if (!holder_core.count(where))
+				holder_core[where] = c;
+		}
+	}
+	std::vector<std::string> holders;
+	std::stringstream ss(arguments["holders"].as<std::string>());
+	for (std::string tok; std::getline(ss, tok, ',');) {
+		if (holder_core.count(tok))
+			holders.push_back(tok);
+		else
+			std::cerr << "No core for holder placement " << tok << ", skipping." << std::endl;
+	}
+
+	if (!pin_to_core(self))
+		return 1;
+
+	std::ofstream results_file(arguments["result"].as<std::string>());
+	results_file << "test,fence,pending,cpu_node,memory_node,placement,holder,ns_per_op,fence_ns,page_size,cxl_shim\n";
+
+	size_t alloc_size = MAX_PENDING * CACHE_LINE_SIZE + 4096;
+	for (int memory_node : m_nodes) {
+		uint8_t *lines = static_cast<uint8_t *>(alloc_on_node(alloc_size, memory_node));
+		if (lines == nullptr) {
+			std::cerr << "Failed to allocate memory on NUMA node " << memory_node << std::endl;
+			return 1;
+		}
+		touch_by_owners(lines, alloc_size, {{lines, alloc_size, self}});
+		size_t page_size = mapping_page_size(lines);
+		std::cout << "Node " << memory_node << ": " << page_size << " B pages" << std::endl;
+		std::string placement = placement_name(cpu_node, memory_node);
+
+		auto best_of = [&](Fence f, size_t pending) {
+			double best = 1e30;
+			for (int trial = 0; trial < num_trials; trial++)
+				best = std::min(best, store_fence(f, lines, pending, iters));
+			return best;
+		};
+
+		// Publication path: one store + fence, with the line optionally kept shared by a reader
+		for (const std::string &h : holders) {
+			alignas(CACHE_LINE_SIZE) std::atomic<bool> stop(false), ready(false);
+			std::thread t;
+			if (holder_core[h] >= 0) {
+				t = std::thread(holder, lines, holder_core[h], std::ref(ready), std::ref(stop));
+				while (!ready.load())
+					_mm_pause();
+			}
+			double baseline = best_of(Fence::None, 1);
+			for (auto &[name, f] : fences) {
+				double ns = best_of(f, 1);
+				results_file << "publish," << name << ",1," << cpu_node << "," << memory_node << "," << placement << "," << h << ","
+					<< ns << "," << ns - baseline << "," << page_size << "," << cxl_shim(memory_node, false) << "\n";
+				std::cout << "Node " << cpu_node << "->" << memory_node << " (" << placement << ", holder " << h << ") "
+					<< name << ": " << ns << " ns/op, fence " << ns - baseline << " ns" << std::endl;
+			}
+			stop.store(true);
+			if (t.joinable())
+				t.join();
+		}
+
+		// Store-buffer drain: k stores to distinct lines, then the fence waits for all of them
+		for (long pending : pendings) {
+			if (pending < 1 || pending > MAX_PENDING)
+				continue;
+			double baseline = best_of(Fence::None, pending);
+			for (auto &[name, f] : fences) {
+				if (f != Fence::MFence && f != Fence::SFence && f != Fence::LockAdd && f != Fence::SeqCst)
+					continue;
+				double ns = best_of(f, pending);
+				results_file << "drain," << name << "," << pending << "," << cpu_node << "," << memory_node << "," << placement << ",none,"
+					<< ns << "," << ns - baseline << "," << page_size << "," << cxl_shim(memory_node, false) << "\n";
+				std::cout << "Node " << cpu_node << "->" << memory_node << " (" << placement << ") " << pending << " stores + "
+					<< name << ": " << ns << " ns/op, drain " << ns - baseline << " ns" << std::endl;
+			}
+		}
+
+		free_on_node(lines, alloc_size);
+	}
+
+	// Close the results file
+	results_file.close();
+
+	return 0;
+}
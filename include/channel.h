@@ -0,0 +1,83 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Message channels between coherence domains. A message is one cache line: an 8-byte
+// header the channel owns plus CHANNEL_PAYLOAD_SIZE bytes of payload, so a message never
+// shares a line with its neighbours and moves between sockets as a single transfer.
+//
+// Producers can batch: sends are written to the ring but only published (made visible to
+// the consumer) every `batch` messages or on an explicit flush, which amortises the
+// cross-socket transfer of the index line. With `nontemporal` set, payloads are written
+// with streaming stores that bypass the producer's cache, for bulk transfers the
+// producer will not read again.
+
+#define CHANNEL_SLOT_SIZE 64
+#define CHANNEL_PAYLOAD_SIZE (CHANNEL_SLOT_SIZE - sizeof(uint64_t))
+#define CHANNEL_MAX_BATCH 64
+
+typedef struct {
+    volatile uint64_t seq; // MPSC: whose turn the slot is; unused by SPSC
+    uint8_t payload[CHANNEL_PAYLOAD_SIZE];
+} __attribute__((aligned(CHANNEL_SLOT_SIZE))) channel_slot_t;
+
+// Single-producer single-consumer ring (Lamport) where each side keeps a private copy of
+// the other side's index and only rereads the shared one when the copy says full/empty.
+// The two published indices and each side's private state sit on four separate lines, so
+// a send only moves the tail line when it publishes and a receive only moves the head line.
+typedef struct {
+    // Published indices
+    volatile uint64_t tail __attribute__((aligned(64))); // published messages
+    volatile uint64_t head __attribute__((aligned(64))); // consumed messages
+    // Producer side
+    uint64_t write_pos __attribute__((aligned(64))); // written, maybe not yet published
+    uint64_t published;                              // producer's copy of tail
+    uint64_t cached_head;
+    // Consumer side
+    uint64_t read_pos __attribute__((aligned(64))); // consumer's copy of head
+    uint64_t cached_tail;
+    // Read-only after init
+    uint64_t mask __attribute__((aligned(64)));
+    int batch;
+    bool nontemporal;
+    channel_slot_t* slots;
+} spsc_channel_t;
+
+// Multi-producer single-consumer ring: producers claim slots with a CAS on the tail, and a
+// per-slot sequence number tells the consumer which slots are filled (Vyukov)
+typedef struct {
+    volatile uint64_t tail __attribute__((aligned(64)));
+    volatile uint64_t head __attribute__((aligned(64)));
+    uint64_t mask __attribute__((aligned(64)));
+    bool nontemporal;
+    channel_slot_t* slots;
+} mpsc_channel_t;
+
+// A producer's handle on an MPSC channel: messages are staged here and claimed and
+// published `batch` at a time
+typedef struct {
+    mpsc_channel_t* ch;
+    int batch;
+    int count;
+    uint8_t staged[CHANNEL_MAX_BATCH][CHANNEL_PAYLOAD_SIZE];
+} mpsc_producer_t;
+
+// capacity is rounded up to a power of two; slot memory is first touched by the caller,
+// so call from a thread running on the node that should home the ring
+int spsc_init(spsc_channel_t* ch, size_t capacity, int batch, bool nontemporal);
+void spsc_destroy(spsc_channel_t* ch);
+bool spsc_send(spsc_channel_t* ch, const void* msg); // false when full
+void spsc_flush(spsc_channel_t* ch);
+bool spsc_recv(spsc_channel_t* ch, void* msg);       // false when empty
+
+int mpsc_init(mpsc_channel_t* ch, size_t capacity, bool nontemporal);
+void mpsc_destroy(mpsc_channel_t* ch);
+void mpsc_producer_init(mpsc_producer_t* p, mpsc_channel_t* ch, int batch);
+bool mpsc_send(mpsc_producer_t* p, const void* msg); // false when full (message not taken)
+bool mpsc_flush(mpsc_producer_t* p);                 // false when the staged batch did not fit
+bool mpsc_recv(mpsc_channel_t* ch, void* msg);
+
+#endif // CHANNEL_H
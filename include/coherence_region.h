@@ -0,0 +1,50 @@
+#ifndef COHERENCE_REGION_H
+#define COHERENCE_REGION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Software-managed coherence for memory that hardware does not keep coherent between the
+// threads sharing it. Readers invalidate the lines they are about to read (acquire) and
+// writers write back the lines they dirtied (release), so a lock section becomes
+//
+//     lock; sc_acquire(ctx, p, n); ...read/write *p...; sc_mark_dirty(ctx, p, n);
+//     sc_release(ctx); unlock;
+//
+// Write-back uses clwb where the CPU has it (the line stays cached), then clflushopt, then
+// clflush. Invalidation uses clflushopt or clflush. Only lines marked dirty since the last
+// release are written back.
+
+#define SC_LINE_SIZE 64
+
+// A shared range of memory; read-only after init
+typedef struct {
+    uintptr_t base; // first line, rounded down
+    size_t num_lines;
+} sc_region_t;
+
+// One thread's view of a region: the lines it has dirtied, and what it has flushed.
+// Dirty state is private, since a non-coherent writer is the only one who knows it.
+typedef struct {
+    const sc_region_t* region;
+    uint64_t* dirty; // one bit per line
+    size_t dirty_lo, dirty_hi; // words of `dirty` that may have bits set
+    long lines_invalidated;
+    long lines_written_back;
+} sc_context_t;
+
+void sc_region_init(sc_region_t* region, void* base, size_t size);
+int sc_context_init(sc_context_t* ctx, const sc_region_t* region);
+void sc_context_destroy(sc_context_t* ctx); // keeps the counters
+
+// Drop cached copies of [addr, addr+len) so the next reads come from memory
+void sc_acquire(sc_context_t* ctx, const void* addr, size_t len);
+void sc_mark_dirty(sc_context_t* ctx, const void* addr, size_t len);
+// Write back every line dirtied since the last release and wait for the write-backs
+void sc_release(sc_context_t* ctx);
+
+// Instruction used for write-back: "clwb", "clflushopt" or "clflush"
+const char* sc_writeback_instruction(void);
+
+#endif // COHERENCE_REGION_H
@@ -0,0 +1,320 @@
+#ifndef CXL_POOL_H
+#define CXL_POOL_H
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+// Emulated CXL memory pool, for machines without a CPU-less CXL node. The pool is one
+// shared mapping bound to the NUMA node farthest from node 0, so it is inherited across
+// fork() and its raw accesses already cross the socket interconnect. On top of that, the
+// cxl_* accessors model the device:
+//
+// - every access waits out the difference between the target CXL load latency and the
+//   backing node's own latency, measured with a pointer chase when the pool is created;
+// - every access also reserves its bytes, in whole cache lines, on one link shared by all
+//   threads and processes, so together they cannot exceed the bandwidth cap.
+//
+// Objects are carved out of the pool by a power-of-two size-class allocator whose state
+// lives in the pool itself, so any process attached to the pool can allocate and free.
+//
+// Everything is static inline so the standalone C++ benchmarks can use the pool without
+// linking the emulator library.
+
+#define CXL_POOL_LINE 64
+#define CXL_POOL_PAGE 4096
+#define CXL_POOL_CLASSES 40 // 64 B << 39 is far beyond any pool
+
+// From <numaif.h>; the emulator does not link libnuma
+#define CXL_MPOL_BIND 2
+
+typedef struct {
+    size_t size;           // bytes of the mapping, pool header included
+    int node;              // backing NUMA node (-1: farthest from node 0)
+    double latency_ns;     // target load-to-use latency of the emulated device
+    double bandwidth_gbps; // cap in GB/s shared by all accessors (0: unlimited)
+} cxl_pool_config_t;
+
+// Lives at the start of the mapping; offsets rather than pointers so the state stays valid
+// in every process that maps the pool
+typedef struct {
+    // Read-only after create
+    size_t size;
+    size_t data_start;
+    int node;
+    double native_ns;       // measured latency of the backing node
+    double ticks_per_ns;
+    uint64_t delay_ticks;   // injected per access
+    double ticks_per_line;  // link occupancy per cache line (0: unlimited)
+    // Modeled link: TSC at which it next goes idle
+    volatile uint64_t link_free_at __attribute__((aligned(64)));
+    // Allocator
+    volatile int lock __attribute__((aligned(64)));
+    size_t brk;
+    size_t free_list[CXL_POOL_CLASSES];
+} cxl_pool_t;
+
+static inline uint64_t cxl_pool_ticks(void) {
+    return __rdtsc();
+}
+
+static inline double cxl_pool_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Integer from a sysfs file, or -1
+static inline long cxl_pool_read_long(const char* path, const char* format) {
+    FILE* f = fopen(path, "r");
+    long v = -1;
+    if (!f) return -1;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, format, &v) == 1) break;
+    }
+    fclose(f);
+    return v;
+}
+
+// The node with memory that is farthest from `from` by the firmware distance table
+static inline int cxl_pool_farthest_node(int from) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/distance", from);
+    FILE* f = fopen(path, "r");
+    if (!f) return from;
+    // The row lists the online nodes in increasing id order
+    int online[1024], num_online = 0;
+    for (int node = 0; node < 1024; node++) {
+        char dir[128];
+        snprintf(dir, sizeof(dir), "/sys/devices/system/node/node%d", node);
+        DIR* d = opendir(dir);
+        if (d) {
+            closedir(d);
+            online[num_online++] = node;
+        }
+    }
+    int best = from, best_distance = 0, distance;
+    for (int i = 0; i < num_online && fscanf(f, "%d", &distance) == 1; i++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/meminfo", online[i]);
+        char format[64];
+        snprintf(format, sizeof(format), "Node %d MemTotal: %%ld kB", online[i]);
+        if (distance > best_distance && cxl_pool_read_long(path, format) > 0) {
+            best = online[i];
+            best_distance = distance;
+        }
+    }
+    fclose(f);
+    return best;
+}
+
+// Average ns per dependent load over `bytes` of memory (random cycle of lines), which it
+// overwrites
+static inline double cxl_pool_chase_ns(char* mem, size_t bytes) {
+    size_t lines = bytes / CXL_POOL_LINE;
+    uint32_t* order = (uint32_t*)malloc(lines * sizeof(uint32_t));
+    for (size_t i = 0; i < lines; i++) order[i] = i;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = lines - 1; i > 0; i--) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        size_t j = (seed >> 33) % i; // Sattolo: one cycle through every line
+        uint32_t t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    for (size_t i = 0; i < lines; i++) {
+        *(char**)(mem + (size_t)order[i] * CXL_POOL_LINE) = mem + (size_t)order[(i + 1) % lines] * CXL_POOL_LINE;
+    }
+    free(order);
+    char* p = mem;
+    for (size_t i = 0; i < lines; i++) p = *(char**)p; // warm the TLB
+    size_t steps = 1 << 20;
+    double t0 = cxl_pool_now_ns();
+    for (size_t i = 0; i < steps; i++) p = *(char* volatile*)p;
+    double t1 = cxl_pool_now_ns();
+    __asm__ volatile("" : : "r"(p));
+    return (t1 - t0) / steps;
+}
+
+// Map and calibrate a pool. Returns NULL on failure.
+static inline cxl_pool_t* cxl_pool_create(const cxl_pool_config_t* config) {
+    size_t size = (config->size + CXL_POOL_PAGE - 1) & ~(size_t)(CXL_POOL_PAGE - 1);
+    char* base = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        perror("cxl_pool: mmap");
+        return NULL;
+    }
+    int node = config->node >= 0 ? config->node : cxl_pool_farthest_node(0);
+    unsigned long mask[16] = {0};
+    if (node < (int)(sizeof(mask) * 8)) {
+        mask[node / 64] = 1UL << (node % 64);
+    }
+    // Before the first touch, so every page is allocated on the node
+    if (syscall(SYS_mbind, base, size, CXL_MPOL_BIND, mask, sizeof(mask) * 8, 0) != 0) {
+        perror("cxl_pool: mbind (pool left unbound)");
+    }
+
+    cxl_pool_t* pool = (cxl_pool_t*)base;
+    size_t data_start = (sizeof(cxl_pool_t) + CXL_POOL_PAGE - 1) & ~(size_t)(CXL_POOL_PAGE - 1);
+    size_t chase_bytes = size - data_start < (64UL << 20) ? size - data_start : (64UL << 20);
+    double native_ns = chase_bytes >= (1 << 20) ? cxl_pool_chase_ns(base + data_start, chase_bytes) : 0;
+    memset(base + data_start, 0, chase_bytes);
+
+    double t0 = cxl_pool_now_ns();
+    uint64_t c0 = cxl_pool_ticks();
+    while (cxl_pool_now_ns() - t0 < 20e6);
+    double ticks_per_ns = (double)(cxl_pool_ticks() - c0) / (cxl_pool_now_ns() - t0);
+
+    memset(pool, 0, sizeof(*pool));
+    pool->size = size;
+    pool->data_start = data_start;
+    pool->brk = data_start;
+    pool->node = node;
+    pool->native_ns = native_ns;
+    pool->ticks_per_ns = ticks_per_ns;
+    double extra_ns = config->latency_ns - native_ns;
+    pool->delay_ticks = extra_ns > 0 ? (uint64_t)(extra_ns * ticks_per_ns) : 0;
+    // GB/s is bytes per ns
+    pool->ticks_per_line = config->bandwidth_gbps > 0 ? CXL_POOL_LINE / config->bandwidth_gbps * ticks_per_ns : 0;
+    return pool;
+}
+
+static inline void cxl_pool_destroy(cxl_pool_t* pool) {
+    munmap(pool, pool->size);
+}
+
+static inline bool cxl_pool_contains(const cxl_pool_t* pool, const void* addr) {
+    const char* p = (const char*)addr;
+    return pool && p >= (const char*)pool + pool->data_start && p < (const char*)pool + pool->size;
+}
+
+static inline double cxl_pool_injected_ns(const cxl_pool_t* pool) {
+    return pool->delay_ticks / pool->ticks_per_ns;
+}
+
+// Reserve the lines of [addr, addr + bytes) on the link without waiting. Returns the tick
+// at which they would have arrived, for cxl_pool_wait; a caller that overlaps the access
+// itself with the wait is bounded by the slower of the two.
+static inline uint64_t cxl_pool_reserve(cxl_pool_t* pool, const void* addr, size_t bytes) {
+    uint64_t now = cxl_pool_ticks();
+    uint64_t done = now + pool->delay_ticks;
+    if (pool->ticks_per_line > 0) {
+        uintptr_t first = (uintptr_t)addr / CXL_POOL_LINE;
+        uintptr_t last = ((uintptr_t)addr + (bytes ? bytes : 1) - 1) / CXL_POOL_LINE;
+        uint64_t cost = (uint64_t)((last - first + 1) * pool->ticks_per_line);
+        uint64_t busy = pool->link_free_at;
+        uint64_t start;
+        do {
+            start = busy > now ? busy : now;
+        } while (!__atomic_compare_exchange_n(&pool->link_free_at, &busy, start + cost, true,
+                                              __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+        done = start + cost + pool->delay_ticks;
+    }
+    return done;
+}
+
+static inline void cxl_pool_wait(uint64_t done) {
+    while (cxl_pool_ticks() < done) {
+        _mm_pause();
+    }
+}
+
+// Charge one access to [addr, addr + bytes): reserve its lines on the link, then wait
+// until they would have arrived
+static inline void cxl_pool_charge(cxl_pool_t* pool, const void* addr, size_t bytes) {
+    cxl_pool_wait(cxl_pool_reserve(pool, addr, bytes));
+}
+
+// Accessors: the access itself goes straight to the (far) backing memory
+static inline uint64_t cxl_load64(cxl_pool_t* pool, const volatile uint64_t* addr) {
+    cxl_pool_charge(pool, (const void*)addr, sizeof(*addr));
+    return *addr;
+}
+
+static inline void cxl_store64(cxl_pool_t* pool, volatile uint64_t* addr, uint64_t value) {
+    cxl_pool_charge(pool, (const void*)addr, sizeof(*addr));
+    *addr = value;
+}
+
+static inline uint64_t cxl_fetch_add64(cxl_pool_t* pool, volatile uint64_t* addr, uint64_t value) {
+    cxl_pool_charge(pool, (const void*)addr, sizeof(*addr));
+    return __atomic_fetch_add(addr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline bool cxl_cas64(cxl_pool_t* pool, volatile uint64_t* addr, uint64_t* expected, uint64_t desired) {
+    cxl_pool_charge(pool, (const void*)addr, sizeof(*addr));
+    return __atomic_compare_exchange_n(addr, expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline void cxl_read(cxl_pool_t* pool, void* dst, const void* src, size_t bytes) {
+    cxl_pool_charge(pool, src, bytes);
+    memcpy(dst, src, bytes);
+}
+
+static inline void cxl_write(cxl_pool_t* pool, void* dst, const void* src, size_t bytes) {
+    cxl_pool_charge(pool, dst, bytes);
+    memcpy(dst, src, bytes);
+}
+
+// Size class of an allocation: 64 B << class
+static inline int cxl_pool_class(size_t size) {
+    int c = 0;
+    while (c < CXL_POOL_CLASSES - 1 && ((size_t)CXL_POOL_LINE << c) < size) c++;
+    return c;
+}
+
+static inline void cxl_pool_lock(cxl_pool_t* pool) {
+    while (__sync_lock_test_and_set(&pool->lock, 1)) {
+        while (pool->lock) _mm_pause();
+    }
+}
+
+static inline void cxl_pool_unlock(cxl_pool_t* pool) {
+    __sync_lock_release(&pool->lock);
+}
+
+// Allocate `size` bytes, aligned to the size class up to a page. Blocks are not zeroed
+// when reused. Returns NULL when the pool is exhausted.
+static inline void* cxl_alloc(cxl_pool_t* pool, size_t size) {
+    int c = cxl_pool_class(size);
+    size_t block = (size_t)CXL_POOL_LINE << c;
+    char* base = (char*)pool;
+    void* result = NULL;
+    cxl_pool_lock(pool);
+    if (pool->free_list[c]) {
+        size_t offset = pool->free_list[c];
+        pool->free_list[c] = *(size_t*)(base + offset);
+        result = base + offset;
+    } else {
+        size_t align = block < CXL_POOL_PAGE ? block : CXL_POOL_PAGE;
+        size_t offset = (pool->brk + align - 1) & ~(align - 1);
+        if (offset + block <= pool->size) {
+            pool->brk = offset + block;
+            result = base + offset;
+        }
+    }
+    cxl_pool_unlock(pool);
+    return result;
+}
+
+// Return a block; `size` must be the size it was allocated with
+static inline void cxl_free(cxl_pool_t* pool, void* ptr, size_t size) {
+    if (!ptr) return;
+    int c = cxl_pool_class(size);
+    size_t offset = (char*)ptr - (char*)pool;
+    cxl_pool_lock(pool);
+    *(size_t*)ptr = pool->free_list[c];
+    pool->free_list[c] = offset;
+    cxl_pool_unlock(pool);
+}
+
+#endif // CXL_POOL_H
@@ -0,0 +1,62 @@
+#ifndef DSM_H
+#define DSM_H
+
+#include "cxl_pool.h"
+#include <stddef.h>
+
+// Page-based software distributed shared memory between the node processes of
+// multi-process mode (TreadMarks-style release consistency, home-based):
+//
+// - Every page has a home copy in shared memory, bound to node (page % num_nodes), and a
+//   version bumped by each release that changed it.
+// - Each node process works on a private copy. Pages start invalid (PROT_NONE); the first
+//   access faults and fetches the home copy. The first write faults again and saves a twin.
+// - dsm_release() diffs every written page against its twin and applies the diff to the
+//   home copy, so several nodes may write disjoint parts of one page.
+// - dsm_acquire() invalidates every page whose home version moved since it was fetched
+//   (write-invalidate), so the next access refetches it.
+//
+// Threads of one node share the private copy and are coherent among themselves, so only
+// inter-node synchronization needs acquire/release.
+//
+// With a CXL pool, the home copies live in the pool instead, and every page fetch and diff
+// pays the pool's latency and bandwidth.
+
+#define DSM_PAGE_SIZE 4096
+
+typedef enum {
+    DSM_PHASE_MAP,
+    DSM_PHASE_SHUFFLE,
+    DSM_PHASE_REDUCE,
+    DSM_PHASES
+} dsm_phase_t;
+
+typedef struct {
+    long faults;
+    long invalidations;
+    long diffs;
+    long bytes; // page fetches plus encoded diffs
+} dsm_stats_t;
+
+// Home copies and directory; created before the node processes fork
+typedef struct {
+    char* pages;
+    volatile unsigned long* versions;
+    size_t num_pages;
+    int num_nodes;
+    cxl_pool_t* cxl; // NULL: homes spread over the NUMA nodes
+} dsm_home_t;
+
+int dsm_home_create(dsm_home_t* home, size_t size, int num_nodes, cxl_pool_t* cxl);
+void dsm_home_destroy(dsm_home_t* home);
+
+// Node side: one per process. Returns this node's view of the shared pages, or NULL.
+void* dsm_attach(dsm_home_t* home);
+void dsm_detach(void);
+void dsm_acquire(void);
+void dsm_release(void);
+// Faults and transfers are charged to the calling thread's current phase
+void dsm_set_phase(dsm_phase_t phase);
+void dsm_get_stats(dsm_stats_t stats[DSM_PHASES]);
+
+#endif // DSM_H
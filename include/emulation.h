@@ -8,7 +8,8 @@
 typedef enum {
     SYSTEM_FULLY_COHERENT,      // System A: Full hardware coherence with tax
     SYSTEM_FEDERATED_COHERENCE, // System B: Our proposal (intra-node HW, inter-node SW)
-    SYSTEM_FULLY_NON_COHERENT   // System C: All software synchronization
+    SYSTEM_FULLY_NON_COHERENT,  // System C: All software synchronization
+    SYSTEM_FEDERATED_RELAXED    // System D: Federated, shared state in per-socket mergeable replicas
 } system_type_t;
 
 // Core emulation functions
@@ -0,0 +1,82 @@
+#ifndef MERGEABLE_H
+#define MERGEABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Mergeable (CRDT-style) objects for relaxed federated consistency. Each socket owns a
+// replica and updates it with intra-node atomics only; replicas are reconciled by merging,
+// which is commutative, associative and idempotent, so replicas that have merged the same
+// updates agree no matter the order. Merges are lock-free and may run while the source
+// replica is still being updated.
+
+#define MERGE_MAX_REPLICAS 16
+#define MERGE_SET_BITS 4096
+#define MERGE_SET_WORDS (MERGE_SET_BITS / 64)
+#define MERGE_MAP_SLOTS 1024
+
+// Grow-only counter: one slot per replica, merged by taking the per-slot maximum
+typedef struct {
+    volatile long counts[MERGE_MAX_REPLICAS];
+} merge_counter_t;
+
+// Max or min register, merged by taking the max (min)
+typedef struct {
+    volatile long value;
+    bool is_max;
+} merge_register_t;
+
+// Two-phase set over [0, MERGE_SET_BITS): merged by OR-ing the add and remove bitmaps;
+// an element is present if it was added and never removed
+typedef struct {
+    volatile uint64_t added[MERGE_SET_WORDS];
+    volatile uint64_t removed[MERGE_SET_WORDS];
+} merge_set_t;
+
+// Map from non-negative keys to max registers (open addressing, fixed capacity),
+// merged key by key
+typedef struct {
+    volatile long keys[MERGE_MAP_SLOTS]; // key + 1, 0 marks an empty slot
+    volatile long values[MERGE_MAP_SLOTS];
+} merge_map_t;
+
+// The set of objects one socket replicates in SYSTEM_FEDERATED_RELAXED
+typedef struct {
+    merge_counter_t counter;
+    merge_register_t max_value;
+    merge_register_t min_value;
+    merge_set_t members;
+    merge_map_t table;
+} federated_objects_t;
+
+void merge_counter_init(merge_counter_t* c);
+void merge_counter_add(merge_counter_t* c, int replica, long n);
+void merge_counter_merge(merge_counter_t* dst, const merge_counter_t* src);
+long merge_counter_value(const merge_counter_t* c);
+
+void merge_register_init(merge_register_t* r, bool is_max);
+void merge_register_update(merge_register_t* r, long v);
+void merge_register_merge(merge_register_t* dst, const merge_register_t* src);
+long merge_register_value(const merge_register_t* r);
+
+void merge_set_init(merge_set_t* s);
+void merge_set_add(merge_set_t* s, int element);
+void merge_set_remove(merge_set_t* s, int element);
+bool merge_set_contains(const merge_set_t* s, int element);
+int merge_set_size(const merge_set_t* s);
+void merge_set_merge(merge_set_t* dst, const merge_set_t* src);
+
+void merge_map_init(merge_map_t* m);
+bool merge_map_put_max(merge_map_t* m, long key, long value); // false when the map is full
+bool merge_map_get(const merge_map_t* m, long key, long* value);
+int merge_map_size(const merge_map_t* m);
+void merge_map_merge(merge_map_t* dst, const merge_map_t* src);
+
+void federated_objects_init(federated_objects_t* o);
+void federated_objects_merge(federated_objects_t* dst, const federated_objects_t* src);
+bool federated_objects_equal(const federated_objects_t* a, const federated_objects_t* b);
+
+// Explicit sync: bring every replica to the join of all of them
+void federated_sync(federated_objects_t* replicas, int num_replicas);
+
+#endif // MERGEABLE_H
@@ -0,0 +1,97 @@
+#ifndef NODE_REPLICATION_H
+#define NODE_REPLICATION_H
+
+#include "sync.h"
+#include <stddef.h>
+
+// Node Replication: a sequential data structure is replicated once per socket. Updates are
+// appended to one shared operation log; each replica has a flat combiner that batches the
+// updates posted by its socket's threads, appends them to the log and replays the log into
+// the local replica. Reads run against the local replica once it has caught up with the
+// log, so they never leave the socket.
+
+#define NR_MAX_REPLICAS 16
+#define NR_MAX_THREADS_PER_REPLICA 64
+#define NR_LOG_SIZE (1 << 18) // default entries in the circular operation log
+
+// A sequential data structure plugged into NR: update may change the state, read may not
+typedef struct {
+    const char* name;
+    size_t state_size;
+    void (*init)(void* state);
+    long (*update)(void* state, int op, long a, long b);
+    long (*read)(const void* state, int op, long a, long b);
+} nr_structure_t;
+
+typedef struct {
+    volatile long seq; // log index + 1 once the entry is filled in
+    int op;
+    int replica;
+    long a, b;
+} nr_log_entry_t;
+
+// A thread's flat-combining slot: the op it wants applied and, later, the response
+typedef struct {
+    volatile int pending;
+    int op;
+    long a, b;
+    volatile long response;
+} __attribute__((aligned(64))) nr_slot_t;
+
+typedef struct {
+    hw_lock_t combiner_lock __attribute__((aligned(64)));
+    volatile int writer __attribute__((aligned(64))); // replica reader-writer lock
+    volatile int readers;
+    volatile long local_tail __attribute__((aligned(64))); // next log entry to apply here
+    volatile int num_slots;
+    nr_slot_t slots[NR_MAX_THREADS_PER_REPLICA];
+    void* state;
+} nr_replica_t;
+
+typedef struct {
+    const nr_structure_t* ds;
+    int num_replicas;
+    nr_log_entry_t* log;
+    long log_size;
+    volatile long tail __attribute__((aligned(64)));           // next free log entry
+    volatile long completed_tail __attribute__((aligned(64))); // every entry below is applied somewhere
+    nr_replica_t* replicas[NR_MAX_REPLICAS];
+} node_replicated_t;
+
+// nr_init sets up a log of log_size entries (0 for NR_LOG_SIZE); each replica is then created
+// by nr_init_replica, ideally from a thread running on that replica's socket so its memory
+// is placed there by first touch
+int nr_init(node_replicated_t* nr, const nr_structure_t* ds, int num_replicas, long log_size);
+int nr_init_replica(node_replicated_t* nr, int replica);
+void nr_destroy(node_replicated_t* nr);
+
+// Each thread registers once with its socket's replica and gets a combining slot
+int nr_register(node_replicated_t* nr, int replica);
+long nr_execute_update(node_replicated_t* nr, int replica, int slot, int op, long a, long b);
+long nr_execute_read(node_replicated_t* nr, int replica, int op, long a, long b);
+
+// Sequential structures for NR (and for a single locked instance)
+
+// Hash map from non-negative keys to values; -1 means "absent"
+#define NR_MAP_CAPACITY (1 << 15)
+enum { NR_MAP_PUT, NR_MAP_REMOVE };  // updates: return the previous value
+enum { NR_MAP_GET };                 // reads
+typedef struct {
+    int size;
+    long keys[NR_MAP_CAPACITY];
+    long values[NR_MAP_CAPACITY];
+} nr_hashmap_t;
+
+// Binary min-heap priority queue; -1 means "empty"
+#define NR_PQ_CAPACITY (1 << 16)
+enum { NR_PQ_PUSH, NR_PQ_POP };     // updates: push returns the new size, pop the minimum
+enum { NR_PQ_PEEK, NR_PQ_SIZE };    // reads
+typedef struct {
+    int size;
+    long heap[NR_PQ_CAPACITY];
+} nr_pqueue_t;
+
+extern const nr_structure_t nr_hashmap;
+extern const nr_structure_t nr_pqueue;
+
+#endif // NODE_REPLICATION_H
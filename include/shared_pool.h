@@ -0,0 +1,16 @@
+#ifndef SHARED_POOL_H
+#define SHARED_POOL_H
+
+#include <stddef.h>
+
+// Memory shared between processes that share nothing else, as emulated nodes attached to
+// one memory pool would. The mapping is backed by an anonymous memfd, so it is inherited
+// across fork() and by nothing else, and is bound to one NUMA node before it is touched.
+
+// Map `size` zeroed bytes on `node` (-1: no binding). Returns NULL on failure.
+void* shared_pool_map(size_t size, int node);
+void shared_pool_unmap(void* pool, size_t size);
+// Move part of a pool (page-aligned) to another node. Returns 0 on success.
+int shared_pool_bind(void* addr, size_t size, int node);
+
+#endif // SHARED_POOL_H
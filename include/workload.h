@@ -4,6 +4,8 @@
 #include "sync.h"
 #include "timer.h"
 #include "emulation.h" // For system_type_t
+#include "mergeable.h"
+#include "coherence_region.h"
 #include <pthread.h>
 
 // Workload configuration
@@ -13,8 +15,18 @@ typedef struct {
     int compute_cycles;
     int total_sockets;
     system_type_t system_type;
+    bool dsm; // inter-node shared data lives in DSM pages (include/dsm.h)
 } workload_config_t;
 
+// Inter-node rendezvous, in memory every node maps (multi-process mode only): node
+// leaders publish their map output and meet at a barrier before the reduce phase.
+// The barrier is always in the shared pool; with DSM the outputs are in shared pages.
+#define EXCHANGE_MAX_NODES MERGE_MAX_REPLICAS
+typedef struct {
+    volatile int* barrier_count;
+    volatile long* node_output; // EXCHANGE_MAX_NODES slots
+} node_exchange_t;
+
 // Shared data structures
 typedef struct {
     volatile int counter;
@@ -22,6 +34,10 @@ typedef struct {
     volatile bool barrier_sense;
     generic_lock_t* intra_node_lock;
     generic_lock_t* inter_node_lock;
+    federated_objects_t* replica; // This socket's replica (SYSTEM_FEDERATED_RELAXED only)
+    federated_objects_t* replicas; // All sockets' replicas, for merging
+    node_exchange_t* exchange; // Shared with the other nodes' processes (multi-process mode only)
+    const sc_region_t* region; // Software-coherent range holding this data (SYSTEM_FULLY_NON_COHERENT only)
 } shared_data_t;
 
 // Thread context
@@ -33,6 +49,7 @@ typedef struct {
     shared_data_t* shared;
     timer phase_timers[3];
     timer total_timer;
+    sc_context_t coherence; // This thread's dirty lines when shared->region is set
     pthread_barrier_t* start_barrier; // Barrier to synchronize thread start
 } thread_context_t;
 
@@ -47,4 +64,8 @@ void init_shared_data(shared_data_t* shared, workload_config_t* config,
                      generic_lock_t* intra_lock, generic_lock_t* inter_lock);
 void cleanup_shared_data(shared_data_t* shared);
 
+// Relaxed mode: the per-thread updates applied directly to one object set, as the
+// eager (lock-per-update) version would; the merged replicas must end up equal to it
+void replay_eager_updates(federated_objects_t* objects, workload_config_t* config);
+
 #endif // WORKLOAD_H
\ No newline at end of file
@@ -0,0 +1,241 @@
+#include "bench_util.h"
+#include <atomic>
+#include <future>
+
+#include <cxxopts.hpp>
+
+#define NUM_TRIALS 3
+#define MIN_LOADS (1UL << 22)
+#define LOADS_PER_LINE 4 // each line of the working set is visited this many times on average
+
+// Follow the chain for loads steps and return the average ns per load
+static double chase(ChaseNode *start, size_t loads) {
+	ChaseNode *p = start;
+	// Warm up the TLB and caches before timing
+	for (size_t i = 0; i < loads / 4; i++)
+		p = p->next;
+	auto start_time = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < loads; i += 16) {
+		p = p->next; p = p->next; p = p->next; p = p->next;
+		p = p->next; p = p->next; p = p->next; p = p->next;
+		p = p->next; p = p->next; p = p->next; p = p->next;
+		p = p->next; p = p->next; p = p->next; p = p->next;
+	}
+	auto end_time = std::chrono::steady_clock::now();
+	asm volatile("" : : "r"(p));
+	return std::chrono::duration<double, std::nano>(end_time - start_time).count() / loads;
+}
+
+// chase() through the emulated CXL pool's accessor, which adds the device latency per load
+static double chase_cxl(cxl_pool_t *pool, ChaseNode *start, size_t loads) {
+	ChaseNode *p = start;
+	for (size_t i = 0; i < loads / 4; i++)
+		p = p->next;
+	auto start_time = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < loads; i++)
+		p = (ChaseNode *)cxl_load64(pool, (volatile uint64_t *)&p->next);
+	auto end_time = std::chrono::steady_clock::now();
+	asm volatile("" : : "r"(p));
+	return std::chrono::duration<double, std::nano>(end_time - start_time).count() / loads;
+}
+
+// Background traffic generator for the loaded-latency mode. Streams over its chunk, writing
+// write_pct percent of the lines and reading the rest, with delay pauses after every line.
+// Returns bytes moved per second.
+double load_generator(uint8_t *chunk, size_t size, int delay, int write_pct, int core_num, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	if (!pin_to_core(core_num))
+		return 0;
+	size_t lines = 0;
+	uint64_t sink = 0;
+	cxl_pool_t *pool = cxl_pool_of(chunk);
+	sync_point.arrive_and_wait();
+	auto start_time = std::chrono::steady_clock::now();
+	while (!stop.load(std::memory_order_relaxed)) {
+		for (size_t off = 0; off < size && !stop.load(std::memory_order_relaxed); off += CACHE_LINE_SIZE) {
+			volatile uint64_t *line = (volatile uint64_t *)(chunk + off);
+			if (pool)
+				cxl_pool_charge(pool, chunk + off, CACHE_LINE_SIZE);
+			if ((int)(lines % 100) < write_pct)
+				*line = lines;
+			else
+				sink += *line;
+			lines++;
+			for (int d = 0; d < delay; d++)
+				_mm_pause();
+		}
+	}
+	auto end_time = std::chrono::steady_clock::now();
+	asm volatile("" : : "r"(sink));
+	return lines * CACHE_LINE_SIZE / std::chrono::duration<double>(end_time - start_time).count();
+}
+
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("Latency Test", "Pointer-chasing idle and loaded memory latency");
+	options.add_options()
+		("c,cpu_node", "NUMA node whose cores run the chase and load threads", cxxopts::value<int>()->default_value("0"))
+		("m,memory_nodes", "Memory nodes to measure, including CXL (default: all)", cxxopts::value<std::string>()->default_value(""))
+		("s,sizes", "Working-set sizes (default: 16K doubling to 4G)", cxxopts::value<std::string>()->default_value(""))
+		("p,pages", "Page modes (4k,huge)", cxxopts::value<std::string>()->default_value("4k,huge"))
+		("l,loaded", "Loaded-latency mode: background threads generate traffic on the same node")
+		("load_threads", "Background load threads (default: all remaining cores of the CPU node)", cxxopts::value<int>()->default_value("0"))
+		("load_delays", "Pause iterations per line in the load threads; one curve point each", cxxopts::value<std::string>()->default_value("0,10,20,50,100,200,500,1000,2000,5000"))
+		("write_pct", "Percentage of load-generator lines that are written", cxxopts::value<int>()->default_value("0"))
+		("load_size", "Working set of the chase thread in loaded mode", cxxopts::value<std::string>()->default_value("1G"))
+		("trials", "Number of trials", cxxopts::value<int>()->default_value(std::to_string(NUM_TRIALS)))
+		("r,result", "Result csv file", cxxopts::value<std::string>()->default_value("results/latency.csv"))
+		("emulate_cxl", "Serve this node id from an emulated CXL pool: node[:latency_ns[:GB/s[:size]]]", cxxopts::value<std::string>())
+		("placement", "Buffer placement (bind,preferred,interleave,first_touch)", cxxopts::value<std::string>()->default_value("bind"))
+		("h,help", "Print usage")
+		;
+	auto arguments = options.parse(argc, argv);
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	// Initialize NUMA library
+	if (numa_available() == -1) {
+		std::cerr << "NUMA is not available on this system." << std::endl;
+		return 1;
+	}
+	if (arguments.count("emulate_cxl") && !enable_cxl_emulation(arguments["emulate_cxl"].as<std::string>()))
+		return 1;
+	if (!set_alloc_policy("default", arguments["placement"].as<std::string>()))
+		return 1;
+
+	int cpu_node = arguments["cpu_node"].as<int>();
+	std::vector<int> cores = cores_of_node(cpu_node);
+	if (cores.empty()) {
+		std::cerr << "No CPUs found on NUMA node " << cpu_node << "." << std::endl;
+		return 1;
+	}
+	std::vector<int> m_nodes = memory_nodes();
+	if (!arguments["memory_nodes"].as<std::string>().empty()) {
+		m_nodes.clear();
+		for (long n : parse_list(arguments["memory_nodes"].as<std::string>()))
+			m_nodes.push_back(n);
+	}
+	std::vector<size_t> sizes;
+	if (arguments["sizes"].as<std::string>().empty()) {
+		for (size_t s = 16UL << 10; s <= 4UL << 30; s *= 2)
+			sizes.push_back(s);
+	} else {
+		std::stringstream ss(arguments["sizes"].as<std::string>());
+		for (std::string tok; std::getline(ss, tok, ',');)
+			sizes.push_back(parse_size(tok));
+	}
+	std::vector<std::string> page_modes;
+	std::stringstream ss(arguments["pages"].as<std::string>());
+	for (std::string tok; std::getline(ss, tok, ',');) {
+		if (tok != "4k" && tok != "huge") {
+			std::cerr << "Unknown page mode: " << tok << std::endl;
+			return 1;
+		}
+		page_modes.push_back(tok);
+	}
+	bool loaded = arguments.count("loaded");
+	int num_trials = arguments["trials"].as<int>();
+	std::mt19937_64 rng(42);
+
+	// Open a file to store the results
+	std::ofstream results_file(arguments["result"].as<std::string>());
+	results_file << "mode,cpu_node,memory_node,pages,page_size,working_set,load_threads,delay,write_pct,load_bandwidth,latency_ns\n";
+
+	// The chase thread always runs on the first core of the CPU node
+	if (!pin_to_core(cores[0]))
+		return 1;
+
+	for (int memory_node : m_nodes) {
+		for (const std::string &page_mode : page_modes) {
+			bool huge = page_mode == "huge";
+			if (!loaded) {
+				// Idle latency: working-set sweep from L1 to DRAM/CXL
+				for (size_t size : sizes) {
+					size_t alloc_size = (size + (2UL << 20) - 1) & ~((2UL << 20) - 1);
+					ChaseNode *buf = static_cast<ChaseNode *>(alloc_pages_on_node(alloc_size, memory_node, huge));
+					if (buf == nullptr) {
+						std::cerr << "Failed to allocate memory on NUMA node " << memory_node << "." << std::endl;
+						return 1;
+					}
+					// alloc_pages_on_node has zeroed the pages unless the placement is first_touch
+					if (alloc_policy().placement == NodePlacement::FirstTouch)
+						touch_by_owners(buf, alloc_size, {{buf, alloc_size, cores[0]}});
+					size_t lines = size / CACHE_LINE_SIZE;
+					ChaseNode *start = build_chase(buf, lines, rng);
+					size_t loads = std::max(MIN_LOADS, lines * LOADS_PER_LINE);
+					double latency = 0;
+					for (int trial = 0; trial < num_trials; trial++)
+						latency += cxl_pool_of(buf) ? chase_cxl(cxl_pool_of(buf), start, loads) : chase(start, loads);
+					latency /= num_trials;
+					size_t page_size = mapping_page_size(buf);
+
+					results_file << "idle," << cpu_node << "," << memory_node << "," << page_mode << "," << page_size << ","
+						<< size << ",0,0,0,0," << latency << "\n";
+					std::cout << "Node " << cpu_node << "->" << memory_node << " " << page_mode << " (" << (page_size >> 10) << "K pages) size "
+						<< size << ": " << latency << " ns/load" << std::endl;
+					free_pages(buf, alloc_size);
+				}
+				continue;
+			}
+
+			// Loaded latency: background threads on the same node produce a latency-vs-bandwidth curve
+			size_t size = parse_size(arguments["load_size"].as<std::string>());
+			size_t alloc_size = (size + (2UL << 20) - 1) & ~((2UL << 20) - 1);
+			ChaseNode *buf = static_cast<ChaseNode *>(alloc_pages_on_node(alloc_size, memory_node, huge));
+			int load_threads = arguments["load_threads"].as<int>();
+			if (load_threads <= 0 || load_threads > (int)cores.size() - 1)
+				load_threads = cores.size() - 1;
+			size_t load_chunk = 256UL << 20;
+			uint8_t *load_buf = static_cast<uint8_t *>(alloc_pages_on_node(load_chunk * std::max(load_threads, 1), memory_node, huge));
+			if (buf == nullptr || load_buf == nullptr) {
+				std::cerr << "Failed to allocate memory on NUMA node " << memory_node << "." << std::endl;
+				return 1;
+			}
+			// Under first_touch, fault the chase from its core and each load chunk from its
+			// generator's core before the trials, so no trial pays for the page faults
+			if (alloc_policy().placement == NodePlacement::FirstTouch) {
+				touch_by_owners(buf, alloc_size, {{buf, alloc_size, cores[0]}});
+				std::vector<OwnedRange> owners;
+				for (int i = 0; i < load_threads; i++)
+					owners.push_back({load_buf + i * load_chunk, load_chunk, cores[i + 1]});
+				touch_by_owners(load_buf, load_chunk * std::max(load_threads, 1), owners);
+			}
+			size_t lines = size / CACHE_LINE_SIZE;
+			ChaseNode *start = build_chase(buf, lines, rng);
+			size_t loads = std::max(MIN_LOADS, lines * LOADS_PER_LINE);
+			size_t page_size = mapping_page_size(buf);
+			int write_pct = arguments["write_pct"].as<int>();
+
+			for (long delay : parse_list(arguments["load_delays"].as<std::string>())) {
+				double latency = 0, bandwidth = 0;
+				for (int trial = 0; trial < num_trials; trial++) {
+					alignas(CACHE_LINE_SIZE) std::atomic<bool> stop(false);
+					std::vector<std::future<double>> futs;
+					MyBarrier sync_point(load_threads + 1);
+					for (int i = 0; i < load_threads; i++)
+						futs.push_back(std::async(std::launch::async, load_generator, load_buf + i * load_chunk, load_chunk,
+							(int)delay, write_pct, cores[i + 1], std::ref(sync_point), std::ref(stop)));
+					sync_point.arrive_and_wait();
+					latency += cxl_pool_of(buf) ? chase_cxl(cxl_pool_of(buf), start, loads) : chase(start, loads);
+					stop.store(true);
+					for (auto &f : futs)
+						bandwidth += f.get();
+				}
+				latency /= num_trials;
+				bandwidth = bandwidth / num_trials / 1e9; // GB/s
+
+				results_file << "loaded," << cpu_node << "," << memory_node << "," << page_mode << "," << page_size << ","
+					<< size << "," << load_threads << "," << delay << "," << write_pct << "," << bandwidth << "," << latency << "\n";
+				std::cout << "Node " << cpu_node << "->" << memory_node << " " << page_mode << " delay " << delay << ": "
+					<< bandwidth << " GB/s, " << latency << " ns/load" << std::endl;
+			}
+			free_pages(buf, alloc_size);
+			free_pages(load_buf, load_chunk * std::max(load_threads, 1));
+		}
+	}
+
+	// Close the results file
+	results_file.close();
+
+	return 0;
+}
@@ -0,0 +1,257 @@
+#include "bench_util.h"
+#include "lockfree_structures.h"
+#include <atomic>
+#include <future>
+#include <map>
+
+#include <cxxopts.hpp>
+
+#define NUM_TRIALS 3
+#define RUN_TIME_MS 1000
+#define SAMPLE_EVERY 64     // every thread times one of this many operations
+#define MAX_SAMPLES (1UL << 18)
+
+// Which cores produce, which consume, and where the structure lives
+struct Placement {
+	std::string threads; // same_group or cross_socket
+	std::string memory;  // local (the producers' node) or cxl
+	int memory_node;
+	std::vector<int> producer_cores, consumer_cores;
+};
+
+struct WorkerResult {
+	size_t ops = 0;
+	uint64_t sum = 0;            // of the values pushed or popped, to check nothing is lost
+	std::vector<double> samples; // latency of successful operations in ns
+};
+
+template <class S>
+WorkerResult structure_worker(S &s, int tid, bool producer, int core_num, size_t max_samples, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	WorkerResult r;
+	if (!pin_to_core(core_num))
+		return r;
+	r.samples.reserve(max_samples);
+	double ticks_per_ns = tsc_per_ns();
+	uint64_t overhead = tsc_overhead();
+	uint64_t next_value = (uint64_t)tid << 40;
+	auto op = [&]() {
+		if (producer) {
+			if (!s.push(tid, next_value))
+				return false;
+			r.sum += next_value++;
+			return true;
+		}
+		uint64_t v;
+		if (!s.pop(tid, v))
+			return false;
+		r.sum += v;
+		return true;
+	};
+	sync_point.arrive_and_wait();
+	while (!stop.load(std::memory_order_relaxed)) {
+		for (int i = 0; i < SAMPLE_EVERY - 1; i++)
+			r.ops += op();
+		uint64_t t0 = tsc_begin();
+		bool ok = op();
+		uint64_t t1 = tsc_end();
+		if (ok) {
+			r.ops++;
+			if (r.samples.size() < max_samples)
+				r.samples.push_back((double)(t1 - t0 > overhead ? t1 - t0 - overhead : 0) / ticks_per_ns);
+		}
+	}
+	return r;
+}
+
+struct StructureResult {
+	double mops = 0; // successful pushes and pops
+	long lost = 0;   // pushed - popped - left over at the end; anything but 0 is a bug
+	std::vector<double> push_samples, pop_samples;
+};
+
+template <class S>
+static StructureResult run_structure(const Placement &p, size_t capacity, int duration_ms, int num_trials) {
+	StructureResult res;
+	size_t num_producers = p.producer_cores.size();
+	size_t num_threads = num_producers + p.consumer_cores.size();
+	for (int trial = 0; trial < num_trials; trial++) {
+		S s(capacity, p.memory_node, num_threads);
+		// Start half full so consumers do not begin on an empty structure
+		uint64_t prefill_sum = 0;
+		long prefilled = 0;
+		for (uint64_t v = 1; v <= capacity / 2 && s.push(0, v); v++) {
+			prefill_sum += v;
+			prefilled++;
+		}
+		alignas(CACHE_LINE_SIZE) std::atomic<bool> stop(false);
+		MyBarrier sync_point(num_threads + 1);
+		std::vector<std::future<WorkerResult>> futs;
+		for (size_t i = 0; i < num_threads; i++) {
+			bool producer = i < num_producers;
+			int core = producer ? p.producer_cores[i] : p.consumer_cores[i - num_producers];
+			futs.push_back(std::async(std::launch::async, structure_worker<S>, std::ref(s), i, producer, core,
+				MAX_SAMPLES / num_threads + 1, std::ref(sync_point), std::ref(stop)));
+		}
+		sync_point.arrive_and_wait();
+		std::this_thread::sleep_for(std::chrono::milliseconds(duration_ms));
+		stop.store(true);
+		size_t ops = 0;
+		long pushed = prefilled, popped = 0;
+		uint64_t pushed_sum = prefill_sum, popped_sum = 0;
+		for (size_t i = 0; i < num_threads; i++) {
+			WorkerResult r = futs[i].get();
+			ops += r.ops;
+			std::vector<double> &samples = i < num_producers ? res.push_samples : res.pop_samples;
+			samples.insert(samples.end(), r.samples.begin(), r.samples.end());
+			(i < num_producers ? pushed : popped) += r.ops;
+			(i < num_producers ? pushed_sum : popped_sum) += r.sum;
+		}
+		res.mops += ops / (duration_ms / 1000.0) / 1e6 / num_trials;
+		// Drain: every pushed value must come out exactly once
+		uint64_t v;
+		while (s.pop(0, v)) {
+			popped++;
+			popped_sum += v;
+		}
+		res.lost += pushed - popped;
+		if (pushed != popped || pushed_sum != popped_sum)
+			std::cerr << "Warning: pushed " << pushed << " values but popped " << popped
+				<< (pushed_sum != popped_sum ? " (checksums differ)" : "") << std::endl;
+	}
+	return res;
+}
+
+static const std::map<std::string, StructureResult (*)(const Placement &, size_t, int, int)> structure_variants = {
+	{"ms_queue", run_structure<MsQueue>},
+	{"vyukov_ring", run_structure<VyukovRing>},
+	{"faa_queue", run_structure<FaaQueue>},
+	{"elimination_stack", run_structure<EliminationStack>},
+};
+
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("Lock-free", "Throughput and per-op latency of lock-free queues and stacks under producer/consumer placements");
+	options.add_options()
+		("v,variants", "Structures (ms_queue,vyukov_ring,faa_queue,elimination_stack)", cxxopts::value<std::string>()->default_value("ms_queue,vyukov_ring,faa_queue,elimination_stack"))
+		("p,placements", "Thread placements (same_group: producers and consumers share one LLC group, cross_socket: producers on one socket, consumers on another)", cxxopts::value<std::string>()->default_value("same_group,cross_socket"))
+		("m,memory", "Structure memory (local: the producers' node, cxl: the first CPU-less node)", cxxopts::value<std::string>()->default_value("local,cxl"))
+		("t,threads", "Producer counts; each run has as many consumers", cxxopts::value<std::string>()->default_value("1,2,4,8"))
+		("c,capacity", "Structure capacity in elements", cxxopts::value<size_t>()->default_value("65536"))
+		("d,duration", "Run time per trial in ms", cxxopts::value<int>()->default_value(std::to_string(RUN_TIME_MS)))
+		("trials", "Number of trials", cxxopts::value<int>()->default_value(std::to_string(NUM_TRIALS)))
+		("r,result", "Result csv file", cxxopts::value<std::string>()->default_value("results/lockfree.csv"))
+		("placement", "Structure placement (bind,preferred,interleave)", cxxopts::value<std::string>()->default_value("bind"))
+		("h,help", "Print usage")
+		;
+	auto arguments = options.parse(argc, argv);
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	// Initialize NUMA library
+	if (numa_available() == -1) {
+		std::cerr << "NUMA is not available on this system." << std::endl;
+		return 1;
+	}
+	if (!set_alloc_policy("default", arguments["placement"].as<std::string>()))
+		return 1;
+	// Every structure is shared by all producers and consumers, so no thread owns its pages
+	if (alloc_policy().placement == NodePlacement::FirstTouch) {
+		std::cerr << "first_touch has no owning thread here; use bind, preferred or interleave." << std::endl;
+		return 1;
+	}
+
+	std::vector<std::string> variants, placements, memories;
+	auto split = [](const std::string &spec) {
+		std::vector<std::string> out;
+		std::stringstream ss(spec);
+		for (std::string tok; std::getline(ss, tok, ',');)
+			out.push_back(tok);
+		return out;
+	};
+	variants = split(arguments["variants"].as<std::string>());
+	placements = split(arguments["placements"].as<std::string>());
+	memories = split(arguments["memory"].as<std::string>());
+	for (const std::string &v : variants) {
+		if (!structure_variants.count(v)) {
+			std::cerr << "Unknown structure: " << v << std::endl;
+			return 1;
+		}
+	}
+	size_t capacity = arguments["capacity"].as<size_t>();
+	int duration_ms = arguments["duration"].as<int>();
+	int num_trials = arguments["trials"].as<int>();
+
+	// Producers always run on the first CPU node; cross_socket consumers on a node of another package
+	std::vector<int> nodes = cpu_nodes();
+	int home_node = nodes[0];
+	std::vector<int> home_cores = cores_of_node(home_node);
+	std::vector<int> group_cores;
+	for (int c : home_cores)
+		if (cpu_llc(c) == cpu_llc(home_cores[0]))
+			group_cores.push_back(c);
+	int far_node = -1;
+	for (int n : nodes)
+		if (far_node == -1 && cpu_package(cores_of_node(n)[0]) != cpu_package(home_cores[0]))
+			far_node = n;
+	int cxl_node = -1;
+	for (int n : memory_nodes())
+		if (cxl_node == -1 && std::find(nodes.begin(), nodes.end(), n) == nodes.end())
+			cxl_node = n;
+
+	std::ofstream results_file(arguments["result"].as<std::string>());
+	results_file << "structure,placement,memory,memory_node,producers,consumers,mops,push_p50_ns,push_p90_ns,push_p99_ns,pop_p50_ns,pop_p90_ns,pop_p99_ns,lost\n";
+
+	for (const std::string &threads : placements) {
+		if (threads != "same_group" && threads != "cross_socket") {
+			std::cerr << "Unknown placement: " << threads << std::endl;
+			return 1;
+		}
+		if (threads == "cross_socket" && far_node == -1) {
+			std::cout << "Skipping cross_socket: only one socket" << std::endl;
+			continue;
+		}
+		for (const std::string &memory : memories) {
+			if (memory != "local" && memory != "cxl") {
+				std::cerr << "Unknown memory placement: " << memory << std::endl;
+				return 1;
+			}
+			if (memory == "cxl" && cxl_node == -1) {
+				std::cout << "Skipping cxl memory: no CPU-less node" << std::endl;
+				continue;
+			}
+			for (long num_producers : parse_list(arguments["threads"].as<std::string>())) {
+				Placement p{threads, memory, memory == "cxl" ? cxl_node : home_node, {}, {}};
+				if (threads == "same_group") {
+					// Producers and consumers interleave over the group's cores
+					for (long i = 0; i < num_producers; i++) {
+						p.producer_cores.push_back(group_cores[(2 * i) % group_cores.size()]);
+						p.consumer_cores.push_back(group_cores[(2 * i + 1) % group_cores.size()]);
+					}
+				} else {
+					std::vector<int> far_cores = cores_of_node(far_node);
+					for (long i = 0; i < num_producers; i++) {
+						p.producer_cores.push_back(home_cores[i % home_cores.size()]);
+						p.consumer_cores.push_back(far_cores[i % far_cores.size()]);
+					}
+				}
+				for (const std::string &variant : variants) {
+					StructureResult r = structure_variants.at(variant)(p, capacity, duration_ms, num_trials);
+					LatencyStats push = latency_stats(r.push_samples);
+					LatencyStats pop = latency_stats(r.pop_samples);
+					results_file << variant << "," << threads << "," << memory << "," << p.memory_node << "," << num_producers << ","
+						<< num_producers << "," << r.mops << "," << push.p50 << "," << push.p90 << "," << push.p99 << ","
+						<< pop.p50 << "," << pop.p90 << "," << pop.p99 << "," << r.lost << "\n";
+					std::cout << variant << " " << threads << " memory " << memory << " (node " << p.memory_node << ") "
+						<< num_producers << "P/" << num_producers << "C: " << r.mops << " Mops/s, push p50 " << push.p50
+						<< " ns p99 " << push.p99 << " ns, pop p50 " << pop.p50 << " ns p99 " << pop.p99 << " ns" << std::endl;
+				}
+			}
+		}
+	}
+
+	// Close the results file
+	results_file.close();
+
+	return 0;
+}
@@ -0,0 +1,488 @@
+#ifndef LOCKFREE_STRUCTURES_H
+#define LOCKFREE_STRUCTURES_H
+
+// Lock-free queues and stacks whose memory is bound to one NUMA node, so the same structure
+// can be homed on the producers' node, the consumers' node or a CPU-less (CXL) node. Every
+// structure is built for a fixed number of threads (tid 0..n-1) with a fixed capacity and
+// offers push(tid, v) and pop(tid, v); push fails when full and pop when empty. Values must
+// be below UINT64_MAX - 1.
+//
+// Nodes are never returned to the OS while a structure is alive: links are 32-bit pool
+// indices carrying a 32-bit ABA tag in the same word, as in the original counted-pointer
+// Michael-Scott design. FaaQueue segments are recycled under per-thread hazard pointers.
+
+#include "bench_util.h"
+#include <atomic>
+#include <new>
+
+#define LF_NIL UINT32_MAX
+
+inline uint64_t lf_pack(uint32_t idx, uint32_t tag) {
+	return (uint64_t)tag << 32 | idx;
+}
+inline uint32_t lf_idx(uint64_t w) {
+	return (uint32_t)w;
+}
+inline uint32_t lf_tag(uint64_t w) {
+	return (uint32_t)(w >> 32);
+}
+
+// Placement-constructed array of T in pages bound to memory_node
+template <class T>
+class NodeArray {
+public:
+	NodeArray(size_t n, int memory_node) : n_(n), bytes_(std::max(n * sizeof(T), (size_t)4096)) {
+		items_ = (T *)alloc_pages_on_node(bytes_, memory_node, false);
+		if (!items_)
+			throw std::bad_alloc();
+		for (size_t i = 0; i < n_; i++)
+			new (&items_[i]) T();
+	}
+	~NodeArray() {
+		for (size_t i = 0; i < n_; i++)
+			items_[i].~T();
+		free_pages(items_, bytes_);
+	}
+	NodeArray(const NodeArray &) = delete;
+	NodeArray &operator=(const NodeArray &) = delete;
+	T &operator[](size_t i) { return items_[i]; }
+	size_t size() const { return n_; }
+
+private:
+	size_t n_, bytes_;
+	T *items_;
+};
+
+// Fixed set of nodes handed out by index; free nodes sit on a tagged Treiber free list
+// threaded through Node::free_next. Nodes are type-stable, so reading a stale node is safe.
+template <class Node>
+class NodePool {
+public:
+	NodePool(size_t capacity, int memory_node) : nodes_(capacity, memory_node) {
+		for (size_t i = 0; i < capacity; i++)
+			nodes_[i].free_next.store(i + 1 < capacity ? i + 1 : LF_NIL, std::memory_order_relaxed);
+		free_.store(lf_pack(capacity ? 0 : LF_NIL, 0));
+	}
+	Node &operator[](uint32_t i) { return nodes_[i]; }
+	uint32_t index_of(const Node *n) { return n - &nodes_[0]; }
+
+	uint32_t alloc() {
+		uint64_t head = free_.load(std::memory_order_acquire);
+		while (lf_idx(head) != LF_NIL) {
+			uint32_t next = nodes_[lf_idx(head)].free_next.load(std::memory_order_relaxed);
+			if (free_.compare_exchange_weak(head, lf_pack(next, lf_tag(head) + 1), std::memory_order_acquire))
+				return lf_idx(head);
+		}
+		return LF_NIL;
+	}
+
+	void free(uint32_t i) {
+		uint64_t head = free_.load(std::memory_order_relaxed);
+		do {
+			nodes_[i].free_next.store(lf_idx(head), std::memory_order_relaxed);
+		} while (!free_.compare_exchange_weak(head, lf_pack(i, lf_tag(head) + 1), std::memory_order_release));
+	}
+
+private:
+	NodeArray<Node> nodes_;
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> free_;
+	char pad_[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+};
+
+// Michael-Scott queue with counted (index + tag) pointers and a dummy head node
+class MsQueue {
+public:
+	MsQueue(size_t capacity, int memory_node, int) : pool_(capacity + 1, memory_node) {
+		uint32_t dummy = pool_.alloc();
+		pool_[dummy].next.store(lf_pack(LF_NIL, 0));
+		head_.store(lf_pack(dummy, 0));
+		tail_.store(lf_pack(dummy, 0));
+	}
+
+	bool push(int, uint64_t v) {
+		uint32_t n = pool_.alloc();
+		if (n == LF_NIL)
+			return false;
+		pool_[n].value.store(v, std::memory_order_relaxed);
+		uint64_t old = pool_[n].next.load(std::memory_order_relaxed);
+		pool_[n].next.store(lf_pack(LF_NIL, lf_tag(old) + 1), std::memory_order_relaxed);
+		uint64_t tail;
+		while (true) {
+			tail = tail_.load(std::memory_order_acquire);
+			uint64_t next = pool_[lf_idx(tail)].next.load(std::memory_order_acquire);
+			if (tail != tail_.load(std::memory_order_acquire))
+				continue;
+			if (lf_idx(next) == LF_NIL) {
+				if (pool_[lf_idx(tail)].next.compare_exchange_weak(next, lf_pack(n, lf_tag(next) + 1), std::memory_order_release))
+					break;
+			} else {
+				// Tail is lagging: help swing it forward
+				tail_.compare_exchange_weak(tail, lf_pack(lf_idx(next), lf_tag(tail) + 1), std::memory_order_release);
+			}
+		}
+		tail_.compare_exchange_strong(tail, lf_pack(n, lf_tag(tail) + 1), std::memory_order_release);
+		return true;
+	}
+
+	bool pop(int, uint64_t &v) {
+		uint64_t head;
+		while (true) {
+			head = head_.load(std::memory_order_acquire);
+			uint64_t tail = tail_.load(std::memory_order_acquire);
+			uint64_t next = pool_[lf_idx(head)].next.load(std::memory_order_acquire);
+			if (head != head_.load(std::memory_order_acquire))
+				continue;
+			if (lf_idx(head) == lf_idx(tail)) {
+				if (lf_idx(next) == LF_NIL)
+					return false;
+				tail_.compare_exchange_weak(tail, lf_pack(lf_idx(next), lf_tag(tail) + 1), std::memory_order_release);
+			} else {
+				// Read before the CAS: once head moves, the next node may be popped and reused
+				v = pool_[lf_idx(next)].value.load(std::memory_order_relaxed);
+				if (head_.compare_exchange_weak(head, lf_pack(lf_idx(next), lf_tag(head) + 1), std::memory_order_acq_rel))
+					break;
+			}
+		}
+		pool_.free(lf_idx(head));
+		return true;
+	}
+
+private:
+	struct alignas(CACHE_LINE_SIZE) Node {
+		std::atomic<uint64_t> next{0};
+		std::atomic<uint32_t> free_next{0};
+		std::atomic<uint64_t> value{0}; // may be read by a pop that then loses its CAS
+	};
+	NodePool<Node> pool_;
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head_;
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail_;
+	char pad_[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+};
+
+// Vyukov's bounded MPMC ring: each cell carries a sequence number that says whose turn it is,
+// so producers and consumers only contend on their own index and on the cell they claim
+class VyukovRing {
+public:
+	VyukovRing(size_t capacity, int memory_node, int) : cells_(next_pow2(capacity), memory_node), mask_(cells_.size() - 1) {
+		for (size_t i = 0; i < cells_.size(); i++)
+			cells_[i].seq.store(i, std::memory_order_relaxed);
+		enqueue_pos_.store(0);
+		dequeue_pos_.store(0);
+	}
+
+	bool push(int, uint64_t v) {
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		Cell *cell;
+		while (true) {
+			cell = &cells_[pos & mask_];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0) {
+				if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+		cell->value = v;
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(int, uint64_t &v) {
+		size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		Cell *cell;
+		while (true) {
+			cell = &cells_[pos & mask_];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+			if (diff == 0) {
+				if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = dequeue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+		v = cell->value;
+		cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t> seq{0};
+		uint64_t value = 0;
+	};
+	static size_t next_pow2(size_t n) {
+		size_t p = 2;
+		while (p < n)
+			p <<= 1;
+		return p;
+	}
+	NodeArray<Cell> cells_;
+	size_t mask_;
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> enqueue_pos_;
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> dequeue_pos_;
+	char pad_[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+};
+
+// Linked segments of slots claimed with fetch_add tickets (FAAArrayQueue, Ramalhete and
+// Correia): the fast path is one fetch_add plus one CAS or exchange on a private slot. A
+// dequeuer that overtakes its enqueuer poisons the slot and both move on to the next ticket.
+class FaaQueue {
+public:
+	static constexpr int SEGMENT_SLOTS = 1024;
+	static constexpr int RETIRE_BATCH = 8; // retired segments per thread before a hazard scan
+
+	FaaQueue(size_t capacity, int memory_node, int num_threads)
+		: num_threads_(num_threads), max_live_(capacity / SEGMENT_SLOTS + 1),
+		  pool_(capacity / SEGMENT_SLOTS + 2 + num_threads * (RETIRE_BATCH + 2), memory_node),
+		  hazards_(num_threads, memory_node), retired_(num_threads) {
+		Segment *first = new_segment();
+		head_.store(first);
+		tail_.store(first);
+	}
+
+	bool push(int tid, uint64_t v) {
+		while (true) {
+			Segment *tail = protect(tid, tail_);
+			int idx = tail->enqidx.fetch_add(1);
+			if (idx >= SEGMENT_SLOTS) {
+				if (tail != tail_.load())
+					continue;
+				Segment *next = tail->next.load();
+				if (next == nullptr) {
+					Segment *seg = new_segment();
+					if (!seg) {
+						clear(tid);
+						return false;
+					}
+					seg->items[0].store(v + 1, std::memory_order_relaxed);
+					seg->enqidx.store(1, std::memory_order_relaxed);
+					Segment *expected = nullptr;
+					if (tail->next.compare_exchange_strong(expected, seg)) {
+						tail_.compare_exchange_strong(tail, seg);
+						clear(tid);
+						return true;
+					}
+					release_segment(seg); // never published
+				} else {
+					tail_.compare_exchange_strong(tail, next);
+				}
+				continue;
+			}
+			uint64_t expected = EMPTY;
+			if (tail->items[idx].compare_exchange_strong(expected, v + 1)) {
+				clear(tid);
+				return true;
+			}
+		}
+	}
+
+	bool pop(int tid, uint64_t &v) {
+		while (true) {
+			Segment *head = protect(tid, head_);
+			if (head->deqidx.load() >= head->enqidx.load() && head->next.load() == nullptr)
+				break;
+			int idx = head->deqidx.fetch_add(1);
+			if (idx >= SEGMENT_SLOTS) {
+				Segment *next = head->next.load();
+				if (next == nullptr)
+					break;
+				Segment *expected = head;
+				tail_.compare_exchange_strong(expected, next); // never leave tail behind head
+				if (head_.compare_exchange_strong(head, next)) {
+					live_.fetch_sub(1, std::memory_order_relaxed);
+					clear(tid);
+					retire(tid, head);
+				}
+				continue;
+			}
+			uint64_t item = head->items[idx].exchange(TAKEN);
+			if (item == EMPTY)
+				continue;
+			clear(tid);
+			v = item - 1;
+			return true;
+		}
+		clear(tid);
+		return false;
+	}
+
+private:
+	static constexpr uint64_t EMPTY = 0;
+	static constexpr uint64_t TAKEN = UINT64_MAX;
+
+	struct alignas(CACHE_LINE_SIZE) Segment {
+		alignas(CACHE_LINE_SIZE) std::atomic<int> deqidx{0};
+		alignas(CACHE_LINE_SIZE) std::atomic<int> enqidx{0};
+		alignas(CACHE_LINE_SIZE) std::atomic<Segment *> next{nullptr};
+		std::atomic<uint32_t> free_next{0};
+		alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> items[SEGMENT_SLOTS];
+	};
+	struct alignas(CACHE_LINE_SIZE) Hazard {
+		std::atomic<Segment *> ptr{nullptr};
+	};
+
+	// The pool has slack for segments awaiting reclamation; the live count is what bounds
+	// the queue to its capacity
+	Segment *new_segment() {
+		if (live_.fetch_add(1, std::memory_order_relaxed) >= max_live_) {
+			live_.fetch_sub(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		uint32_t i = pool_.alloc();
+		if (i == LF_NIL) {
+			live_.fetch_sub(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		Segment *seg = &pool_[i];
+		seg->deqidx.store(0, std::memory_order_relaxed);
+		seg->enqidx.store(0, std::memory_order_relaxed);
+		seg->next.store(nullptr, std::memory_order_relaxed);
+		for (auto &item : seg->items)
+			item.store(EMPTY, std::memory_order_relaxed);
+		return seg;
+	}
+
+	void release_segment(Segment *seg) {
+		live_.fetch_sub(1, std::memory_order_relaxed);
+		pool_.free(pool_.index_of(seg));
+	}
+
+	Segment *protect(int tid, std::atomic<Segment *> &src) {
+		Segment *p = src.load();
+		while (true) {
+			hazards_[tid].ptr.store(p);
+			Segment *again = src.load();
+			if (again == p)
+				return p;
+			p = again;
+		}
+	}
+
+	void clear(int tid) { hazards_[tid].ptr.store(nullptr, std::memory_order_release); }
+
+	// Segments no thread holds a hazard on go back to the pool
+	void retire(int tid, Segment *seg) {
+		std::vector<Segment *> &list = retired_[tid];
+		list.push_back(seg);
+		if (list.size() < RETIRE_BATCH)
+			return;
+		std::vector<Segment *> keep;
+		for (Segment *s : list) {
+			bool hazardous = false;
+			for (int t = 0; t < num_threads_ && !hazardous; t++)
+				hazardous = hazards_[t].ptr.load() == s;
+			if (hazardous)
+				keep.push_back(s);
+			else
+				pool_.free(pool_.index_of(s));
+		}
+		list.swap(keep);
+	}
+
+	int num_threads_;
+	long max_live_;
+	NodePool<Segment> pool_;
+	NodeArray<Hazard> hazards_;
+	std::vector<std::vector<Segment *>> retired_; // touched only by its own thread
+	alignas(CACHE_LINE_SIZE) std::atomic<long> live_{0}; // segments in the list
+	alignas(CACHE_LINE_SIZE) std::atomic<Segment *> head_;
+	alignas(CACHE_LINE_SIZE) std::atomic<Segment *> tail_;
+	char pad_[CACHE_LINE_SIZE - sizeof(std::atomic<Segment *>)];
+};
+
+// Treiber stack with an elimination array (Hendler, Shavit, Yerushalmi): after a failed CAS
+// on the top, a push parks its node in a random slot for a while and a pop that also failed
+// may take it from there, so the pair completes without touching the top at all
+class EliminationStack {
+public:
+	static constexpr int ELIMINATION_SPINS = 128;
+
+	EliminationStack(size_t capacity, int memory_node, int num_threads)
+		: pool_(capacity, memory_node), slots_(std::max(1, num_threads / 2), memory_node), rng_(num_threads, memory_node) {
+		top_.store(lf_pack(LF_NIL, 0));
+		for (int t = 0; t < num_threads; t++)
+			rng_[t].state = 0x9E3779B97F4A7C15UL * (t + 1);
+	}
+
+	bool push(int tid, uint64_t v) {
+		uint32_t n = pool_.alloc();
+		if (n == LF_NIL)
+			return false;
+		pool_[n].value = v;
+		while (true) {
+			uint64_t top = top_.load(std::memory_order_acquire);
+			pool_[n].next.store(lf_idx(top), std::memory_order_relaxed);
+			if (top_.compare_exchange_weak(top, lf_pack(n, lf_tag(top) + 1), std::memory_order_release))
+				return true;
+			// Contended: offer the node to a pop
+			Slot &slot = slots_[random_slot(tid)];
+			uint64_t expected = 0;
+			uint64_t offer = (uint64_t)n + 1;
+			if (!slot.offer.compare_exchange_strong(expected, offer))
+				continue;
+			for (int i = 0; i < ELIMINATION_SPINS && slot.offer.load(std::memory_order_relaxed) == offer; i++)
+				_mm_pause();
+			expected = offer;
+			if (!slot.offer.compare_exchange_strong(expected, 0))
+				return true; // a pop took the node
+		}
+	}
+
+	bool pop(int tid, uint64_t &v) {
+		while (true) {
+			uint64_t top = top_.load(std::memory_order_acquire);
+			if (lf_idx(top) == LF_NIL)
+				return false;
+			uint32_t next = pool_[lf_idx(top)].next.load(std::memory_order_relaxed);
+			if (top_.compare_exchange_weak(top, lf_pack(next, lf_tag(top) + 1), std::memory_order_acq_rel)) {
+				v = pool_[lf_idx(top)].value;
+				pool_.free(lf_idx(top));
+				return true;
+			}
+			// Contended: look for a parked push
+			Slot &slot = slots_[random_slot(tid)];
+			uint64_t offer = slot.offer.load(std::memory_order_acquire);
+			if (offer != 0 && slot.offer.compare_exchange_strong(offer, 0, std::memory_order_acquire)) {
+				v = pool_[offer - 1].value;
+				pool_.free(offer - 1);
+				return true;
+			}
+		}
+	}
+
+private:
+	struct alignas(CACHE_LINE_SIZE) Node {
+		std::atomic<uint32_t> next{LF_NIL}; // read racily by pops that then lose their CAS
+		std::atomic<uint32_t> free_next{0};
+		uint64_t value = 0;
+	};
+	struct alignas(CACHE_LINE_SIZE) Slot {
+		std::atomic<uint64_t> offer{0}; // node index + 1 of a parked push, 0 when free
+	};
+	struct alignas(CACHE_LINE_SIZE) Rng {
+		uint64_t state = 1;
+	};
+
+	size_t random_slot(int tid) {
+		uint64_t &x = rng_[tid].state;
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		return x % slots_.size();
+	}
+
+	NodePool<Node> pool_;
+	NodeArray<Slot> slots_;
+	NodeArray<Rng> rng_;
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> top_;
+	char pad_[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+};
+
+#endif // LOCKFREE_STRUCTURES_H
@@ -0,0 +1,355 @@
+#include "bench_util.h"
+#include <atomic>
+#include <future>
+#include <map>
+
+#include <cxxopts.hpp>
+
+#define NUM_TRIALS 3
+#define FOREGROUND_MS 2000
+#define BALANCING_MS 20000   // NUMA balancing scans in seconds, not milliseconds
+#define SAMPLE_MS 100        // page-node sampling period during the balancing runs
+
+// Moves [buf, buf + size) to node in batches of `batch` pages with numa_move_pages. Returns
+// the pages that ended up there; per-call latencies (us) go to latency_us.
+static size_t move_region(char *buf, size_t size, size_t page, size_t batch, int node, std::vector<double> &latency_us) {
+	size_t n = size / page, moved = 0;
+	std::vector<void *> pages(batch);
+	std::vector<int> nodes(batch, node), status(batch);
+	for (size_t first = 0; first < n; first += batch) {
+		size_t count = std::min(batch, n - first);
+		for (size_t i = 0; i < count; i++)
+			pages[i] = buf + (first + i) * page;
+		auto t0 = std::chrono::steady_clock::now();
+		numa_move_pages(0, count, pages.data(), nodes.data(), status.data(), MPOL_MF_MOVE);
+		auto t1 = std::chrono::steady_clock::now();
+		latency_us.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+		moved += std::count(status.begin(), status.begin() + count, node);
+	}
+	return moved;
+}
+
+// Random 8-byte read-modify-writes over buf until stop; returns ops per second
+double foreground_worker(char *buf, size_t size, int core_num, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	if (!pin_to_core(core_num))
+		return 0;
+	std::mt19937_64 rng(core_num);
+	size_t words = size / sizeof(uint64_t), ops = 0;
+	sync_point.arrive_and_wait();
+	auto start_time = std::chrono::steady_clock::now();
+	while (!stop.load(std::memory_order_relaxed)) {
+		for (int i = 0; i < 256; i++) {
+			volatile uint64_t *w = (volatile uint64_t *)buf + rng() % words;
+			*w = *w + 1;
+		}
+		ops += 256;
+	}
+	return ops / std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+// Ping-pongs buf between two nodes until stop; returns bytes migrated per second
+double migrator(char *buf, size_t size, size_t page, size_t batch, int node_a, int node_b, int core_num, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	if (!pin_to_core(core_num))
+		return 0;
+	std::vector<double> latency;
+	size_t moved = 0;
+	sync_point.arrive_and_wait();
+	auto start_time = std::chrono::steady_clock::now();
+	for (int round = 0; !stop.load(std::memory_order_relaxed); round++)
+		moved += move_region(buf, size, page, batch, round % 2 ? node_a : node_b, latency);
+	return moved * page / std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+// Counter from /proc/vmstat (0 when missing)
+static long vmstat(const std::string &name) {
+	std::ifstream f("/proc/vmstat");
+	std::string key;
+	long value;
+	while (f >> key >> value)
+		if (key == name)
+			return value;
+	return 0;
+}
+
+static int read_numa_balancing() {
+	std::ifstream f("/proc/sys/kernel/numa_balancing");
+	int v = -1;
+	f >> v;
+	return v;
+}
+
+static bool write_numa_balancing(int v) {
+	std::ofstream f("/proc/sys/kernel/numa_balancing");
+	f << v;
+	f.close();
+	return read_numa_balancing() == v;
+}
+
+// The atomic_test and false_sharing loops: every thread bumps one shared counter, or its own
+// word of one shared line
+size_t contended_worker(uint64_t *line, bool shared_word, int slot, int core_num, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	if (!pin_to_core(core_num))
+		return 0;
+	std::atomic<uint64_t> *word = (std::atomic<uint64_t> *)(shared_word ? line : line + slot);
+	size_t count = 0;
+	sync_point.arrive_and_wait();
+	while (!stop.load(std::memory_order_relaxed)) {
+		if (shared_word) {
+			word->fetch_add(1);
+		} else {
+			word->store(word->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+		count++;
+	}
+	return count;
+}
+
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("Migration", "Page migration cost, foreground slowdown during migration, and NUMA balancing ping-pong");
+	options.add_options()
+		("c,cpu_node", "NUMA node whose cores run the threads", cxxopts::value<int>()->default_value("0"))
+		("tests", "Tests (move,foreground,balancing)", cxxopts::value<std::string>()->default_value("move,foreground,balancing"))
+		("pairs", "Source:destination node pairs, including CXL (default: every ordered pair of memory nodes)", cxxopts::value<std::string>()->default_value(""))
+		("p,pages", "Page modes (4k,huge)", cxxopts::value<std::string>()->default_value("4k,huge"))
+		("s,size", "Region moved per trial", cxxopts::value<std::string>()->default_value("256M"))
+		("b,batches", "Pages per move_pages call", cxxopts::value<std::string>()->default_value("1,16,256,4096"))
+		("fg_threads", "Foreground threads (default: all cores of the CPU node but one, which migrates)", cxxopts::value<int>()->default_value("0"))
+		("bal_threads", "Threads per CPU node in the balancing tests", cxxopts::value<int>()->default_value("2"))
+		("bal_ms", "Run time of each balancing test", cxxopts::value<int>()->default_value(std::to_string(BALANCING_MS)))
+		("trials", "Number of trials", cxxopts::value<int>()->default_value(std::to_string(NUM_TRIALS)))
+		("r,result", "Result csv file for the move test", cxxopts::value<std::string>()->default_value("results/migration.csv"))
+		("foreground_result", "Result csv file for the foreground test", cxxopts::value<std::string>()->default_value("results/migration_foreground.csv"))
+		("balancing_result", "Result csv file for the balancing test", cxxopts::value<std::string>()->default_value("results/numa_balancing.csv"))
+		("h,help", "Print usage")
+		;
+	auto arguments = options.parse(argc, argv);
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	// Initialize NUMA library
+	if (numa_available() == -1) {
+		std::cerr << "NUMA is not available on this system." << std::endl;
+		return 1;
+	}
+
+	int cpu_node = arguments["cpu_node"].as<int>();
+	std::vector<int> cores = cores_of_node(cpu_node);
+	if (cores.empty()) {
+		std::cerr << "No CPUs found on NUMA node " << cpu_node << "." << std::endl;
+		return 1;
+	}
+	std::vector<std::pair<int, int>> pairs;
+	if (arguments["pairs"].as<std::string>().empty()) {
+		for (int src : memory_nodes())
+			for (int dst : memory_nodes())
+				if (src != dst)
+					pairs.push_back({src, dst});
+	} else {
+		std::stringstream ss(arguments["pairs"].as<std::string>());
+		for (std::string tok; std::getline(ss, tok, ',');) {
+			int src, dst;
+			if (sscanf(tok.c_str(), "%d:%d", &src, &dst) != 2) {
+				std::cerr << "Invalid pair: " << tok << std::endl;
+				return 1;
+			}
+			pairs.push_back({src, dst});
+		}
+	}
+	if (pairs.empty())
+		std::cerr << "Only one memory node: the move and foreground tests need two" << std::endl;
+	std::vector<std::string> page_modes;
+	std::stringstream ps(arguments["pages"].as<std::string>());
+	for (std::string tok; std::getline(ps, tok, ',');) {
+		if (tok != "4k" && tok != "huge") {
+			std::cerr << "Unknown page mode: " << tok << std::endl;
+			return 1;
+		}
+		page_modes.push_back(tok);
+	}
+	std::string tests = "," + arguments["tests"].as<std::string>() + ",";
+	size_t size = parse_size(arguments["size"].as<std::string>());
+	size = (size + (2UL << 20) - 1) & ~((2UL << 20) - 1); // whole huge pages
+	int num_trials = arguments["trials"].as<int>();
+
+	// move_pages by batch size and one mbind(MPOL_MF_MOVE) for the whole region, per page size and
+	// pair. Throughput and call latency cover only the buffer's pages.
+	if (tests.find(",move,") != std::string::npos) {
+		std::ofstream results_file(arguments["result"].as<std::string>());
+		results_file << "call,page_mode,page_size,src_node,dst_node,batch,bytes,moved_pct,gbps,call_p50_us,call_p99_us\n";
+		for (const std::string &mode : page_modes) {
+			for (auto [src, dst] : pairs) {
+				std::vector<size_t> batches;
+				for (long b : parse_list(arguments["batches"].as<std::string>()))
+					batches.push_back(b);
+				batches.push_back(0); // mbind
+				for (size_t batch : batches) {
+					double gbps = 0, moved_pct = 0;
+					std::vector<double> latency;
+					size_t page = 0;
+					for (int trial = 0; trial < num_trials; trial++) {
+						char *buf = static_cast<char *>(alloc_pages_on_node(size, src, mode == "huge"));
+						if (buf == nullptr) {
+							std::cerr << "Failed to allocate memory on NUMA node " << src << "." << std::endl;
+							return 1;
+						}
+						page = mapping_page_size(buf);
+						auto t0 = std::chrono::steady_clock::now();
+						size_t moved;
+						if (batch) {
+							moved = move_region(buf, size, page, batch, dst, latency);
+						} else {
+							// Rebinding the buffer moves only its pages; migrate_pages would move every
+							// page the process has on src and overstate the cost per buffer page
+							unsigned long nodemask[16] = {0};
+							nodemask[dst / 64] |= 1UL << (dst % 64);
+							if (mbind(buf, size, MPOL_BIND, nodemask, sizeof(nodemask) * 8, MPOL_MF_MOVE) != 0)
+								perror("mbind");
+							moved = fraction_on_node(buf, size, dst) * size / page;
+						}
+						auto t1 = std::chrono::steady_clock::now();
+						if (!batch)
+							latency.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+						gbps += moved * page / 1e9 / std::chrono::duration<double>(t1 - t0).count() / num_trials;
+						moved_pct += 100.0 * moved * page / size / num_trials;
+						free_pages(buf, size);
+					}
+					LatencyStats lat = latency_stats(latency);
+					const char *call = batch ? "move_pages" : "mbind_move";
+					results_file << call << "," << mode << "," << page << "," << src << "," << dst << "," << batch << "," << size << ","
+						<< moved_pct << "," << gbps << "," << lat.p50 << "," << lat.p99 << "\n";
+					std::cout << call << " " << mode << " (" << (page >> 10) << "K pages) " << src << "->" << dst;
+					if (batch)
+						std::cout << " batch " << batch;
+					std::cout << ": " << gbps << " GB/s, " << moved_pct << "% moved, call p50 " << lat.p50 << " us, p99 " << lat.p99 << " us" << std::endl;
+				}
+			}
+		}
+		results_file.close();
+	}
+
+	// Foreground random RMW throughput while another core ping-pongs a region between the pair,
+	// both for a separate region and for the foreground's own buffer
+	if (tests.find(",foreground,") != std::string::npos) {
+		std::ofstream results_file(arguments["foreground_result"].as<std::string>());
+		results_file << "page_mode,node_a,node_b,target,fg_threads,baseline_ops,during_ops,slowdown_pct,migrated_gbps\n";
+		int migrate_core = cores.back();
+		int fg_threads = arguments["fg_threads"].as<int>();
+		if (fg_threads <= 0)
+			fg_threads = std::max<int>(1, cores.size() - 1);
+		for (const std::string &mode : page_modes) {
+			for (auto [node_a, node_b] : pairs) {
+				for (const char *target : {"other", "same"}) {
+					double baseline = 0, during = 0, migrated = 0;
+					for (int trial = 0; trial < num_trials; trial++) {
+						char *fg_buf = static_cast<char *>(alloc_pages_on_node(size, node_a, mode == "huge"));
+						char *mig_buf = strcmp(target, "same") ? static_cast<char *>(alloc_pages_on_node(size, node_a, mode == "huge")) : fg_buf;
+						if (fg_buf == nullptr || mig_buf == nullptr) {
+							std::cerr << "Failed to allocate memory on NUMA node " << node_a << "." << std::endl;
+							return 1;
+						}
+						size_t page = mapping_page_size(mig_buf);
+						for (bool migrating : {false, true}) {
+							std::atomic<bool> stop{false};
+							MyBarrier sync_point(fg_threads + migrating + 1);
+							std::vector<std::future<double>> futs;
+							for (int i = 0; i < fg_threads; i++)
+								futs.push_back(std::async(std::launch::async, foreground_worker, fg_buf, size, cores[i % cores.size()],
+									std::ref(sync_point), std::ref(stop)));
+							std::future<double> mig;
+							if (migrating)
+								mig = std::async(std::launch::async, migrator, mig_buf, size, page, (size_t)512, node_a, node_b, migrate_core,
+									std::ref(sync_point), std::ref(stop));
+							sync_point.arrive_and_wait();
+							std::this_thread::sleep_for(std::chrono::milliseconds(FOREGROUND_MS));
+							stop.store(true);
+							double ops = 0;
+							for (auto &f : futs)
+								ops += f.get();
+							(migrating ? during : baseline) += ops / num_trials;
+							if (migrating)
+								migrated += mig.get() / 1e9 / num_trials;
+						}
+						free_pages(fg_buf, size);
+						if (mig_buf != fg_buf)
+							free_pages(mig_buf, size);
+					}
+					double slowdown = baseline ? 100 * (1 - during / baseline) : 0;
+					results_file << mode << "," << node_a << "," << node_b << "," << target << "," << fg_threads << "," << baseline << ","
+						<< during << "," << slowdown << "," << migrated << "\n";
+					std::cout << "foreground " << mode << " " << node_a << "<->" << node_b << " migrating " << target << " buffer: "
+						<< slowdown << "% slower (" << during << " vs " << baseline << " ops/s), " << migrated << " GB/s migrated" << std::endl;
+				}
+			}
+		}
+		results_file.close();
+	}
+
+	// The atomic and false-sharing loops with threads pinned on every CPU node, with kernel NUMA
+	// balancing off and on. The line sits in a default-policy page, so balancing may move it
+	// after whichever node faulted on it last; the sampled page node shows any ping-pong.
+	if (tests.find(",balancing,") != std::string::npos) {
+		std::ofstream results_file(arguments["balancing_result"].as<std::string>());
+		results_file << "test,numa_balancing,threads,ops_per_sec,page_node_changes,pages_migrated,hint_faults\n";
+		int original = read_numa_balancing();
+		if (original < 0)
+			std::cerr << "No /proc/sys/kernel/numa_balancing: kernel built without NUMA balancing" << std::endl;
+		int bal_threads = arguments["bal_threads"].as<int>();
+		int bal_ms = arguments["bal_ms"].as<int>();
+		std::vector<int> bal_cores;
+		for (int n : cpu_nodes()) {
+			std::vector<int> c = cores_of_node(n);
+			for (int i = 0; i < bal_threads && i < (int)c.size(); i++)
+				bal_cores.push_back(c[i]);
+		}
+		for (int setting : {0, 1}) {
+			if (original < 0 || (read_numa_balancing() != setting && !write_numa_balancing(setting))) {
+				std::cerr << "Cannot set numa_balancing=" << setting << " (needs root); skipping" << std::endl;
+				continue;
+			}
+			for (bool shared_word : {true, false}) {
+				const char *test = shared_word ? "atomic" : "false_sharing";
+				// Default policy, first touched here
+				char *page = static_cast<char *>(mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+				memset(page, 0, 4096);
+				uint64_t *line = (uint64_t *)page;
+				long migrated0 = vmstat("numa_pages_migrated"), faults0 = vmstat("numa_hint_faults");
+				std::atomic<bool> stop{false};
+				MyBarrier sync_point(bal_cores.size() + 1);
+				std::vector<std::future<size_t>> futs;
+				for (size_t i = 0; i < bal_cores.size(); i++)
+					futs.push_back(std::async(std::launch::async, contended_worker, line, shared_word, (int)(i % (CACHE_LINE_SIZE / sizeof(uint64_t))),
+						bal_cores[i], std::ref(sync_point), std::ref(stop)));
+				sync_point.arrive_and_wait();
+				auto start_time = std::chrono::steady_clock::now();
+				int last_node = -1, changes = 0;
+				while (std::chrono::steady_clock::now() - start_time < std::chrono::milliseconds(bal_ms)) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(SAMPLE_MS));
+					void *addr = page;
+					int node = -1;
+					numa_move_pages(0, 1, &addr, nullptr, &node, 0);
+					if (last_node >= 0 && node >= 0 && node != last_node)
+						changes++;
+					if (node >= 0)
+						last_node = node;
+				}
+				stop.store(true);
+				double ops = 0;
+				for (auto &f : futs)
+					ops += f.get();
+				ops /= std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+				long migrated = vmstat("numa_pages_migrated") - migrated0, faults = vmstat("numa_hint_faults") - faults0;
+				munmap(page, 4096);
+				results_file << test << "," << setting << "," << bal_cores.size() << "," << ops << "," << changes << "," << migrated << "," << faults << "\n";
+				std::cout << test << " numa_balancing=" << setting << ": " << ops << " ops/s, page moved " << changes << " times, "
+					<< migrated << " pages migrated system-wide, " << faults << " hint faults" << std::endl;
+			}
+		}
+		if (original >= 0 && read_numa_balancing() != original)
+			write_numa_balancing(original);
+		results_file.close();
+	}
+
+	return 0;
+}
@@ -1,6 +1,29 @@
+import os
 import pandas as pd
 import matplotlib.pyplot as plt
 
+MATRIX_FILE = 'results/atomic_matrix.csv'
+
+def placement(row):
+    if row['cpuless']:
+        return 'CXL'
+    return 'Local' if row['cpu_node'] == row['memory_node'] else 'Remote'
+
+if os.path.exists(MATRIX_FILE):
+    # Tidy output of `atomic_test --matrix`: one line per CPU node x memory node pair
+    df = pd.read_csv(MATRIX_FILE)
+    plt.figure(figsize=(10, 6))
+    for (cpu, mem), group in df.groupby(['cpu_node', 'memory_node']):
+        label = 'CPU %d -> Mem %d (%s, dist %d)' % (cpu, mem, placement(group.iloc[0]), group.iloc[0]['distance'])
+        plt.plot(group['threads'], group['num_ops'], label=label)
+    plt.title('#of Atomic operations for 3 seconds per CPU node and memory node')
+    plt.xlabel('Number of Threads')
+    plt.ylabel('Number of operations')
+    plt.legend()
+    plt.grid(True)
+    plt.tight_layout()
+    plt.savefig('results/atomic_matrix.png')
+
 # Read the results from the CSV files
 df1 = pd.read_csv('results/local_atomic.csv')
 df2 = pd.read_csv('results/remote_atomic.csv')
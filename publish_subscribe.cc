@@ -0,0 +1,258 @@
+#include "bench_util.h"
+#include <atomic>
+#include <future>
+#include <map>
+
+#include <cxxopts.hpp>
+
+#define NUM_TRIALS 3
+#define RUN_TIME_MS 1000
+#define MAX_SAMPLES (1UL << 18)
+
+// A published word packs a sequence number and the writer's TSC at publication, so readers
+// get a consistent (version, timestamp) pair from a single load.
+#define SEQ_BITS 20
+#define STAMP_BITS (64 - SEQ_BITS)
+#define STAMP_MASK ((1ULL << STAMP_BITS) - 1)
+#define SEQ_MASK ((1ULL << SEQ_BITS) - 1)
+
+struct alignas(CACHE_LINE_SIZE) VersionLine {
+	std::atomic<uint64_t> word;
+};
+
+// Where the writer publishes: one line for everyone, a replica per socket, or a line per reader
+enum class Variant { Shared, PerSocket, PerReader };
+
+static const std::map<std::string, Variant> variant_names = {
+	{"shared", Variant::Shared},
+	{"per_socket", Variant::PerSocket},
+	{"per_reader", Variant::PerReader},
+};
+
+struct ReaderResult {
+	size_t observed = 0;  // distinct versions seen
+	size_t skipped = 0;   // versions published but never seen
+	std::vector<double> samples; // propagation latency in ns
+};
+
+size_t publisher(std::vector<VersionLine *> lines, uint64_t interval_ticks, int core_num, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	if (!pin_to_core(core_num))
+		return 0;
+	size_t seq = 0;
+	sync_point.arrive_and_wait();
+	uint64_t next = __rdtsc();
+	while (!stop.load(std::memory_order_relaxed)) {
+		if (interval_ticks) {
+			while (__rdtsc() < next)
+				_mm_pause();
+			next += interval_ticks;
+		}
+		seq++;
+		uint64_t word = ((seq & SEQ_MASK) << STAMP_BITS) | (__rdtsc() & STAMP_MASK);
+		for (VersionLine *l : lines)
+			l->word.store(word, std::memory_order_release);
+	}
+	return seq;
+}
+
+ReaderResult subscriber(VersionLine *line, int core_num, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	ReaderResult r;
+	if (!pin_to_core(core_num))
+		return r;
+	r.samples.reserve(MAX_SAMPLES);
+	double ticks_per_ns = tsc_per_ns();
+	uint64_t last = line->word.load(std::memory_order_acquire);
+	sync_point.arrive_and_wait();
+	while (!stop.load(std::memory_order_relaxed)) {
+		uint64_t word = line->word.load(std::memory_order_acquire);
+		if (word == last)
+			continue;
+		uint64_t now = __rdtsc();
+		uint64_t seq = word >> STAMP_BITS, last_seq = last >> STAMP_BITS;
+		r.skipped += ((seq - last_seq) & SEQ_MASK) - 1;
+		r.observed++;
+		if (r.samples.size() < MAX_SAMPLES)
+			r.samples.push_back(((now - word) & STAMP_MASK) / ticks_per_ns);
+		last = word;
+	}
+	return r;
+}
+
+// Reader cores: packed next to the writer, spread over LLC domains of its socket, or over all nodes
+static std::vector<int> place_readers(const std::string &placement, int writer, size_t num_readers) {
+	std::vector<int> all;
+	for (int n : cpu_nodes())
+		for (int c : cores_of_node(n))
+			if (c != writer)
+				all.push_back(c);
+	std::vector<std::vector<int>> groups;
+	std::map<int, size_t> group_of;
+	for (int c : all) {
+		int key;
+		if (placement == "packed")
+			key = numa_node_of_cpu(c) == numa_node_of_cpu(writer) ? 0 : -1;
+		else if (placement == "llc")
+			key = cpu_package(c) == cpu_package(writer) ? cpu_llc(c) : -1;
+		else
+			key = numa_node_of_cpu(c);
+		if (key < 0)
+			continue;
+		if (!group_of.count(key)) {
+			group_of[key] = groups.size();
+			groups.emplace_back();
+		}
+		groups[group_of[key]].push_back(c);
+	}
+	// Round-robin over the groups
+	std::vector<int> out;
+	for (size_t i = 0; out.size() < num_readers; i++) {
+		bool any = false;
+		for (auto &g : groups) {
+			if (i < g.size() && out.size() < num_readers) {
+				out.push_back(g[i]);
+				any = true;
+			}
+		}
+		if (!any)
+			break;
+	}
+	return out;
+}
+
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("Publish Subscribe", "One writer publishing a version word to many polling readers");
+	options.add_options()
+		("w,writer", "Core of the writer (default: first core of the first CPU node)", cxxopts::value<int>()->default_value("-1"))
+		("n,readers", "Reader counts", cxxopts::value<std::string>()->default_value("1,2,4,8,16,32,64"))
+		("p,placements", "Reader placements (packed,llc,nodes)", cxxopts::value<std::string>()->default_value("packed,llc,nodes"))
+		("v,variants", "Publication variants (shared,per_socket,per_reader)", cxxopts::value<std::string>()->default_value("shared,per_socket,per_reader"))
+		("i,intervals", "Writer interval between updates in ns (0 = as fast as possible)", cxxopts::value<std::string>()->default_value("0,100,1000,10000"))
+		("d,duration", "Run time per trial in ms", cxxopts::value<int>()->default_value(std::to_string(RUN_TIME_MS)))
+		("trials", "Number of trials", cxxopts::value<int>()->default_value(std::to_string(NUM_TRIALS)))
+		("r,result", "Result csv file", cxxopts::value<std::string>()->default_value("results/publish_subscribe.csv"))
+		("page_mode", "Buffer pages (default,4k,thp,2m,1g)", cxxopts::value<std::string>()->default_value("default"))
+		("placement", "Buffer placement (bind,preferred,interleave,first_touch)", cxxopts::value<std::string>()->default_value("bind"))
+		("h,help", "Print usage")
+		;
+	auto arguments = options.parse(argc, argv);
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	// Initialize NUMA library
+	if (numa_available() == -1) {
+		std::cerr << "NUMA is not available on this system." << std::endl;
+		return 1;
+	}
+	if (!set_alloc_policy(arguments["page_mode"].as<std::string>(), arguments["placement"].as<std::string>()))
+		return 1;
+
+	int writer = arguments["writer"].as<int>();
+	if (writer < 0)
+		writer = cores_of_node(cpu_nodes()[0])[0];
+	int duration_ms = arguments["duration"].as<int>();
+	int num_trials = arguments["trials"].as<int>();
+	double ticks_per_ns = tsc_per_ns();
+
+	std::vector<std::string> placements, variants;
+	std::stringstream ss(arguments["placements"].as<std::string>());
+	for (std::string tok; std::getline(ss, tok, ',');)
+		placements.push_back(tok);
+	ss = std::stringstream(arguments["variants"].as<std::string>());
+	for (std::string tok; std::getline(ss, tok, ',');) {
+		if (!variant_names.count(tok)) {
+			std::cerr << "Unknown variant: " << tok << std::endl;
+			return 1;
+		}
+		variants.push_back(tok);
+	}
+
+	std::ofstream results_file(arguments["result"].as<std::string>());
+	results_file << "variant,placement,readers,interval_ns,writer_mops,observed_fraction,mean_skipped,p50_ns,p90_ns,p99_ns,max_ns,page_size\n";
+
+	for (const std::string &variant_name : variants) {
+		Variant variant = variant_names.at(variant_name);
+		for (const std::string &placement : placements) {
+			for (long num_readers : parse_list(arguments["readers"].as<std::string>())) {
+				std::vector<int> readers = place_readers(placement, writer, num_readers);
+				if ((long)readers.size() < num_readers)
+					continue;
+
+				// Lines live on the node of whoever reads them (the writer's node for the shared line)
+				std::vector<VersionLine *> lines;
+				std::vector<VersionLine *> reader_line(num_readers);
+				std::map<int, VersionLine *> socket_line;
+				auto alloc_line = [&](int node, int owner) {
+					VersionLine *l = static_cast<VersionLine *>(alloc_on_node(sizeof(VersionLine), node));
+					if (l == nullptr) {
+						std::cerr << "Failed to allocate memory on NUMA node " << node << "." << std::endl;
+						exit(1);
+					}
+					touch_by_owners(l, sizeof(VersionLine), {{l, sizeof(VersionLine), owner}});
+					l->word.store(0);
+					lines.push_back(l);
+					return l;
+				};
+				for (long i = 0; i < num_readers; i++) {
+					int c = readers[i];
+					switch (variant) {
+						case Variant::Shared:
+							reader_line[i] = lines.empty() ? alloc_line(numa_node_of_cpu(writer), writer) : lines[0];
+							break;
+						case Variant::PerSocket:
+							if (!socket_line.count(cpu_package(c)))
+								socket_line[cpu_package(c)] = alloc_line(numa_node_of_cpu(c), c);
+							reader_line[i] = socket_line[cpu_package(c)];
+							break;
+						case Variant::PerReader:
+							reader_line[i] = alloc_line(numa_node_of_cpu(c), c);
+							break;
+					}
+				}
+
+				size_t page_size = lines.empty() ? 0 : mapping_page_size(lines[0]);
+				for (long interval : parse_list(arguments["intervals"].as<std::string>())) {
+					double publishes = 0, observed = 0, skipped = 0;
+					std::vector<double> samples;
+					for (int trial = 0; trial < num_trials; trial++) {
+						for (VersionLine *l : lines)
+							l->word.store(0);
+						alignas(CACHE_LINE_SIZE) std::atomic<bool> stop(false);
+						MyBarrier sync_point(num_readers + 2);
+						std::vector<std::future<ReaderResult>> futs;
+						for (long i = 0; i < num_readers; i++)
+							futs.push_back(std::async(std::launch::async, subscriber, reader_line[i], readers[i], std::ref(sync_point), std::ref(stop)));
+						auto pub = std::async(std::launch::async, publisher, lines, (uint64_t)(interval * ticks_per_ns), writer, std::ref(sync_point), std::ref(stop));
+						sync_point.arrive_and_wait();
+						std::this_thread::sleep_for(std::chrono::milliseconds(duration_ms));
+						stop.store(true);
+						publishes += pub.get();
+						for (auto &f : futs) {
+							ReaderResult r = f.get();
+							observed += r.observed;
+							skipped += r.skipped;
+							samples.insert(samples.end(), r.samples.begin(), r.samples.end());
+						}
+					}
+					double writer_mops = publishes / num_trials / (duration_ms / 1000.0) / 1e6;
+					double observed_fraction = observed / (publishes * num_readers);
+					double mean_skipped = observed ? skipped / observed : 0;
+					LatencyStats lat = latency_stats(samples);
+					results_file << variant_name << "," << placement << "," << num_readers << "," << interval << "," << writer_mops << ","
+						<< observed_fraction << "," << mean_skipped << "," << lat.p50 << "," << lat.p90 << "," << lat.p99 << "," << lat.max << "," << page_size << "\n";
+					std::cout << variant_name << " " << placement << " readers " << num_readers << " interval " << interval << " ns: writer "
+						<< writer_mops << " Mupd/s, seen " << observed_fraction * 100 << "%, p50 " << lat.p50 << " ns, p99 " << lat.p99 << " ns" << std::endl;
+				}
+
+				for (VersionLine *l : lines)
+					free_on_node(l, sizeof(VersionLine));
+			}
+		}
+	}
+
+	// Close the results file
+	results_file.close();
+
+	return 0;
+}
@@ -0,0 +1,178 @@
+#include "bench_util.h"
+#include "reclamation.h"
+#include <atomic>
+#include <future>
+#include <map>
+
+#include <cxxopts.hpp>
+
+#define NUM_TRIALS 3
+#define RUN_TIME_MS 1000
+#define POLL_US 1000 // how often the main thread samples the unreclaimed node count
+
+template <class R>
+size_t map_worker(MichaelHashMap<R> &map, R &reclaimer, int tid, int core_num, long key_range, int update_pct,
+	MyBarrier &sync_point, std::atomic<bool> &stop) {
+	if (!pin_to_core(core_num))
+		return 0;
+	uint64_t x = 0x9E3779B97F4A7C15UL * (tid + 1);
+	size_t ops = 0;
+	sync_point.arrive_and_wait();
+	while (!stop.load(std::memory_order_relaxed)) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		long key = (x >> 16) % key_range;
+		int dice = x % 200;
+		// Updates split evenly between inserts and removes, so the size stays put
+		if (dice < update_pct)
+			map.insert(tid, key);
+		else if (dice < 2 * update_pct)
+			map.remove(tid, key);
+		else
+			map.contains(tid, key);
+		ops++;
+	}
+	reclaimer.offline(tid);
+	return ops;
+}
+
+struct SchemeResult {
+	double mops = 0;
+	long unreclaimed_hwm = 0;    // most retired-but-not-freed nodes seen at once
+	std::vector<double> latency; // retire-to-free in us
+};
+
+template <class R>
+static SchemeResult run_scheme(const std::vector<int> &thread_cores, size_t buckets, long key_range, int update_pct, int duration_ms, int num_trials) {
+	SchemeResult res;
+	size_t num_threads = thread_cores.size();
+	double ticks_per_us = tsc_per_ns() * 1000;
+	for (int trial = 0; trial < num_trials; trial++) {
+		R reclaimer(thread_cores);
+		{
+			MichaelHashMap<R> map(buckets, reclaimer);
+			// Start half full
+			for (long k = 0; k < key_range; k += 2)
+				map.insert(0, k);
+			alignas(CACHE_LINE_SIZE) std::atomic<bool> stop(false);
+			MyBarrier sync_point(num_threads + 1);
+			std::vector<std::future<size_t>> futs;
+			for (size_t i = 0; i < num_threads; i++)
+				futs.push_back(std::async(std::launch::async, map_worker<R>, std::ref(map), std::ref(reclaimer), i, thread_cores[i],
+					key_range, update_pct, std::ref(sync_point), std::ref(stop)));
+			sync_point.arrive_and_wait();
+			auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(duration_ms);
+			while (std::chrono::steady_clock::now() < end) {
+				std::this_thread::sleep_for(std::chrono::microseconds(POLL_US));
+				res.unreclaimed_hwm = std::max(res.unreclaimed_hwm, reclaimer.unreclaimed());
+			}
+			stop.store(true);
+			size_t ops = 0;
+			for (auto &f : futs)
+				ops += f.get();
+			res.mops += ops / (duration_ms / 1000.0) / 1e6 / num_trials;
+		}
+		for (double t : reclaimer.latency_ticks())
+			res.latency.push_back(t / ticks_per_us);
+	}
+	return res;
+}
+
+static const std::map<std::string, SchemeResult (*)(const std::vector<int> &, size_t, long, int, int, int)> schemes = {
+	{"none", run_scheme<LeakReclaimer>},
+	{"ebr", run_scheme<EbrReclaimer>},
+	{"ebr_socket", run_scheme<SocketEbrReclaimer>},
+	{"qsbr", run_scheme<QsbrReclaimer>},
+	{"qsbr_socket", run_scheme<SocketQsbrReclaimer>},
+	{"hp", run_scheme<HazardPointerReclaimer>},
+	{"he", run_scheme<HazardEraReclaimer>},
+	{"ibr", run_scheme<IbrReclaimer>},
+};
+
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("Reclamation", "Throughput and memory overhead of safe memory reclamation schemes on a read-mostly list and hash map");
+	options.add_options()
+		("s,schemes", "Schemes (none,ebr,ebr_socket,qsbr,qsbr_socket,hp,he,ibr)", cxxopts::value<std::string>()->default_value("none,ebr,ebr_socket,qsbr,qsbr_socket,hp,he,ibr"))
+		("structures", "Structures (list,hashmap)", cxxopts::value<std::string>()->default_value("list,hashmap"))
+		("t,threads", "Thread counts; threads beyond the core count share cores", cxxopts::value<std::string>()->default_value("1,2,4,8,16,32,64,128,256"))
+		("list-keys", "Key range of the linked list", cxxopts::value<long>()->default_value("512"))
+		("map-keys", "Key range of the hash map", cxxopts::value<long>()->default_value("65536"))
+		("u,updates", "Percent of operations that update (half inserts, half removes)", cxxopts::value<int>()->default_value("10"))
+		("d,duration", "Run time per trial in ms", cxxopts::value<int>()->default_value(std::to_string(RUN_TIME_MS)))
+		("trials", "Number of trials", cxxopts::value<int>()->default_value(std::to_string(NUM_TRIALS)))
+		("r,result", "Result csv file", cxxopts::value<std::string>()->default_value("results/reclamation.csv"))
+		("h,help", "Print usage")
+		;
+	auto arguments = options.parse(argc, argv);
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	// Initialize NUMA library
+	if (numa_available() == -1) {
+		std::cerr << "NUMA is not available on this system." << std::endl;
+		return 1;
+	}
+
+	auto split = [](const std::string &spec) {
+		std::vector<std::string> out;
+		std::stringstream ss(spec);
+		for (std::string tok; std::getline(ss, tok, ',');)
+			out.push_back(tok);
+		return out;
+	};
+	std::vector<std::string> scheme_names = split(arguments["schemes"].as<std::string>());
+	std::vector<std::string> structures = split(arguments["structures"].as<std::string>());
+	for (const std::string &s : scheme_names) {
+		if (!schemes.count(s)) {
+			std::cerr << "Unknown scheme: " << s << std::endl;
+			return 1;
+		}
+	}
+	for (const std::string &s : structures) {
+		if (s != "list" && s != "hashmap") {
+			std::cerr << "Unknown structure: " << s << std::endl;
+			return 1;
+		}
+	}
+	int update_pct = arguments["updates"].as<int>();
+	int duration_ms = arguments["duration"].as<int>();
+	int num_trials = arguments["trials"].as<int>();
+
+	// Threads fill one socket's cores before moving to the next
+	std::vector<int> cores;
+	for (int n : cpu_nodes())
+		for (int c : cores_of_node(n))
+			cores.push_back(c);
+
+	std::ofstream results_file(arguments["result"].as<std::string>());
+	results_file << "scheme,structure,threads,sockets,mops,unreclaimed_hwm,reclaim_p50_us,reclaim_p99_us,reclaim_max_us\n";
+
+	for (const std::string &structure : structures) {
+		long key_range = arguments[structure == "list" ? "list-keys" : "map-keys"].as<long>();
+		size_t buckets = structure == "list" ? 1 : std::max(1L, key_range / 4);
+		for (const std::string &scheme : scheme_names) {
+			for (long num_threads : parse_list(arguments["threads"].as<std::string>())) {
+				std::vector<int> thread_cores;
+				std::map<int, int> sockets;
+				for (long i = 0; i < num_threads; i++) {
+					thread_cores.push_back(cores[i % cores.size()]);
+					sockets[cpu_package(thread_cores.back())]++;
+				}
+				SchemeResult r = schemes.at(scheme)(thread_cores, buckets, key_range, update_pct, duration_ms, num_trials);
+				LatencyStats lat = latency_stats(r.latency);
+				results_file << scheme << "," << structure << "," << num_threads << "," << sockets.size() << "," << r.mops << ","
+					<< r.unreclaimed_hwm << "," << lat.p50 << "," << lat.p99 << "," << lat.max << "\n";
+				std::cout << scheme << " " << structure << " threads " << num_threads << ": " << r.mops << " Mops/s, unreclaimed max "
+					<< r.unreclaimed_hwm << ", reclaim p50 " << lat.p50 << " us, p99 " << lat.p99 << " us" << std::endl;
+			}
+		}
+	}
+
+	// Close the results file
+	results_file.close();
+
+	return 0;
+}
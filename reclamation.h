@@ -0,0 +1,544 @@
+#ifndef RECLAMATION_H
+#define RECLAMATION_H
+
+// Safe memory reclamation schemes for lock-free structures, plus a Michael lock-free hash map
+// (a sorted linked list per bucket) to exercise them. Every scheme is built for a fixed set
+// of threads (tid 0..n-1, with the core each one is pinned to) and offers:
+//
+//   begin_op(tid) / end_op(tid)    around every operation on the structure
+//   protect(tid, slot, src)        load a link so the node it points to stays allocated
+//   copy(tid, dst, src)            move an existing protection to another slot
+//   on_alloc(tid, node)            stamp a new node before it is published
+//   retire(tid, node)              hand over an unlinked node; it is freed once safe
+//   offline(tid)                   the thread does no more operations
+//
+// Nodes are retired and freed by the same thread, so the per-thread retired and freed
+// counts give the unreclaimed total without shared counters.
+
+#include "bench_util.h"
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+
+#define SMR_SLOTS 3 // protected pointers per thread: next, current and previous node
+
+struct SmrNode {
+	std::atomic<SmrNode *> next{nullptr}; // low bit marks the node as logically deleted
+	long key = 0;
+	uint64_t birth_era = 0;
+	uint64_t retire_era = 0; // retire epoch for the epoch schemes
+	uint64_t retire_tsc = 0;
+};
+
+inline bool smr_marked(SmrNode *p) {
+	return (uintptr_t)p & 1;
+}
+inline SmrNode *smr_mark(SmrNode *p) {
+	return (SmrNode *)((uintptr_t)p | 1);
+}
+inline SmrNode *smr_unmark(SmrNode *p) {
+	return (SmrNode *)((uintptr_t)p & ~(uintptr_t)1);
+}
+
+// Bookkeeping shared by every scheme: retired/freed counts and retire-to-free latency
+class ReclaimerBase {
+public:
+	static constexpr int LATENCY_SAMPLE_EVERY = 16; // freed nodes per latency sample
+
+	explicit ReclaimerBase(size_t num_threads) : stats_(new ThreadStats[num_threads]), num_threads_(num_threads) {}
+
+	// Retired but not yet freed nodes over all threads; safe to call while threads run
+	long unreclaimed() const {
+		long sum = 0;
+		for (size_t t = 0; t < num_threads_; t++)
+			sum += stats_[t].retired.load(std::memory_order_relaxed) - stats_[t].freed.load(std::memory_order_relaxed);
+		return sum;
+	}
+
+	// Retire-to-free latency samples in TSC ticks; call once the threads are done
+	std::vector<double> latency_ticks() const {
+		std::vector<double> all;
+		for (size_t t = 0; t < num_threads_; t++)
+			all.insert(all.end(), stats_[t].samples.begin(), stats_[t].samples.end());
+		return all;
+	}
+
+protected:
+	void count_retire(int tid, SmrNode *n) {
+		n->retire_tsc = __rdtsc();
+		std::atomic<long> &r = stats_[tid].retired;
+		r.store(r.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	void free_node(int tid, SmrNode *n) {
+		ThreadStats &s = stats_[tid];
+		long freed = s.freed.load(std::memory_order_relaxed) + 1;
+		if (freed % LATENCY_SAMPLE_EVERY == 0)
+			s.samples.push_back((double)(__rdtsc() - n->retire_tsc));
+		s.freed.store(freed, std::memory_order_relaxed);
+		delete n;
+	}
+
+	struct alignas(CACHE_LINE_SIZE) ThreadStats {
+		std::atomic<long> retired{0};
+		std::atomic<long> freed{0};
+		std::vector<double> samples;
+	};
+	std::unique_ptr<ThreadStats[]> stats_;
+	size_t num_threads_;
+};
+
+// No reclamation: retired nodes are only freed when the scheme is destroyed (upper bound
+// on throughput, lower bound on memory efficiency)
+class LeakReclaimer : public ReclaimerBase {
+public:
+	explicit LeakReclaimer(const std::vector<int> &thread_cores) : ReclaimerBase(thread_cores.size()), retired_(thread_cores.size()) {}
+	~LeakReclaimer() {
+		for (auto &list : retired_)
+			for (SmrNode *n : list)
+				delete n;
+	}
+	void begin_op(int) {}
+	void end_op(int) {}
+	SmrNode *protect(int, int, const std::atomic<SmrNode *> &src) { return src.load(std::memory_order_acquire); }
+	void copy(int, int, int) {}
+	void on_alloc(int, SmrNode *) {}
+	void retire(int tid, SmrNode *n) {
+		count_retire(tid, n);
+		retired_[tid].push_back(n);
+	}
+	void offline(int) {}
+
+private:
+	std::vector<std::vector<SmrNode *>> retired_;
+};
+
+// Epoch-based reclamation (Fraser) and quiescent-state-based reclamation (McKenney, Slingwine).
+//
+// EBR threads announce the epoch they run in at begin_op and go inactive at end_op; QSBR
+// threads announce the epoch at end_op, which is their quiescent state, and stay online in
+// between. The global epoch advances once every online thread has announced it, and a node
+// retired in epoch e is freed when the global epoch reaches e + 2.
+//
+// With PerSocket, each socket keeps a copy of the epoch that its threads read and announce,
+// and a ready mark saying all of its threads have caught up. Advancing then scans the
+// announcements of the local socket only, plus one line per socket, instead of every thread.
+template <bool Quiescent, bool PerSocket>
+class EpochReclaimer : public ReclaimerBase {
+public:
+	static constexpr int ADVANCE_EVERY = 64; // retires per thread between advance attempts
+
+	explicit EpochReclaimer(const std::vector<int> &thread_cores)
+		: ReclaimerBase(thread_cores.size()), threads_(new ThreadState[thread_cores.size()]), socket_of_(thread_cores.size()) {
+		std::map<int, int> index;
+		for (size_t t = 0; t < thread_cores.size(); t++) {
+			int pkg = cpu_package(thread_cores[t]);
+			if (!index.count(pkg)) {
+				int next = index.size();
+				index[pkg] = next;
+			}
+			socket_of_[t] = PerSocket ? index[pkg] : 0;
+			// QSBR threads start online in epoch 0
+			threads_[t].announce.store(Quiescent ? 1 : 0, std::memory_order_relaxed);
+		}
+		num_sockets_ = PerSocket ? index.size() : 1;
+		sockets_.reset(new SocketState[num_sockets_]);
+		socket_threads_.resize(num_sockets_);
+		for (size_t t = 0; t < thread_cores.size(); t++)
+			socket_threads_[socket_of_[t]].push_back(t);
+	}
+	~EpochReclaimer() {
+		for (size_t t = 0; t < num_threads_; t++)
+			for (SmrNode *n : threads_[t].limbo)
+				delete n;
+	}
+
+	void begin_op(int tid) {
+		if (Quiescent)
+			return;
+		std::atomic<uint64_t> &epoch = local_epoch(tid);
+		uint64_t e = epoch.load();
+		while (true) {
+			threads_[tid].announce.store(e << 1 | 1);
+			uint64_t again = epoch.load();
+			if (again == e)
+				return;
+			e = again;
+		}
+	}
+
+	void end_op(int tid) {
+		if (Quiescent)
+			threads_[tid].announce.store(local_epoch(tid).load() << 1 | 1, std::memory_order_release);
+		else
+			threads_[tid].announce.store(0, std::memory_order_release);
+	}
+
+	SmrNode *protect(int, int, const std::atomic<SmrNode *> &src) { return src.load(std::memory_order_acquire); }
+	void copy(int, int, int) {}
+	void on_alloc(int, SmrNode *) {}
+
+	void retire(int tid, SmrNode *n) {
+		count_retire(tid, n);
+		ThreadState &t = threads_[tid];
+		n->retire_era = global_.load();
+		t.limbo.push_back(n);
+		if (++t.retires % ADVANCE_EVERY != 0)
+			return;
+		try_advance(tid);
+		uint64_t g = global_.load(std::memory_order_acquire);
+		while (!t.limbo.empty() && t.limbo.front()->retire_era + 2 <= g) {
+			free_node(tid, t.limbo.front());
+			t.limbo.pop_front();
+		}
+	}
+
+	void offline(int tid) { threads_[tid].announce.store(0, std::memory_order_release); }
+
+private:
+	struct alignas(CACHE_LINE_SIZE) ThreadState {
+		std::atomic<uint64_t> announce{0}; // epoch << 1 | online
+		std::deque<SmrNode *> limbo;       // in retire order, so epochs never decrease
+		long retires = 0;
+	};
+	struct alignas(CACHE_LINE_SIZE) SocketState {
+		std::atomic<uint64_t> epoch{0}; // this socket's copy of the global epoch
+		std::atomic<uint64_t> ready{0}; // epoch every thread of the socket has announced
+	};
+
+	std::atomic<uint64_t> &local_epoch(int tid) { return PerSocket ? sockets_[socket_of_[tid]].epoch : global_; }
+
+	// Whether every online thread in the list has announced epoch e
+	bool caught_up(const std::vector<int> &tids, uint64_t e) {
+		for (int t : tids) {
+			uint64_t a = threads_[t].announce.load();
+			if ((a & 1) && (a >> 1) != e)
+				return false;
+		}
+		return true;
+	}
+
+	void try_advance(int tid) {
+		uint64_t g = global_.load();
+		if (!PerSocket) {
+			if (caught_up(socket_threads_[0], g))
+				global_.compare_exchange_strong(g, g + 1);
+			return;
+		}
+		SocketState &s = sockets_[socket_of_[tid]];
+		uint64_t e = s.epoch.load();
+		if (e < g && s.epoch.compare_exchange_strong(e, g))
+			e = g;
+		if (e == g && caught_up(socket_threads_[socket_of_[tid]], g))
+			s.ready.store(g);
+		for (size_t i = 0; i < num_sockets_; i++)
+			if (sockets_[i].ready.load() != g)
+				return;
+		global_.compare_exchange_strong(g, g + 1);
+	}
+
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> global_{0};
+	char pad_[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+	std::unique_ptr<ThreadState[]> threads_;
+	std::unique_ptr<SocketState[]> sockets_;
+	std::vector<int> socket_of_;
+	std::vector<std::vector<int>> socket_threads_;
+	size_t num_sockets_;
+};
+
+using EbrReclaimer = EpochReclaimer<false, false>;
+using SocketEbrReclaimer = EpochReclaimer<false, true>;
+using QsbrReclaimer = EpochReclaimer<true, false>;
+using SocketQsbrReclaimer = EpochReclaimer<true, true>;
+
+// Hazard pointers (Michael): a thread publishes every node it is about to dereference; a
+// retired node is freed once no published slot holds it. Scans run every 2 * H retires.
+class HazardPointerReclaimer : public ReclaimerBase {
+public:
+	explicit HazardPointerReclaimer(const std::vector<int> &thread_cores)
+		: ReclaimerBase(thread_cores.size()), threads_(new ThreadState[thread_cores.size()]),
+		  scan_threshold_(std::max<size_t>(64, 2 * SMR_SLOTS * thread_cores.size())) {}
+	~HazardPointerReclaimer() {
+		for (size_t t = 0; t < num_threads_; t++)
+			for (SmrNode *n : threads_[t].retired)
+				delete n;
+	}
+
+	void begin_op(int) {}
+	void end_op(int tid) {
+		for (auto &h : threads_[tid].hazards)
+			h.store(nullptr, std::memory_order_release);
+	}
+
+	SmrNode *protect(int tid, int slot, const std::atomic<SmrNode *> &src) {
+		std::atomic<SmrNode *> &h = threads_[tid].hazards[slot];
+		SmrNode *p = src.load();
+		while (true) {
+			h.store(smr_unmark(p));
+			SmrNode *again = src.load();
+			if (again == p)
+				return p;
+			p = again;
+		}
+	}
+	void copy(int tid, int dst, int src) {
+		threads_[tid].hazards[dst].store(threads_[tid].hazards[src].load(std::memory_order_relaxed));
+	}
+	void on_alloc(int, SmrNode *) {}
+
+	void retire(int tid, SmrNode *n) {
+		count_retire(tid, n);
+		std::vector<SmrNode *> &retired = threads_[tid].retired;
+		retired.push_back(n);
+		if (retired.size() < scan_threshold_)
+			return;
+		std::vector<SmrNode *> hazards;
+		for (size_t t = 0; t < num_threads_; t++)
+			for (auto &h : threads_[t].hazards)
+				if (SmrNode *p = h.load())
+					hazards.push_back(p);
+		std::sort(hazards.begin(), hazards.end());
+		std::vector<SmrNode *> keep;
+		for (SmrNode *r : retired) {
+			if (std::binary_search(hazards.begin(), hazards.end(), r))
+				keep.push_back(r);
+			else
+				free_node(tid, r);
+		}
+		retired.swap(keep);
+	}
+
+	void offline(int) {}
+
+private:
+	struct alignas(CACHE_LINE_SIZE) ThreadState {
+		std::atomic<SmrNode *> hazards[SMR_SLOTS] = {};
+		alignas(CACHE_LINE_SIZE) std::vector<SmrNode *> retired;
+	};
+	std::unique_ptr<ThreadState[]> threads_;
+	size_t scan_threshold_;
+};
+
+// Hazard eras (Ramalhete, Correia) and 2-global-era interval-based reclamation (Wen et al.).
+// Nodes carry the era they were allocated and retired in. Hazard eras publish the era seen
+// by each protect per slot; IBR publishes one [lower, upper] era interval per operation.
+// A node is freed once no published era (interval) overlaps [birth, retire]. The global
+// era ticks every ERA_EVERY retires of a thread, so protect only writes when it moved.
+template <bool Interval>
+class EraReclaimer : public ReclaimerBase {
+public:
+	static constexpr int ERA_EVERY = 64;
+	static constexpr uint64_t NONE = UINT64_MAX;
+
+	explicit EraReclaimer(const std::vector<int> &thread_cores)
+		: ReclaimerBase(thread_cores.size()), threads_(new ThreadState[thread_cores.size()]),
+		  scan_threshold_(std::max<size_t>(64, 2 * SMR_SLOTS * thread_cores.size())) {}
+	~EraReclaimer() {
+		for (size_t t = 0; t < num_threads_; t++)
+			for (SmrNode *n : threads_[t].retired)
+				delete n;
+	}
+
+	void begin_op(int tid) {
+		if (!Interval)
+			return;
+		uint64_t e = era_.load();
+		threads_[tid].lower.store(e);
+		threads_[tid].upper.store(e);
+	}
+
+	void end_op(int tid) {
+		ThreadState &t = threads_[tid];
+		if (Interval) {
+			t.lower.store(NONE, std::memory_order_release);
+			t.upper.store(NONE, std::memory_order_release);
+		} else {
+			for (auto &e : t.eras)
+				e.store(NONE, std::memory_order_release);
+		}
+	}
+
+	SmrNode *protect(int tid, int slot, const std::atomic<SmrNode *> &src) {
+		std::atomic<uint64_t> &reserved = Interval ? threads_[tid].upper : threads_[tid].eras[slot];
+		uint64_t prev = reserved.load(std::memory_order_relaxed);
+		while (true) {
+			SmrNode *p = src.load();
+			uint64_t e = era_.load();
+			if (e == prev)
+				return p;
+			reserved.store(e);
+			prev = e;
+		}
+	}
+	void copy(int tid, int dst, int src) {
+		if (!Interval)
+			threads_[tid].eras[dst].store(threads_[tid].eras[src].load(std::memory_order_relaxed));
+	}
+	void on_alloc(int, SmrNode *n) { n->birth_era = era_.load(std::memory_order_relaxed); }
+
+	void retire(int tid, SmrNode *n) {
+		count_retire(tid, n);
+		ThreadState &t = threads_[tid];
+		n->retire_era = era_.load();
+		t.retired.push_back(n);
+		if (++t.retires % ERA_EVERY == 0)
+			era_.fetch_add(1);
+		if (t.retired.size() < scan_threshold_)
+			return;
+		std::vector<std::pair<uint64_t, uint64_t>> reserved; // [lower, upper]
+		for (size_t i = 0; i < num_threads_; i++) {
+			if (Interval) {
+				uint64_t lo = threads_[i].lower.load(), hi = threads_[i].upper.load();
+				if (lo != NONE)
+					reserved.push_back({lo, hi});
+			} else {
+				for (auto &e : threads_[i].eras)
+					if (uint64_t v = e.load(); v != NONE)
+						reserved.push_back({v, v});
+			}
+		}
+		std::vector<SmrNode *> keep;
+		for (SmrNode *r : t.retired) {
+			bool in_use = false;
+			for (auto &[lo, hi] : reserved)
+				in_use |= lo <= r->retire_era && r->birth_era <= hi;
+			if (in_use)
+				keep.push_back(r);
+			else
+				free_node(tid, r);
+		}
+		t.retired.swap(keep);
+	}
+
+	void offline(int) {}
+
+private:
+	struct alignas(CACHE_LINE_SIZE) ThreadState {
+		std::atomic<uint64_t> eras[SMR_SLOTS] = {NONE, NONE, NONE}; // hazard eras
+		std::atomic<uint64_t> lower{NONE};                           // IBR interval
+		std::atomic<uint64_t> upper{NONE};
+		alignas(CACHE_LINE_SIZE) std::vector<SmrNode *> retired;
+		long retires = 0;
+	};
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> era_{1};
+	char pad_[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+	std::unique_ptr<ThreadState[]> threads_;
+	size_t scan_threshold_;
+};
+
+using HazardEraReclaimer = EraReclaimer<false>;
+using IbrReclaimer = EraReclaimer<true>;
+
+// Michael's lock-free hash map: a sorted Harris-Michael list per bucket. Removal marks the
+// node's next link, then unlinks it; traversals unlink marked nodes they pass. Hazard slots:
+// 0 the next node, 1 the current node, 2 the node whose link is being followed. With one
+// bucket it is the plain linked list.
+template <class R>
+class MichaelHashMap {
+public:
+	MichaelHashMap(size_t buckets, R &reclaimer) : num_buckets_(buckets), heads_(new Bucket[buckets]), r_(reclaimer) {}
+	~MichaelHashMap() {
+		for (size_t b = 0; b < num_buckets_; b++) {
+			SmrNode *n = heads_[b].head.load();
+			while (n) {
+				SmrNode *next = smr_unmark(n->next.load());
+				delete n;
+				n = next;
+			}
+		}
+	}
+
+	bool contains(int tid, long key) {
+		std::atomic<SmrNode *> *prev;
+		SmrNode *cur, *next;
+		r_.begin_op(tid);
+		bool found = find(tid, key, prev, cur, next);
+		r_.end_op(tid);
+		return found;
+	}
+
+	bool insert(int tid, long key) {
+		SmrNode *n = new SmrNode;
+		n->key = key;
+		r_.on_alloc(tid, n);
+		std::atomic<SmrNode *> *prev;
+		SmrNode *cur, *next;
+		r_.begin_op(tid);
+		while (true) {
+			if (find(tid, key, prev, cur, next)) {
+				r_.end_op(tid);
+				delete n; // never published
+				return false;
+			}
+			n->next.store(cur, std::memory_order_relaxed);
+			if (prev->compare_exchange_strong(cur, n)) {
+				r_.end_op(tid);
+				return true;
+			}
+		}
+	}
+
+	bool remove(int tid, long key) {
+		std::atomic<SmrNode *> *prev;
+		SmrNode *cur, *next;
+		r_.begin_op(tid);
+		while (true) {
+			if (!find(tid, key, prev, cur, next)) {
+				r_.end_op(tid);
+				return false;
+			}
+			if (!cur->next.compare_exchange_strong(next, smr_mark(next)))
+				continue;
+			SmrNode *expected = cur;
+			if (prev->compare_exchange_strong(expected, next))
+				r_.retire(tid, cur);
+			else
+				find(tid, key, prev, cur, next); // unlinks and retires it
+			r_.end_op(tid);
+			return true;
+		}
+	}
+
+private:
+	struct alignas(CACHE_LINE_SIZE) Bucket {
+		std::atomic<SmrNode *> head{nullptr};
+	};
+
+	size_t bucket(long key) const { return ((uint64_t)key * 0x9E3779B97F4A7C15UL >> 20) % num_buckets_; }
+
+	// On return cur is the first node with a key >= key (or null), prev the link to it
+	bool find(int tid, long key, std::atomic<SmrNode *> *&prev, SmrNode *&cur, SmrNode *&next) {
+		std::atomic<SmrNode *> &head = heads_[bucket(key)].head;
+	retry:
+		prev = &head;
+		cur = r_.protect(tid, 1, *prev);
+		while (true) {
+			if (cur == nullptr)
+				return false;
+			next = r_.protect(tid, 0, cur->next);
+			if (prev->load() != cur)
+				goto retry;
+			if (!smr_marked(next)) {
+				if (cur->key >= key)
+					return cur->key == key;
+				prev = &cur->next;
+				r_.copy(tid, 2, 1);
+			} else {
+				next = smr_unmark(next);
+				SmrNode *expected = cur;
+				if (!prev->compare_exchange_strong(expected, next))
+					goto retry;
+				r_.retire(tid, cur);
+			}
+			cur = next;
+			r_.copy(tid, 1, 0);
+		}
+	}
+
+	size_t num_buckets_;
+	std::unique_ptr<Bucket[]> heads_;
+	R &r_;
+};
+
+#endif // RECLAMATION_H
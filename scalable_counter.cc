@@ -0,0 +1,167 @@
+#include "bench_util.h"
+#include "scalable_counters.h"
+#include <atomic>
+#include <future>
+#include <map>
+
+#include <cxxopts.hpp>
+
+#define NUM_TRIALS 3
+#define RUN_TIME_MS 1000
+#define READ_EVERY 4096     // every thread times one read per this many increments
+#define MAX_SAMPLES (1UL << 18)
+
+// SNZI as a counter: an increment is an arrive/depart pair, a read is the non-zero query
+class SnziPair {
+public:
+	explicit SnziPair(const std::vector<int> &thread_cores) : snzi_(thread_cores) {}
+	void inc(int tid) {
+		snzi_.arrive(tid);
+		snzi_.depart(tid);
+	}
+	uint64_t read() const { return snzi_.query(); }
+
+private:
+	Snzi snzi_;
+};
+
+struct WorkerResult {
+	size_t ops = 0;
+	std::vector<double> samples; // read latency in ns
+};
+
+template <class C>
+WorkerResult counter_worker(C &counter, int tid, int core_num, size_t max_samples, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	WorkerResult r;
+	if (!pin_to_core(core_num))
+		return r;
+	r.samples.reserve(max_samples);
+	double ticks_per_ns = tsc_per_ns();
+	uint64_t overhead = tsc_overhead();
+	sync_point.arrive_and_wait();
+	while (!stop.load(std::memory_order_relaxed)) {
+		for (int i = 0; i < READ_EVERY; i++)
+			counter.inc(tid);
+		r.ops += READ_EVERY;
+		uint64_t t0 = tsc_begin();
+		uint64_t v = counter.read();
+		uint64_t t1 = tsc_end();
+		asm volatile("" : : "r"(v));
+		if (r.samples.size() < max_samples)
+			r.samples.push_back((double)(t1 - t0 > overhead ? t1 - t0 - overhead : 0) / ticks_per_ns);
+	}
+	return r;
+}
+
+struct CounterResult {
+	double mops = 0;
+	double error = 0; // (final read - increments) / increments
+	std::vector<double> samples;
+};
+
+template <class C>
+static CounterResult run_counter(const std::vector<int> &thread_cores, int duration_ms, int num_trials) {
+	CounterResult res;
+	size_t num_threads = thread_cores.size();
+	for (int trial = 0; trial < num_trials; trial++) {
+		C counter(thread_cores);
+		alignas(CACHE_LINE_SIZE) std::atomic<bool> stop(false);
+		MyBarrier sync_point(num_threads + 1);
+		std::vector<std::future<WorkerResult>> futs;
+		for (size_t i = 0; i < num_threads; i++)
+			futs.push_back(std::async(std::launch::async, counter_worker<C>, std::ref(counter), i, thread_cores[i],
+				MAX_SAMPLES / num_threads + 1, std::ref(sync_point), std::ref(stop)));
+		sync_point.arrive_and_wait();
+		std::this_thread::sleep_for(std::chrono::milliseconds(duration_ms));
+		stop.store(true);
+		size_t ops = 0;
+		for (auto &f : futs) {
+			WorkerResult r = f.get();
+			ops += r.ops;
+			res.samples.insert(res.samples.end(), r.samples.begin(), r.samples.end());
+		}
+		res.mops += ops / (duration_ms / 1000.0) / 1e6;
+		// Quiescent read: exact counters must match, SNZI must be back to zero
+		double final_value = counter.read();
+		double expected = std::is_same_v<C, SnziPair> ? 0 : ops;
+		res.error += expected ? (final_value - expected) / expected / num_trials : final_value;
+	}
+	res.mops /= num_trials;
+	return res;
+}
+
+static const std::map<std::string, CounterResult (*)(const std::vector<int> &, int, int)> counter_variants = {
+	{"atomic", run_counter<AtomicCounter>},
+	{"sharded", run_counter<ShardedCounter>},
+	{"per_socket", run_counter<SocketCounter>},
+	{"combining_tree", run_counter<CombiningTreeCounter>},
+	{"probabilistic", run_counter<ProbabilisticCounter>},
+	{"snzi", run_counter<SnziPair>},
+};
+
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("Scalable Counter", "Increment throughput and read latency of scalable statistics counters");
+	options.add_options()
+		("v,variants", "Counters (atomic,sharded,per_socket,combining_tree,probabilistic,snzi)", cxxopts::value<std::string>()->default_value("atomic,sharded,per_socket,combining_tree,probabilistic,snzi"))
+		("t,threads", "Thread counts; threads beyond the core count share cores", cxxopts::value<std::string>()->default_value("1,2,4,8,16,32,64,128,256"))
+		("d,duration", "Run time per trial in ms", cxxopts::value<int>()->default_value(std::to_string(RUN_TIME_MS)))
+		("trials", "Number of trials", cxxopts::value<int>()->default_value(std::to_string(NUM_TRIALS)))
+		("r,result", "Result csv file", cxxopts::value<std::string>()->default_value("results/scalable_counter.csv"))
+		("h,help", "Print usage")
+		;
+	auto arguments = options.parse(argc, argv);
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	// Initialize NUMA library
+	if (numa_available() == -1) {
+		std::cerr << "NUMA is not available on this system." << std::endl;
+		return 1;
+	}
+
+	std::vector<std::string> variants;
+	std::stringstream ss(arguments["variants"].as<std::string>());
+	for (std::string tok; std::getline(ss, tok, ',');) {
+		if (!counter_variants.count(tok)) {
+			std::cerr << "Unknown counter: " << tok << std::endl;
+			return 1;
+		}
+		variants.push_back(tok);
+	}
+	int duration_ms = arguments["duration"].as<int>();
+	int num_trials = arguments["trials"].as<int>();
+
+	// Threads fill one socket's cores before moving to the next
+	std::vector<int> cores;
+	for (int n : cpu_nodes())
+		for (int c : cores_of_node(n))
+			cores.push_back(c);
+
+	std::ofstream results_file(arguments["result"].as<std::string>());
+	results_file << "counter,threads,cores,sockets,mops,read_p50_ns,read_p90_ns,read_p99_ns,read_max_ns,error\n";
+
+	for (const std::string &variant : variants) {
+		for (long num_threads : parse_list(arguments["threads"].as<std::string>())) {
+			std::vector<int> thread_cores;
+			std::map<int, int> sockets;
+			for (long i = 0; i < num_threads; i++) {
+				thread_cores.push_back(cores[i % cores.size()]);
+				sockets[cpu_package(thread_cores.back())]++;
+			}
+			size_t used_cores = std::min((size_t)num_threads, cores.size());
+			CounterResult r = counter_variants.at(variant)(thread_cores, duration_ms, num_trials);
+			LatencyStats lat = latency_stats(r.samples);
+			results_file << variant << "," << num_threads << "," << used_cores << "," << sockets.size() << "," << r.mops << ","
+				<< lat.p50 << "," << lat.p90 << "," << lat.p99 << "," << lat.max << "," << r.error << "\n";
+			std::cout << variant << " threads " << num_threads << ": " << r.mops << " Mops/s, read p50 " << lat.p50
+				<< " ns, p99 " << lat.p99 << " ns, error " << r.error << std::endl;
+		}
+	}
+
+	// Close the results file
+	results_file.close();
+
+	return 0;
+}
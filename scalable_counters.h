@@ -0,0 +1,232 @@
+#ifndef SCALABLE_COUNTERS_H
+#define SCALABLE_COUNTERS_H
+
+// Statistics counters that scale past one contended cache line. Every counter is built for a
+// fixed set of threads (tid 0..n-1, with the core each one is pinned to) and offers
+// inc(tid) and read(). Reads other than AtomicCounter's are not linearizable: an increment
+// in flight may be missed, but none is ever lost.
+
+#include "bench_util.h"
+#include <atomic>
+#include <map>
+#include <memory>
+
+struct alignas(CACHE_LINE_SIZE) PaddedCounter {
+	std::atomic<uint64_t> value{0};
+};
+
+// One shared atomic: every increment moves the same line (the global atomic_var_ case)
+class AtomicCounter {
+public:
+	explicit AtomicCounter(const std::vector<int> &) {}
+	void inc(int) { value_.fetch_add(1, std::memory_order_relaxed); }
+	uint64_t read() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> value_{0};
+};
+
+// A padded slot per thread; increments are plain single-writer stores, a read sums every slot
+class ShardedCounter {
+public:
+	explicit ShardedCounter(const std::vector<int> &thread_cores)
+		: num_slots_(thread_cores.size()), slots_(new PaddedCounter[thread_cores.size()]) {}
+	void inc(int tid) {
+		std::atomic<uint64_t> &v = slots_[tid].value;
+		v.store(v.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+	uint64_t read() const {
+		uint64_t sum = 0;
+		for (size_t i = 0; i < num_slots_; i++)
+			sum += slots_[i].value.load(std::memory_order_relaxed);
+		return sum;
+	}
+
+private:
+	size_t num_slots_;
+	std::unique_ptr<PaddedCounter[]> slots_;
+};
+
+// A slot per socket, shared with fetch_add by the threads of that socket: contention stays
+// inside one socket's caches and a read touches one line per socket
+class SocketCounter {
+public:
+	explicit SocketCounter(const std::vector<int> &thread_cores) {
+		std::map<int, int> index;
+		for (int c : thread_cores) {
+			int pkg = cpu_package(c);
+			if (!index.count(pkg)) {
+				int next = index.size();
+				index[pkg] = next;
+			}
+			socket_of_.push_back(index[pkg]);
+		}
+		num_slots_ = index.size();
+		slots_.reset(new PaddedCounter[num_slots_]);
+	}
+	void inc(int tid) { slots_[socket_of_[tid]].value.fetch_add(1, std::memory_order_relaxed); }
+	uint64_t read() const {
+		uint64_t sum = 0;
+		for (size_t i = 0; i < num_slots_; i++)
+			sum += slots_[i].value.load(std::memory_order_relaxed);
+		return sum;
+	}
+
+private:
+	std::vector<int> socket_of_;
+	size_t num_slots_;
+	std::unique_ptr<PaddedCounter[]> slots_;
+};
+
+// Binary combining tree in heap order (root 1, leaves from leaf_base_), two threads per leaf.
+// An increment deposits at its leaf and then climbs: at each node it tries to take the
+// node's carry flag, moves everything deposited there to the parent and goes on. A thread that
+// finds the flag taken stops, leaving its deposit for the current carrier's successors, so
+// under contention many increments reach the root as one fetch_add. A read sums all nodes.
+class CombiningTreeCounter {
+public:
+	explicit CombiningTreeCounter(const std::vector<int> &thread_cores) {
+		leaf_base_ = 1;
+		while (leaf_base_ * 2 < thread_cores.size())
+			leaf_base_ *= 2;
+		nodes_.reset(new Node[2 * leaf_base_]);
+	}
+	void inc(int tid) {
+		size_t i = leaf_base_ + tid / 2;
+		nodes_[i].pending.fetch_add(1, std::memory_order_relaxed);
+		while (i > 1) {
+			if (nodes_[i].busy.exchange(true, std::memory_order_acquire))
+				return;
+			uint64_t delta = nodes_[i].pending.exchange(0, std::memory_order_acq_rel);
+			size_t parent = i / 2;
+			if (delta)
+				nodes_[parent].pending.fetch_add(delta, std::memory_order_relaxed);
+			nodes_[i].busy.store(false, std::memory_order_release);
+			i = parent;
+		}
+	}
+	uint64_t read() const {
+		uint64_t sum = 0;
+		for (size_t i = 1; i < 2 * leaf_base_; i++)
+			sum += nodes_[i].pending.load(std::memory_order_relaxed);
+		return sum;
+	}
+
+private:
+	struct alignas(CACHE_LINE_SIZE) Node {
+		std::atomic<uint64_t> pending{0};
+		std::atomic<bool> busy{false};
+	};
+	size_t leaf_base_;
+	std::unique_ptr<Node[]> nodes_;
+};
+
+// Probabilistic counter: exact below 2^precision_bits; above that an increment adds 2^k with
+// probability 2^-k, where k keeps the update unit at about 2^-precision_bits of the value.
+// The value is an unbiased estimate, and updates to the shared line become rarer as it grows.
+class ProbabilisticCounter {
+public:
+	explicit ProbabilisticCounter(const std::vector<int> &thread_cores, int precision_bits = 8)
+		: precision_bits_(precision_bits), rng_(new PaddedCounter[thread_cores.size()]) {
+		for (size_t i = 0; i < thread_cores.size(); i++)
+			rng_[i].value.store(0x9E3779B97F4A7C15ULL * (i + 1));
+	}
+	void inc(int tid) {
+		uint64_t v = value_.load(std::memory_order_relaxed);
+		int k = v ? 63 - __builtin_clzll(v) - precision_bits_ : 0;
+		if (k <= 0) {
+			value_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		// xorshift64 in the thread's own slot
+		std::atomic<uint64_t> &s = rng_[tid].value;
+		uint64_t x = s.load(std::memory_order_relaxed);
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		s.store(x, std::memory_order_relaxed);
+		if ((x & ((1ULL << k) - 1)) == 0)
+			value_.fetch_add(1ULL << k, std::memory_order_relaxed);
+	}
+	uint64_t read() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> value_{0};
+	int precision_bits_;
+	std::unique_ptr<PaddedCounter[]> rng_;
+};
+
+// Scalable NonZero Indicator (Ellen, Lev, Luchangco, Moir): arrive/depart with a query that
+// only says whether the surplus is non-zero. Hierarchical nodes pack (count, version) in one
+// word, with count HALF marking a node that is propagating its first arrival to the parent;
+// only 0 <-> non-zero transitions of a child reach the parent, so the root is rarely written.
+class Snzi {
+public:
+	explicit Snzi(const std::vector<int> &thread_cores) {
+		leaf_base_ = 1;
+		while (leaf_base_ * 2 < thread_cores.size())
+			leaf_base_ *= 2;
+		nodes_.reset(new PaddedCounter[2 * leaf_base_]);
+	}
+	void arrive(int tid) { arrive_at(leaf_base_ + tid / 2); }
+	void depart(int tid) { depart_at(leaf_base_ + tid / 2); }
+	bool query() const { return nodes_[1].value.load() != 0; }
+
+private:
+	static constexpr uint32_t HALF = UINT32_MAX;
+	static uint32_t count(uint64_t w) { return (uint32_t)w; }
+	static uint32_t version(uint64_t w) { return w >> 32; }
+	static uint64_t make(uint32_t c, uint32_t v) { return ((uint64_t)v << 32) | c; }
+	bool cas(size_t i, uint64_t expected, uint64_t desired) {
+		return nodes_[i].value.compare_exchange_strong(expected, desired);
+	}
+
+	// The root (node 1) is a plain surplus counter
+	void arrive_at(size_t i) {
+		if (i == 1) {
+			nodes_[1].value.fetch_add(1);
+			return;
+		}
+		bool done = false;
+		int undo = 0;
+		while (!done) {
+			uint64_t x = nodes_[i].value.load();
+			uint32_t c = count(x), v = version(x);
+			if (c != HALF && c >= 1 && cas(i, x, make(c + 1, v)))
+				done = true;
+			if (c == 0 && cas(i, x, make(HALF, v + 1))) {
+				done = true;
+				x = make(HALF, v + 1);
+				c = HALF;
+				v = v + 1;
+			}
+			if (c == HALF) {
+				arrive_at(i / 2);
+				if (!cas(i, x, make(1, v)))
+					undo++;
+			}
+		}
+		for (; undo > 0; undo--)
+			depart_at(i / 2);
+	}
+
+	void depart_at(size_t i) {
+		if (i == 1) {
+			nodes_[1].value.fetch_sub(1);
+			return;
+		}
+		while (true) {
+			uint64_t x = nodes_[i].value.load();
+			if (cas(i, x, make(count(x) - 1, version(x)))) {
+				if (count(x) == 1)
+					depart_at(i / 2);
+				return;
+			}
+		}
+	}
+
+	size_t leaf_base_;
+	std::unique_ptr<PaddedCounter[]> nodes_;
+};
+
+#endif // SCALABLE_COUNTERS_H
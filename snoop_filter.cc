@@ -0,0 +1,277 @@
+#include "bench_util.h"
+#include <atomic>
+#include <future>
+#include <map>
+
+#include <cxxopts.hpp>
+
+#define NUM_TRIALS 3
+#define RUN_TIME_MS 500
+#define KNEE_THRESHOLD 0.10 // victim slowdown over the control that counts as the knee
+
+// Victim: chase a private, cache-resident working set until stopped and return ns per load.
+// Any increase over the idle value means lines were evicted or back-invalidated under it.
+double victim(ChaseNode *start, size_t lines, int core_num, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	if (!pin_to_core(core_num))
+		return 0;
+	ChaseNode *p = start;
+	for (size_t i = 0; i < lines * 4; i++)
+		p = p->next;
+	size_t loads = 0;
+	sync_point.arrive_and_wait();
+	auto start_time = std::chrono::steady_clock::now();
+	while (!stop.load(std::memory_order_relaxed)) {
+		for (int i = 0; i < 64; i += 16) {
+			p = p->next; p = p->next; p = p->next; p = p->next;
+			p = p->next; p = p->next; p = p->next; p = p->next;
+			p = p->next; p = p->next; p = p->next; p = p->next;
+			p = p->next; p = p->next; p = p->next; p = p->next;
+		}
+		loads += 64;
+	}
+	auto end_time = std::chrono::steady_clock::now();
+	asm volatile("" : : "r"(p));
+	return std::chrono::duration<double, std::nano>(end_time - start_time).count() / loads;
+}
+
+// Toucher: stream over its slice of the shared set, reading (or writing) every line, and
+// return bytes touched per second. Sharers on the victim socket run the same loop over the
+// whole set so every line has a copy on both sides of the interconnect.
+double toucher(uint8_t *slice, size_t size, bool write, int core_num, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	if (!pin_to_core(core_num))
+		return 0;
+	size_t lines = 0;
+	uint64_t sink = 0;
+	sync_point.arrive_and_wait();
+	auto start_time = std::chrono::steady_clock::now();
+	while (!stop.load(std::memory_order_relaxed)) {
+		for (size_t off = 0; off < size && !stop.load(std::memory_order_relaxed); off += CACHE_LINE_SIZE) {
+			volatile uint64_t *line = (volatile uint64_t *)(slice + off);
+			if (write)
+				*line = lines;
+			else
+				sink += *line;
+			lines++;
+		}
+	}
+	auto end_time = std::chrono::steady_clock::now();
+	asm volatile("" : : "r"(sink));
+	return lines * CACHE_LINE_SIZE / std::chrono::duration<double>(end_time - start_time).count();
+}
+
+struct ProbeResult {
+	double victim_ns = 0;
+	double toucher_bandwidth = 0; // GB/s
+};
+
+// One point of the sweep: victims chase their private sets while the touchers cover the first
+// shared_size bytes of shared in equal slices and the sharers read all of it. shared_size 0 is the idle baseline.
+static ProbeResult probe(const std::vector<ChaseNode *> &starts, size_t private_lines, const std::vector<int> &victims,
+		uint8_t *shared, size_t shared_size, const std::vector<int> &touchers, const std::vector<int> &sharers,
+		bool write, int duration_ms, int num_trials) {
+	ProbeResult r;
+	size_t num_touchers = shared_size ? touchers.size() : 0;
+	size_t num_sharers = shared_size ? sharers.size() : 0;
+	size_t slice = num_touchers ? (shared_size / num_touchers) & ~(size_t)(CACHE_LINE_SIZE - 1) : 0;
+	for (int trial = 0; trial < num_trials; trial++) {
+		alignas(CACHE_LINE_SIZE) std::atomic<bool> stop(false);
+		MyBarrier sync_point(victims.size() + num_touchers + num_sharers + 1);
+		std::vector<std::future<double>> victim_futs, toucher_futs, sharer_futs;
+		for (size_t i = 0; i < num_touchers; i++)
+			toucher_futs.push_back(std::async(std::launch::async, toucher, shared + i * slice, slice, write,
+				touchers[i], std::ref(sync_point), std::ref(stop)));
+		for (size_t i = 0; i < num_sharers; i++)
+			sharer_futs.push_back(std::async(std::launch::async, toucher, shared, slice * num_touchers, false,
+				sharers[i], std::ref(sync_point), std::ref(stop)));
+		for (size_t i = 0; i < victims.size(); i++)
+			victim_futs.push_back(std::async(std::launch::async, victim, starts[i], private_lines,
+				victims[i], std::ref(sync_point), std::ref(stop)));
+		sync_point.arrive_and_wait();
+		std::this_thread::sleep_for(std::chrono::milliseconds(duration_ms));
+		stop.store(true);
+		for (auto &f : victim_futs)
+			r.victim_ns += f.get() / victims.size();
+		for (auto &f : toucher_futs)
+			r.toucher_bandwidth += f.get() / 1e9;
+		for (auto &f : sharer_futs)
+			f.get();
+	}
+	r.victim_ns /= num_trials;
+	r.toucher_bandwidth /= num_trials;
+	return r;
+}
+
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("Snoop Filter", "Shared working-set size at which remote sharing starts evicting a socket's private data");
+	options.add_options()
+		("c,cpu_node", "Node of the victim threads (default: first CPU node)", cxxopts::value<int>()->default_value("-1"))
+		("o,remote_node", "Node of the remote touchers (default: first CPU node on another socket)", cxxopts::value<int>()->default_value("-1"))
+		("m,memory_node", "Home of the shared set (default: the victim node)", cxxopts::value<int>()->default_value("-1"))
+		("v,victims", "Victim threads, each chasing its own private set", cxxopts::value<int>()->default_value("4"))
+		("t,touchers", "Threads touching the shared set", cxxopts::value<int>()->default_value("4"))
+		("sharers", "Victim-socket threads that also read the whole shared set", cxxopts::value<int>()->default_value("1"))
+		("p,private", "Private working set per victim", cxxopts::value<std::string>()->default_value("256K"))
+		("s,max_shared", "Largest shared set; the sweep doubles up to it from 64K", cxxopts::value<std::string>()->default_value("1G"))
+		("w,write", "Touchers write the shared lines instead of reading them")
+		("threshold", "Slowdown over the control that marks the knee", cxxopts::value<double>()->default_value(std::to_string(KNEE_THRESHOLD)))
+		("d,duration", "Run time per trial in ms", cxxopts::value<int>()->default_value(std::to_string(RUN_TIME_MS)))
+		("trials", "Number of trials", cxxopts::value<int>()->default_value(std::to_string(NUM_TRIALS)))
+		("r,result", "Result csv file", cxxopts::value<std::string>()->default_value("results/snoop_filter.csv"))
+		("emulate_cxl", "Serve this node id from an emulated CXL pool: node[:latency_ns[:GB/s[:size]]]", cxxopts::value<std::string>())
+		("placement", "Buffer placement (bind,preferred,interleave,first_touch)", cxxopts::value<std::string>()->default_value("bind"))
+		("h,help", "Print usage")
+		;
+	auto arguments = options.parse(argc, argv);
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	// Initialize NUMA library
+	if (numa_available() == -1) {
+		std::cerr << "NUMA is not available on this system." << std::endl;
+		return 1;
+	}
+	if (arguments.count("emulate_cxl") && !enable_cxl_emulation(arguments["emulate_cxl"].as<std::string>()))
+		return 1;
+	warn_unshimmed_cxl();
+	if (!set_alloc_policy("default", arguments["placement"].as<std::string>()))
+		return 1;
+
+	std::vector<int> c_nodes = cpu_nodes();
+	int victim_node = arguments["cpu_node"].as<int>();
+	if (victim_node < 0)
+		victim_node = c_nodes[0];
+	std::vector<int> local_cores = cores_of_node(victim_node);
+	if (local_cores.empty()) {
+		std::cerr << "No CPUs found on NUMA node " << victim_node << "." << std::endl;
+		return 1;
+	}
+	int remote_node = arguments["remote_node"].as<int>();
+	if (remote_node < 0) {
+		for (int n : c_nodes) {
+			if (cpu_package(cores_of_node(n)[0]) != cpu_package(local_cores[0])) {
+				remote_node = n;
+				break;
+			}
+		}
+	}
+	int memory_node = arguments["memory_node"].as<int>();
+	if (memory_node < 0)
+		memory_node = victim_node;
+
+	size_t num_victims = arguments["victims"].as<int>();
+	size_t num_touchers = arguments["touchers"].as<int>();
+	size_t num_sharers = arguments["sharers"].as<int>();
+	if (num_victims < 1 || num_touchers < 1 || local_cores.size() < num_victims + num_sharers) {
+		std::cerr << "Need " << num_victims + num_sharers << " cores on node " << victim_node << " and at least one toucher." << std::endl;
+		return 1;
+	}
+	std::vector<int> victims(local_cores.begin(), local_cores.begin() + num_victims);
+	std::vector<int> sharers(local_cores.begin() + num_victims, local_cores.begin() + num_victims + num_sharers);
+
+	// Remote mode: the touchers sit on the other socket. Control mode: the same number of touchers
+	// on the victim socket, so LLC pressure alone is separated from cross-socket tracking.
+	std::vector<std::pair<std::string, std::vector<int>>> modes;
+	if (remote_node >= 0) {
+		std::vector<int> remote_cores = cores_of_node(remote_node);
+		if (remote_cores.size() >= num_touchers)
+			modes.push_back({"remote", std::vector<int>(remote_cores.begin(), remote_cores.begin() + num_touchers)});
+	}
+	if (modes.empty())
+		std::cerr << "No remote socket with " << num_touchers << " cores; only the local control runs." << std::endl;
+	if (local_cores.size() >= num_victims + num_sharers + num_touchers)
+		modes.push_back({"local", std::vector<int>(local_cores.begin() + num_victims + num_sharers,
+			local_cores.begin() + num_victims + num_sharers + num_touchers)});
+	else
+		std::cerr << "Not enough cores on node " << victim_node << " for the local control." << std::endl;
+	if (modes.empty())
+		return 1;
+
+	bool write = arguments.count("write");
+	int duration_ms = arguments["duration"].as<int>();
+	int num_trials = arguments["trials"].as<int>();
+	double threshold = arguments["threshold"].as<double>();
+	size_t private_size = parse_size(arguments["private"].as<std::string>());
+	size_t max_shared = parse_size(arguments["max_shared"].as<std::string>());
+	std::vector<size_t> shared_sizes = {0};
+	for (size_t s = 64UL << 10; s <= max_shared; s *= 2)
+		shared_sizes.push_back(s);
+
+	// Private sets live on the victims' node, the shared set on its home node
+	std::mt19937_64 rng(42);
+	size_t private_lines = private_size / CACHE_LINE_SIZE;
+	size_t private_alloc = (private_size + 4095) & ~4095UL;
+	std::vector<ChaseNode *> private_bufs, starts;
+	for (size_t i = 0; i < num_victims; i++) {
+		ChaseNode *buf = static_cast<ChaseNode *>(alloc_pages_on_node(private_alloc, victim_node, false));
+		if (buf == nullptr) {
+			std::cerr << "Failed to allocate memory on NUMA node " << victim_node << "." << std::endl;
+			return 1;
+		}
+		// Under first_touch the victim's own core places its set (otherwise already zeroed)
+		if (alloc_policy().placement == NodePlacement::FirstTouch)
+			touch_by_owners(buf, private_alloc, {{buf, private_alloc, victims[i]}});
+		private_bufs.push_back(buf);
+		starts.push_back(build_chase(buf, private_lines, rng));
+	}
+	size_t shared_alloc = (max_shared + 4095) & ~4095UL;
+	uint8_t *shared = static_cast<uint8_t *>(alloc_pages_on_node(shared_alloc, memory_node, false));
+	if (shared == nullptr) {
+		std::cerr << "Failed to allocate memory on NUMA node " << memory_node << "." << std::endl;
+		return 1;
+	}
+	// The shared set has no single owner; fault it in here so no trial pays for it
+	if (alloc_policy().placement == NodePlacement::FirstTouch)
+		touch_by_owners(shared, shared_alloc, {});
+
+	std::ofstream results_file(arguments["result"].as<std::string>());
+	results_file << "mode,victim_node,toucher_node,memory_node,victims,touchers,sharers,write,private_bytes,shared_bytes,victim_ns,toucher_bandwidth,slowdown,excess,cxl_shim\n";
+
+	ProbeResult idle = probe(starts, private_lines, victims, shared, 0, {}, {}, write, duration_ms, num_trials);
+	std::cout << "Idle victim latency: " << idle.victim_ns << " ns/load" << std::endl;
+
+	// Victim latency per mode and shared size; "excess" is the remote slowdown over the local control
+	std::map<std::string, std::vector<double>> curve;
+	for (auto &[mode, touchers] : modes) {
+		int toucher_node = numa_node_of_cpu(touchers[0]);
+		for (size_t shared_size : shared_sizes) {
+			ProbeResult r = probe(starts, private_lines, victims, shared, shared_size, touchers, sharers, write, duration_ms, num_trials);
+			curve[mode].push_back(r.victim_ns);
+			std::cout << mode << " shared " << shared_size << ": victim " << r.victim_ns << " ns/load ("
+				<< r.victim_ns / idle.victim_ns << "x idle), touchers " << r.toucher_bandwidth << " GB/s" << std::endl;
+			results_file << mode << "," << victim_node << "," << toucher_node << "," << memory_node << "," << num_victims << ","
+				<< num_touchers << "," << num_sharers << "," << write << "," << private_size << "," << shared_size << ","
+				<< r.victim_ns << "," << r.toucher_bandwidth << "," << r.victim_ns / idle.victim_ns << ",";
+			if (mode == "local" && curve.count("remote"))
+				results_file << curve["remote"][curve[mode].size() - 1] / r.victim_ns;
+			else
+				results_file << 0;
+			results_file << "," << cxl_shim(memory_node, false) << "\n";
+		}
+	}
+
+	// The knee is the smallest shared set at which remote sharing hurts the victims beyond what the
+	// same traffic from their own socket does (against the idle latency when there is no control)
+	if (curve.count("remote")) {
+		size_t knee = 0;
+		for (size_t i = 1; i < shared_sizes.size() && !knee; i++) {
+			double reference = curve.count("local") ? curve["local"][i] : idle.victim_ns;
+			if (curve["remote"][i] > reference * (1 + threshold))
+				knee = shared_sizes[i];
+		}
+		if (knee)
+			std::cout << "Knee: private data starts missing once the remote shared set reaches " << knee << " bytes" << std::endl;
+		else
+			std::cout << "No knee found up to " << max_shared << " bytes" << std::endl;
+	}
+
+	for (ChaseNode *buf : private_bufs)
+		free_pages(buf, private_alloc);
+	free_pages(shared, shared_alloc);
+
+	// Close the results file
+	results_file.close();
+
+	return 0;
+}
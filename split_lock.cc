@@ -0,0 +1,294 @@
+#include "bench_util.h"
+#include <atomic>
+#include <future>
+#include <map>
+#include <csignal>
+
+#include <cxxopts.hpp>
+
+#define NUM_TRIALS 3
+#define RUN_TIME_MS 1000
+#define SLOT_STRIDE 4096 // private variables live a page apart
+
+// Where the locked operand sits relative to its cache line
+enum class Alignment { Aligned, Misaligned, Straddle };
+
+static const std::map<std::string, Alignment> alignment_names = {
+	{"aligned", Alignment::Aligned},
+	{"misaligned", Alignment::Misaligned},
+	{"straddle", Alignment::Straddle},
+};
+
+// Byte offset of a width-byte operand inside its slot: line start, inside the line but not
+// naturally aligned, or across the boundary between two lines (a split lock)
+static size_t operand_offset(Alignment a, int width) {
+	switch (a) {
+		case Alignment::Aligned: return 0;
+		case Alignment::Misaligned: return 1;
+		case Alignment::Straddle: return CACHE_LINE_SIZE - width / 2;
+	}
+	return 0;
+}
+
+// lock xadd on a possibly misaligned operand; std::atomic would refuse the pointer
+static inline void locked_add(uint8_t *p, int width) {
+	if (width == 4) {
+		uint32_t v = 1;
+		asm volatile("lock xaddl %0, %1" : "+r"(v), "+m"(*(uint32_t *)p) : : "memory", "cc");
+	} else {
+		uint64_t v = 1;
+		asm volatile("lock xaddq %0, %1" : "+r"(v), "+m"(*(uint64_t *)p) : : "memory", "cc");
+	}
+}
+
+size_t attacker(uint8_t *operand, int width, int core_num, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	if (!pin_to_core(core_num))
+		return 0;
+	size_t count = 0;
+	sync_point.arrive_and_wait();
+	while (!stop.load(std::memory_order_relaxed)) {
+		for (int i = 0; i < 16; i++)
+			locked_add(operand, width);
+		count += 16;
+	}
+	return count;
+}
+
+// The local_atomic loop from coherence.cc: fetch_add on a private, aligned atomic
+size_t local_atomic(int core_num, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	if (!pin_to_core(core_num))
+		return 0;
+	std::atomic<int> atomic_var(0);
+	size_t count = 0;
+	sync_point.arrive_and_wait();
+	while (!stop.load(std::memory_order_relaxed)) {
+		atomic_var.fetch_add(1);
+		count++;
+	}
+	return count;
+}
+
+// Kernel split-lock handling: "off", "warn", "fatal" or "ratelimit:N" from the command line,
+// "warn" when the CPU supports detection and nothing overrides it, "unsupported" otherwise.
+// With warn, split_lock_mitigate=1 makes the kernel put offending tasks to sleep.
+static std::string split_lock_mode() {
+	std::ifstream cmdline("/proc/cmdline");
+	std::string line, mode;
+	std::getline(cmdline, line);
+	size_t pos = line.find("split_lock_detect=");
+	if (pos != std::string::npos) {
+		mode = line.substr(pos + strlen("split_lock_detect="));
+		mode = mode.substr(0, mode.find(' '));
+	}
+	bool supported = false;
+	std::ifstream cpuinfo("/proc/cpuinfo");
+	while (std::getline(cpuinfo, line)) {
+		if (line.rfind("flags", 0) == 0) {
+			supported = line.find(" split_lock_detect") != std::string::npos;
+			break;
+		}
+	}
+	// The boot log says what was actually enabled, when we are allowed to read it
+	FILE *dmesg = popen("dmesg 2>/dev/null | grep -i 'split lock'", "r");
+	if (dmesg) {
+		char buf[256];
+		while (fgets(buf, sizeof(buf), dmesg)) {
+			std::string msg(buf);
+			if (msg.find("sending SIGBUS on user-space split_locks") != std::string::npos)
+				mode = "fatal";
+			else if (msg.find("warning on user-space split_locks") != std::string::npos && mode.empty())
+				mode = "warn";
+			supported = true;
+		}
+		pclose(dmesg);
+	}
+	if (mode.empty())
+		mode = supported ? "warn" : "unsupported";
+	if (mode == "warn") {
+		std::ifstream mitigate("/proc/sys/kernel/split_lock_mitigate");
+		int m = 0;
+		if (mitigate >> m)
+			mode += m ? "+mitigate" : "";
+	}
+	return mode;
+}
+
+static void on_sigbus(int) {
+	const char msg[] = "SIGBUS on a split lock: kernel split-lock detection is fatal, rerun with -a aligned,misaligned\n";
+	if (write(STDERR_FILENO, msg, sizeof(msg) - 1) < 0) {}
+	_exit(1);
+}
+
+// Run attackers (and optionally local_atomic victims) for one trial set, returning per-group ops/s
+static std::pair<double, double> run(const std::vector<uint8_t *> &operands, int width, const std::vector<int> &attackers,
+		const std::vector<int> &victims, int duration_ms, int num_trials) {
+	double attack_ops = 0, victim_ops = 0;
+	for (int trial = 0; trial < num_trials; trial++) {
+		alignas(CACHE_LINE_SIZE) std::atomic<bool> stop(false);
+		MyBarrier sync_point(attackers.size() + victims.size() + 1);
+		std::vector<std::future<size_t>> attack_futs, victim_futs;
+		for (size_t i = 0; i < attackers.size(); i++)
+			attack_futs.push_back(std::async(std::launch::async, attacker, operands[i], width, attackers[i], std::ref(sync_point), std::ref(stop)));
+		for (int c : victims)
+			victim_futs.push_back(std::async(std::launch::async, local_atomic, c, std::ref(sync_point), std::ref(stop)));
+		sync_point.arrive_and_wait();
+		std::this_thread::sleep_for(std::chrono::milliseconds(duration_ms));
+		stop.store(true);
+		for (auto &f : attack_futs)
+			attack_ops += f.get();
+		for (auto &f : victim_futs)
+			victim_ops += f.get();
+	}
+	double seconds = num_trials * duration_ms / 1000.0;
+	return {attack_ops / seconds, victim_ops / seconds};
+}
+
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("Split Lock", "Penalty of misaligned and cache-line-straddling atomics, and their blast radius");
+	options.add_options()
+		("c,cpu_node", "NUMA node of the attacking threads", cxxopts::value<int>()->default_value("0"))
+		("m,memory_node", "Home node of the atomic operands", cxxopts::value<int>()->default_value("0"))
+		("a,alignments", "Operand alignments (aligned,misaligned,straddle)", cxxopts::value<std::string>()->default_value("aligned,misaligned,straddle"))
+		("w,widths", "Operand widths in bytes (4,8)", cxxopts::value<std::string>()->default_value("4,8"))
+		("t,max_threads", "Largest attacker count (default: all cores of the CPU node)", cxxopts::value<int>()->default_value("0"))
+		("v,victims", "local_atomic victim threads per placement in the collateral test", cxxopts::value<int>()->default_value("4"))
+		("d,duration", "Run time per trial in ms", cxxopts::value<int>()->default_value(std::to_string(RUN_TIME_MS)))
+		("trials", "Number of trials", cxxopts::value<int>()->default_value(std::to_string(NUM_TRIALS)))
+		("r,result", "Result csv file", cxxopts::value<std::string>()->default_value("results/split_lock.csv"))
+		("emulate_cxl", "Serve this node id from an emulated CXL pool: node[:latency_ns[:GB/s[:size]]]", cxxopts::value<std::string>())
+		("page_mode", "Buffer pages (default,4k,thp,2m,1g)", cxxopts::value<std::string>()->default_value("default"))
+		("placement", "Buffer placement (bind,preferred,interleave,first_touch)", cxxopts::value<std::string>()->default_value("bind"))
+		("h,help", "Print usage")
+		;
+	auto arguments = options.parse(argc, argv);
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	// Initialize NUMA library
+	if (numa_available() == -1) {
+		std::cerr << "NUMA is not available on this system." << std::endl;
+		return 1;
+	}
+	if (arguments.count("emulate_cxl") && !enable_cxl_emulation(arguments["emulate_cxl"].as<std::string>()))
+		return 1;
+	warn_unshimmed_cxl();
+	if (!set_alloc_policy(arguments["page_mode"].as<std::string>(), arguments["placement"].as<std::string>()))
+		return 1;
+
+	int cpu_node = arguments["cpu_node"].as<int>();
+	int memory_node = arguments["memory_node"].as<int>();
+	std::vector<int> cores = cores_of_node(cpu_node);
+	if (cores.empty()) {
+		std::cerr << "No CPUs found on NUMA node " << cpu_node << "." << std::endl;
+		return 1;
+	}
+	size_t max_threads = arguments["max_threads"].as<int>();
+	if (max_threads == 0 || max_threads > cores.size())
+		max_threads = cores.size();
+	size_t num_victims = arguments["victims"].as<int>();
+	int duration_ms = arguments["duration"].as<int>();
+	int num_trials = arguments["trials"].as<int>();
+
+	std::vector<std::string> alignments;
+	std::stringstream ss(arguments["alignments"].as<std::string>());
+	for (std::string tok; std::getline(ss, tok, ',');) {
+		if (!alignment_names.count(tok)) {
+			std::cerr << "Unknown alignment: " << tok << std::endl;
+			return 1;
+		}
+		alignments.push_back(tok);
+	}
+	std::vector<long> widths = parse_list(arguments["widths"].as<std::string>());
+	for (long w : widths) {
+		if (w != 4 && w != 8) {
+			std::cerr << "Unsupported width: " << w << std::endl;
+			return 1;
+		}
+	}
+
+	std::string split_lock = split_lock_mode();
+	std::cout << "Kernel split-lock detection: " << split_lock << std::endl;
+	if (split_lock == "fatal" && std::find(alignments.begin(), alignments.end(), "straddle") != alignments.end()) {
+		std::cerr << "Split locks are fatal on this kernel; skipping the straddle alignment." << std::endl;
+		alignments.erase(std::find(alignments.begin(), alignments.end(), "straddle"));
+	}
+	signal(SIGBUS, on_sigbus);
+
+	// One page per attacker so private operands never share a line
+	size_t alloc_size = max_threads * SLOT_STRIDE + SLOT_STRIDE;
+	uint8_t *memory = static_cast<uint8_t *>(alloc_on_node(alloc_size, memory_node));
+	if (memory == nullptr) {
+		std::cerr << "Failed to allocate memory on NUMA node " << memory_node << std::endl;
+		return 1;
+	}
+	// Attacker i owns slot i + 1, which for attacker 0 also holds the shared operand
+	std::vector<OwnedRange> owners;
+	for (size_t i = 0; i < max_threads; i++)
+		owners.push_back({memory + (i + 1) * SLOT_STRIDE, SLOT_STRIDE, cores[i]});
+	touch_by_owners(memory, alloc_size, owners);
+	size_t page_size = mapping_page_size(memory);
+	std::cout << "Operands on node " << memory_node << ", " << page_size << " B pages" << std::endl;
+
+	// Collateral victims: other cores of the attackers' socket and cores of another socket
+	std::map<std::string, std::vector<int>> victim_cores;
+	for (int n : cpu_nodes()) {
+		for (int c : cores_of_node(n)) {
+			if (c == cores[0])
+				continue;
+			std::string where = cpu_package(c) == cpu_package(cores[0]) ? "same_socket" : "remote_socket";
+			if (victim_cores[where].size() < num_victims)
+				victim_cores[where].push_back(c);
+		}
+	}
+
+	std::ofstream results_file(arguments["result"].as<std::string>());
+	results_file << "test,alignment,width,contention,threads,victim_placement,victims,mops,relative,split_lock,page_size,cxl_shim\n";
+
+	for (long width : widths) {
+		// Attacker sweep: private operands (one per thread) and one shared operand
+		std::map<std::string, double> single_thread;
+		for (std::string contention : {"private", "shared"}) {
+			for (const std::string &name : alignments) {
+				size_t offset = operand_offset(alignment_names.at(name), width);
+				for (size_t threads : pow2_sweep(max_threads)) {
+					std::vector<uint8_t *> operands;
+					for (size_t i = 0; i < threads; i++)
+						operands.push_back(memory + SLOT_STRIDE + (contention == "private" ? i * SLOT_STRIDE : 0) + offset);
+					std::vector<int> attackers(cores.begin(), cores.begin() + threads);
+					double mops = run(operands, width, attackers, {}, duration_ms, num_trials).first / 1e6;
+					if (threads == 1 && contention == "private")
+						single_thread[name] = mops;
+					double relative = single_thread.count("aligned") ? mops / (single_thread["aligned"] * threads) : 0;
+					results_file << "attack," << name << "," << width << "," << contention << "," << threads << ",,0,"
+						<< mops << "," << relative << "," << split_lock << "," << page_size << "," << cxl_shim(memory_node, false) << "\n";
+					std::cout << name << " " << width << "B " << contention << " threads " << threads << ": " << mops << " Mops/s" << std::endl;
+				}
+			}
+		}
+
+		// Collateral: one attacker on cores[0] against local_atomic loops elsewhere, relative to the victims alone
+		uint8_t *operand_base = memory + SLOT_STRIDE;
+		for (auto &[where, victims] : victim_cores) {
+			if (victims.empty())
+				continue;
+			double alone = run({}, width, {}, victims, duration_ms, num_trials).second / 1e6;
+			for (const std::string &name : alignments) {
+				uint8_t *operand = operand_base + operand_offset(alignment_names.at(name), width);
+				double mops = run({operand}, width, {cores[0]}, victims, duration_ms, num_trials).second / 1e6;
+				results_file << "collateral," << name << "," << width << ",private,1," << where << "," << victims.size() << ","
+					<< mops << "," << mops / alone << "," << split_lock << "," << page_size << "," << cxl_shim(memory_node, false) << "\n";
+				std::cout << "Collateral " << name << " " << width << "B on " << victims.size() << " " << where << " victims: "
+					<< mops << " Mops/s (" << mops / alone << "x alone)" << std::endl;
+			}
+		}
+	}
+
+	free_on_node(memory, alloc_size);
+
+	// Close the results file
+	results_file.close();
+
+	return 0;
+}
@@ -0,0 +1,161 @@
+#include "../include/channel.h"
+#include <emmintrin.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t round_up_pow2(size_t n) {
+    uint64_t p = 2;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+static channel_slot_t* alloc_slots(uint64_t n) {
+    channel_slot_t* slots = NULL;
+    if (posix_memalign((void**)&slots, CHANNEL_SLOT_SIZE, n * sizeof(channel_slot_t)) != 0) {
+        return NULL;
+    }
+    // First touch places the ring on the caller's node
+    memset(slots, 0, n * sizeof(channel_slot_t));
+    return slots;
+}
+
+// Copy a payload into a slot, optionally with streaming stores that skip the cache
+static void write_payload(channel_slot_t* slot, const void* msg, bool nontemporal) {
+    if (!nontemporal) {
+        memcpy(slot->payload, msg, CHANNEL_PAYLOAD_SIZE);
+        return;
+    }
+    long long words[CHANNEL_PAYLOAD_SIZE / 8];
+    memcpy(words, msg, CHANNEL_PAYLOAD_SIZE);
+    long long* dst = (long long*)slot->payload;
+    for (size_t i = 0; i < CHANNEL_PAYLOAD_SIZE / 8; i++) {
+        _mm_stream_si64(&dst[i], words[i]);
+    }
+}
+
+// SPSC
+int spsc_init(spsc_channel_t* ch, size_t capacity, int batch, bool nontemporal) {
+    if (batch < 1 || batch > CHANNEL_MAX_BATCH) {
+        fprintf(stderr, "Channel batch must be between 1 and %d\n", CHANNEL_MAX_BATCH);
+        return -1;
+    }
+    memset(ch, 0, sizeof(*ch));
+    uint64_t n = round_up_pow2(capacity);
+    ch->mask = n - 1;
+    ch->batch = batch;
+    ch->nontemporal = nontemporal;
+    ch->slots = alloc_slots(n);
+    return ch->slots ? 0 : -1;
+}
+
+void spsc_destroy(spsc_channel_t* ch) {
+    free(ch->slots);
+}
+
+void spsc_flush(spsc_channel_t* ch) {
+    if (ch->write_pos == ch->published) return;
+    // Streaming stores are weakly ordered: drain them before the tail says they are there
+    if (ch->nontemporal) _mm_sfence();
+    ch->published = ch->write_pos;
+    __atomic_store_n(&ch->tail, ch->published, __ATOMIC_RELEASE);
+}
+
+bool spsc_send(spsc_channel_t* ch, const void* msg) {
+    if (ch->write_pos - ch->cached_head > ch->mask) {
+        ch->cached_head = __atomic_load_n(&ch->head, __ATOMIC_ACQUIRE);
+        if (ch->write_pos - ch->cached_head > ch->mask) {
+            // Full: whatever is still unpublished must become visible or we never drain
+            spsc_flush(ch);
+            return false;
+        }
+    }
+    write_payload(&ch->slots[ch->write_pos & ch->mask], msg, ch->nontemporal);
+    ch->write_pos++;
+    if (ch->write_pos - ch->published >= (uint64_t)ch->batch) spsc_flush(ch);
+    return true;
+}
+
+bool spsc_recv(spsc_channel_t* ch, void* msg) {
+    uint64_t head = ch->read_pos;
+    if (head == ch->cached_tail) {
+        ch->cached_tail = __atomic_load_n(&ch->tail, __ATOMIC_ACQUIRE);
+        if (head == ch->cached_tail) return false;
+    }
+    memcpy(msg, ch->slots[head & ch->mask].payload, CHANNEL_PAYLOAD_SIZE);
+    ch->read_pos = head + 1;
+    __atomic_store_n(&ch->head, ch->read_pos, __ATOMIC_RELEASE);
+    return true;
+}
+
+// MPSC
+int mpsc_init(mpsc_channel_t* ch, size_t capacity, bool nontemporal) {
+    memset(ch, 0, sizeof(*ch));
+    uint64_t n = round_up_pow2(capacity);
+    ch->mask = n - 1;
+    ch->nontemporal = nontemporal;
+    ch->slots = alloc_slots(n);
+    if (!ch->slots) return -1;
+    for (uint64_t i = 0; i < n; i++) {
+        ch->slots[i].seq = i; // free for the producer that claims position i
+    }
+    return 0;
+}
+
+void mpsc_destroy(mpsc_channel_t* ch) {
+    free(ch->slots);
+}
+
+void mpsc_producer_init(mpsc_producer_t* p, mpsc_channel_t* ch, int batch) {
+    p->ch = ch;
+    p->batch = batch < 1 ? 1 : (batch > CHANNEL_MAX_BATCH ? CHANNEL_MAX_BATCH : batch);
+    if ((uint64_t)p->batch > ch->mask + 1) p->batch = ch->mask + 1;
+    p->count = 0;
+}
+
+bool mpsc_flush(mpsc_producer_t* p) {
+    mpsc_channel_t* ch = p->ch;
+    int n = p->count;
+    if (n == 0) return true;
+    // Claim n consecutive positions. The consumer frees slots in order, so if the last
+    // one is free for this lap, all of them are.
+    uint64_t pos = ch->tail;
+    while (1) {
+        uint64_t last = pos + n - 1;
+        if (__atomic_load_n(&ch->slots[last & ch->mask].seq, __ATOMIC_ACQUIRE) != last) {
+            uint64_t now = ch->tail;
+            if (now == pos) return false; // full
+            pos = now;
+            continue;
+        }
+        if (__sync_bool_compare_and_swap(&ch->tail, pos, pos + n)) break;
+        pos = ch->tail;
+    }
+    for (int i = 0; i < n; i++) {
+        write_payload(&ch->slots[(pos + i) & ch->mask], p->staged[i], ch->nontemporal);
+    }
+    if (ch->nontemporal) _mm_sfence();
+    for (int i = 0; i < n; i++) {
+        __atomic_store_n(&ch->slots[(pos + i) & ch->mask].seq, pos + i + 1, __ATOMIC_RELEASE);
+    }
+    p->count = 0;
+    return true;
+}
+
+bool mpsc_send(mpsc_producer_t* p, const void* msg) {
+    if (p->count == p->batch && !mpsc_flush(p)) return false;
+    memcpy(p->staged[p->count++], msg, CHANNEL_PAYLOAD_SIZE);
+    if (p->count == p->batch) mpsc_flush(p);
+    return true;
+}
+
+bool mpsc_recv(mpsc_channel_t* ch, void* msg) {
+    uint64_t head = ch->head;
+    channel_slot_t* slot = &ch->slots[head & ch->mask];
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != head + 1) return false;
+    memcpy(msg, slot->payload, CHANNEL_PAYLOAD_SIZE);
+    // Free the slot for the producer one lap ahead
+    __atomic_store_n(&slot->seq, head + ch->mask + 1, __ATOMIC_RELEASE);
+    ch->head = head + 1;
+    return true;
+}
@@ -0,0 +1,358 @@
+#define _GNU_SOURCE
+#include "../include/emulation.h"
+#include "../include/channel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/sysinfo.h>
+#include <time.h>
+
+#define MAX_LIST 32
+#define MAX_LATENCY_SAMPLES (1 << 20)
+
+typedef enum { TEST_PINGPONG, TEST_SPSC, TEST_MPSC } test_t;
+
+typedef struct {
+    test_t test;
+    int producer_socket;
+    int consumer_socket;
+    int num_producers;
+    int batch;
+    bool nontemporal;
+    bool home_on_producer; // ring memory on the producer's node instead of the consumer's
+    size_t capacity;
+    int duration_ms;
+} channel_config_t;
+
+typedef struct {
+    double mmsgs;  // million messages per second
+    double gbps;   // payload bytes per second
+    double p50_ns; // one-way latency, ping-pong only
+    double p99_ns;
+} channel_result_t;
+
+typedef struct {
+    const channel_config_t* config;
+    int core;
+    spsc_channel_t* to_consumer;
+    spsc_channel_t* to_producer;
+    mpsc_channel_t* mpsc;
+    pthread_barrier_t* barrier;
+    volatile bool* stop;
+    long messages;
+    double* samples;
+    long num_samples;
+} channel_thread_t;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Ping-pong: the producer sends, the consumer echoes, half the round trip is the latency
+static void* pingpong_producer(void* arg) {
+    channel_thread_t* t = arg;
+    uint8_t msg[CHANNEL_PAYLOAD_SIZE] = {0};
+    pin_thread_to_core(t->core);
+    pthread_barrier_wait(t->barrier);
+    while (!*t->stop) {
+        double start = now_ns();
+        while (!spsc_send(t->to_consumer, msg)) {}
+        while (!spsc_recv(t->to_producer, msg)) {
+            if (*t->stop) return NULL;
+        }
+        if (t->num_samples < MAX_LATENCY_SAMPLES) t->samples[t->num_samples++] = (now_ns() - start) / 2;
+        t->messages++;
+    }
+    return NULL;
+}
+
+static void* pingpong_consumer(void* arg) {
+    channel_thread_t* t = arg;
+    uint8_t msg[CHANNEL_PAYLOAD_SIZE];
+    pin_thread_to_core(t->core);
+    pthread_barrier_wait(t->barrier);
+    while (!*t->stop) {
+        if (spsc_recv(t->to_consumer, msg)) {
+            while (!spsc_send(t->to_producer, msg)) {}
+        }
+    }
+    return NULL;
+}
+
+static void* spsc_producer(void* arg) {
+    channel_thread_t* t = arg;
+    uint8_t msg[CHANNEL_PAYLOAD_SIZE] = {0};
+    pin_thread_to_core(t->core);
+    pthread_barrier_wait(t->barrier);
+    while (!*t->stop) {
+        if (spsc_send(t->to_consumer, msg)) t->messages++;
+    }
+    spsc_flush(t->to_consumer);
+    return NULL;
+}
+
+static void* mpsc_producer(void* arg) {
+    channel_thread_t* t = arg;
+    uint8_t msg[CHANNEL_PAYLOAD_SIZE] = {0};
+    mpsc_producer_t p;
+    mpsc_producer_init(&p, t->mpsc, t->config->batch);
+    pin_thread_to_core(t->core);
+    pthread_barrier_wait(t->barrier);
+    while (!*t->stop) {
+        if (mpsc_send(&p, msg)) t->messages++;
+    }
+    return NULL;
+}
+
+// Counts what arrives while the clock runs; that is the throughput
+static void* stream_consumer(void* arg) {
+    channel_thread_t* t = arg;
+    uint8_t msg[CHANNEL_PAYLOAD_SIZE];
+    pin_thread_to_core(t->core);
+    pthread_barrier_wait(t->barrier);
+    while (!*t->stop) {
+        bool got = t->mpsc ? mpsc_recv(t->mpsc, msg) : spsc_recv(t->to_consumer, msg);
+        if (got) t->messages++;
+    }
+    return NULL;
+}
+
+static int cores_of_socket(int socket, int* cores, int max) {
+    int n = 0;
+    for (int c = 0; c < get_nprocs() && n < max; c++) {
+        if (get_socket_for_core(c) == socket) cores[n++] = c;
+    }
+    return n;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static channel_result_t run_channel(const channel_config_t* config) {
+    int producer_cores[1024], consumer_cores[1024];
+    int np = cores_of_socket(config->producer_socket, producer_cores, 1024);
+    int nc = cores_of_socket(config->consumer_socket, consumer_cores, 1024);
+    if (np == 0 || nc == 0) {
+        fprintf(stderr, "No cores found on socket %d or %d\n", config->producer_socket, config->consumer_socket);
+        exit(1);
+    }
+    // The consumer takes the first core of its socket; producers avoid it when they can
+    int consumer_core = consumer_cores[0];
+    int first_producer = (config->producer_socket == config->consumer_socket && np > 1) ? 1 : 0;
+
+    // Home the rings by first touch from the chosen side's socket
+    pin_thread_to_core(config->home_on_producer ? producer_cores[first_producer] : consumer_core);
+    spsc_channel_t to_consumer, to_producer;
+    mpsc_channel_t mpsc;
+    int batch = config->test == TEST_PINGPONG ? 1 : config->batch;
+    if (config->test == TEST_MPSC) {
+        if (mpsc_init(&mpsc, config->capacity, config->nontemporal) != 0) exit(1);
+    } else if (spsc_init(&to_consumer, config->capacity, batch, config->nontemporal) != 0 ||
+               spsc_init(&to_producer, config->capacity, 1, false) != 0) {
+        exit(1);
+    }
+
+    int num_producers = config->test == TEST_MPSC ? config->num_producers : 1;
+    int num_threads = num_producers + 1;
+    channel_thread_t* threads = calloc(num_threads, sizeof(channel_thread_t));
+    pthread_t* handles = malloc(num_threads * sizeof(pthread_t));
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, num_threads + 1);
+    volatile bool stop = false;
+
+    for (int i = 0; i < num_threads; i++) {
+        channel_thread_t* t = &threads[i];
+        t->config = config;
+        t->to_consumer = &to_consumer;
+        t->to_producer = &to_producer;
+        t->mpsc = config->test == TEST_MPSC ? &mpsc : NULL;
+        t->barrier = &barrier;
+        t->stop = &stop;
+        void* (*fn)(void*);
+        if (i == 0) {
+            t->core = consumer_core;
+            fn = config->test == TEST_PINGPONG ? pingpong_consumer : stream_consumer;
+        } else {
+            int span = np - first_producer;
+            t->core = producer_cores[first_producer + (i - 1) % (span > 0 ? span : 1)];
+            if (config->test == TEST_PINGPONG) {
+                t->samples = malloc(MAX_LATENCY_SAMPLES * sizeof(double));
+                fn = pingpong_producer;
+            } else {
+                fn = config->test == TEST_SPSC ? spsc_producer : mpsc_producer;
+            }
+        }
+        pthread_create(&handles[i], NULL, fn, t);
+    }
+
+    pthread_barrier_wait(&barrier);
+    usleep(config->duration_ms * 1000);
+    stop = true;
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(handles[i], NULL);
+    }
+
+    channel_result_t result = {0};
+    long messages = config->test == TEST_PINGPONG ? threads[1].messages : threads[0].messages;
+    result.mmsgs = messages / (config->duration_ms * 1e3);
+    result.gbps = messages * (double)CHANNEL_PAYLOAD_SIZE / (config->duration_ms * 1e6);
+    if (config->test == TEST_PINGPONG) {
+        channel_thread_t* p = &threads[1];
+        if (p->num_samples > 0) {
+            qsort(p->samples, p->num_samples, sizeof(double), compare_doubles);
+            result.p50_ns = p->samples[p->num_samples / 2];
+            result.p99_ns = p->samples[(long)(p->num_samples * 0.99)];
+        }
+        free(p->samples);
+    }
+
+    if (config->test == TEST_MPSC) {
+        mpsc_destroy(&mpsc);
+    } else {
+        spsc_destroy(&to_consumer);
+        spsc_destroy(&to_producer);
+    }
+    pthread_barrier_destroy(&barrier);
+    free(handles);
+    free(threads);
+    return result;
+}
+
+static int parse_int_list(const char* s, int* out, int max) {
+    int n = 0;
+    char* copy = strdup(s);
+    for (char* tok = strtok(copy, ","); tok && n < max; tok = strtok(NULL, ",")) {
+        out[n++] = atoi(tok);
+    }
+    free(copy);
+    return n;
+}
+
+static void print_usage(const char* prog_name) {
+    printf("Usage: %s [options]\n", prog_name);
+    printf("Options:\n");
+    printf("  -b <batches>    Producer flush thresholds, comma separated (default: 1,8,32)\n");
+    printf("  -p <producers>  Producers for the MPSC test (default: 4)\n");
+    printf("  -c <slots>      Ring capacity in messages (default: 1024)\n");
+    printf("  -d <ms>         Run time per configuration in ms (default: 1000)\n");
+    printf("  -m <home>       Ring memory: consumer, producer (default: consumer)\n");
+    printf("  -n              Also run with non-temporal payload stores\n");
+    printf("  -o <file>       Also write results as csv\n");
+    printf("  -h              Show this help\n");
+}
+
+int main(int argc, char* argv[]) {
+    int batches[MAX_LIST];
+    int num_batches = parse_int_list("1,8,32", batches, MAX_LIST);
+    channel_config_t config = {
+        .num_producers = 4,
+        .capacity = 1024,
+        .duration_ms = 1000,
+        .home_on_producer = false
+    };
+    bool with_nontemporal = false;
+    const char* csv_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:p:c:d:m:no:h")) != -1) {
+        switch (opt) {
+            case 'b':
+                num_batches = parse_int_list(optarg, batches, MAX_LIST);
+                break;
+            case 'p':
+                config.num_producers = atoi(optarg);
+                break;
+            case 'c':
+                config.capacity = atol(optarg);
+                break;
+            case 'd':
+                config.duration_ms = atoi(optarg);
+                break;
+            case 'm':
+                if (strcmp(optarg, "consumer") == 0) {
+                    config.home_on_producer = false;
+                } else if (strcmp(optarg, "producer") == 0) {
+                    config.home_on_producer = true;
+                } else {
+                    fprintf(stderr, "Invalid ring home: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'n':
+                with_nontemporal = true;
+                break;
+            case 'o':
+                csv_path = optarg;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    for (int i = 0; i < num_batches; i++) {
+        if (batches[i] < 1 || batches[i] > CHANNEL_MAX_BATCH || (size_t)batches[i] > config.capacity) {
+            fprintf(stderr, "Batch %d must be between 1 and min(%d, capacity)\n", batches[i], CHANNEL_MAX_BATCH);
+            return 1;
+        }
+    }
+    if (config.num_producers < 1) {
+        fprintf(stderr, "Need at least one producer\n");
+        return 1;
+    }
+
+    FILE* csv = NULL;
+    if (csv_path) {
+        csv = fopen(csv_path, "w");
+        if (!csv) {
+            perror(csv_path);
+            return 1;
+        }
+        fprintf(csv, "test,stores,batch,producer_socket,consumer_socket,producers,mmsgs,gbps,latency_p50_ns,latency_p99_ns\n");
+    }
+
+    const char* test_names[] = {"pingpong", "spsc", "mpsc"};
+    int total_sockets = get_total_sockets();
+    printf("=== CHANNEL BENCHMARK ===\n");
+    printf("%-9s %-8s %5s %6s %6s %9s %9s %8s %10s %10s\n", "test", "stores", "batch", "from", "to", "producers",
+           "Mmsg/s", "GB/s", "p50 ns", "p99 ns");
+    for (int ps = 0; ps < total_sockets; ps++) {
+        for (int cs = 0; cs < total_sockets; cs++) {
+            config.producer_socket = ps;
+            config.consumer_socket = cs;
+            for (int test = TEST_PINGPONG; test <= TEST_MPSC; test++) {
+                config.test = test;
+                // Ping-pong measures one message at a time: no batching, no streaming stores
+                int runs_batches = test == TEST_PINGPONG ? 1 : num_batches;
+                int runs_nt = test == TEST_PINGPONG || !with_nontemporal ? 1 : 2;
+                for (int b = 0; b < runs_batches; b++) {
+                    for (int nt = 0; nt < runs_nt; nt++) {
+                        config.batch = test == TEST_PINGPONG ? 1 : batches[b];
+                        config.nontemporal = nt;
+                        channel_result_t r = run_channel(&config);
+                        int producers = test == TEST_MPSC ? config.num_producers : 1;
+                        const char* stores = nt ? "nt" : "regular";
+                        printf("%-9s %-8s %5d %6d %6d %9d %9.3f %8.3f %10.1f %10.1f\n", test_names[test], stores,
+                               config.batch, ps, cs, producers, r.mmsgs, r.gbps, r.p50_ns, r.p99_ns);
+                        if (csv) {
+                            fprintf(csv, "%s,%s,%d,%d,%d,%d,%.4f,%.4f,%.1f,%.1f\n", test_names[test], stores,
+                                    config.batch, ps, cs, producers, r.mmsgs, r.gbps, r.p50_ns, r.p99_ns);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (csv) fclose(csv);
+    return 0;
+}
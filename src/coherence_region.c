@@ -0,0 +1,115 @@
+#include "../include/coherence_region.h"
+#include <cpuid.h>
+#include <immintrin.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+enum { USE_CLFLUSH, USE_CLFLUSHOPT, USE_CLWB };
+
+static int flush_level = USE_CLFLUSH;
+static pthread_once_t detect_once = PTHREAD_ONCE_INIT;
+
+// CPUID leaf 7: EBX bit 23 is CLFLUSHOPT, bit 24 is CLWB
+static void detect_flush_level(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return;
+    if (ebx & (1u << 24)) flush_level = USE_CLWB;
+    else if (ebx & (1u << 23)) flush_level = USE_CLFLUSHOPT;
+}
+
+__attribute__((target("clflushopt")))
+static void invalidate_opt(uintptr_t line) {
+    _mm_clflushopt((void*)line);
+}
+
+__attribute__((target("clwb")))
+static void writeback_clwb(uintptr_t line) {
+    _mm_clwb((void*)line);
+}
+
+static void invalidate_line(uintptr_t line) {
+    if (flush_level >= USE_CLFLUSHOPT) invalidate_opt(line);
+    else _mm_clflush((void*)line);
+}
+
+static void writeback_line(uintptr_t line) {
+    if (flush_level == USE_CLWB) writeback_clwb(line);
+    else invalidate_line(line);
+}
+
+void sc_region_init(sc_region_t* region, void* base, size_t size) {
+    pthread_once(&detect_once, detect_flush_level);
+    uintptr_t start = (uintptr_t)base & ~(uintptr_t)(SC_LINE_SIZE - 1);
+    uintptr_t end = (uintptr_t)base + size;
+    region->base = start;
+    region->num_lines = (end - start + SC_LINE_SIZE - 1) / SC_LINE_SIZE;
+}
+
+int sc_context_init(sc_context_t* ctx, const sc_region_t* region) {
+    size_t words = (region->num_lines + 63) / 64;
+    ctx->region = region;
+    ctx->dirty = calloc(words ? words : 1, sizeof(uint64_t));
+    ctx->dirty_lo = words;
+    ctx->dirty_hi = 0;
+    ctx->lines_invalidated = 0;
+    ctx->lines_written_back = 0;
+    return ctx->dirty ? 0 : -1;
+}
+
+void sc_context_destroy(sc_context_t* ctx) {
+    free(ctx->dirty);
+    ctx->dirty = NULL;
+}
+
+void sc_acquire(sc_context_t* ctx, const void* addr, size_t len) {
+    if (len == 0) return;
+    uintptr_t line = (uintptr_t)addr & ~(uintptr_t)(SC_LINE_SIZE - 1);
+    for (; line < (uintptr_t)addr + len; line += SC_LINE_SIZE) {
+        invalidate_line(line);
+        ctx->lines_invalidated++;
+    }
+    // Later loads must not be satisfied from the lines before they are gone
+    _mm_mfence();
+}
+
+void sc_mark_dirty(sc_context_t* ctx, const void* addr, size_t len) {
+    if (len == 0) return;
+    const sc_region_t* region = ctx->region;
+    size_t first = ((uintptr_t)addr - region->base) / SC_LINE_SIZE;
+    size_t last = ((uintptr_t)addr + len - 1 - region->base) / SC_LINE_SIZE;
+    if ((uintptr_t)addr < region->base || first >= region->num_lines) return; // not ours
+    if (last >= region->num_lines) last = region->num_lines - 1;
+    for (size_t i = first; i <= last; i++) {
+        ctx->dirty[i / 64] |= 1UL << (i % 64);
+    }
+    if (first / 64 < ctx->dirty_lo) ctx->dirty_lo = first / 64;
+    if (last / 64 + 1 > ctx->dirty_hi) ctx->dirty_hi = last / 64 + 1;
+}
+
+void sc_release(sc_context_t* ctx) {
+    const sc_region_t* region = ctx->region;
+    size_t words = (region->num_lines + 63) / 64;
+    for (size_t w = ctx->dirty_lo; w < ctx->dirty_hi; w++) {
+        uint64_t bits = ctx->dirty[w];
+        ctx->dirty[w] = 0;
+        while (bits) {
+            size_t i = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            writeback_line(region->base + i * SC_LINE_SIZE);
+            ctx->lines_written_back++;
+        }
+    }
+    ctx->dirty_lo = words;
+    ctx->dirty_hi = 0;
+    // clwb/clflushopt are only ordered by a fence; the caller's unlock must come after
+    _mm_sfence();
+}
+
+const char* sc_writeback_instruction(void) {
+    pthread_once(&detect_once, detect_flush_level);
+    switch (flush_level) {
+        case USE_CLWB: return "clwb";
+        case USE_CLFLUSHOPT: return "clflushopt";
+        default: return "clflush";
+    }
+}
@@ -0,0 +1,234 @@
+#define _GNU_SOURCE
+#include "../include/dsm.h"
+#include "../include/shared_pool.h"
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+enum { PAGE_INVALID, PAGE_READ, PAGE_WRITE };
+
+// This process's side of the DSM. The view is what the workload touches; the backdoor maps
+// the same memory read-write so pages can be filled and diffed whatever the view allows.
+static struct {
+    dsm_home_t* home;
+    char* view;
+    char* backdoor;
+    char* twins;
+    size_t size;
+    volatile int* page_locks;
+    int* state;
+    unsigned long* fetched_version; // home version each local copy was fetched at
+    dsm_stats_t stats[DSM_PHASES];
+    struct sigaction previous;
+} dsm;
+
+static __thread int current_phase = DSM_PHASE_MAP;
+
+static void lock_page(size_t p) {
+    while (__sync_lock_test_and_set(&dsm.page_locks[p], 1)) {
+        while (dsm.page_locks[p]);
+    }
+}
+
+static void unlock_page(size_t p) {
+    __sync_lock_release(&dsm.page_locks[p]);
+}
+
+static void count(long* field, long n) {
+    __sync_fetch_and_add(field, n);
+}
+
+static void protect(size_t p, int prot) {
+    if (mprotect(dsm.view + p * DSM_PAGE_SIZE, DSM_PAGE_SIZE, prot) != 0) {
+        perror("mprotect");
+        abort();
+    }
+}
+
+// Copy the home copy in; the version is read first, so a diff that lands during the
+// copy makes the page look stale rather than current
+static void fetch_page(size_t p) {
+    dsm.fetched_version[p] = __atomic_load_n(&dsm.home->versions[p], __ATOMIC_ACQUIRE);
+    if (dsm.home->cxl) cxl_pool_charge(dsm.home->cxl, dsm.home->pages + p * DSM_PAGE_SIZE, DSM_PAGE_SIZE);
+    memcpy(dsm.backdoor + p * DSM_PAGE_SIZE, dsm.home->pages + p * DSM_PAGE_SIZE, DSM_PAGE_SIZE);
+    count(&dsm.stats[current_phase].bytes, DSM_PAGE_SIZE);
+}
+
+// Apply the words that differ from the twin to the home copy. Runs of changed words cost
+// an 8-byte header plus their contents.
+static void flush_page(size_t p) {
+    const uint64_t* now = (const uint64_t*)(dsm.backdoor + p * DSM_PAGE_SIZE);
+    const uint64_t* twin = (const uint64_t*)(dsm.twins + p * DSM_PAGE_SIZE);
+    uint64_t* home = (uint64_t*)(dsm.home->pages + p * DSM_PAGE_SIZE);
+    size_t words = DSM_PAGE_SIZE / sizeof(uint64_t);
+    long bytes = 0;
+    for (size_t i = 0; i < words;) {
+        if (now[i] == twin[i]) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while (i < words && now[i] != twin[i]) i++;
+        if (dsm.home->cxl) cxl_pool_charge(dsm.home->cxl, &home[start], (i - start) * sizeof(uint64_t));
+        memcpy(&home[start], &now[start], (i - start) * sizeof(uint64_t));
+        bytes += sizeof(uint64_t) + (i - start) * sizeof(uint64_t);
+    }
+    if (bytes == 0) return;
+    count(&dsm.stats[current_phase].diffs, 1);
+    count(&dsm.stats[current_phase].bytes, bytes);
+    unsigned long before = __atomic_fetch_add(&dsm.home->versions[p], 1, __ATOMIC_RELEASE);
+    // Our copy is still current if nobody else released the page since we fetched it
+    if (before == dsm.fetched_version[p]) dsm.fetched_version[p] = before + 1;
+}
+
+static void fault_handler(int sig, siginfo_t* info, void* context) {
+    char* addr = info->si_addr;
+    if (addr < dsm.view || addr >= dsm.view + dsm.size) {
+        // Not ours: fall back to whatever was installed before
+        sigaction(SIGSEGV, &dsm.previous, NULL);
+        return;
+    }
+    bool write = ((ucontext_t*)context)->uc_mcontext.gregs[REG_ERR] & 2;
+    size_t p = (addr - dsm.view) / DSM_PAGE_SIZE;
+    lock_page(p);
+    // Another thread of this node may have resolved it while we waited
+    if (dsm.state[p] == PAGE_WRITE || (dsm.state[p] == PAGE_READ && !write)) {
+        unlock_page(p);
+        return;
+    }
+    count(&dsm.stats[current_phase].faults, 1);
+    if (dsm.state[p] == PAGE_INVALID) {
+        fetch_page(p);
+        dsm.state[p] = PAGE_READ;
+    }
+    if (write) {
+        memcpy(dsm.twins + p * DSM_PAGE_SIZE, dsm.backdoor + p * DSM_PAGE_SIZE, DSM_PAGE_SIZE);
+        dsm.state[p] = PAGE_WRITE;
+    }
+    protect(p, write ? PROT_READ | PROT_WRITE : PROT_READ);
+    unlock_page(p);
+}
+
+int dsm_home_create(dsm_home_t* home, size_t size, int num_nodes, cxl_pool_t* cxl) {
+    home->num_pages = (size + DSM_PAGE_SIZE - 1) / DSM_PAGE_SIZE;
+    home->num_nodes = num_nodes;
+    home->cxl = cxl;
+    if (cxl) {
+        home->pages = cxl_alloc(cxl, home->num_pages * DSM_PAGE_SIZE);
+        home->versions = cxl_alloc(cxl, home->num_pages * sizeof(unsigned long));
+        if (!home->pages || !home->versions) {
+            fprintf(stderr, "dsm: CXL pool exhausted\n");
+            return -1;
+        }
+        memset(home->pages, 0, home->num_pages * DSM_PAGE_SIZE);
+        memset((void*)home->versions, 0, home->num_pages * sizeof(unsigned long));
+        return 0;
+    }
+    home->pages = shared_pool_map(home->num_pages * DSM_PAGE_SIZE, -1);
+    home->versions = shared_pool_map(home->num_pages * sizeof(unsigned long), -1);
+    if (!home->pages || !home->versions) return -1;
+    for (size_t p = 0; p < home->num_pages; p++) {
+        // Best effort: nodes without memory keep the page where it is
+        shared_pool_bind(home->pages + p * DSM_PAGE_SIZE, DSM_PAGE_SIZE, p % num_nodes);
+    }
+    return 0;
+}
+
+void dsm_home_destroy(dsm_home_t* home) {
+    if (home->cxl) {
+        cxl_free(home->cxl, home->pages, home->num_pages * DSM_PAGE_SIZE);
+        cxl_free(home->cxl, (void*)home->versions, home->num_pages * sizeof(unsigned long));
+        return;
+    }
+    shared_pool_unmap(home->pages, home->num_pages * DSM_PAGE_SIZE);
+    shared_pool_unmap((void*)home->versions, home->num_pages * sizeof(unsigned long));
+}
+
+void* dsm_attach(dsm_home_t* home) {
+    memset(&dsm, 0, sizeof(dsm));
+    dsm.home = home;
+    dsm.size = home->num_pages * DSM_PAGE_SIZE;
+    int fd = memfd_create("dsm-node", 0);
+    if (fd < 0 || ftruncate(fd, dsm.size) != 0) {
+        perror("dsm: memfd");
+        return NULL;
+    }
+    dsm.view = mmap(NULL, dsm.size, PROT_NONE, MAP_SHARED, fd, 0);
+    dsm.backdoor = mmap(NULL, dsm.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    dsm.twins = mmap(NULL, dsm.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (dsm.view == MAP_FAILED || dsm.backdoor == MAP_FAILED || dsm.twins == MAP_FAILED) {
+        perror("dsm: mmap");
+        return NULL;
+    }
+    dsm.page_locks = calloc(home->num_pages, sizeof(int));
+    dsm.state = calloc(home->num_pages, sizeof(int)); // all PAGE_INVALID
+    dsm.fetched_version = calloc(home->num_pages, sizeof(unsigned long));
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = fault_handler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGSEGV, &sa, &dsm.previous) != 0) {
+        perror("dsm: sigaction");
+        return NULL;
+    }
+    return dsm.view;
+}
+
+void dsm_detach(void) {
+    sigaction(SIGSEGV, &dsm.previous, NULL);
+    munmap(dsm.view, dsm.size);
+    munmap(dsm.backdoor, dsm.size);
+    munmap(dsm.twins, dsm.size);
+    free((void*)dsm.page_locks);
+    free(dsm.state);
+    free(dsm.fetched_version);
+}
+
+void dsm_release(void) {
+    for (size_t p = 0; p < dsm.home->num_pages; p++) {
+        if (dsm.state[p] != PAGE_WRITE) continue;
+        lock_page(p);
+        if (dsm.state[p] == PAGE_WRITE) {
+            // Stop this node's writers first, so no store lands after the diff
+            protect(p, PROT_READ);
+            flush_page(p);
+            dsm.state[p] = PAGE_READ;
+        }
+        unlock_page(p);
+    }
+}
+
+void dsm_acquire(void) {
+    for (size_t p = 0; p < dsm.home->num_pages; p++) {
+        if (dsm.state[p] == PAGE_INVALID ||
+            __atomic_load_n(&dsm.home->versions[p], __ATOMIC_ACQUIRE) == dsm.fetched_version[p]) {
+            continue;
+        }
+        lock_page(p);
+        if (dsm.state[p] != PAGE_INVALID) {
+            protect(p, PROT_NONE);
+            // Local writes must reach home before the copy holding them is dropped
+            if (dsm.state[p] == PAGE_WRITE) flush_page(p);
+            dsm.state[p] = PAGE_INVALID;
+            count(&dsm.stats[current_phase].invalidations, 1);
+        }
+        unlock_page(p);
+    }
+}
+
+void dsm_set_phase(dsm_phase_t phase) {
+    current_phase = phase;
+}
+
+void dsm_get_stats(dsm_stats_t stats[DSM_PHASES]) {
+    memcpy(stats, dsm.stats, sizeof(dsm.stats));
+}
@@ -1,12 +1,17 @@
+#define _GNU_SOURCE
 #include "../include/emulation.h"
 #include "../include/sync.h"
 #include "../include/workload.h"
 #include "../include/timer.h"
+#include "../include/shared_pool.h"
+#include "../include/dsm.h"
+#include "../include/cxl_pool.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/wait.h>
 
 // Experiment configuration
 typedef struct {
@@ -15,6 +20,10 @@ typedef struct {
     int increments_per_thread;
     int compute_cycles;
     bool verbose;
+    bool multi_process; // one process per node, sharing only a mapped pool
+    int pool_node;      // NUMA node holding the pool (-1: unbound)
+    bool dsm;           // multi-process mode with inter-node data in DSM pages
+    cxl_pool_t* cxl;    // multi-process pool carved from an emulated CXL pool instead
 } experiment_config_t;
 
 // Results structure
@@ -24,35 +33,49 @@ typedef struct {
     double reduce_phase_avg_ns;
     double total_avg_ns;
     const char* system_name;
+    int validation_trials;   // relaxed mode: trials whose final state was checked
+    int validation_failures; // ... and how many did not match the eager version
+    const char* validation_desc; // what was checked
+    bool dsm;
+    dsm_stats_t dsm_stats[DSM_PHASES]; // DSM traffic per phase, averaged over trials
 } experiment_results_t;
 
-// System configuration functions
+// Storage for an inter-node lock placed in the shared pool
+typedef union {
+    hw_lock_t hw;
+    bakery_lock_t bakery;
+} inter_lock_storage_t;
+
+// System configuration functions. The inter-node lock goes in inter_storage when given
+// (multi-process mode), otherwise it is allocated like the intra-node one.
 static void setup_system_locks(system_type_t system_type, int socket_id, 
                               generic_lock_t* intra_lock, generic_lock_t* inter_lock,
-                              void** intra_data, void** inter_data) {
+                              void** intra_data, void** inter_data, inter_lock_storage_t* inter_storage) {
+    void* inter = inter_storage;
     switch (system_type) {
         case SYSTEM_FULLY_COHERENT:
             // Both intra and inter use hardware locks
             *intra_data = malloc(sizeof(hw_lock_t));
-            *inter_data = malloc(sizeof(hw_lock_t));
+            *inter_data = inter ? NULL : malloc(sizeof(hw_lock_t));
             generic_lock_init_hw(intra_lock, (hw_lock_t*)*intra_data);
-            generic_lock_init_hw(inter_lock, (hw_lock_t*)*inter_data);
+            generic_lock_init_hw(inter_lock, (hw_lock_t*)(inter ? inter : *inter_data));
             break;
             
         case SYSTEM_FEDERATED_COHERENCE:
+        case SYSTEM_FEDERATED_RELAXED:
             // Intra-node uses hardware, inter-node uses software
             *intra_data = malloc(sizeof(hw_lock_t));
-            *inter_data = malloc(sizeof(bakery_lock_t));
+            *inter_data = inter ? NULL : malloc(sizeof(bakery_lock_t));
             generic_lock_init_hw(intra_lock, (hw_lock_t*)*intra_data);
-            generic_lock_init_bakery(inter_lock, (bakery_lock_t*)*inter_data);
+            generic_lock_init_bakery(inter_lock, (bakery_lock_t*)(inter ? inter : *inter_data));
             break;
             
         case SYSTEM_FULLY_NON_COHERENT:
             // Both use software locks
             *intra_data = malloc(sizeof(bakery_lock_t));
-            *inter_data = malloc(sizeof(bakery_lock_t));
+            *inter_data = inter ? NULL : malloc(sizeof(bakery_lock_t));
             generic_lock_init_bakery(intra_lock, (bakery_lock_t*)*intra_data);
-            generic_lock_init_bakery(inter_lock, (bakery_lock_t*)*inter_data);
+            generic_lock_init_bakery(inter_lock, (bakery_lock_t*)(inter ? inter : *inter_data));
             break;
     }
 }
@@ -62,10 +85,314 @@ static const char* get_system_name(system_type_t system_type) {
         case SYSTEM_FULLY_COHERENT: return "Fully Coherent";
         case SYSTEM_FEDERATED_COHERENCE: return "Federated Coherence";
         case SYSTEM_FULLY_NON_COHERENT: return "Fully Non-Coherent";
+        case SYSTEM_FEDERATED_RELAXED: return "Federated Relaxed";
         default: return "Unknown";
     }
 }
 
+// Per-thread phase times: map, shuffle, reduce, total (ns)
+static void record_thread_times(double times[4], thread_context_t* ctx) {
+    times[0] = timer_get_elapsed_ns(&ctx->phase_timers[2]);
+    times[1] = timer_get_elapsed_ns(&ctx->phase_timers[1]);
+    times[2] = timer_get_elapsed_ns(&ctx->phase_timers[0]);
+    times[3] = timer_get_elapsed_ns(&ctx->total_timer);
+}
+
+static void average_phase_times(experiment_results_t* results, double (*times)[4], int total_threads) {
+    double total_map = 0, total_shuffle = 0, total_reduce = 0, total_overall = 0;
+    for (int i = 0; i < total_threads; i++) {
+        total_map += times[i][0];
+        total_shuffle += times[i][1];
+        total_reduce += times[i][2];
+        total_overall += times[i][3];
+    }
+
+    results->map_phase_avg_ns = total_map / total_threads;
+    results->shuffle_phase_avg_ns = total_shuffle / total_threads;
+    results->reduce_phase_avg_ns = total_reduce / total_threads;
+    results->total_avg_ns = total_overall / total_threads;
+}
+
+// Relaxed mode validation: after an explicit sync every replica must equal the eager
+// version, i.e. the same updates applied directly to a single copy
+static void validate_relaxed(experiment_results_t* results, federated_objects_t* replicas,
+                             workload_config_t* workload_conf, bool verbose) {
+    int total_sockets = workload_conf->total_sockets;
+    federated_sync(replicas, total_sockets);
+    federated_objects_t* eager = malloc(sizeof(federated_objects_t));
+    federated_objects_init(eager);
+    replay_eager_updates(eager, workload_conf);
+    results->validation_trials = 1;
+    results->validation_desc = "merged replicas matched the eager version";
+    for (int i = 0; i < total_sockets; i++) {
+        if (!federated_objects_equal(&replicas[i], eager)) {
+            results->validation_failures = 1;
+        }
+    }
+    long expected = (long)total_sockets * workload_conf->num_threads_per_socket * workload_conf->increments_per_thread;
+    if (merge_counter_value(&replicas[0].counter) != expected) {
+        results->validation_failures = 1;
+    }
+    if (verbose || results->validation_failures) {
+        printf("Relaxed state %s the eager version: counter %ld (expected %ld), max %ld, min %ld, set size %d, map size %d\n",
+               results->validation_failures ? "DOES NOT MATCH" : "matches",
+               merge_counter_value(&replicas[0].counter), expected,
+               merge_register_value(&replicas[0].max_value), merge_register_value(&replicas[0].min_value),
+               merge_set_size(&replicas[0].members), merge_map_size(&replicas[0].table));
+    }
+    free(eager);
+}
+
+// Non-coherent mode validation: no write-back of a socket's counter was lost
+static void validate_counters(experiment_results_t* results, const int* counters, workload_config_t* workload_conf,
+                              long lines_invalidated, long lines_written_back, bool verbose) {
+    int expected = workload_conf->num_threads_per_socket * workload_conf->increments_per_thread;
+    results->validation_trials = 1;
+    results->validation_desc = "software-coherent counters were complete";
+    for (int i = 0; i < workload_conf->total_sockets; i++) {
+        if (counters[i] != expected) {
+            results->validation_failures = 1;
+        }
+    }
+    if (verbose || results->validation_failures) {
+        printf("Software coherence (%s): %ld lines invalidated, %ld written back; socket 0 counter %d (expected %d)\n",
+               sc_writeback_instruction(), lines_invalidated, lines_written_back, counters[0], expected);
+    }
+}
+
+// Multi-process mode: the only memory emulated nodes share, mapped before the fork
+typedef struct {
+    volatile int barrier_count;
+    volatile int ready; // node processes set up and waiting to start
+    inter_lock_storage_t inter_locks[EXCHANGE_MAX_NODES];
+    long node_output[EXCHANGE_MAX_NODES];
+    federated_objects_t replicas[EXCHANGE_MAX_NODES]; // relaxed mode
+    // Results, written by each node process after its threads have joined
+    double times[MAX_THREADS][4];
+    int counters[EXCHANGE_MAX_NODES];
+    volatile long lines_invalidated;
+    volatile long lines_written_back;
+    dsm_stats_t dsm_stats[DSM_PHASES];
+} process_pool_t;
+
+// With DSM, the inter-node data is in shared pages instead: every node's shared_data_t
+// entry, the exchanged map outputs and the relaxed-mode replicas. Locks and the barrier
+// stay in the pool, standing in for the messages a DSM would synchronize with.
+typedef struct {
+    shared_data_t shared[EXCHANGE_MAX_NODES];
+    long node_output[EXCHANGE_MAX_NODES];
+    federated_objects_t replicas[EXCHANGE_MAX_NODES];
+} dsm_data_t;
+
+// Body of the process emulating node `node`: its threads run on that socket's cores, with
+// all intra-node state in private memory and everything inter-node in the pool (or in
+// DSM pages when `home` is given)
+static int run_node_process(experiment_config_t* config, workload_config_t* workload_conf,
+                            process_pool_t* pool, dsm_home_t* home, int node) {
+    int total_sockets = workload_conf->total_sockets;
+    int threads_per_node = config->num_threads_per_socket;
+
+    int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int node_cores[num_cores];
+    int num_node_cores = 0;
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (int c = 0; c < num_cores; c++) {
+        if (get_socket_for_core(c) == node) {
+            node_cores[num_node_cores++] = c;
+            CPU_SET(c, &cpuset);
+        }
+    }
+    if (num_node_cores == 0 || sched_setaffinity(0, sizeof(cpuset), &cpuset) != 0) {
+        fprintf(stderr, "Node %d: cannot run on its socket's cores\n", node);
+        return 1;
+    }
+
+    // Only this node's entry is used; the array keeps the workload's per-socket indexing
+    shared_data_t* shared_data = malloc(total_sockets * sizeof(shared_data_t));
+    generic_lock_t* intra_locks = malloc(total_sockets * sizeof(generic_lock_t));
+    generic_lock_t* inter_locks = malloc(total_sockets * sizeof(generic_lock_t));
+    void* intra_lock_data = NULL;
+    void* inter_lock_data = NULL;
+    setup_system_locks(config->system_type, node, &intra_locks[node], &inter_locks[node],
+                       &intra_lock_data, &inter_lock_data, &pool->inter_locks[node]);
+    init_shared_data(shared_data, workload_conf, intra_locks, inter_locks);
+    node_exchange_t exchange = { .barrier_count = &pool->barrier_count, .node_output = pool->node_output };
+    federated_objects_t* replicas = pool->replicas;
+    shared_data_t* private_data = shared_data;
+    if (home) {
+        dsm_data_t* data = dsm_attach(home);
+        if (!data) {
+            return 1;
+        }
+        // Write only our own entry: the pointers in it mean nothing to other nodes
+        data->shared[node] = shared_data[node];
+        shared_data = data->shared;
+        exchange.node_output = data->node_output;
+        replicas = data->replicas;
+    }
+    shared_data[node].exchange = &exchange;
+    if (config->system_type == SYSTEM_FEDERATED_RELAXED) {
+        shared_data[node].replica = &replicas[node];
+        shared_data[node].replicas = replicas;
+    }
+    bool non_coherent = config->system_type == SYSTEM_FULLY_NON_COHERENT;
+    sc_region_t region;
+    if (non_coherent) {
+        sc_region_init(&region, &shared_data[node], sizeof(shared_data_t));
+        shared_data[node].region = &region;
+    }
+
+    pthread_t threads[threads_per_node];
+    thread_context_t contexts[threads_per_node];
+    pthread_barrier_t start_barrier;
+    pthread_barrier_init(&start_barrier, NULL, threads_per_node + 1);
+    for (int k = 0; k < threads_per_node; k++) {
+        contexts[k] = (thread_context_t){
+            .thread_id = node * threads_per_node + k,
+            .socket_id = node,
+            .core_id = node_cores[k % num_node_cores],
+            .config = workload_conf,
+            .shared = shared_data,
+            .start_barrier = &start_barrier
+        };
+        pthread_create(&threads[k], NULL, workload_thread, &contexts[k]);
+    }
+
+    // Start once every node is ready
+    __sync_fetch_and_add(&pool->ready, 1);
+    while (pool->ready < total_sockets) { usleep(1); }
+    pthread_barrier_wait(&start_barrier);
+
+    for (int k = 0; k < threads_per_node; k++) {
+        pthread_join(threads[k], NULL);
+        record_thread_times(pool->times[contexts[k].thread_id], &contexts[k]);
+        if (non_coherent) {
+            __sync_fetch_and_add(&pool->lines_invalidated, contexts[k].coherence.lines_invalidated);
+            __sync_fetch_and_add(&pool->lines_written_back, contexts[k].coherence.lines_written_back);
+        }
+    }
+    if (non_coherent) {
+        sc_context_t reader;
+        sc_context_init(&reader, &region);
+        sc_acquire(&reader, &shared_data[node], sizeof(shared_data_t));
+        sc_context_destroy(&reader);
+    }
+    pool->counters[node] = shared_data[node].counter;
+    if (home) {
+        // Publish the reduce results, as the end of the run is a release like any other
+        dsm_set_phase(DSM_PHASE_REDUCE);
+        dsm_release();
+        dsm_stats_t stats[DSM_PHASES];
+        dsm_get_stats(stats);
+        for (int phase = 0; phase < DSM_PHASES; phase++) {
+            __sync_fetch_and_add(&pool->dsm_stats[phase].faults, stats[phase].faults);
+            __sync_fetch_and_add(&pool->dsm_stats[phase].invalidations, stats[phase].invalidations);
+            __sync_fetch_and_add(&pool->dsm_stats[phase].diffs, stats[phase].diffs);
+            __sync_fetch_and_add(&pool->dsm_stats[phase].bytes, stats[phase].bytes);
+        }
+        dsm_detach();
+    }
+
+    pthread_barrier_destroy(&start_barrier);
+    free(intra_lock_data);
+    free(inter_lock_data);
+    free(private_data);
+    free(intra_locks);
+    free(inter_locks);
+    return 0;
+}
+
+static experiment_results_t run_experiment_processes(experiment_config_t* config, experiment_results_t results,
+                                                     int total_sockets) {
+    int total_threads = total_sockets * config->num_threads_per_socket;
+    if (total_sockets > EXCHANGE_MAX_NODES || total_threads > MAX_THREADS) {
+        fprintf(stderr, "Multi-process mode supports at most %d nodes and %d threads\n", EXCHANGE_MAX_NODES, MAX_THREADS);
+        exit(1);
+    }
+    process_pool_t* pool = config->cxl ? cxl_alloc(config->cxl, sizeof(process_pool_t))
+                                       : shared_pool_map(sizeof(process_pool_t), config->pool_node);
+    if (!pool) {
+        exit(1);
+    }
+    if (config->cxl) {
+        memset(pool, 0, sizeof(process_pool_t));
+    }
+    workload_config_t workload_conf = {
+        .num_threads_per_socket = config->num_threads_per_socket,
+        .increments_per_thread = config->increments_per_thread,
+        .compute_cycles = config->compute_cycles,
+        .system_type = config->system_type,
+        .total_sockets = total_sockets
+    };
+    federated_objects_t* replicas = pool->replicas;
+    dsm_home_t home;
+    dsm_data_t* home_data = NULL;
+    if (config->dsm) {
+        if (dsm_home_create(&home, sizeof(dsm_data_t), total_sockets, config->cxl) != 0) {
+            exit(1);
+        }
+        home_data = (dsm_data_t*)home.pages;
+        replicas = home_data->replicas;
+        workload_conf.dsm = true;
+    }
+    for (int i = 0; i < total_sockets; i++) {
+        federated_objects_init(&replicas[i]);
+    }
+
+    fflush(stdout); // or the children print our buffered output again
+    pid_t pids[total_sockets];
+    for (int node = 0; node < total_sockets; node++) {
+        pids[node] = fork();
+        if (pids[node] < 0) {
+            perror("fork");
+            exit(1);
+        }
+        if (pids[node] == 0) {
+            _exit(run_node_process(config, &workload_conf, pool, config->dsm ? &home : NULL, node));
+        }
+    }
+    bool failed = false;
+    for (int node = 0; node < total_sockets; node++) {
+        int status;
+        waitpid(pids[node], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Node process %d failed\n", node);
+            failed = true;
+        }
+    }
+    if (failed) {
+        exit(1);
+    }
+
+    average_phase_times(&results, pool->times, total_threads);
+    if (config->system_type == SYSTEM_FEDERATED_RELAXED) {
+        validate_relaxed(&results, replicas, &workload_conf, config->verbose);
+    } else if (config->dsm) {
+        // Check what reached the home copies, i.e. what any node would fetch next
+        for (int i = 0; i < total_sockets; i++) {
+            pool->counters[i] = home_data->shared[i].counter;
+        }
+        validate_counters(&results, pool->counters, &workload_conf, pool->lines_invalidated,
+                          pool->lines_written_back, config->verbose);
+    } else if (config->system_type == SYSTEM_FULLY_NON_COHERENT) {
+        validate_counters(&results, pool->counters, &workload_conf, pool->lines_invalidated,
+                          pool->lines_written_back, config->verbose);
+    }
+    if (config->dsm) {
+        results.dsm = true;
+        memcpy(results.dsm_stats, pool->dsm_stats, sizeof(results.dsm_stats));
+        dsm_home_destroy(&home);
+    }
+
+    if (config->cxl) {
+        cxl_free(config->cxl, pool, sizeof(process_pool_t));
+    } else {
+        shared_pool_unmap(pool, sizeof(process_pool_t));
+    }
+    return results;
+}
+
 // Run experiment for a specific system type
 static experiment_results_t run_experiment(experiment_config_t* config) {
     experiment_results_t results = {0};
@@ -84,6 +411,17 @@ static experiment_results_t run_experiment(experiment_config_t* config) {
         printf("\n--- Running Experiment: %s ---\n", results.system_name);
         printf("Configuration: %d threads (%d per socket across %d sockets)\n", 
                total_threads, config->num_threads_per_socket, total_sockets);
+        if (config->multi_process && config->cxl) {
+            printf("One process per node; shared pool in emulated CXL memory on node %d%s\n", config->cxl->node,
+                   config->dsm ? "; inter-node data in page-based DSM" : "");
+        } else if (config->multi_process) {
+            printf("One process per node; shared pool on node %d%s\n", config->pool_node,
+                   config->dsm ? "; inter-node data in page-based DSM" : "");
+        }
+    }
+
+    if (config->multi_process) {
+        return run_experiment_processes(config, results, total_sockets);
     }
 
     // Allocate resources
@@ -109,10 +447,36 @@ static experiment_results_t run_experiment(experiment_config_t* config) {
 
     // Setup locks for each socket based on the system type
     for (int i = 0; i < total_sockets; i++) {
-        setup_system_locks(config->system_type, i, &intra_locks[i], &inter_locks[i], &intra_lock_data[i], &inter_lock_data[i]);
+        setup_system_locks(config->system_type, i, &intra_locks[i], &inter_locks[i], &intra_lock_data[i], &inter_lock_data[i], NULL);
     }
     init_shared_data(shared_data, &workload_conf, intra_locks, inter_locks);
 
+    // Relaxed mode: one replica of the mergeable objects per socket
+    bool relaxed = config->system_type == SYSTEM_FEDERATED_RELAXED;
+    federated_objects_t* replicas = NULL;
+    if (relaxed) {
+        if (total_sockets > MERGE_MAX_REPLICAS) {
+            fprintf(stderr, "Relaxed mode supports at most %d sockets\n", MERGE_MAX_REPLICAS);
+            exit(1);
+        }
+        replicas = malloc(total_sockets * sizeof(federated_objects_t));
+        for (int i = 0; i < total_sockets; i++) {
+            federated_objects_init(&replicas[i]);
+            shared_data[i].replica = &replicas[i];
+            shared_data[i].replicas = replicas;
+        }
+    }
+
+    // Non-coherent mode: the shared data is a software-coherent region
+    bool non_coherent = config->system_type == SYSTEM_FULLY_NON_COHERENT;
+    sc_region_t region;
+    if (non_coherent) {
+        sc_region_init(&region, shared_data, total_sockets * sizeof(shared_data_t));
+        for (int i = 0; i < total_sockets; i++) {
+            shared_data[i].region = &region;
+        }
+    }
+
     // Create and configure threads
     for (int i = 0; i < total_threads; i++) {
         int socket_id = i / config->num_threads_per_socket;
@@ -137,18 +501,35 @@ static experiment_results_t run_experiment(experiment_config_t* config) {
     }
 
     // Aggregate results
-    double total_map = 0, total_shuffle = 0, total_reduce = 0, total_overall = 0;
+    double (*times)[4] = malloc(total_threads * sizeof(*times));
     for (int i = 0; i < total_threads; i++) {
-        total_map += timer_get_elapsed_ns(&contexts[i].phase_timers[2]);
-        total_shuffle += timer_get_elapsed_ns(&contexts[i].phase_timers[1]);
-        total_reduce += timer_get_elapsed_ns(&contexts[i].phase_timers[0]);
-        total_overall += timer_get_elapsed_ns(&contexts[i].total_timer);
+        record_thread_times(times[i], &contexts[i]);
     }
+    average_phase_times(&results, times, total_threads);
+    free(times);
 
-    results.map_phase_avg_ns = total_map / total_threads;
-    results.shuffle_phase_avg_ns = total_shuffle / total_threads;
-    results.reduce_phase_avg_ns = total_reduce / total_threads;
-    results.total_avg_ns = total_overall / total_threads;
+    if (relaxed) {
+        validate_relaxed(&results, replicas, &workload_conf, config->verbose);
+        free(replicas);
+    }
+
+    // Non-coherent mode: fetch the counters the way any other reader would
+    if (non_coherent) {
+        sc_context_t reader;
+        long lines_invalidated = 0, lines_written_back = 0;
+        for (int i = 0; i < total_threads; i++) {
+            lines_invalidated += contexts[i].coherence.lines_invalidated;
+            lines_written_back += contexts[i].coherence.lines_written_back;
+        }
+        sc_context_init(&reader, &region);
+        sc_acquire(&reader, shared_data, total_sockets * sizeof(shared_data_t));
+        sc_context_destroy(&reader);
+        int counters[total_sockets];
+        for (int i = 0; i < total_sockets; i++) {
+            counters[i] = shared_data[i].counter;
+        }
+        validate_counters(&results, counters, &workload_conf, lines_invalidated, lines_written_back, config->verbose);
+    }
 
     // Cleanup
     for (int i = 0; i < total_sockets; i++) {
@@ -167,6 +548,37 @@ static experiment_results_t run_experiment(experiment_config_t* config) {
     return results;
 }
 
+// Accumulate one trial into a system's totals, then average them
+static void add_trial(experiment_results_t* total, const experiment_results_t* trial) {
+    total->map_phase_avg_ns += trial->map_phase_avg_ns;
+    total->shuffle_phase_avg_ns += trial->shuffle_phase_avg_ns;
+    total->reduce_phase_avg_ns += trial->reduce_phase_avg_ns;
+    total->total_avg_ns += trial->total_avg_ns;
+    total->validation_trials += trial->validation_trials;
+    total->validation_failures += trial->validation_failures;
+    total->validation_desc = trial->validation_desc;
+    total->dsm = trial->dsm;
+    for (int phase = 0; phase < DSM_PHASES; phase++) {
+        total->dsm_stats[phase].faults += trial->dsm_stats[phase].faults;
+        total->dsm_stats[phase].invalidations += trial->dsm_stats[phase].invalidations;
+        total->dsm_stats[phase].diffs += trial->dsm_stats[phase].diffs;
+        total->dsm_stats[phase].bytes += trial->dsm_stats[phase].bytes;
+    }
+}
+
+static void average_trials(experiment_results_t* total, int num_trials) {
+    total->map_phase_avg_ns /= num_trials;
+    total->shuffle_phase_avg_ns /= num_trials;
+    total->reduce_phase_avg_ns /= num_trials;
+    total->total_avg_ns /= num_trials;
+    for (int phase = 0; phase < DSM_PHASES; phase++) {
+        total->dsm_stats[phase].faults /= num_trials;
+        total->dsm_stats[phase].invalidations /= num_trials;
+        total->dsm_stats[phase].diffs /= num_trials;
+        total->dsm_stats[phase].bytes /= num_trials;
+    }
+}
+
 // Print results
 static void print_results(experiment_results_t* results, int num_systems) {
     printf("\n--- Experiment Results ---\n");
@@ -181,17 +593,42 @@ static void print_results(experiment_results_t* results, int num_systems) {
                results[i].reduce_phase_avg_ns / 1e6, 
                results[i].total_avg_ns / 1e6);
     }
+
+    for (int i = 0; i < num_systems; i++) {
+        if (!results[i].dsm) continue;
+        static const char* phase_names[DSM_PHASES] = {"Map", "Shuffle", "Reduce"};
+        printf("\n%s DSM traffic per run:\n", results[i].system_name);
+        printf("%-10s %12s %15s %12s %15s\n", "Phase", "Faults", "Invalidations", "Diffs", "Bytes");
+        for (int phase = 0; phase < DSM_PHASES; phase++) {
+            dsm_stats_t* st = &results[i].dsm_stats[phase];
+            printf("%-10s %12ld %15ld %12ld %15ld\n", phase_names[phase], st->faults, st->invalidations, st->diffs, st->bytes);
+        }
+    }
+
+    for (int i = 0; i < num_systems; i++) {
+        if (results[i].validation_trials > 0) {
+            printf("\n%s: %s in %d of %d trial(s)\n",
+                   results[i].system_name, results[i].validation_desc,
+                   results[i].validation_trials - results[i].validation_failures,
+                   results[i].validation_trials);
+        }
+    }
 }
 
 // Usage function
 static void print_usage(const char* prog_name) {
     printf("Usage: %s [options]\n", prog_name);
     printf("Options:\n");
-    printf("  -s <system>     System type: coherent, federated, non-coherent, all (default: all)\n");
+    printf("  -s <system>     System type: coherent, federated, non-coherent, relaxed, all (default: all)\n");
     printf("  -t <threads>    Threads per socket (default: 4)\n");
     printf("  -i <increments> Increments per thread (default: 1000)\n");
     printf("  -c <cycles>     Compute cycles (default: 100000)\n");
     printf("  -n <trials>     Number of trials to run and average (default: 5)\n");
+    printf("  -p              Run each node as a separate process sharing only a memory pool\n");
+    printf("  -m <node>       NUMA node for the multi-process pool, -1 for none (default: 0)\n");
+    printf("  -D              Keep inter-node data in page-based software DSM (implies -p)\n");
+    printf("  -x <ns>[:<GB/s>] Put the pool in emulated CXL memory on the farthest node, with this\n");
+    printf("                  load latency and bandwidth cap for DSM traffic (default cap: 24; implies -p)\n");
     printf("  -v              Verbose output\n");
     printf("  -h              Show this help\n");
 }
@@ -202,15 +639,21 @@ int main(int argc, char* argv[]) {
         .num_threads_per_socket = 4,
         .increments_per_thread = 1000,
         .compute_cycles = 100000,
-        .verbose = false
+        .verbose = false,
+        .multi_process = false,
+        .pool_node = 0,
+        .dsm = false,
+        .cxl = NULL
     };
+    cxl_pool_config_t cxl_config = { .size = 256UL << 20, .node = -1, .bandwidth_gbps = 24 };
+    bool emulate_cxl = false;
     
     bool run_all = true;
     int num_trials = 5; // Default number of trials
     
     // Parse command line arguments
     int opt;
-    while ((opt = getopt(argc, argv, "s:t:i:c:n:vh")) != -1) {
+    while ((opt = getopt(argc, argv, "s:t:i:c:n:pm:Dx:vh")) != -1) {
         switch (opt) {
             case 's':
                 run_all = false;
@@ -220,6 +663,8 @@ int main(int argc, char* argv[]) {
                     config.system_type = SYSTEM_FEDERATED_COHERENCE;
                 } else if (strcmp(optarg, "non-coherent") == 0) {
                     config.system_type = SYSTEM_FULLY_NON_COHERENT;
+                } else if (strcmp(optarg, "relaxed") == 0) {
+                    config.system_type = SYSTEM_FEDERATED_RELAXED;
                 } else if (strcmp(optarg, "all") == 0) {
                     run_all = true;
                 } else {
@@ -240,6 +685,24 @@ int main(int argc, char* argv[]) {
             case 'n':
                 num_trials = atoi(optarg);
                 break;
+            case 'p':
+                config.multi_process = true;
+                break;
+            case 'm':
+                config.pool_node = atoi(optarg);
+                break;
+            case 'D':
+                config.dsm = true;
+                config.multi_process = true; // DSM is between node processes
+                break;
+            case 'x':
+                emulate_cxl = true;
+                config.multi_process = true;
+                if (sscanf(optarg, "%lf:%lf", &cxl_config.latency_ns, &cxl_config.bandwidth_gbps) < 1) {
+                    fprintf(stderr, "Invalid CXL latency: %s\n", optarg);
+                    return 1;
+                }
+                break;
             case 'v':
                 config.verbose = true;
                 break;
@@ -254,51 +717,53 @@ int main(int argc, char* argv[]) {
     
     printf("=== FEDERATED COHERENCE EXPERIMENT ===\n");
     printf("Running %d trial(s) for each system...\n", num_trials);
+    if (emulate_cxl) {
+        // Created once: calibration takes a while and the pool outlives every trial
+        config.cxl = cxl_pool_create(&cxl_config);
+        if (!config.cxl) {
+            return 1;
+        }
+        printf("Emulated CXL pool on node %d: %.0f ns native + %.0f ns injected, %.0f GB/s cap\n",
+               config.cxl->node, config.cxl->native_ns, cxl_pool_injected_ns(config.cxl), cxl_config.bandwidth_gbps);
+    }
     
     if (run_all) {
-        experiment_results_t final_results[3];
-        system_type_t systems[] = {SYSTEM_FULLY_COHERENT, SYSTEM_FEDERATED_COHERENCE, SYSTEM_FULLY_NON_COHERENT};
+        system_type_t systems[] = {SYSTEM_FULLY_COHERENT, SYSTEM_FEDERATED_COHERENCE, SYSTEM_FULLY_NON_COHERENT,
+                                   SYSTEM_FEDERATED_RELAXED};
+        const int num_systems = sizeof(systems) / sizeof(systems[0]);
+        experiment_results_t final_results[num_systems];
         
-        for (int i = 0; i < 3; i++) {
+        for (int i = 0; i < num_systems; i++) {
             // Initialize aggregated results for this system
             final_results[i] = (experiment_results_t){ .system_name = get_system_name(systems[i]) };
 
             for (int trial = 0; trial < num_trials; trial++) {
                 config.system_type = systems[i];
                 experiment_results_t trial_result = run_experiment(&config);
-                final_results[i].map_phase_avg_ns += trial_result.map_phase_avg_ns;
-                final_results[i].shuffle_phase_avg_ns += trial_result.shuffle_phase_avg_ns;
-                final_results[i].reduce_phase_avg_ns += trial_result.reduce_phase_avg_ns;
-                final_results[i].total_avg_ns += trial_result.total_avg_ns;
+                add_trial(&final_results[i], &trial_result);
             }
 
             // Average the results
-            final_results[i].map_phase_avg_ns /= num_trials;
-            final_results[i].shuffle_phase_avg_ns /= num_trials;
-            final_results[i].reduce_phase_avg_ns /= num_trials;
-            final_results[i].total_avg_ns /= num_trials;
+            average_trials(&final_results[i], num_trials);
         }
         
-        print_results(final_results, 3);
+        print_results(final_results, num_systems);
     } else {
         experiment_results_t final_result = { .system_name = get_system_name(config.system_type) };
 
         for (int trial = 0; trial < num_trials; trial++) {
             experiment_results_t trial_result = run_experiment(&config);
-            final_result.map_phase_avg_ns += trial_result.map_phase_avg_ns;
-            final_result.shuffle_phase_avg_ns += trial_result.shuffle_phase_avg_ns;
-            final_result.reduce_phase_avg_ns += trial_result.reduce_phase_avg_ns;
-            final_result.total_avg_ns += trial_result.total_avg_ns;
+            add_trial(&final_result, &trial_result);
         }
 
         // Average the results
-        final_result.map_phase_avg_ns /= num_trials;
-        final_result.shuffle_phase_avg_ns /= num_trials;
-        final_result.reduce_phase_avg_ns /= num_trials;
-        final_result.total_avg_ns /= num_trials;
+        average_trials(&final_result, num_trials);
 
         print_results(&final_result, 1);
     }
-    
+
+    if (config.cxl) {
+        cxl_pool_destroy(config.cxl);
+    }
     return 0;
 }
@@ -2,10 +2,33 @@
 #include "../include/sync.h"
 #include "../include/workload.h"
 #include "../include/timer.h"
+#include "../include/mergeable.h"
+#include "../include/node_replication.h"
+#include "../include/channel.h"
+#include "../include/coherence_region.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
+#define NR_SMALL_LOG 16
+#define NR_SMALL_LOG_OPS 4000
+
+// One thread per replica, each writing its own keys through a log far smaller than the op count
+typedef struct {
+    node_replicated_t* nr;
+    int replica;
+} nr_writer_t;
+
+static void* nr_writer(void* arg) {
+    nr_writer_t* w = arg;
+    int slot = nr_register(w->nr, w->replica);
+    for (long i = 0; i < NR_SMALL_LOG_OPS; i++) {
+        nr_execute_update(w->nr, w->replica, slot, NR_MAP_PUT, i * 2 + w->replica, i);
+    }
+    return NULL;
+}
+
 // Simple test to verify the basic functionality
 int main() {
     printf("=== FEDERATED COHERENCE - BASIC TEST ===\n");
@@ -56,6 +79,168 @@ int main() {
     double elapsed = timer_get_elapsed_ns(&t);
     printf("✓ Timer test passed (measured: %.3f ms)\n", elapsed / 1e6);
     
+    // Test 5: Mergeable objects converge regardless of merge order
+    printf("Testing mergeable objects...\n");
+    federated_objects_t* replicas = malloc(2 * sizeof(federated_objects_t));
+    federated_objects_init(&replicas[0]);
+    federated_objects_init(&replicas[1]);
+    merge_counter_add(&replicas[0].counter, 0, 5);
+    merge_counter_add(&replicas[1].counter, 1, 7);
+    merge_register_update(&replicas[0].max_value, 42);
+    merge_register_update(&replicas[1].max_value, 17);
+    merge_register_update(&replicas[1].min_value, -3);
+    merge_set_add(&replicas[0].members, 10);
+    merge_set_add(&replicas[1].members, 20);
+    merge_set_remove(&replicas[1].members, 10);
+    merge_map_put_max(&replicas[0].table, 1, 100);
+    merge_map_put_max(&replicas[1].table, 1, 200);
+    merge_map_put_max(&replicas[1].table, 2, 5);
+    federated_objects_merge(&replicas[0], &replicas[1]);
+    federated_objects_merge(&replicas[1], &replicas[0]);
+    federated_objects_merge(&replicas[1], &replicas[0]); // merging twice changes nothing
+    long v = 0;
+    if (!federated_objects_equal(&replicas[0], &replicas[1]) ||
+        merge_counter_value(&replicas[0].counter) != 12 ||
+        merge_register_value(&replicas[0].max_value) != 42 ||
+        merge_register_value(&replicas[0].min_value) != -3 ||
+        merge_set_contains(&replicas[0].members, 10) || !merge_set_contains(&replicas[0].members, 20) ||
+        !merge_map_get(&replicas[0].table, 1, &v) || v != 200) {
+        printf("✗ Mergeable objects did not converge\n");
+        return 1;
+    }
+    free(replicas);
+    printf("✓ Mergeable objects test passed\n");
+    
+    // Test 6: Node replication keeps replicas in step through the shared log
+    printf("Testing node replication...\n");
+    node_replicated_t* nr = malloc(sizeof(node_replicated_t));
+    nr_init(nr, &nr_hashmap, 2, 0);
+    nr_init_replica(nr, 0);
+    nr_init_replica(nr, 1);
+    int slot0 = nr_register(nr, 0);
+    int slot1 = nr_register(nr, 1);
+    nr_execute_update(nr, 0, slot0, NR_MAP_PUT, 7, 70);
+    nr_execute_update(nr, 1, slot1, NR_MAP_PUT, 8, 80);
+    long old = nr_execute_update(nr, 0, slot0, NR_MAP_REMOVE, 8, 0);
+    if (old != 80 || nr_execute_read(nr, 1, NR_MAP_GET, 7, 0) != 70 ||
+        nr_execute_read(nr, 1, NR_MAP_GET, 8, 0) != -1) {
+        printf("✗ Node-replicated hash map diverged\n");
+        return 1;
+    }
+    nr_destroy(nr);
+    nr_init(nr, &nr_pqueue, 2, 0);
+    nr_init_replica(nr, 0);
+    nr_init_replica(nr, 1);
+    slot0 = nr_register(nr, 0);
+    slot1 = nr_register(nr, 1);
+    nr_execute_update(nr, 0, slot0, NR_PQ_PUSH, 5, 0);
+    nr_execute_update(nr, 1, slot1, NR_PQ_PUSH, 3, 0);
+    nr_execute_update(nr, 0, slot0, NR_PQ_PUSH, 9, 0);
+    if (nr_execute_update(nr, 0, slot0, NR_PQ_POP, 0, 0) != 3 ||
+        nr_execute_read(nr, 1, NR_PQ_PEEK, 0, 0) != 5 || nr_execute_read(nr, 1, NR_PQ_SIZE, 0, 0) != 2) {
+        printf("✗ Node-replicated priority queue diverged\n");
+        return 1;
+    }
+    nr_destroy(nr);
+    // A small log wraps many times: a replica that falls a whole log behind while its own
+    // combiner waits for space must still be replayed
+    nr_init(nr, &nr_hashmap, 2, NR_SMALL_LOG);
+    nr_init_replica(nr, 0);
+    nr_init_replica(nr, 1);
+    slot0 = nr_register(nr, 0);
+    slot1 = nr_register(nr, 1);
+    for (int i = 0; i < 3 * NR_SMALL_LOG; i++) {
+        nr_execute_update(nr, 1, slot1, NR_MAP_PUT, 1000 + i, i);
+    }
+    nr_execute_update(nr, 0, slot0, NR_MAP_PUT, 999, 1);
+    bool nr_ok = nr_execute_read(nr, 0, NR_MAP_GET, 1000 + 3 * NR_SMALL_LOG - 1, 0) == 3 * NR_SMALL_LOG - 1;
+    nr_destroy(nr);
+    nr_init(nr, &nr_hashmap, 2, NR_SMALL_LOG);
+    nr_init_replica(nr, 0);
+    nr_init_replica(nr, 1);
+    pthread_t writers[2];
+    nr_writer_t writer_args[2];
+    for (int r = 0; r < 2; r++) {
+        writer_args[r] = (nr_writer_t){nr, r};
+        pthread_create(&writers[r], NULL, nr_writer, &writer_args[r]);
+    }
+    for (int r = 0; r < 2; r++) {
+        pthread_join(writers[r], NULL);
+    }
+    for (long k = 0; nr_ok && k < 2 * NR_SMALL_LOG_OPS; k++) {
+        nr_ok = nr_execute_read(nr, 0, NR_MAP_GET, k, 0) == k / 2 &&
+                nr_execute_read(nr, 1, NR_MAP_GET, k, 0) == k / 2;
+    }
+    nr_destroy(nr);
+    free(nr);
+    if (!nr_ok) {
+        printf("✗ Node replication with a wrapping log diverged\n");
+        return 1;
+    }
+    printf("✓ Node replication test passed\n");
+    
+    // Test 7: Channels deliver in order, and batched sends only after a flush
+    printf("Testing message channels...\n");
+    spsc_channel_t spsc;
+    mpsc_channel_t mpsc;
+    mpsc_producer_t producers[2];
+    uint8_t msg[CHANNEL_PAYLOAD_SIZE] = {0};
+    bool channels_ok = spsc_init(&spsc, 8, 4, false) == 0 && mpsc_init(&mpsc, 8, true) == 0;
+    for (int i = 0; channels_ok && i < 3; i++) {
+        msg[0] = i;
+        channels_ok = spsc_send(&spsc, msg);
+    }
+    channels_ok = channels_ok && !spsc_recv(&spsc, msg); // 3 < batch: nothing published yet
+    spsc_flush(&spsc);
+    for (int i = 0; channels_ok && i < 3; i++) {
+        channels_ok = spsc_recv(&spsc, msg) && msg[0] == i;
+    }
+    mpsc_producer_init(&producers[0], &mpsc, 2);
+    mpsc_producer_init(&producers[1], &mpsc, 1);
+    msg[0] = 10;
+    channels_ok = channels_ok && mpsc_send(&producers[0], msg);
+    msg[0] = 20;
+    channels_ok = channels_ok && mpsc_send(&producers[1], msg);
+    msg[0] = 11;
+    channels_ok = channels_ok && mpsc_send(&producers[0], msg);
+    int expected[] = {20, 10, 11};
+    for (int i = 0; channels_ok && i < 3; i++) {
+        channels_ok = mpsc_recv(&mpsc, msg) && msg[0] == expected[i];
+    }
+    if (!channels_ok || mpsc_recv(&mpsc, msg)) {
+        printf("✗ Message channels delivered the wrong messages\n");
+        return 1;
+    }
+    spsc_destroy(&spsc);
+    mpsc_destroy(&mpsc);
+    printf("✓ Message channel test passed\n");
+
+    // Test 8: Release writes back only the dirtied lines, and data survives invalidation
+    printf("Testing software coherence region (%s)...\n", sc_writeback_instruction());
+    char buffer[4 * SC_LINE_SIZE] __attribute__((aligned(SC_LINE_SIZE))) = {0};
+    sc_region_t region;
+    sc_context_t sc;
+    sc_region_init(&region, buffer, sizeof(buffer));
+    if (region.num_lines != 4 || sc_context_init(&sc, &region) != 0) {
+        printf("✗ Coherence region setup failed\n");
+        return 1;
+    }
+    buffer[SC_LINE_SIZE - 1] = 1;
+    buffer[SC_LINE_SIZE] = 2;
+    sc_mark_dirty(&sc, &buffer[SC_LINE_SIZE - 1], 2); // straddles lines 0 and 1
+    sc_release(&sc);
+    sc_release(&sc); // nothing dirty any more
+    sc_acquire(&sc, &buffer[SC_LINE_SIZE], 3 * SC_LINE_SIZE);
+    bool region_ok = sc.lines_written_back == 2 && sc.lines_invalidated == 3 &&
+                     buffer[SC_LINE_SIZE - 1] == 1 && buffer[SC_LINE_SIZE] == 2;
+    sc_context_destroy(&sc);
+    if (!region_ok) {
+        printf("✗ Coherence region flushed %ld lines and invalidated %ld (expected 2 and 3)\n",
+               sc.lines_written_back, sc.lines_invalidated);
+        return 1;
+    }
+    printf("✓ Software coherence region test passed\n");
+    
     printf("\n=== ALL TESTS PASSED ===\n");
     printf("Run './experiment' to start the full federated coherence experiment.\n");
     printf("Use './experiment -h' for help with command line options.\n");
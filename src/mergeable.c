@@ -0,0 +1,213 @@
+#include "../include/mergeable.h"
+#include <limits.h>
+#include <string.h>
+
+// Raise *p to at least v; concurrent raisers and merges never lose an update
+static void atomic_max(volatile long* p, long v) {
+    long cur = *p;
+    while (cur < v && !__sync_bool_compare_and_swap(p, cur, v)) {
+        cur = *p;
+    }
+}
+
+static void atomic_min(volatile long* p, long v) {
+    long cur = *p;
+    while (cur > v && !__sync_bool_compare_and_swap(p, cur, v)) {
+        cur = *p;
+    }
+}
+
+// Counter
+void merge_counter_init(merge_counter_t* c) {
+    for (int i = 0; i < MERGE_MAX_REPLICAS; i++) {
+        c->counts[i] = 0;
+    }
+}
+
+void merge_counter_add(merge_counter_t* c, int replica, long n) {
+    __sync_fetch_and_add(&c->counts[replica], n);
+}
+
+void merge_counter_merge(merge_counter_t* dst, const merge_counter_t* src) {
+    for (int i = 0; i < MERGE_MAX_REPLICAS; i++) {
+        atomic_max(&dst->counts[i], src->counts[i]);
+    }
+}
+
+long merge_counter_value(const merge_counter_t* c) {
+    long sum = 0;
+    for (int i = 0; i < MERGE_MAX_REPLICAS; i++) {
+        sum += c->counts[i];
+    }
+    return sum;
+}
+
+// Max/min register
+void merge_register_init(merge_register_t* r, bool is_max) {
+    r->is_max = is_max;
+    r->value = is_max ? LONG_MIN : LONG_MAX;
+}
+
+void merge_register_update(merge_register_t* r, long v) {
+    if (r->is_max) {
+        atomic_max(&r->value, v);
+    } else {
+        atomic_min(&r->value, v);
+    }
+}
+
+void merge_register_merge(merge_register_t* dst, const merge_register_t* src) {
+    merge_register_update(dst, src->value);
+}
+
+long merge_register_value(const merge_register_t* r) {
+    return r->value;
+}
+
+// Two-phase set
+void merge_set_init(merge_set_t* s) {
+    memset((void*)s, 0, sizeof(*s));
+}
+
+void merge_set_add(merge_set_t* s, int element) {
+    __sync_fetch_and_or(&s->added[element / 64], 1ULL << (element % 64));
+}
+
+void merge_set_remove(merge_set_t* s, int element) {
+    __sync_fetch_and_or(&s->removed[element / 64], 1ULL << (element % 64));
+}
+
+bool merge_set_contains(const merge_set_t* s, int element) {
+    uint64_t bit = 1ULL << (element % 64);
+    return (s->added[element / 64] & bit) && !(s->removed[element / 64] & bit);
+}
+
+int merge_set_size(const merge_set_t* s) {
+    int size = 0;
+    for (int i = 0; i < MERGE_SET_WORDS; i++) {
+        size += __builtin_popcountll(s->added[i] & ~s->removed[i]);
+    }
+    return size;
+}
+
+void merge_set_merge(merge_set_t* dst, const merge_set_t* src) {
+    for (int i = 0; i < MERGE_SET_WORDS; i++) {
+        if (src->added[i] & ~dst->added[i]) {
+            __sync_fetch_and_or(&dst->added[i], src->added[i]);
+        }
+        if (src->removed[i] & ~dst->removed[i]) {
+            __sync_fetch_and_or(&dst->removed[i], src->removed[i]);
+        }
+    }
+}
+
+// Map of max registers
+void merge_map_init(merge_map_t* m) {
+    for (int i = 0; i < MERGE_MAP_SLOTS; i++) {
+        m->keys[i] = 0;
+        m->values[i] = LONG_MIN;
+    }
+}
+
+static int merge_map_slot(long key) {
+    return (int)((((unsigned long)key * 0x9E3779B97F4A7C15UL) >> 32) % MERGE_MAP_SLOTS);
+}
+
+bool merge_map_put_max(merge_map_t* m, long key, long value) {
+    int slot = merge_map_slot(key);
+    for (int probe = 0; probe < MERGE_MAP_SLOTS; probe++) {
+        int i = (slot + probe) % MERGE_MAP_SLOTS;
+        long k = m->keys[i];
+        if (k == 0 && __sync_bool_compare_and_swap(&m->keys[i], 0, key + 1)) {
+            k = key + 1;
+        } else {
+            k = m->keys[i];
+        }
+        if (k == key + 1) {
+            atomic_max(&m->values[i], value);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool merge_map_get(const merge_map_t* m, long key, long* value) {
+    int slot = merge_map_slot(key);
+    for (int probe = 0; probe < MERGE_MAP_SLOTS; probe++) {
+        int i = (slot + probe) % MERGE_MAP_SLOTS;
+        if (m->keys[i] == 0) {
+            return false;
+        }
+        if (m->keys[i] == key + 1) {
+            *value = m->values[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+int merge_map_size(const merge_map_t* m) {
+    int size = 0;
+    for (int i = 0; i < MERGE_MAP_SLOTS; i++) {
+        if (m->keys[i] != 0) {
+            size++;
+        }
+    }
+    return size;
+}
+
+void merge_map_merge(merge_map_t* dst, const merge_map_t* src) {
+    for (int i = 0; i < MERGE_MAP_SLOTS; i++) {
+        long k = src->keys[i];
+        if (k != 0) {
+            merge_map_put_max(dst, k - 1, src->values[i]);
+        }
+    }
+}
+
+// Object bundle
+void federated_objects_init(federated_objects_t* o) {
+    merge_counter_init(&o->counter);
+    merge_register_init(&o->max_value, true);
+    merge_register_init(&o->min_value, false);
+    merge_set_init(&o->members);
+    merge_map_init(&o->table);
+}
+
+void federated_objects_merge(federated_objects_t* dst, const federated_objects_t* src) {
+    merge_counter_merge(&dst->counter, &src->counter);
+    merge_register_merge(&dst->max_value, &src->max_value);
+    merge_register_merge(&dst->min_value, &src->min_value);
+    merge_set_merge(&dst->members, &src->members);
+    merge_map_merge(&dst->table, &src->table);
+}
+
+// Equal observable state; map slots may differ between replicas, so compare by key
+bool federated_objects_equal(const federated_objects_t* a, const federated_objects_t* b) {
+    for (int i = 0; i < MERGE_MAX_REPLICAS; i++) {
+        if (a->counter.counts[i] != b->counter.counts[i]) return false;
+    }
+    if (a->max_value.value != b->max_value.value) return false;
+    if (a->min_value.value != b->min_value.value) return false;
+    for (int i = 0; i < MERGE_SET_WORDS; i++) {
+        if (a->members.added[i] != b->members.added[i]) return false;
+        if (a->members.removed[i] != b->members.removed[i]) return false;
+    }
+    if (merge_map_size(&a->table) != merge_map_size(&b->table)) return false;
+    for (int i = 0; i < MERGE_MAP_SLOTS; i++) {
+        long k = a->table.keys[i], v;
+        if (k == 0) continue;
+        if (!merge_map_get(&b->table, k - 1, &v) || v != a->table.values[i]) return false;
+    }
+    return true;
+}
+
+void federated_sync(federated_objects_t* replicas, int num_replicas) {
+    // Gather everything into replica 0, then hand the join back out
+    for (int i = 1; i < num_replicas; i++) {
+        federated_objects_merge(&replicas[0], &replicas[i]);
+    }
+    for (int i = 1; i < num_replicas; i++) {
+        federated_objects_merge(&replicas[i], &replicas[0]);
+    }
+}
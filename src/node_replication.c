@@ -0,0 +1,212 @@
+#include "../include/node_replication.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Replica reader-writer lock: readers only come from the replica's own socket, so the
+// reader count stays within one node's hardware coherence domain
+static void replica_read_lock(nr_replica_t* rep) {
+    while (1) {
+        while (rep->writer) _mm_pause();
+        __sync_fetch_and_add(&rep->readers, 1);
+        if (!rep->writer) return;
+        __sync_fetch_and_sub(&rep->readers, 1);
+    }
+}
+
+static void replica_read_unlock(nr_replica_t* rep) {
+    __sync_fetch_and_sub(&rep->readers, 1);
+}
+
+static void replica_write_lock(nr_replica_t* rep) {
+    while (__sync_lock_test_and_set(&rep->writer, 1)) _mm_pause();
+    while (rep->readers) _mm_pause();
+}
+
+static void replica_write_unlock(nr_replica_t* rep) {
+    __sync_lock_release(&rep->writer);
+}
+
+static bool combiner_trylock(nr_replica_t* rep) {
+    return !rep->combiner_lock && !__sync_lock_test_and_set(&rep->combiner_lock, 1);
+}
+
+// Replay log entries into rep up to target. Non-blocking replay stops at the first entry
+// that another combiner has reserved but not filled yet. Responses for the entries of
+// the caller's own batch [batch_start, batch_start + batch_n) go to the batch's slots.
+static void replay(node_replicated_t* nr, nr_replica_t* rep, long target, bool blocking,
+                   long batch_start, int batch_n, const int* batch_slots) {
+    if (rep->local_tail >= target) return;
+    replica_write_lock(rep);
+    while (rep->local_tail < target) {
+        long idx = rep->local_tail;
+        nr_log_entry_t* e = &nr->log[idx % nr->log_size];
+        if (e->seq != idx + 1) {
+            if (!blocking) break;
+            while (e->seq != idx + 1) _mm_pause();
+        }
+        long response = nr->ds->update(rep->state, e->op, e->a, e->b);
+        if (idx >= batch_start && idx < batch_start + batch_n) {
+            rep->slots[batch_slots[idx - batch_start]].response = response;
+        }
+        rep->local_tail = idx + 1;
+    }
+    replica_write_unlock(rep);
+}
+
+static long min_local_tail(node_replicated_t* nr) {
+    long min = nr->tail;
+    for (int i = 0; i < nr->num_replicas; i++) {
+        if (nr->replicas[i]->local_tail < min) min = nr->replicas[i]->local_tail;
+    }
+    return min;
+}
+
+// The log is circular: entry idx may only be written once every replica has replayed
+// idx - log_size. While waiting, bring idle lagging replicas forward ourselves. The caller
+// holds its own replica's combiner lock, so nobody else can advance that one: replay it here
+// too, or it becomes the minimum once other sockets append a whole log between two of its
+// combines and every combiner spins forever. Entries of the caller's own batch met on the
+// way get their responses as in replay(). Replay runs to the log's end rather than to
+// completed_tail: entries of a combiner that is itself still waiting are filled but not
+// yet completed, and non-blocking replay stops at the first unfilled one anyway.
+static void wait_for_log_space(node_replicated_t* nr, int replica, long idx,
+                               long batch_start, int batch_n, const int* batch_slots) {
+    while (idx - min_local_tail(nr) >= nr->log_size) {
+        for (int i = 0; i < nr->num_replicas; i++) {
+            nr_replica_t* rep = nr->replicas[i];
+            if (rep->local_tail + nr->log_size > idx) continue;
+            if (i == replica) {
+                replay(nr, rep, nr->tail, false, batch_start, batch_n, batch_slots);
+            } else if (combiner_trylock(rep)) {
+                replay(nr, rep, nr->tail, false, 0, 0, NULL);
+                __sync_lock_release(&rep->combiner_lock);
+            }
+        }
+        _mm_pause();
+    }
+}
+
+static void advance_completed_tail(node_replicated_t* nr, long end) {
+    long cur = nr->completed_tail;
+    while (cur < end && !__sync_bool_compare_and_swap(&nr->completed_tail, cur, end)) {
+        cur = nr->completed_tail;
+    }
+}
+
+// Flat combining, called with the replica's combiner lock held: collect the pending ops of
+// this socket, append them to the log as one batch and replay the log up to its end
+static void combine(node_replicated_t* nr, int replica) {
+    nr_replica_t* rep = nr->replicas[replica];
+    int batch_slots[NR_MAX_THREADS_PER_REPLICA];
+    int n = 0;
+    for (int s = 0; s < rep->num_slots; s++) {
+        if (rep->slots[s].pending) batch_slots[n++] = s;
+    }
+    if (n == 0) return;
+
+    long start = __sync_fetch_and_add(&nr->tail, n);
+    for (int i = 0; i < n; i++) {
+        nr_slot_t* slot = &rep->slots[batch_slots[i]];
+        nr_log_entry_t* e = &nr->log[(start + i) % nr->log_size];
+        wait_for_log_space(nr, replica, start + i, start, n, batch_slots);
+        e->op = slot->op;
+        e->a = slot->a;
+        e->b = slot->b;
+        e->replica = replica;
+        memory_barrier();
+        e->seq = start + i + 1;
+    }
+
+    replay(nr, rep, start + n, true, start, n, batch_slots);
+    advance_completed_tail(nr, start + n);
+    memory_barrier();
+    for (int i = 0; i < n; i++) {
+        rep->slots[batch_slots[i]].pending = 0;
+    }
+}
+
+int nr_init(node_replicated_t* nr, const nr_structure_t* ds, int num_replicas, long log_size) {
+    if (num_replicas < 1 || num_replicas > NR_MAX_REPLICAS) {
+        fprintf(stderr, "Node replication supports 1 to %d replicas\n", NR_MAX_REPLICAS);
+        return -1;
+    }
+    memset(nr, 0, sizeof(*nr));
+    nr->ds = ds;
+    nr->num_replicas = num_replicas;
+    nr->log_size = log_size > 0 ? log_size : NR_LOG_SIZE;
+    nr->log = calloc(nr->log_size, sizeof(nr_log_entry_t));
+    return nr->log ? 0 : -1;
+}
+
+int nr_init_replica(node_replicated_t* nr, int replica) {
+    nr_replica_t* rep = NULL;
+    if (posix_memalign((void**)&rep, 64, sizeof(nr_replica_t)) != 0) return -1;
+    memset(rep, 0, sizeof(*rep));
+    hw_lock_init(&rep->combiner_lock);
+    rep->state = malloc(nr->ds->state_size);
+    if (!rep->state) {
+        free(rep);
+        return -1;
+    }
+    nr->ds->init(rep->state);
+    nr->replicas[replica] = rep;
+    return 0;
+}
+
+void nr_destroy(node_replicated_t* nr) {
+    for (int i = 0; i < nr->num_replicas; i++) {
+        if (nr->replicas[i]) {
+            free(nr->replicas[i]->state);
+            free(nr->replicas[i]);
+        }
+    }
+    free(nr->log);
+}
+
+int nr_register(node_replicated_t* nr, int replica) {
+    int slot = __sync_fetch_and_add(&nr->replicas[replica]->num_slots, 1);
+    if (slot >= NR_MAX_THREADS_PER_REPLICA) {
+        fprintf(stderr, "Too many threads on replica %d\n", replica);
+        exit(1);
+    }
+    return slot;
+}
+
+long nr_execute_update(node_replicated_t* nr, int replica, int slot, int op, long a, long b) {
+    nr_replica_t* rep = nr->replicas[replica];
+    nr_slot_t* s = &rep->slots[slot];
+    s->op = op;
+    s->a = a;
+    s->b = b;
+    memory_barrier();
+    s->pending = 1;
+    // Either some combiner picks the op up, or we become the combiner
+    while (s->pending) {
+        if (combiner_trylock(rep)) {
+            combine(nr, replica);
+            __sync_lock_release(&rep->combiner_lock);
+        } else {
+            _mm_pause();
+        }
+    }
+    return s->response;
+}
+
+long nr_execute_read(node_replicated_t* nr, int replica, int op, long a, long b) {
+    nr_replica_t* rep = nr->replicas[replica];
+    // Linearizable read: the replica must include every update completed before we started
+    long target = nr->completed_tail;
+    while (rep->local_tail < target) {
+        if (combiner_trylock(rep)) {
+            replay(nr, rep, target, false, 0, 0, NULL);
+            __sync_lock_release(&rep->combiner_lock);
+        } else {
+            _mm_pause();
+        }
+    }
+    replica_read_lock(rep);
+    long result = nr->ds->read(rep->state, op, a, b);
+    replica_read_unlock(rep);
+    return result;
+}
@@ -0,0 +1,368 @@
+#define _GNU_SOURCE
+#include "../include/emulation.h"
+#include "../include/sync.h"
+#include "../include/node_replication.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/sysinfo.h>
+
+#define MAX_LIST 32
+
+// Node-replicated structures against one instance behind a single lock
+typedef enum { IMPL_NR, IMPL_LOCKED } impl_t;
+
+typedef struct {
+    const nr_structure_t* ds;
+    impl_t impl;
+    int num_sockets;
+    int threads_per_socket;
+    int read_ratio;
+    int duration_ms;
+    long key_range;
+    long log_size;
+    bool bakery;
+} bench_config_t;
+
+typedef struct {
+    double read_mops;
+    double write_mops;
+} bench_result_t;
+
+typedef struct {
+    int thread_id;
+    int socket;
+    int local_id; // index among the threads of its socket
+    int core;
+    const bench_config_t* config;
+    node_replicated_t* nr;
+    void* locked_state;
+    generic_lock_t* lock;
+    pthread_barrier_t* barrier;
+    volatile bool* stop;
+    long reads;
+    long writes;
+} bench_thread_t;
+
+static unsigned long xorshift(unsigned long* s) {
+    unsigned long x = *s;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *s = x;
+}
+
+// The next operation of the mix: a read with probability read_ratio %, otherwise an
+// insert or delete with equal probability
+static void next_op(const bench_config_t* config, unsigned long* seed, bool* is_read, int* op, long* a, long* b) {
+    unsigned long r = xorshift(seed);
+    *is_read = (int)(r % 100) < config->read_ratio;
+    bool insert = (r >> 8) & 1;
+    *a = (long)((r >> 16) % config->key_range);
+    *b = (long)(r >> 40);
+    if (config->ds == &nr_hashmap) {
+        *op = *is_read ? NR_MAP_GET : (insert ? NR_MAP_PUT : NR_MAP_REMOVE);
+    } else {
+        *op = *is_read ? NR_PQ_PEEK : (insert ? NR_PQ_PUSH : NR_PQ_POP);
+    }
+}
+
+// Start half full: every other key in the map, key_range / 2 elements in the queue
+static void prefill(const bench_config_t* config, node_replicated_t* nr, int replica, int slot, void* state) {
+    int op = config->ds == &nr_hashmap ? NR_MAP_PUT : NR_PQ_PUSH;
+    for (long k = 0; k < config->key_range; k += 2) {
+        if (nr) {
+            nr_execute_update(nr, replica, slot, op, k, k);
+        } else {
+            config->ds->update(state, op, k, k);
+        }
+    }
+}
+
+static void* bench_thread(void* arg) {
+    bench_thread_t* t = arg;
+    const bench_config_t* config = t->config;
+    pin_thread_to_core(t->core);
+
+    int slot = 0;
+    if (config->impl == IMPL_NR) {
+        // The first thread of each socket allocates that socket's replica
+        if (t->local_id == 0 && nr_init_replica(t->nr, t->socket) != 0) {
+            fprintf(stderr, "Failed to allocate replica %d\n", t->socket);
+            exit(1);
+        }
+        pthread_barrier_wait(t->barrier);
+        slot = nr_register(t->nr, t->socket);
+        if (t->thread_id == 0) prefill(config, t->nr, t->socket, slot, NULL);
+    } else {
+        pthread_barrier_wait(t->barrier);
+        if (t->thread_id == 0) prefill(config, NULL, 0, 0, t->locked_state);
+    }
+    pthread_barrier_wait(t->barrier);
+
+    unsigned long seed = 0x9E3779B97F4A7C15UL * (t->thread_id + 1);
+    long reads = 0, writes = 0;
+    while (!*t->stop) {
+        bool is_read;
+        int op;
+        long a, b;
+        next_op(config, &seed, &is_read, &op, &a, &b);
+        long result;
+        if (config->impl == IMPL_NR) {
+            result = is_read ? nr_execute_read(t->nr, t->socket, op, a, b)
+                             : nr_execute_update(t->nr, t->socket, slot, op, a, b);
+        } else {
+            generic_lock_acquire(t->lock, t->thread_id);
+            result = is_read ? config->ds->read(t->locked_state, op, a, b)
+                             : config->ds->update(t->locked_state, op, a, b);
+            generic_lock_release(t->lock, t->thread_id);
+        }
+        __asm__ volatile("" : : "r"(result));
+        if (is_read) {
+            reads++;
+        } else {
+            writes++;
+        }
+    }
+    t->reads = reads;
+    t->writes = writes;
+    return NULL;
+}
+
+static int cores_of_socket(int socket, int* cores, int max) {
+    int n = 0;
+    for (int c = 0; c < get_nprocs() && n < max; c++) {
+        if (get_socket_for_core(c) == socket) cores[n++] = c;
+    }
+    return n;
+}
+
+static bench_result_t run_bench(const bench_config_t* config) {
+    int num_threads = config->num_sockets * config->threads_per_socket;
+    bench_thread_t* threads = calloc(num_threads, sizeof(bench_thread_t));
+    pthread_t* handles = malloc(num_threads * sizeof(pthread_t));
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, num_threads + 1);
+    volatile bool stop = false;
+
+    node_replicated_t* nr = NULL;
+    void* locked_state = NULL;
+    generic_lock_t lock;
+    hw_lock_t hw_lock;
+    bakery_lock_t bakery_lock;
+    if (config->impl == IMPL_NR) {
+        nr = malloc(sizeof(node_replicated_t));
+        if (nr_init(nr, config->ds, config->num_sockets, config->log_size) != 0) exit(1);
+    } else {
+        locked_state = malloc(config->ds->state_size);
+        config->ds->init(locked_state);
+        if (config->bakery) {
+            bakery_lock_init(&bakery_lock);
+            generic_lock_init_bakery(&lock, &bakery_lock);
+        } else {
+            hw_lock_init(&hw_lock);
+            generic_lock_init_hw(&lock, &hw_lock);
+        }
+    }
+
+    int cores[1024];
+    for (int s = 0; s < config->num_sockets; s++) {
+        int n = cores_of_socket(s, cores, 1024);
+        for (int i = 0; i < config->threads_per_socket; i++) {
+            bench_thread_t* t = &threads[s * config->threads_per_socket + i];
+            t->thread_id = s * config->threads_per_socket + i;
+            t->socket = s;
+            t->local_id = i;
+            t->core = cores[i % n]; // more threads than cores share them
+            t->config = config;
+            t->nr = nr;
+            t->locked_state = locked_state;
+            t->lock = &lock;
+            t->barrier = &barrier;
+            t->stop = &stop;
+            pthread_create(&handles[t->thread_id], NULL, bench_thread, t);
+        }
+    }
+
+    // Replicas allocated, then prefilled: start the clock
+    pthread_barrier_wait(&barrier);
+    pthread_barrier_wait(&barrier);
+    usleep(config->duration_ms * 1000);
+    stop = true;
+
+    long reads = 0, writes = 0;
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(handles[i], NULL);
+        reads += threads[i].reads;
+        writes += threads[i].writes;
+    }
+
+    bench_result_t result = {
+        .read_mops = reads / (config->duration_ms * 1e3),
+        .write_mops = writes / (config->duration_ms * 1e3),
+    };
+
+    if (nr) {
+        nr_destroy(nr);
+        free(nr);
+    }
+    free(locked_state);
+    pthread_barrier_destroy(&barrier);
+    free(handles);
+    free(threads);
+    return result;
+}
+
+static int parse_int_list(const char* s, int* out, int max) {
+    int n = 0;
+    char* copy = strdup(s);
+    for (char* tok = strtok(copy, ","); tok && n < max; tok = strtok(NULL, ",")) {
+        out[n++] = atoi(tok);
+    }
+    free(copy);
+    return n;
+}
+
+static void print_usage(const char* prog_name) {
+    printf("Usage: %s [options]\n", prog_name);
+    printf("Options:\n");
+    printf("  -s <sockets>    Socket counts, comma separated (default: 1..all sockets)\n");
+    printf("  -t <threads>    Threads per socket (default: 4)\n");
+    printf("  -r <ratios>     Read percentages, comma separated (default: 0,50,90,99,100)\n");
+    printf("  -d <ms>         Run time per configuration in ms (default: 1000)\n");
+    printf("  -k <keys>       Key range (default: 8192)\n");
+    printf("  -l <lock>       Baseline lock: hw, bakery (default: hw)\n");
+    printf("  -L <entries>    Operation log entries, 0 for the default (default: %d)\n", NR_LOG_SIZE);
+    printf("  -o <file>       Also write results as csv\n");
+    printf("  -h              Show this help\n");
+}
+
+int main(int argc, char* argv[]) {
+    int socket_counts[MAX_LIST], read_ratios[MAX_LIST];
+    int num_socket_counts = 0;
+    int num_read_ratios = parse_int_list("0,50,90,99,100", read_ratios, MAX_LIST);
+    bench_config_t config = {
+        .threads_per_socket = 4,
+        .duration_ms = 1000,
+        .key_range = 8192,
+        .bakery = false
+    };
+    const char* csv_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:t:r:d:k:l:L:o:h")) != -1) {
+        switch (opt) {
+            case 's':
+                num_socket_counts = parse_int_list(optarg, socket_counts, MAX_LIST);
+                break;
+            case 't':
+                config.threads_per_socket = atoi(optarg);
+                break;
+            case 'r':
+                num_read_ratios = parse_int_list(optarg, read_ratios, MAX_LIST);
+                break;
+            case 'd':
+                config.duration_ms = atoi(optarg);
+                break;
+            case 'k':
+                config.key_range = atol(optarg);
+                break;
+            case 'l':
+                if (strcmp(optarg, "hw") == 0) {
+                    config.bakery = false;
+                } else if (strcmp(optarg, "bakery") == 0) {
+                    config.bakery = true;
+                } else {
+                    fprintf(stderr, "Invalid lock type: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'L':
+                config.log_size = atol(optarg);
+                break;
+            case 'o':
+                csv_path = optarg;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    int total_sockets = get_total_sockets();
+    if (num_socket_counts == 0) {
+        for (int s = 1; s <= total_sockets && s <= MAX_LIST; s++) {
+            socket_counts[num_socket_counts++] = s;
+        }
+    }
+    for (int i = 0; i < num_socket_counts; i++) {
+        int s = socket_counts[i];
+        if (s < 1 || s > total_sockets || s > NR_MAX_REPLICAS) {
+            fprintf(stderr, "Socket count %d not available (%d sockets, at most %d replicas)\n",
+                    s, total_sockets, NR_MAX_REPLICAS);
+            return 1;
+        }
+        if (config.bakery && s * config.threads_per_socket > MAX_THREADS) {
+            fprintf(stderr, "The bakery lock supports at most %d threads\n", MAX_THREADS);
+            return 1;
+        }
+    }
+    if (config.threads_per_socket < 1 || config.threads_per_socket > NR_MAX_THREADS_PER_REPLICA) {
+        fprintf(stderr, "Threads per socket must be between 1 and %d\n", NR_MAX_THREADS_PER_REPLICA);
+        return 1;
+    }
+    if (config.log_size < 0) {
+        fprintf(stderr, "Log size must be non-negative (0 for the default)\n");
+        return 1;
+    }
+    if (config.key_range < 2 || config.key_range >= NR_MAP_CAPACITY) {
+        fprintf(stderr, "Key range must be between 2 and %d\n", NR_MAP_CAPACITY - 1);
+        return 1;
+    }
+
+    FILE* csv = NULL;
+    if (csv_path) {
+        csv = fopen(csv_path, "w");
+        if (!csv) {
+            perror(csv_path);
+            return 1;
+        }
+        fprintf(csv, "structure,impl,sockets,threads,read_ratio,read_mops,write_mops\n");
+    }
+
+    const nr_structure_t* structures[] = {&nr_hashmap, &nr_pqueue};
+    const char* baseline = config.bakery ? "locked-bakery" : "locked-hw";
+
+    printf("=== NODE REPLICATION BENCHMARK ===\n");
+    printf("%-8s %-14s %7s %7s %5s %11s %11s\n", "struct", "impl", "sockets", "threads", "read%",
+           "read Mops", "write Mops");
+    for (int d = 0; d < 2; d++) {
+        config.ds = structures[d];
+        for (int i = 0; i < num_socket_counts; i++) {
+            config.num_sockets = socket_counts[i];
+            for (int j = 0; j < num_read_ratios; j++) {
+                config.read_ratio = read_ratios[j];
+                for (int impl = IMPL_NR; impl <= IMPL_LOCKED; impl++) {
+                    config.impl = impl;
+                    bench_result_t r = run_bench(&config);
+                    const char* name = impl == IMPL_NR ? "nr" : baseline;
+                    int threads = config.num_sockets * config.threads_per_socket;
+                    printf("%-8s %-14s %7d %7d %5d %11.3f %11.3f\n", config.ds->name, name,
+                           config.num_sockets, threads, config.read_ratio, r.read_mops, r.write_mops);
+                    if (csv) {
+                        fprintf(csv, "%s,%s,%d,%d,%d,%.4f,%.4f\n", config.ds->name, name,
+                                config.num_sockets, threads, config.read_ratio, r.read_mops, r.write_mops);
+                    }
+                }
+            }
+        }
+    }
+
+    if (csv) fclose(csv);
+    return 0;
+}
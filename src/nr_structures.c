@@ -0,0 +1,165 @@
+#include "../include/node_replication.h"
+
+// Hash map: open addressing with linear probing and backward-shift deletion
+
+static int map_home(long key) {
+    return (int)(((unsigned long)key * 0x9E3779B97F4A7C15UL) >> 32) & (NR_MAP_CAPACITY - 1);
+}
+
+static int map_find(const nr_hashmap_t* m, long key) {
+    int i = map_home(key);
+    for (int probe = 0; probe < NR_MAP_CAPACITY; probe++) {
+        if (m->keys[i] == key) return i;
+        if (m->keys[i] == -1) return -1;
+        i = (i + 1) & (NR_MAP_CAPACITY - 1);
+    }
+    return -1;
+}
+
+static void hashmap_init(void* state) {
+    nr_hashmap_t* m = state;
+    m->size = 0;
+    for (int i = 0; i < NR_MAP_CAPACITY; i++) {
+        m->keys[i] = -1;
+        m->values[i] = -1;
+    }
+}
+
+static long hashmap_put(nr_hashmap_t* m, long key, long value) {
+    int i = map_home(key);
+    for (int probe = 0; probe < NR_MAP_CAPACITY; probe++) {
+        if (m->keys[i] == key) {
+            long old = m->values[i];
+            m->values[i] = value;
+            return old;
+        }
+        if (m->keys[i] == -1) {
+            // Keep one slot free so lookups of absent keys terminate
+            if (m->size == NR_MAP_CAPACITY - 1) return -1;
+            m->keys[i] = key;
+            m->values[i] = value;
+            m->size++;
+            return -1;
+        }
+        i = (i + 1) & (NR_MAP_CAPACITY - 1);
+    }
+    return -1;
+}
+
+static long hashmap_remove(nr_hashmap_t* m, long key) {
+    int i = map_find(m, key);
+    if (i < 0) return -1;
+    long old = m->values[i];
+    // Shift later entries of the probe run back so no tombstones are needed
+    int hole = i;
+    int j = (i + 1) & (NR_MAP_CAPACITY - 1);
+    while (m->keys[j] != -1) {
+        int home = map_home(m->keys[j]);
+        // Move j into the hole unless its home lies cyclically in (hole, j]
+        bool stays = hole <= j ? (home > hole && home <= j) : (home > hole || home <= j);
+        if (!stays) {
+            m->keys[hole] = m->keys[j];
+            m->values[hole] = m->values[j];
+            hole = j;
+        }
+        j = (j + 1) & (NR_MAP_CAPACITY - 1);
+    }
+    m->keys[hole] = -1;
+    m->values[hole] = -1;
+    m->size--;
+    return old;
+}
+
+static long hashmap_update(void* state, int op, long a, long b) {
+    switch (op) {
+        case NR_MAP_PUT:
+            return hashmap_put(state, a, b);
+        case NR_MAP_REMOVE:
+            return hashmap_remove(state, a);
+    }
+    return -1;
+}
+
+static long hashmap_read(const void* state, int op, long a, long b) {
+    (void)b;
+    const nr_hashmap_t* m = state;
+    if (op == NR_MAP_GET) {
+        int i = map_find(m, a);
+        return i < 0 ? -1 : m->values[i];
+    }
+    return -1;
+}
+
+const nr_structure_t nr_hashmap = {
+    .name = "hashmap",
+    .state_size = sizeof(nr_hashmap_t),
+    .init = hashmap_init,
+    .update = hashmap_update,
+    .read = hashmap_read,
+};
+
+// Priority queue: binary min-heap
+
+static void pqueue_init(void* state) {
+    nr_pqueue_t* q = state;
+    q->size = 0;
+}
+
+static long pqueue_push(nr_pqueue_t* q, long value) {
+    if (q->size == NR_PQ_CAPACITY) return q->size;
+    int i = q->size++;
+    while (i > 0 && q->heap[(i - 1) / 2] > value) {
+        q->heap[i] = q->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    q->heap[i] = value;
+    return q->size;
+}
+
+static long pqueue_pop(nr_pqueue_t* q) {
+    if (q->size == 0) return -1;
+    long min = q->heap[0];
+    long last = q->heap[--q->size];
+    int i = 0;
+    while (2 * i + 1 < q->size) {
+        int child = 2 * i + 1;
+        if (child + 1 < q->size && q->heap[child + 1] < q->heap[child]) child++;
+        if (q->heap[child] >= last) break;
+        q->heap[i] = q->heap[child];
+        i = child;
+    }
+    q->heap[i] = last;
+    return min;
+}
+
+static long pqueue_update(void* state, int op, long a, long b) {
+    (void)b;
+    switch (op) {
+        case NR_PQ_PUSH:
+            return pqueue_push(state, a);
+        case NR_PQ_POP:
+            return pqueue_pop(state);
+    }
+    return -1;
+}
+
+static long pqueue_read(const void* state, int op, long a, long b) {
+    (void)a;
+    (void)b;
+    const nr_pqueue_t* q = state;
+    switch (op) {
+        case NR_PQ_PEEK:
+            return q->size ? q->heap[0] : -1;
+        case NR_PQ_SIZE:
+            return q->size;
+    }
+    return -1;
+}
+
+const nr_structure_t nr_pqueue = {
+    .name = "pqueue",
+    .state_size = sizeof(nr_pqueue_t),
+    .init = pqueue_init,
+    .update = pqueue_update,
+    .read = pqueue_read,
+};
@@ -0,0 +1,49 @@
+#define _GNU_SOURCE
+#include "../include/shared_pool.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// From <numaif.h>; the emulator does not link libnuma
+#define POOL_MPOL_BIND 2
+#define POOL_MPOL_MF_MOVE (1 << 1)
+
+int shared_pool_bind(void* addr, size_t size, int node) {
+    unsigned long mask[16] = {0};
+    if (node < 0 || node >= (int)(sizeof(mask) * 8)) {
+        return -1;
+    }
+    mask[node / 64] = 1UL << (node % 64);
+    return syscall(SYS_mbind, addr, size, POOL_MPOL_BIND, mask, sizeof(mask) * 8, POOL_MPOL_MF_MOVE) == 0 ? 0 : -1;
+}
+
+void* shared_pool_map(size_t size, int node) {
+    int fd = memfd_create("coherence-pool", 0);
+    if (fd < 0) {
+        perror("memfd_create");
+        return NULL;
+    }
+    if (ftruncate(fd, size) != 0) {
+        perror("ftruncate");
+        close(fd);
+        return NULL;
+    }
+    void* pool = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the memory alive
+    if (pool == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+    if (node >= 0 && shared_pool_bind(pool, size, node) != 0) {
+        perror("mbind (pool left unbound)");
+    }
+    // Fault every page in now, on the bound node, rather than in whoever touches it first
+    memset(pool, 0, size);
+    return pool;
+}
+
+void shared_pool_unmap(void* pool, size_t size) {
+    munmap(pool, size);
+}
@@ -1,10 +1,30 @@
 #include "../include/workload.h"
 #include "../include/emulation.h"
+#include "../include/dsm.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <unistd.h>
 
+// Deterministic per-thread output of the map phase, recorded into the mergeable objects
+// in SYSTEM_FEDERATED_RELAXED
+static long map_output(int thread_id) {
+    unsigned long x = (unsigned long)(thread_id + 1) * 0x9E3779B97F4A7C15UL;
+    return (long)((x ^ (x >> 29)) % 1000003);
+}
+
+static void record_map_output(federated_objects_t* objects, int thread_id) {
+    long v = map_output(thread_id);
+    merge_register_update(&objects->max_value, v);
+    merge_register_update(&objects->min_value, v);
+    merge_set_add(&objects->members, (int)(v % MERGE_SET_BITS));
+    // Every fourth thread retracts an earlier thread's element, which may live on another socket
+    if (thread_id % 4 == 3) {
+        merge_set_remove(&objects->members, (int)(map_output(thread_id - 2) % MERGE_SET_BITS));
+    }
+    merge_map_put_max(&objects->table, thread_id % 64, v);
+}
+
 /**
  * @brief MAP PHASE (formerly phase3_scalable_compute)
  * 
@@ -22,6 +42,7 @@
  * performance in this phase.
  */
 void map_phase(thread_context_t* ctx) {
+    if (ctx->config->dsm) dsm_set_phase(DSM_PHASE_MAP);
     timer_start(&ctx->phase_timers[2]);
 
     // Simulate independent computation on private stack data.
@@ -30,6 +51,11 @@ void map_phase(thread_context_t* ctx) {
         result += i; // This is just to keep the CPU busy.
     }
 
+    // Relaxed mode publishes the result to this socket's replica only
+    if (ctx->config->system_type == SYSTEM_FEDERATED_RELAXED) {
+        record_map_output(ctx->shared[ctx->socket_id].replica, ctx->thread_id);
+    }
+
     timer_stop(&ctx->phase_timers[2]);
 }
 
@@ -41,6 +67,7 @@ void map_phase(thread_context_t* ctx) {
  * where each node must signal completion of its Map tasks.
  */
 void shuffle_phase(thread_context_t* ctx) {
+    if (ctx->config->dsm) dsm_set_phase(DSM_PHASE_SHUFFLE);
     timer_start(&ctx->phase_timers[1]);
 
     // A simple barrier to ensure all threads are done with the map phase.
@@ -57,12 +84,36 @@ void shuffle_phase(thread_context_t* ctx) {
 
     // Then, a global barrier across sockets.
     // Only the first thread of each socket participates in the global barrier.
-    if (ctx->thread_id == socket_base_thread_id) {
+    // In relaxed mode this is where replicas reconcile: the leader pulls every other
+    // socket's replica into its own, with no inter-node lock.
+    if (ctx->thread_id == socket_base_thread_id && ctx->config->system_type == SYSTEM_FEDERATED_RELAXED) {
+        for (int s = 0; s < ctx->config->total_sockets; s++) {
+            if (s != ctx->socket_id) {
+                federated_objects_merge(ctx->shared[ctx->socket_id].replica, &ctx->shared[ctx->socket_id].replicas[s]);
+            }
+        }
+    } else if (ctx->thread_id == socket_base_thread_id) {
+        node_exchange_t* exchange = ctx->shared[ctx->socket_id].exchange;
         generic_lock_acquire(ctx->shared[ctx->socket_id].inter_node_lock, ctx->thread_id);
+        if (ctx->config->dsm) dsm_acquire();
         // In a real scenario, this is where nodes would exchange data pointers.
+        // Separate processes exchange values through the shared pool instead.
+        if (exchange != NULL) {
+            exchange->node_output[ctx->socket_id] = map_output(ctx->thread_id);
+        }
+        if (ctx->config->dsm) dsm_release();
         generic_lock_release(ctx->shared[ctx->socket_id].inter_node_lock, ctx->thread_id);
     }
 
+    // Nodes that are separate processes have no other way to know the others are done
+    node_exchange_t* exchange = ctx->shared[ctx->socket_id].exchange;
+    if (ctx->thread_id == socket_base_thread_id && exchange != NULL) {
+        if (ctx->config->dsm) dsm_release();
+        __sync_fetch_and_add(exchange->barrier_count, 1);
+        while (*exchange->barrier_count < ctx->config->total_sockets) { usleep(1); }
+        if (ctx->config->dsm) dsm_acquire();
+    }
+
     timer_stop(&ctx->phase_timers[1]);
 }
 
@@ -74,13 +125,35 @@ void shuffle_phase(thread_context_t* ctx) {
  * designed to stress the intra-node coherence mechanism.
  */
 void reduce_phase(thread_context_t* ctx) {
+    if (ctx->config->dsm) dsm_set_phase(DSM_PHASE_REDUCE);
     timer_start(&ctx->phase_timers[0]);
 
+    // Relaxed mode: increment this socket's slot of the replicated counter, no locks.
+    if (ctx->config->system_type == SYSTEM_FEDERATED_RELAXED) {
+        federated_objects_t* replica = ctx->shared[ctx->socket_id].replica;
+        for (int i = 0; i < ctx->config->increments_per_thread; i++) {
+            merge_counter_add(&replica->counter, ctx->socket_id, 1);
+        }
+        timer_stop(&ctx->phase_timers[0]);
+        return;
+    }
+
     // Each thread repeatedly acquires a lock and increments a shared counter.
+    // Without hardware coherence the lock section must also fetch the counter from
+    // memory and write it back before the next holder can see it.
+    shared_data_t* shared = &ctx->shared[ctx->socket_id];
+    bool software_coherent = shared->region != NULL;
     for (int i = 0; i < ctx->config->increments_per_thread; i++) {
-        generic_lock_acquire(ctx->shared[ctx->socket_id].intra_node_lock, ctx->thread_id);
-        ctx->shared[ctx->socket_id].counter++;
-        generic_lock_release(ctx->shared[ctx->socket_id].intra_node_lock, ctx->thread_id);
+        generic_lock_acquire(shared->intra_node_lock, ctx->thread_id);
+        if (software_coherent) {
+            sc_acquire(&ctx->coherence, (const void*)&shared->counter, sizeof(shared->counter));
+        }
+        shared->counter++;
+        if (software_coherent) {
+            sc_mark_dirty(&ctx->coherence, (const void*)&shared->counter, sizeof(shared->counter));
+            sc_release(&ctx->coherence);
+        }
+        generic_lock_release(shared->intra_node_lock, ctx->thread_id);
     }
 
     timer_stop(&ctx->phase_timers[0]);
@@ -94,6 +167,12 @@ void* workload_thread(void* arg) {
     // Pin this thread to its assigned core for stable measurements.
     pin_thread_to_core(ctx->core_id);
 
+    if (ctx->shared[ctx->socket_id].region != NULL &&
+        sc_context_init(&ctx->coherence, ctx->shared[ctx->socket_id].region) != 0) {
+        fprintf(stderr, "Failed to allocate dirty-line tracking for thread %d\n", ctx->thread_id);
+        exit(1);
+    }
+
     // Wait for the master thread to signal the start.
     pthread_barrier_wait(ctx->start_barrier);
 
@@ -106,6 +185,10 @@ void* workload_thread(void* arg) {
 
     timer_stop(&ctx->total_timer);
 
+    if (ctx->shared[ctx->socket_id].region != NULL) {
+        sc_context_destroy(&ctx->coherence);
+    }
+
     return NULL;
 }
 
@@ -117,6 +200,19 @@ void init_shared_data(shared_data_t* shared_data_array, workload_config_t* confi
         shared_data_array[i].barrier_count = 0;
         shared_data_array[i].intra_node_lock = &intra_locks[i];
         shared_data_array[i].inter_node_lock = &inter_locks[i];
+        shared_data_array[i].replica = NULL;
+        shared_data_array[i].replicas = NULL;
+        shared_data_array[i].exchange = NULL;
+        shared_data_array[i].region = NULL;
+    }
+}
+
+// Apply every thread's map output and reduce increments to a single object set
+void replay_eager_updates(federated_objects_t* objects, workload_config_t* config) {
+    int total_threads = config->total_sockets * config->num_threads_per_socket;
+    for (int t = 0; t < total_threads; t++) {
+        record_map_output(objects, t);
+        merge_counter_add(&objects->counter, t / config->num_threads_per_socket, config->increments_per_thread);
     }
 }
 
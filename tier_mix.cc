@@ -0,0 +1,219 @@
+#include "bandwidth_kernels.h"
+#include <future>
+#include <map>
+#include <numeric>
+
+#include <cxxopts.hpp>
+
+#define NUM_TRIALS 3
+#define MIN_BYTES_PER_TRIAL (1UL << 30) // repeat small buffers until at least this much is moved
+#define IDLE_CHASE_MS 200               // chase time for the zero-thread (idle latency) point
+
+// Pointer chase until stop, alongside the bandwidth threads; returns ns per load
+double loaded_chase(ChaseNode *start, int core_num, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	if (!pin_to_core(core_num))
+		return 0;
+	ChaseNode *p = start;
+	size_t loads = 0;
+	sync_point.arrive_and_wait();
+	auto start_time = std::chrono::steady_clock::now();
+	while (!stop.load(std::memory_order_relaxed)) {
+		for (int i = 0; i < 64; i++) {
+			p = p->next; p = p->next; p = p->next; p = p->next;
+		}
+		loads += 256;
+	}
+	auto end_time = std::chrono::steady_clock::now();
+	asm volatile("" : : "r"(p));
+	return loads ? std::chrono::duration<double, std::nano>(end_time - start_time).count() / loads : 0;
+}
+
+struct MixPoint {
+	double bandwidth = 0; // GB/s
+	double latency = 0;   // ns per load of the concurrent chase
+};
+
+// Parse "3:1" into DRAM and CXL page weights
+static bool parse_ratio(const std::string &spec, int &dram, int &cxl) {
+	return sscanf(spec.c_str(), "%d:%d", &dram, &cxl) == 2 && dram >= 0 && cxl >= 0 && dram + cxl > 0;
+}
+
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("Tier Mix", "Bandwidth and loaded latency of buffers split between DRAM and CXL by page ratio");
+	options.add_options()
+		("c,cpu_node", "NUMA node whose cores run the threads", cxxopts::value<int>()->default_value("0"))
+		("dram_node", "DRAM node (default: the CPU node)", cxxopts::value<int>()->default_value("-1"))
+		("cxl_node", "CXL node (default: the first CPU-less memory node, else the farthest one)", cxxopts::value<int>()->default_value("-1"))
+		("ratios", "DRAM:CXL page ratios", cxxopts::value<std::string>()->default_value("1:0,7:1,3:1,2:1,1:1,1:2,1:3,0:1"))
+		("k,kernels", "Access patterns (read,write,copy)", cxxopts::value<std::string>()->default_value("read,write,copy"))
+		("t,threads", "Bandwidth thread counts, 0 for idle latency (default: 0 and powers of two up to the node's cores but one)", cxxopts::value<std::string>()->default_value(""))
+		("s,size", "Buffer size per array", cxxopts::value<std::string>()->default_value("1G"))
+		("latency_size", "Working set of the latency chase", cxxopts::value<std::string>()->default_value("256M"))
+		("trials", "Number of trials", cxxopts::value<int>()->default_value(std::to_string(NUM_TRIALS)))
+		("r,result", "Result csv file", cxxopts::value<std::string>()->default_value("results/tier_mix.csv"))
+		("h,help", "Print usage")
+		;
+	auto arguments = options.parse(argc, argv);
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	// Initialize NUMA library
+	if (numa_available() == -1) {
+		std::cerr << "NUMA is not available on this system." << std::endl;
+		return 1;
+	}
+
+	int cpu_node = arguments["cpu_node"].as<int>();
+	std::vector<int> cores = cores_of_node(cpu_node);
+	if (cores.empty()) {
+		std::cerr << "No CPUs found on NUMA node " << cpu_node << "." << std::endl;
+		return 1;
+	}
+	int dram_node = arguments["dram_node"].as<int>() >= 0 ? arguments["dram_node"].as<int>() : cpu_node;
+	int cxl_node = arguments["cxl_node"].as<int>();
+	if (cxl_node < 0) {
+		cxl_node = dram_node;
+		for (int m : memory_nodes()) {
+			if (cores_of_node(m).empty()) {
+				cxl_node = m;
+				break;
+			}
+			if (node_distance(dram_node, m) > node_distance(dram_node, cxl_node))
+				cxl_node = m;
+		}
+	}
+
+	std::vector<std::pair<int, int>> ratios;
+	std::stringstream rs(arguments["ratios"].as<std::string>());
+	for (std::string tok; std::getline(rs, tok, ',');) {
+		int d, c;
+		if (!parse_ratio(tok, d, c)) {
+			std::cerr << "Invalid ratio: " << tok << std::endl;
+			return 1;
+		}
+		ratios.push_back({d, c});
+	}
+	std::map<std::string, int> pattern_kernel = {{kernel_names[READ], READ}, {kernel_names[WRITE], WRITE}, {kernel_names[COPY], COPY}};
+	std::vector<std::string> patterns;
+	std::stringstream ks(arguments["kernels"].as<std::string>());
+	for (std::string tok; std::getline(ks, tok, ',');) {
+		if (!pattern_kernel.count(tok)) {
+			std::cerr << "Unknown pattern: " << tok << std::endl;
+			return 1;
+		}
+		patterns.push_back(tok);
+	}
+
+	// The last core runs the latency chase
+	int chase_core = cores.back();
+	size_t max_threads = cores.size() > 1 ? cores.size() - 1 : 1;
+	std::vector<size_t> thread_counts;
+	if (arguments["threads"].as<std::string>().empty()) {
+		thread_counts.push_back(0);
+		for (size_t t : pow2_sweep(max_threads))
+			thread_counts.push_back(t);
+	} else {
+		for (long t : parse_list(arguments["threads"].as<std::string>()))
+			if ((size_t)t <= max_threads)
+				thread_counts.push_back(t);
+	}
+
+	size_t size = (parse_size(arguments["size"].as<std::string>()) + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+	size_t elems = size / sizeof(double);
+	size_t chase_size = parse_size(arguments["latency_size"].as<std::string>());
+	int num_trials = arguments["trials"].as<int>();
+	int impl = best_impl();
+	std::cout << "DRAM node " << dram_node << ", CXL node " << cxl_node << ", " << impl_names[impl] << " kernels" << std::endl;
+
+	std::ofstream results_file(arguments["result"].as<std::string>());
+	results_file << "pattern,dram_weight,cxl_weight,dram_pct,cpu_node,dram_node,cxl_node,threads,buffer_bytes,bandwidth,loaded_latency_ns\n";
+
+	// results[pattern][threads] = (bandwidth, ratio index) of the best ratio so far
+	std::map<std::string, std::map<size_t, std::pair<double, size_t>>> best;
+	std::map<std::string, std::map<size_t, double>> dram_only;
+	std::mt19937_64 rng(42);
+	for (size_t r = 0; r < ratios.size(); r++) {
+		auto [dram_w, cxl_w] = ratios[r];
+		std::vector<int> nodes = {dram_node, cxl_node}, weights = {dram_w, cxl_w};
+		double *bufs[2];
+		for (int b = 0; b < 2; b++) {
+			bufs[b] = static_cast<double *>(alloc_weighted(size, nodes, weights));
+			if (bufs[b] == nullptr) {
+				std::cerr << "Failed to place " << dram_w << ":" << cxl_w << " on nodes " << dram_node << "," << cxl_node << std::endl;
+				return 1;
+			}
+			memset(bufs[b], 0, size);
+		}
+		ChaseNode *chase_buf = static_cast<ChaseNode *>(alloc_weighted(chase_size, nodes, weights));
+		if (chase_buf == nullptr)
+			return 1;
+		ChaseNode *chase_start = build_chase(chase_buf, chase_size / sizeof(ChaseNode), rng);
+		double dram_pct = 100 * fraction_on_node(bufs[0], size, dram_node);
+
+		for (const std::string &pattern : patterns) {
+			int kernel = pattern_kernel[pattern];
+			for (size_t num_threads : thread_counts) {
+				size_t chunk = num_threads ? (elems / num_threads) / KERNEL_CHUNK_ELEMS * KERNEL_CHUNK_ELEMS : 0;
+				if (num_threads && chunk == 0)
+					continue;
+				size_t passes = num_threads ? std::max<size_t>(1, MIN_BYTES_PER_TRIAL / (chunk * num_threads * sizeof(double))) : 0;
+				MixPoint avg;
+				for (int trial = 0; trial < num_trials; ++trial) {
+					std::atomic<bool> stop{false};
+					MyBarrier sync_point(num_threads + 1);
+					auto chase_fut = std::async(std::launch::async, loaded_chase, chase_start, chase_core, std::ref(sync_point), std::ref(stop));
+					std::vector<std::future<double>> futs;
+					for (size_t i = 0; i < num_threads; ++i) {
+						size_t off = i * chunk;
+						futs.push_back(std::async(std::launch::async, bandwidth_worker, kernel_table[kernel][impl], kernel_streams[kernel],
+							bufs[0] + off, bufs[1] + off, bufs[1] + off, chunk, passes, cores[i], std::ref(sync_point)));
+					}
+					if (num_threads == 0)
+						std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_CHASE_MS));
+					// The slowest thread bounds the run
+					double duration = 0;
+					for (auto &f : futs)
+						duration = std::max(duration, f.get());
+					stop.store(true);
+					avg.latency += chase_fut.get() / num_trials;
+					if (num_threads)
+						avg.bandwidth += (double)kernel_streams[kernel] * chunk * num_threads * sizeof(double) * passes
+							/ 1e9 / duration / num_trials;
+				}
+
+				results_file << pattern << "," << dram_w << "," << cxl_w << "," << dram_pct << "," << cpu_node << "," << dram_node << ","
+					<< cxl_node << "," << num_threads << "," << size << "," << avg.bandwidth << "," << avg.latency << "\n";
+				std::cout << pattern << " " << dram_w << ":" << cxl_w << " (" << dram_pct << "% DRAM) threads " << num_threads
+					<< ": " << avg.bandwidth << " GB/s, loaded latency " << avg.latency << " ns" << std::endl;
+				if (num_threads && (!best[pattern].count(num_threads) || avg.bandwidth > best[pattern][num_threads].first))
+					best[pattern][num_threads] = {avg.bandwidth, r};
+				if (cxl_w == 0)
+					dram_only[pattern][num_threads] = avg.bandwidth;
+			}
+		}
+
+		for (int b = 0; b < 2; b++)
+			free_pages(bufs[b], size);
+		free_pages(chase_buf, chase_size);
+	}
+
+	// The split to use per pattern, at the highest thread count measured
+	std::cout << "\nRecommended DRAM:CXL split:" << std::endl;
+	for (const std::string &pattern : patterns) {
+		if (best[pattern].empty())
+			continue;
+		auto [threads, choice] = *best[pattern].rbegin();
+		auto [dram_w, cxl_w] = ratios[choice.second];
+		std::cout << "  " << pattern << ": " << dram_w << ":" << cxl_w << " (" << choice.first << " GB/s at " << threads << " threads";
+		if (dram_only[pattern].count(threads) && dram_only[pattern][threads] > 0)
+			std::cout << ", " << choice.first / dram_only[pattern][threads] << "x DRAM only";
+		std::cout << ")" << std::endl;
+	}
+
+	// Close the results file
+	results_file.close();
+
+	return 0;
+}
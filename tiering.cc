@@ -0,0 +1,256 @@
+#include "tiering.h"
+#include <cmath>
+#include <future>
+#include <numeric>
+
+#include <cxxopts.hpp>
+
+#define NUM_TRIALS 3
+#define RUN_TIME_MS 10000
+#define TOUCH_SAMPLE 16       // one access in this many bumps the software counter
+#define LATENCY_SAMPLE 256    // one access in this many is timed
+
+// Zipfian ranks over n items: inverse CDF by binary search
+class Zipf {
+public:
+	Zipf(size_t n, double theta) : cdf_(n) {
+		double sum = 0;
+		for (size_t i = 0; i < n; i++)
+			cdf_[i] = sum += 1.0 / std::pow(i + 1, theta);
+		for (double &c : cdf_)
+			c /= sum;
+	}
+	size_t operator()(std::mt19937_64 &rng) {
+		double u = std::uniform_real_distribution<double>(0, 1)(rng);
+		return std::min(cdf_.size() - 1, (size_t)(std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin()));
+	}
+
+private:
+	std::vector<double> cdf_;
+};
+
+struct WorkerResult {
+	size_t ops = 0;
+	size_t fast_hits = 0;
+	std::vector<double> latency_ns;
+};
+
+// Read-modify-write one line of a Zipf-chosen page. The rank-to-page mapping is a fixed
+// permutation rotated by shift, so the hot set moves whenever the main thread bumps it.
+WorkerResult tier_worker(char *region, const std::vector<uint32_t> &perm, Zipf zipf, TieringEngine &engine, bool counters,
+		std::atomic<size_t> &shift, int core_num, int seed, MyBarrier &sync_point, std::atomic<bool> &stop) {
+	WorkerResult r;
+	if (!pin_to_core(core_num))
+		return r;
+	std::mt19937_64 rng(seed);
+	size_t n = perm.size();
+	double ns_per_tick = 1.0 / tsc_per_ns();
+	sync_point.arrive_and_wait();
+	while (!stop.load(std::memory_order_relaxed)) {
+		size_t page = perm[(zipf(rng) + shift.load(std::memory_order_relaxed)) % n];
+		char *addr = region + page * TIER_PAGE_SIZE + (rng() % (TIER_PAGE_SIZE / CACHE_LINE_SIZE)) * CACHE_LINE_SIZE;
+		volatile uint64_t *word = (volatile uint64_t *)addr;
+		if (counters && r.ops % TOUCH_SAMPLE == 0)
+			engine.touch(addr);
+		r.fast_hits += engine.is_fast(addr);
+		if (r.ops % LATENCY_SAMPLE == 0) {
+			uint64_t t0 = tsc_begin();
+			*word = *word + 1;
+			uint64_t t1 = tsc_end();
+			r.latency_ns.push_back((t1 - t0 - tsc_overhead()) * ns_per_tick);
+		} else {
+			*word = *word + 1;
+		}
+		r.ops++;
+	}
+	return r;
+}
+
+struct PolicyResult {
+	double mops = 0;
+	double hit_ratio = 0;
+	std::vector<double> latency_ns;
+	TieringStats stats;
+};
+
+// One trial: fresh region with the first fast_pages on the fast node, the rest on the slow
+// node, then the workload for duration_ms with the hot set shifting every shift_ms
+static PolicyResult run_policy(const std::string &policy, const std::vector<int> &cores, int engine_core, size_t num_pages,
+		const TieringConfig &config, double theta, int shift_ms, double shift_frac, int duration_ms, int trial) {
+	PolicyResult res;
+	size_t bytes = num_pages * TIER_PAGE_SIZE;
+	char *region = (char *)mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED) {
+		std::cerr << "mmap failed: " << strerror(errno) << std::endl;
+		return res;
+	}
+	madvise(region, bytes, MADV_NOHUGEPAGE);
+	size_t fast_pages = std::min(config.fast_pages, num_pages);
+	if (!tier_place(region, fast_pages * TIER_PAGE_SIZE, config.fast_node) ||
+			!tier_place(region + fast_pages * TIER_PAGE_SIZE, bytes - fast_pages * TIER_PAGE_SIZE, config.slow_node)) {
+		munmap(region, bytes);
+		return res;
+	}
+
+	// Same permutation for every policy, so the static run sees the same hot pages
+	std::vector<uint32_t> perm(num_pages);
+	std::iota(perm.begin(), perm.end(), 0);
+	std::mt19937_64 perm_rng(trial);
+	std::shuffle(perm.begin(), perm.end(), perm_rng);
+	Zipf zipf(num_pages, theta);
+
+	TieringConfig engine_config = config;
+	engine_config.source = policy == "idle" ? HotnessSource::IdleBits : HotnessSource::Counters;
+	TieringEngine engine(region, bytes, engine_config);
+	bool counters = policy == "counters" || (policy == "idle" && engine.source() == HotnessSource::Counters);
+	if (policy != "static")
+		engine.start(engine_core);
+
+	std::atomic<size_t> shift{0};
+	std::atomic<bool> stop{false};
+	MyBarrier sync_point(cores.size() + 1);
+	std::vector<std::future<WorkerResult>> futs;
+	for (size_t i = 0; i < cores.size(); i++)
+		futs.push_back(std::async(std::launch::async, tier_worker, region, std::cref(perm), zipf, std::ref(engine), counters,
+			std::ref(shift), cores[i], trial * 1000 + i, std::ref(sync_point), std::ref(stop)));
+	sync_point.arrive_and_wait();
+	auto start_time = std::chrono::steady_clock::now();
+	auto end_time = start_time + std::chrono::milliseconds(duration_ms);
+	for (auto next = start_time + std::chrono::milliseconds(shift_ms); next < end_time; next += std::chrono::milliseconds(shift_ms)) {
+		std::this_thread::sleep_until(next);
+		shift.fetch_add(std::max<size_t>(1, num_pages * shift_frac));
+	}
+	std::this_thread::sleep_until(end_time);
+	stop.store(true);
+
+	size_t ops = 0, hits = 0;
+	for (auto &f : futs) {
+		WorkerResult r = f.get();
+		ops += r.ops;
+		hits += r.fast_hits;
+		res.latency_ns.insert(res.latency_ns.end(), r.latency_ns.begin(), r.latency_ns.end());
+	}
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	engine.stop();
+	res.stats = engine.stats();
+	res.mops = ops / secs / 1e6;
+	res.hit_ratio = ops ? (double)hits / ops : 0;
+	munmap(region, bytes);
+	return res;
+}
+
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("Tiering", "Hot-page promotion/demotion between a DRAM and a CXL node under a shifting Zipfian hot set");
+	options.add_options()
+		("c,cpu_node", "NUMA node whose cores run the workload", cxxopts::value<int>()->default_value("0"))
+		("fast_node", "Fast tier (default: the CPU node)", cxxopts::value<int>()->default_value("-1"))
+		("slow_node", "Slow tier (default: the memory node farthest from the fast one)", cxxopts::value<int>()->default_value("-1"))
+		("p,policies", "Placement policies (static,counters,idle)", cxxopts::value<std::string>()->default_value("static,counters,idle"))
+		("s,size", "Region size", cxxopts::value<std::string>()->default_value("1G"))
+		("fast_pct", "Fast-tier capacity as a percentage of the region", cxxopts::value<double>()->default_value("25"))
+		("t,threads", "Workload threads (default: all cores of the CPU node but one, which runs the engine)", cxxopts::value<int>()->default_value("0"))
+		("theta", "Zipf skew", cxxopts::value<double>()->default_value("0.99"))
+		("shift_ms", "Hot set shift period", cxxopts::value<int>()->default_value("2000"))
+		("shift_pct", "Rotation of the rank-to-page mapping per shift, in percent of the pages", cxxopts::value<double>()->default_value("10"))
+		("budget", "Migration budget in MB/s", cxxopts::value<double>()->default_value("1000"))
+		("interval_ms", "Tiering epoch", cxxopts::value<int>()->default_value("100"))
+		("d,duration", "Run time per trial in ms", cxxopts::value<int>()->default_value(std::to_string(RUN_TIME_MS)))
+		("trials", "Number of trials", cxxopts::value<int>()->default_value(std::to_string(NUM_TRIALS)))
+		("r,result", "Result csv file", cxxopts::value<std::string>()->default_value("results/tiering.csv"))
+		("h,help", "Print usage")
+		;
+	auto arguments = options.parse(argc, argv);
+	if (arguments.count("help")) {
+		std::cout << options.help() << std::endl;
+		return 0;
+	}
+
+	// Initialize NUMA library
+	if (numa_available() == -1) {
+		std::cerr << "NUMA is not available on this system." << std::endl;
+		return 1;
+	}
+
+	int cpu_node = arguments["cpu_node"].as<int>();
+	std::vector<int> node_cores = cores_of_node(cpu_node);
+	if (node_cores.empty()) {
+		std::cerr << "No CPUs found on NUMA node " << cpu_node << "." << std::endl;
+		return 1;
+	}
+	TieringConfig config;
+	config.fast_node = arguments["fast_node"].as<int>() >= 0 ? arguments["fast_node"].as<int>() : cpu_node;
+	config.slow_node = arguments["slow_node"].as<int>();
+	if (config.slow_node < 0) {
+		config.slow_node = config.fast_node;
+		for (int m : memory_nodes())
+			if (node_distance(config.fast_node, m) > node_distance(config.fast_node, config.slow_node))
+				config.slow_node = m;
+	}
+	size_t num_pages = parse_size(arguments["size"].as<std::string>()) / TIER_PAGE_SIZE;
+	config.fast_pages = num_pages * arguments["fast_pct"].as<double>() / 100;
+	config.budget_mbps = arguments["budget"].as<double>();
+	config.interval_ms = arguments["interval_ms"].as<int>();
+
+	// The engine gets the last core of the node when there is more than one
+	int num_threads = arguments["threads"].as<int>();
+	if (num_threads <= 0)
+		num_threads = std::max<int>(1, node_cores.size() - 1);
+	int engine_core = node_cores.back();
+	size_t worker_cores = node_cores.size() > 1 ? node_cores.size() - 1 : 1;
+	std::vector<int> cores;
+	for (int i = 0; i < num_threads; i++)
+		cores.push_back(node_cores[i % worker_cores]);
+
+	double theta = arguments["theta"].as<double>();
+	int shift_ms = arguments["shift_ms"].as<int>();
+	double shift_frac = arguments["shift_pct"].as<double>() / 100;
+	int duration_ms = arguments["duration"].as<int>();
+	int num_trials = arguments["trials"].as<int>();
+	std::cout << "Fast node " << config.fast_node << ", slow node " << config.slow_node << ", " << num_pages << " pages, "
+		<< config.fast_pages << " fast, " << num_threads << " threads" << std::endl;
+
+	std::ofstream results_file(arguments["result"].as<std::string>());
+	results_file << "policy,fast_node,slow_node,threads,theta,fast_pct,budget_mbps,mops,speedup_vs_static,local_hit_pct,"
+		"p50_ns,p99_ns,p999_ns,promoted,demoted,failed,migrated_mb,scan_ms_per_epoch\n";
+
+	std::stringstream ss(arguments["policies"].as<std::string>());
+	double static_mops = 0;
+	for (std::string policy; std::getline(ss, policy, ',');) {
+		if (policy != "static" && policy != "counters" && policy != "idle") {
+			std::cerr << "Unknown policy: " << policy << std::endl;
+			return 1;
+		}
+		double mops = 0, hit = 0;
+		std::vector<double> latency;
+		TieringStats total;
+		for (int trial = 0; trial < num_trials; trial++) {
+			PolicyResult r = run_policy(policy, cores, engine_core, num_pages, config, theta, shift_ms, shift_frac, duration_ms, trial);
+			mops += r.mops / num_trials;
+			hit += r.hit_ratio / num_trials;
+			latency.insert(latency.end(), r.latency_ns.begin(), r.latency_ns.end());
+			total.epochs += r.stats.epochs;
+			total.promoted += r.stats.promoted;
+			total.demoted += r.stats.demoted;
+			total.failed += r.stats.failed;
+			total.scan_ms += r.stats.scan_ms;
+		}
+		if (policy == "static")
+			static_mops = mops;
+		LatencyStats lat = latency_stats(latency);
+		double migrated_mb = (double)(total.promoted + total.demoted) * TIER_PAGE_SIZE / num_trials / 1e6;
+		double scan_ms = total.epochs ? total.scan_ms / total.epochs : 0;
+		results_file << policy << "," << config.fast_node << "," << config.slow_node << "," << num_threads << "," << theta << ","
+			<< arguments["fast_pct"].as<double>() << "," << config.budget_mbps << "," << mops << "," << (static_mops ? mops / static_mops : 0) << ","
+			<< hit * 100 << "," << lat.p50 << "," << lat.p99 << "," << lat.p999 << "," << total.promoted / num_trials << ","
+			<< total.demoted / num_trials << "," << total.failed / num_trials << "," << migrated_mb << "," << scan_ms << "\n";
+		std::cout << policy << ": " << mops << " Mops/s";
+		if (static_mops)
+			std::cout << " (" << mops / static_mops << "x static)";
+		std::cout << ", local hits " << hit * 100 << "%, p99 " << lat.p99 << " ns, migrated " << migrated_mb << " MB" << std::endl;
+	}
+
+	// Close the results file
+	results_file.close();
+
+	return 0;
+}
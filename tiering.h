@@ -0,0 +1,300 @@
+#ifndef TIERING_H
+#define TIERING_H
+
+// User-space page tiering between a fast (local DRAM) and a slow (CXL) NUMA node. A
+// TieringEngine owns the placement of one 4K-page region:
+//
+//   - every epoch it samples page hotness, either from software access counters the workload
+//     bumps with touch() or from idle page tracking (/proc/self/pagemap PFNs plus
+//     /sys/kernel/mm/page_idle/bitmap, which needs root), into a decaying per-page score;
+//   - it then promotes the hottest slow-tier pages while the fast tier has room, and swaps
+//     out the coldest fast-tier page for a hotter slow one when the fast tier is full;
+//   - every move goes through numa_move_pages and is charged to a migration bandwidth
+//     budget per epoch, so promotion never saturates the links the workload uses.
+//
+// A swap needs the candidate to beat the victim by a margin, which keeps two pages of
+// similar heat from ping-ponging between the tiers.
+
+#include "bench_util.h"
+#include <fcntl.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#define TIER_PAGE_SIZE 4096
+
+enum class HotnessSource { Counters, IdleBits };
+
+struct TieringConfig {
+	int fast_node = 0;
+	int slow_node = 1;
+	size_t fast_pages = 0;         // capacity of the fast tier for this region
+	double budget_mbps = 1000;     // migration budget (promotions plus demotions)
+	int interval_ms = 100;         // epoch length
+	double decay = 0.5;            // weight of the previous score each epoch
+	double swap_margin = 1.25;     // a swap needs score > victim * margin
+	HotnessSource source = HotnessSource::Counters;
+};
+
+struct TieringStats {
+	uint64_t epochs = 0;
+	uint64_t promoted = 0;
+	uint64_t demoted = 0;
+	uint64_t failed = 0;           // moves move_pages refused (busy or pinned pages)
+	double scan_ms = 0;            // time spent sampling hotness
+	double migrate_ms = 0;         // time spent in move_pages
+};
+
+// Bind [addr, addr + bytes) to node and fault it in there, then drop the binding so later
+// migrations are not fought by the policy
+inline bool tier_place(void *addr, size_t bytes, int node) {
+	if (bytes == 0)
+		return true;
+	unsigned long nodemask[16] = {0};
+	nodemask[node / 64] |= 1UL << (node % 64);
+	if (mbind(addr, bytes, MPOL_BIND, nodemask, sizeof(nodemask) * 8, MPOL_MF_MOVE) != 0) {
+		std::cerr << "mbind to node " << node << " failed: " << strerror(errno) << std::endl;
+		return false;
+	}
+	for (size_t off = 0; off < bytes; off += TIER_PAGE_SIZE)
+		((volatile char *)addr)[off] = 0;
+	mbind(addr, bytes, MPOL_DEFAULT, nullptr, 0, 0);
+	return true;
+}
+
+class TieringEngine {
+public:
+	// region must be page aligned and already placed (see tier_place)
+	TieringEngine(void *region, size_t bytes, const TieringConfig &config)
+		: base_((char *)region), num_pages_(bytes / TIER_PAGE_SIZE), config_(config),
+		  counters_(new std::atomic<uint32_t>[num_pages_]), score_(num_pages_, 0.0), fast_(new std::atomic<bool>[num_pages_]) {
+		for (size_t p = 0; p < num_pages_; p++)
+			counters_[p].store(0, std::memory_order_relaxed);
+		// Where the pages actually are (nodes == nullptr queries)
+		std::vector<void *> pages(num_pages_);
+		std::vector<int> status(num_pages_, -1);
+		for (size_t p = 0; p < num_pages_; p++)
+			pages[p] = base_ + p * TIER_PAGE_SIZE;
+		numa_move_pages(0, num_pages_, pages.data(), nullptr, status.data(), 0);
+		for (size_t p = 0; p < num_pages_; p++) {
+			fast_[p].store(status[p] == config_.fast_node, std::memory_order_relaxed);
+			fast_count_ += status[p] == config_.fast_node;
+		}
+		if (config_.source == HotnessSource::IdleBits && !open_idle_tracking()) {
+			std::cerr << "Idle page tracking unavailable (needs root and CONFIG_IDLE_PAGE_TRACKING); using access counters" << std::endl;
+			config_.source = HotnessSource::Counters;
+		}
+	}
+
+	~TieringEngine() {
+		stop();
+		if (pagemap_fd_ >= 0)
+			close(pagemap_fd_);
+		if (idle_fd_ >= 0)
+			close(idle_fd_);
+	}
+
+	HotnessSource source() const { return config_.source; }
+
+	// Software access counter; callers usually sample, e.g. one access in 16
+	void touch(const void *addr) {
+		std::atomic<uint32_t> &c = counters_[((const char *)addr - base_) / TIER_PAGE_SIZE];
+		c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	// Whether the page holding addr is (as far as the engine knows) on the fast node
+	bool is_fast(const void *addr) const {
+		return fast_[((const char *)addr - base_) / TIER_PAGE_SIZE].load(std::memory_order_relaxed);
+	}
+
+	// Run epochs on a background thread until stop()
+	void start(int core_num) {
+		running_.store(true);
+		thread_ = std::thread([this, core_num] {
+			pin_to_core(core_num);
+			while (running_.load()) {
+				auto next = std::chrono::steady_clock::now() + std::chrono::milliseconds(config_.interval_ms);
+				epoch();
+				std::this_thread::sleep_until(next);
+			}
+		});
+	}
+
+	void stop() {
+		running_.store(false);
+		if (thread_.joinable())
+			thread_.join();
+	}
+
+	// One sample-and-migrate round
+	void epoch() {
+		auto t0 = std::chrono::steady_clock::now();
+		sample();
+		auto t1 = std::chrono::steady_clock::now();
+		size_t budget_pages = config_.budget_mbps * 1e6 * config_.interval_ms / 1e3 / TIER_PAGE_SIZE;
+		plan(budget_pages);
+		migrate(demote_, config_.slow_node, false);
+		migrate(promote_, config_.fast_node, true);
+		auto t2 = std::chrono::steady_clock::now();
+		std::lock_guard<std::mutex> guard(stats_lock_);
+		stats_.epochs++;
+		stats_.scan_ms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+		stats_.migrate_ms += std::chrono::duration<double, std::milli>(t2 - t1).count();
+	}
+
+	TieringStats stats() {
+		std::lock_guard<std::mutex> guard(stats_lock_);
+		return stats_;
+	}
+
+private:
+	bool open_idle_tracking() {
+		pagemap_fd_ = open("/proc/self/pagemap", O_RDONLY);
+		idle_fd_ = open("/sys/kernel/mm/page_idle/bitmap", O_RDWR);
+		if (pagemap_fd_ < 0 || idle_fd_ < 0)
+			return false;
+		// Without CAP_SYS_ADMIN the PFNs read back as zero
+		uint64_t entry = 0;
+		if (pread(pagemap_fd_, &entry, sizeof(entry), (uintptr_t)base_ / TIER_PAGE_SIZE * sizeof(entry)) != sizeof(entry))
+			return false;
+		if ((entry & PAGEMAP_PFN_MASK) == 0)
+			return false;
+		mark_idle(); // start the first epoch's window
+		return true;
+	}
+
+	static constexpr uint64_t PAGEMAP_PFN_MASK = (1ULL << 55) - 1;
+	static constexpr uint64_t PAGEMAP_PRESENT = 1ULL << 63;
+
+	// PFN of every page (0 when not present)
+	void read_pfns() {
+		pfns_.resize(num_pages_);
+		std::vector<uint64_t> entries(num_pages_);
+		ssize_t got = pread(pagemap_fd_, entries.data(), num_pages_ * sizeof(uint64_t), (uintptr_t)base_ / TIER_PAGE_SIZE * sizeof(uint64_t));
+		for (size_t p = 0; p < num_pages_; p++)
+			pfns_[p] = (ssize_t)((p + 1) * sizeof(uint64_t)) <= got && (entries[p] & PAGEMAP_PRESENT) ? entries[p] & PAGEMAP_PFN_MASK : 0;
+	}
+
+	// The bitmap words covering our PFNs, read or written as one span
+	bool idle_span(std::vector<uint64_t> &words, uint64_t &first_word, bool write) {
+		uint64_t lo = UINT64_MAX, hi = 0;
+		for (uint64_t pfn : pfns_) {
+			if (pfn) {
+				lo = std::min(lo, pfn / 64);
+				hi = std::max(hi, pfn / 64);
+			}
+		}
+		if (lo > hi)
+			return false;
+		if (!write) {
+			first_word = lo;
+			words.assign(hi - lo + 1, 0);
+			return pread(idle_fd_, words.data(), words.size() * 8, lo * 8) == (ssize_t)(words.size() * 8);
+		}
+		return pwrite(idle_fd_, words.data(), words.size() * 8, first_word * 8) == (ssize_t)(words.size() * 8);
+	}
+
+	void mark_idle() {
+		read_pfns();
+		std::vector<uint64_t> words;
+		uint64_t first = 0;
+		if (!idle_span(words, first, false))
+			return;
+		// Only our bits: writing a 1 marks that frame idle, zeros are ignored
+		std::fill(words.begin(), words.end(), 0);
+		for (uint64_t pfn : pfns_)
+			if (pfn)
+				words[pfn / 64 - first] |= 1ULL << (pfn % 64);
+		idle_span(words, first, true);
+	}
+
+	// Fold this epoch's accesses into the decayed scores
+	void sample() {
+		if (config_.source == HotnessSource::Counters) {
+			for (size_t p = 0; p < num_pages_; p++)
+				score_[p] = score_[p] * config_.decay + counters_[p].exchange(0, std::memory_order_relaxed);
+			return;
+		}
+		// Pages whose idle bit was cleared were accessed since mark_idle()
+		read_pfns();
+		std::vector<uint64_t> words;
+		uint64_t first = 0;
+		bool ok = idle_span(words, first, false);
+		for (size_t p = 0; p < num_pages_; p++) {
+			uint64_t pfn = pfns_[p];
+			bool accessed = ok && pfn && !(words[pfn / 64 - first] >> (pfn % 64) & 1);
+			score_[p] = score_[p] * config_.decay + (accessed ? 1 : 0);
+		}
+		mark_idle();
+	}
+
+	// Pick this epoch's moves: fill free fast capacity with the hottest slow pages, then swap
+	// hottest-slow for coldest-fast while the margin holds. Each page moved costs one budget page.
+	void plan(size_t budget_pages) {
+		promote_.clear();
+		demote_.clear();
+		std::vector<size_t> hot, cold;
+		for (size_t p = 0; p < num_pages_; p++) {
+			if (fast_[p].load(std::memory_order_relaxed))
+				cold.push_back(p);
+			else if (score_[p] > 0)
+				hot.push_back(p);
+		}
+		std::sort(hot.begin(), hot.end(), [&](size_t a, size_t b) { return score_[a] > score_[b]; });
+		std::sort(cold.begin(), cold.end(), [&](size_t a, size_t b) { return score_[a] < score_[b]; });
+		size_t fast_count = fast_count_, h = 0, c = 0;
+		while (h < hot.size() && budget_pages > 0) {
+			if (fast_count < config_.fast_pages) {
+				promote_.push_back(hot[h++]);
+				fast_count++;
+				budget_pages--;
+			} else if (c < cold.size() && budget_pages >= 2 && score_[hot[h]] > score_[cold[c]] * config_.swap_margin) {
+				demote_.push_back(cold[c++]);
+				promote_.push_back(hot[h++]);
+				budget_pages -= 2;
+			} else {
+				break;
+			}
+		}
+	}
+
+	void migrate(const std::vector<size_t> &which, int node, bool to_fast) {
+		if (which.empty())
+			return;
+		std::vector<void *> pages;
+		for (size_t p : which)
+			pages.push_back(base_ + p * TIER_PAGE_SIZE);
+		std::vector<int> nodes(which.size(), node), status(which.size(), -1);
+		numa_move_pages(0, pages.size(), pages.data(), nodes.data(), status.data(), MPOL_MF_MOVE);
+		uint64_t moved = 0, failed = 0;
+		for (size_t i = 0; i < which.size(); i++) {
+			if (status[i] == node) {
+				fast_[which[i]].store(to_fast, std::memory_order_relaxed);
+				fast_count_ += to_fast ? 1 : -1;
+				moved++;
+			} else {
+				failed++;
+			}
+		}
+		std::lock_guard<std::mutex> guard(stats_lock_);
+		(to_fast ? stats_.promoted : stats_.demoted) += moved;
+		stats_.failed += failed;
+	}
+
+	char *base_;
+	size_t num_pages_;
+	TieringConfig config_;
+	std::unique_ptr<std::atomic<uint32_t>[]> counters_;
+	std::vector<double> score_;
+	std::unique_ptr<std::atomic<bool>[]> fast_;
+	size_t fast_count_ = 0;
+	std::vector<size_t> promote_, demote_;
+	std::vector<uint64_t> pfns_;
+	int pagemap_fd_ = -1, idle_fd_ = -1;
+	std::atomic<bool> running_{false};
+	std::thread thread_;
+	std::mutex stats_lock_;
+	TieringStats stats_;
+};
+
+#endif // TIERING_H